@@ -91,6 +91,17 @@
 // Required for QEMU
 #define EMMC_ALLOW_OLD_SDHCI
 
+// Use ADMA2 (DMA) for block transfers, if supported by the host controller
+// (e.g. EMMC2 on the Raspberry Pi 4). Programmed I/O is used otherwise and
+// for buffers, which are not cache line aligned or not DMA accessible.
+// Buffers must be word aligned in any case.
+//#define EMMC_USE_DMA
+
+#define EMMC_ADMA_DESCRIPTORS	128
+#define EMMC_ADMA_MAX_LENGTH	0x8000		// per descriptor
+#define EMMC_DMA_ADDRESS_LIMIT	0x40000000	// 32-bit ADMA2, 1 GB bus window
+#define EMMC_DMA_ALIGN		64		// max. cache line length
+
 #if RASPPI <= 3
 	#define EMMC_BASE	ARM_EMMC_BASE
 #else
@@ -116,6 +127,8 @@
 #define EMMC_CAPABILITIES_0	(EMMC_BASE + 0x40)
 #define EMMC_CAPABILITIES_1	(EMMC_BASE + 0x44)
 #define EMMC_FORCE_IRPT		(EMMC_BASE + 0x50)
+#define EMMC_ADMA_ERR_STAT	(EMMC_BASE + 0x54)
+#define EMMC_ADMA_SYS_ADDR	(EMMC_BASE + 0x58)
 #define EMMC_BOOT_TIMEOUT	(EMMC_BASE + 0x70)
 #define EMMC_DBG_SEL		(EMMC_BASE + 0x74)
 #define EMMC_EXRDFIFO_CFG	(EMMC_BASE + 0x80)
@@ -188,6 +201,11 @@
 #define SD_CARD_REMOVAL         (1 << 7)
 #define SD_CARD_INTERRUPT       (1 << 8)
 
+#define ADMA2_VALID		(1 << 0)
+#define ADMA2_END		(1 << 1)
+#define ADMA2_INT		(1 << 2)
+#define ADMA2_ACT_TRAN		(2 << 4)
+
 #endif
 
 #define SD_RESP_NONE        SD_CMD_RSPNS_TYPE_NONE
@@ -475,6 +493,14 @@ CEMMCDevice::CEMMCDevice (CInterruptSystem *pInterruptSystem, CTimer *pTimer, CA
 	m_hci_ver (0),
 #endif
 	m_pSCR (0)
+#ifndef USE_SDHOST
+	, m_bDMASupported (FALSE),
+	m_pADMATable (0),
+	m_bIRQConnected (FALSE),
+	m_bDMADone (FALSE),
+	m_nDMAInterrupts (0),
+	m_nWaitTicks (0)
+#endif
 {
 	assert (m_pInterruptSystem != 0);
 	assert (m_pTimer != 0);
@@ -508,6 +534,17 @@ CEMMCDevice::~CEMMCDevice (void)
 {
 #ifdef USE_SDHOST
 	m_Host.Reset ();
+#else
+	if (m_bIRQConnected)
+	{
+		write32 (EMMC_IRPT_EN, 0);
+
+		assert (m_pInterruptSystem != 0);
+		m_pInterruptSystem->DisconnectIRQ (ARM_IRQ_ARASANSDIO);
+	}
+
+	delete [] m_pADMATable;
+	m_pADMATable = 0;
 #endif
 
 	delete m_pSCR;
@@ -554,6 +591,29 @@ boolean CEMMCDevice::Initialize (void)
 
 	PeripheralExit ();
 
+#if !defined (USE_SDHOST) && defined (EMMC_USE_DMA)
+	if (m_bDMASupported)
+	{
+		m_pADMATable = new TADMA2Descriptor[EMMC_ADMA_DESCRIPTORS];
+		if (   m_pADMATable != 0
+		    && (uintptr) (m_pADMATable + EMMC_ADMA_DESCRIPTORS) <= EMMC_DMA_ADDRESS_LIMIT)
+		{
+			assert (m_pInterruptSystem != 0);
+			m_pInterruptSystem->ConnectIRQ (ARM_IRQ_ARASANSDIO, InterruptHandler, this);
+			m_bIRQConnected = TRUE;
+
+			LogWrite (LogDebug, "Using ADMA2");
+		}
+		else
+		{
+			delete [] m_pADMATable;
+			m_pADMATable = 0;
+
+			m_bDMASupported = FALSE;
+		}
+	}
+#endif
+
 	const char DeviceName[] = "emmc1";
 
 	assert (m_pPartitionManager == 0);
@@ -907,6 +967,17 @@ void CEMMCDevice::IssueCommandInt (u32 cmd_reg, u32 argument, int timeout)
 	u32 blksizecnt = m_block_size | (m_blocks_to_transfer << 16);
 	write32 (EMMC_BLKSIZECNT, blksizecnt);
 
+	// Use DMA for block transfers, if possible
+	boolean bDMA = FALSE;
+	if (   (cmd_reg & SD_CMD_ISDATA)
+	    && m_block_size == SD_BLOCK_SIZE
+	    && m_bIRQConnected			// DMA is set up after CardInit()
+	    && SetupDMA ())
+	{
+		cmd_reg |= SD_CMD_DMA;
+		bDMA = TRUE;
+	}
+
 	// Set argument 1 reg
 	write32 (EMMC_ARG1, argument);
 
@@ -952,6 +1023,37 @@ void CEMMCDevice::IssueCommandInt (u32 cmd_reg, u32 argument, int timeout)
 		break;
 	}
 
+	if (bDMA)
+	{
+		// The transfer complete interrupt signals the end of the DMA transfer
+		irpts = WaitDMA (timeout);
+
+		if (cmd_reg & SD_CMD_DAT_DIR_CH)
+		{
+			// Discard data, which may have been fetched speculatively into the cache
+			CleanAndInvalidateDataCacheRange ((uintptr) m_buf, m_block_size * m_blocks_to_transfer);
+		}
+
+		if (   ((irpts & 0xffff0002) != 2)
+		    && ((irpts & 0xffff0002) != 0x100002))
+		{
+#ifdef EMMC_DEBUG
+			LogWrite (LogWarning, "Error occured during DMA transfer (0x%X, 0x%X)",
+				  irpts, read32 (EMMC_ADMA_ERR_STAT));
+#endif
+			m_last_error = irpts & 0xffff0000;
+			m_last_interrupt = irpts;
+
+			ResetDat ();
+
+			return;
+		}
+
+		m_last_cmd_success = 1;
+
+		return;
+	}
+
 	// If with data, wait for the appropriate interrupt
 	if (cmd_reg & SD_CMD_ISDATA)
 	{
@@ -1492,6 +1594,15 @@ int CEMMCDevice::CardReset (void)
 #endif
 	write32 (EMMC_IRPT_MASK, irpt_mask);
 
+	if (m_bDMASupported)
+	{
+		// Select 32-bit ADMA2 in Host Control 1 (cleared by the reset)
+		u32 host_control = read32 (EMMC_CONTROL0);
+		host_control &= ~(3 << 3);
+		host_control |= 2 << 3;
+		write32 (EMMC_CONTROL0, host_control);
+	}
+
 	usDelay (2000);
 
 #else	// #ifndef USE_SDHOST
@@ -2050,6 +2161,10 @@ int CEMMCDevice::CardInit (void)
 #endif
 	}
 
+#ifdef EMMC_USE_DMA
+	m_bDMASupported = read32 (EMMC_CAPABILITIES_0) & (1 << 19) ? TRUE : FALSE;
+#endif
+
 #endif	// #ifndef USE_SDHOST
 
 	// The SEND_SCR command may fail with a DATA_TIMEOUT on the Raspberry Pi 4
@@ -2306,16 +2421,127 @@ int CEMMCDevice::TimeoutWait (unsigned reg, unsigned mask, int value, unsigned u
 	unsigned nStartTicks = m_pTimer->GetClockTicks ();
 	unsigned nTimeoutTicks = usec * (CLOCKHZ / 1000000);
 
+	int nResult = -1;
+	unsigned nTicks;
 	do
 	{
+		nTicks = m_pTimer->GetClockTicks ();
+
 		if ((read32 (reg) & mask) ? value : !value)
 		{
-			return 0;
+			nResult = 0;
+
+			break;
+		}
+	}
+	while (nTicks - nStartTicks < nTimeoutTicks);
+
+	m_nWaitTicks += nTicks - nStartTicks;
+
+	return nResult;
+}
+
+boolean CEMMCDevice::SetupDMA (void)
+{
+	assert (m_pADMATable != 0);
+
+	uintptr nAddress = (uintptr) m_buf;
+	size_t nLength = m_block_size * m_blocks_to_transfer;
+
+	// the buffer must not share cache lines with other data, which could be
+	// written back by the CPU while the transfer is running
+	if (   (nAddress & (EMMC_DMA_ALIGN-1)) != 0
+	    || (nLength & (EMMC_DMA_ALIGN-1)) != 0
+	    || nLength == 0
+	    || nAddress + nLength > EMMC_DMA_ADDRESS_LIMIT
+	    || nLength > EMMC_ADMA_DESCRIPTORS * EMMC_ADMA_MAX_LENGTH)
+	{
+		return FALSE;
+	}
+
+	// Write back data to be sent and dirty lines, which would overwrite received data
+	CleanAndInvalidateDataCacheRange (nAddress, nLength);
+
+	TADMA2Descriptor *pDesc = m_pADMATable;
+	while (nLength > 0)
+	{
+		size_t nChunk = nLength < EMMC_ADMA_MAX_LENGTH ? nLength : EMMC_ADMA_MAX_LENGTH;
+
+		pDesc->attributes = ADMA2_ACT_TRAN | ADMA2_VALID;
+		pDesc->length = (u16) nChunk;			// 0x8000 fits, 0 would mean 64K
+		pDesc->address = BUS_ADDRESS (nAddress);
+
+		nAddress += nChunk;
+		nLength -= nChunk;
+
+		if (nLength == 0)
+		{
+			pDesc->attributes |= ADMA2_END;
+		}
+		else
+		{
+			pDesc++;
 		}
 	}
-	while (m_pTimer->GetClockTicks () - nStartTicks < nTimeoutTicks);
 
-	return -1;
+	CleanAndInvalidateDataCacheRange ((uintptr) m_pADMATable,
+					  (pDesc - m_pADMATable + 1) * sizeof (TADMA2Descriptor));
+
+	write32 (EMMC_ADMA_SYS_ADDR, BUS_ADDRESS ((uintptr) m_pADMATable));
+
+	m_bDMADone = FALSE;
+
+	return TRUE;
+}
+
+int CEMMCDevice::WaitDMA (int timeout)
+{
+	// Enable the transfer complete and error interrupts
+	write32 (EMMC_IRPT_EN, 0xffff0002);
+
+	assert (m_pTimer != 0);
+	unsigned nStartTicks = m_pTimer->GetClockTicks ();
+	unsigned nTimeoutTicks = timeout * (CLOCKHZ / 1000000);
+
+	while (!m_bDMADone)
+	{
+		if (m_pTimer->GetClockTicks () - nStartTicks >= nTimeoutTicks)
+		{
+			m_nWaitTicks += nTimeoutTicks;
+
+			write32 (EMMC_IRPT_EN, 0);
+
+			u32 irpts = read32 (EMMC_INTERRUPT);
+			write32 (EMMC_INTERRUPT, 0xffff0002);
+
+			return irpts & 0xffff0002 ? irpts : 0;
+		}
+	}
+
+	m_nWaitTicks += m_pTimer->GetClockTicks () - nStartTicks;
+
+	DataMemBarrier ();
+
+	return m_nDMAInterrupts;
+}
+
+void CEMMCDevice::InterruptHandler (void *pParam)
+{
+	CEMMCDevice *pThis = (CEMMCDevice *) pParam;
+	assert (pThis != 0);
+
+	u32 irpts = read32 (EMMC_INTERRUPT);
+	if (!(irpts & 0xffff0002))
+	{
+		return;
+	}
+
+	write32 (EMMC_IRPT_EN, 0);
+	write32 (EMMC_INTERRUPT, irpts & 0xffff0002);
+
+	pThis->m_nDMAInterrupts = irpts;
+	DataMemBarrier ();
+	pThis->m_bDMADone = TRUE;
 }
 
 #endif
@@ -2342,3 +2568,12 @@ const u32 *CEMMCDevice::GetID (void)
 {
 	return m_device_id;
 }
+
+unsigned CEMMCDevice::GetWaitTicks (void) const
+{
+#ifndef USE_SDHOST
+	return m_nWaitTicks;
+#else
+	return 0;
+#endif
+}
@@ -36,6 +36,7 @@
 #include <circle/gpiopin.h>
 #include <circle/fs/partitionmanager.h>
 #include <circle/logger.h>
+#include <circle/macros.h>
 #include <circle/types.h>
 #include <circle/sysconfig.h>
 #ifdef USE_SDHOST
@@ -49,6 +50,18 @@ struct TSCR			// SD configuration register
 	int	sd_version;
 };
 
+#ifndef USE_SDHOST
+
+struct TADMA2Descriptor		// 32-bit ADMA2 descriptor (HCSS 1.13.4)
+{
+	u16	attributes;
+	u16	length;			// 0 means 65536 bytes
+	u32	address;		// bus address
+}
+PACKED;
+
+#endif
+
 class CEMMCDevice : public CDevice
 {
 public:
@@ -66,6 +79,10 @@ public:
 
 	const u32 *GetID (void);
 
+	// returns the clock ticks (CLOCKHZ), which have been spent polling for the host controller,
+	// the CPU would be available for other work in this time (always 0 with SDHOST)
+	unsigned GetWaitTicks (void) const;
+
 private:
 #ifndef USE_SDHOST
 	int PowerOn (void);
@@ -83,6 +100,10 @@ private:
 #ifndef USE_SDHOST
 	void HandleCardInterrupt (void);
 	void HandleInterrupts (void);
+
+	boolean SetupDMA (void);		// for m_buf, returns FALSE if not possible
+	int WaitDMA (int timeout);		// returns interrupt status or 0 on timeout
+	static void InterruptHandler (void *pParam);
 #endif
 	boolean IssueCommand (u32 command, u32 argument, int timeout = 500000);
 
@@ -154,6 +175,14 @@ private:
 #ifndef USE_SDHOST
 	int m_card_removal;
 	u32 m_base_clock;
+
+	boolean m_bDMASupported;		// ADMA2 is used for block transfers
+	TADMA2Descriptor *m_pADMATable;
+	boolean m_bIRQConnected;
+	volatile boolean m_bDMADone;
+	volatile u32 m_nDMAInterrupts;
+
+	unsigned m_nWaitTicks;
 #endif
 
 	static const char *sd_versions[];
@@ -2,7 +2,7 @@
 // kernel.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -19,10 +19,22 @@
 //
 #include "kernel.h"
 #include <circle/string.h>
+#include <circle/util.h>
+#include <circle/macros.h>
+#include <assert.h>
 
 #define PARTITION	"emmc1-1"
 #define FILENAME	"circle.txt"
 
+#define BENCH_SIZE	(4 * 1024 * 1024)	// bytes read from the start of the card
+#define MAX_REQUEST	(64 * 1024)
+
+static const unsigned RequestSizes[] = {512, 4096, MAX_REQUEST};
+
+// cache line aligned, the DMA buffer must not share cache lines with other data
+static u8 s_AlignedBuffer[MAX_REQUEST] ALIGN (64);
+static u8 s_UnalignedBuffer[MAX_REQUEST + 64] ALIGN (64);
+
 static const char FromKernel[] = "kernel";
 
 CKernel::CKernel (void)
@@ -169,5 +181,80 @@ TShutdownMode CKernel::Run (void)
 		m_Logger.Write (FromKernel, LogPanic, "Cannot close file");
 	}
 
+	m_FileSystem.UnMount ();
+
+	// Raw read throughput, an aligned buffer uses ADMA2 (if enabled), an unaligned one PIO.
+	// PIO requires word alignment, so the unaligned buffer is word, but not cache line aligned.
+	m_Logger.Write (FromKernel, LogNotice, "Reading %u KB from the start of the card",
+			BENCH_SIZE / 1024);
+
+	u8 *pAligned = s_AlignedBuffer;
+	u8 *pUnaligned = s_UnalignedBuffer + 4;
+
+	for (unsigned i = 0; i < sizeof RequestSizes / sizeof RequestSizes[0]; i++)
+	{
+		unsigned nAlignedRate, nUnalignedRate;
+		if (   !ReadBenchmark (pAligned, RequestSizes[i], &nAlignedRate)
+		    || !ReadBenchmark (pUnaligned, RequestSizes[i], &nUnalignedRate))
+		{
+			break;
+		}
+
+		m_Logger.Write (FromKernel, LogNotice,
+				"%5u bytes/request: aligned %u.%03u MB/s, unaligned %u.%03u MB/s",
+				RequestSizes[i],
+				nAlignedRate / 1000, nAlignedRate % 1000,
+				nUnalignedRate / 1000, nUnalignedRate % 1000);
+	}
+
+	// both paths must deliver the same data
+	for (unsigned nOffset = 0; nOffset < BENCH_SIZE; nOffset += MAX_REQUEST)
+	{
+		if (   m_EMMC.Seek (nOffset) != nOffset
+		    || m_EMMC.Read (pAligned, MAX_REQUEST) != MAX_REQUEST
+		    || m_EMMC.Seek (nOffset) != nOffset
+		    || m_EMMC.Read (pUnaligned, MAX_REQUEST) != MAX_REQUEST)
+		{
+			m_Logger.Write (FromKernel, LogError, "Read error at offset %u", nOffset);
+
+			break;
+		}
+
+		if (memcmp (pAligned, pUnaligned, MAX_REQUEST) != 0)
+		{
+			m_Logger.Write (FromKernel, LogError, "Data mismatch at offset %u", nOffset);
+
+			break;
+		}
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Done");
+
 	return ShutdownHalt;
 }
+
+boolean CKernel::ReadBenchmark (u8 *pBuffer, unsigned nRequestSize, unsigned *pRate)
+{
+	assert (pBuffer != 0);
+	assert (nRequestSize <= MAX_REQUEST);
+
+	unsigned nStart = CTimer::GetClockTicks ();
+
+	for (unsigned nOffset = 0; nOffset < BENCH_SIZE; nOffset += nRequestSize)
+	{
+		if (   m_EMMC.Seek (nOffset) != nOffset
+		    || m_EMMC.Read (pBuffer, nRequestSize) != (int) nRequestSize)
+		{
+			m_Logger.Write (FromKernel, LogError, "Read error at offset %u", nOffset);
+
+			return FALSE;
+		}
+	}
+
+	unsigned nTime = CTimer::GetClockTicks () - nStart;
+
+	assert (pRate != 0);
+	*pRate = (unsigned) (BENCH_SIZE * 1000ULL / (nTime ? nTime : 1));
+
+	return TRUE;
+}
@@ -2,7 +2,7 @@
 // kernel.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -50,7 +50,11 @@ public:
 	boolean Initialize (void);
 
 	TShutdownMode Run (void);
-	
+
+private:
+	// returns FALSE on error, *pRate is set in KB/s
+	boolean ReadBenchmark (u8 *pBuffer, unsigned nRequestSize, unsigned *pRate);
+
 private:
 	// do not change this order
 	CMemorySystem		m_Memory;
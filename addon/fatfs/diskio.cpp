@@ -21,6 +21,9 @@
 #endif
 #define SECTOR_SIZE		FF_MIN_SS
 
+/* Unaligned transfers are split into chunks of this size */
+#define BOUNCE_SECTORS		16
+
 /*-----------------------------------------------------------------------*/
 /* Static Data                                                           */
 /*-----------------------------------------------------------------------*/
@@ -35,8 +38,29 @@ static const char *s_pVolumeName[FF_VOLUMES] =
 
 static CDevice *s_pVolume[FF_VOLUMES] = {0};
 
-static u8 *s_pBuffer = 0;
-static unsigned s_nBufferSize = 0;
+/* Only used for caller buffers, which are not word aligned */
+static u8 *s_pBounceBuffer[FF_VOLUMES] = {0};
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Get Bounce Buffer for Unaligned Transfers                             */
+/*-----------------------------------------------------------------------*/
+
+static u8 *GetBounceBuffer (
+	BYTE pdrv		/* Physical drive nmuber to identify the drive */
+)
+{
+	assert (pdrv < FF_VOLUMES);
+
+	/* Each volume has its own buffer, because volumes are locked separately */
+	if (s_pBounceBuffer[pdrv] == 0)
+	{
+		s_pBounceBuffer[pdrv] = new u8[BOUNCE_SECTORS * SECTOR_SIZE];
+	}
+
+	return s_pBounceBuffer[pdrv];
+}
 
 
 
@@ -105,36 +129,45 @@ DRESULT disk_read (
 		return RES_NOTRDY;
 	}
 
-	/* Ensure that the transfer buffer is word aligned */
-	BYTE *pBuffer = buff;
-	unsigned nSize = count * SECTOR_SIZE;
-	if (((uintptr) pBuffer & 3) != 0)
-	{
-		if (s_nBufferSize < nSize)
-		{
-			delete [] s_pBuffer;
+	QWORD offset = sector;
+	offset *= SECTOR_SIZE;
 
-			s_nBufferSize = nSize;
+	/* Word aligned buffers are used directly by the device drivers */
+	if (((uintptr) buff & 3) == 0)
+	{
+		pDevice->Seek (offset);
 
-			s_pBuffer = new u8[s_nBufferSize];
-			assert (s_pBuffer != 0);
+		if (pDevice->Read (buff, count * SECTOR_SIZE) < 0)
+		{
+			return RES_ERROR;
 		}
 
-		pBuffer = s_pBuffer;
+		return RES_OK;
 	}
 
-	QWORD offset = sector;
-	offset *= SECTOR_SIZE;
-	pDevice->Seek (offset);
-
-	if (pDevice->Read (pBuffer, nSize) < 0)
+	u8 *pBounceBuffer = GetBounceBuffer (pdrv);
+	if (pBounceBuffer == 0)
 	{
 		return RES_ERROR;
 	}
 
-	if (pBuffer != buff)
+	while (count > 0)
 	{
-		memcpy (buff, pBuffer, nSize);
+		UINT nSectors = count < BOUNCE_SECTORS ? count : BOUNCE_SECTORS;
+		unsigned nSize = nSectors * SECTOR_SIZE;
+
+		pDevice->Seek (offset);
+
+		if (pDevice->Read (pBounceBuffer, nSize) < 0)
+		{
+			return RES_ERROR;
+		}
+
+		memcpy (buff, pBounceBuffer, nSize);
+
+		buff += nSize;
+		offset += nSize;
+		count -= nSectors;
 	}
 
 	return RES_OK;
@@ -166,35 +199,47 @@ DRESULT disk_write (
 		return RES_NOTRDY;
 	}
 
-	/* Ensure that the transfer buffer is word aligned */
-	const BYTE *pBuffer = buff;
-	unsigned nSize = count * SECTOR_SIZE;
-	if (((uintptr) pBuffer & 3) != 0)
-	{
-		if (s_nBufferSize < nSize)
-		{
-			delete [] s_pBuffer;
+	QWORD offset = sector;
+	offset *= SECTOR_SIZE;
 
-			s_nBufferSize = nSize;
+	/* Word aligned buffers are used directly by the device drivers */
+	if (((uintptr) buff & 3) == 0)
+	{
+		pDevice->Seek (offset);
 
-			s_pBuffer = new u8[s_nBufferSize];
-			assert (s_pBuffer != 0);
+		if (pDevice->Write (buff, count * SECTOR_SIZE) < 0)
+		{
+			return RES_ERROR;
 		}
 
-		memcpy (s_pBuffer, buff, nSize);
-
-		pBuffer = s_pBuffer;
+		return RES_OK;
 	}
 
-	QWORD offset = sector;
-	offset *= SECTOR_SIZE;
-	pDevice->Seek (offset);
-
-	if (pDevice->Write (pBuffer, nSize) < 0)
+	u8 *pBounceBuffer = GetBounceBuffer (pdrv);
+	if (pBounceBuffer == 0)
 	{
 		return RES_ERROR;
 	}
 
+	while (count > 0)
+	{
+		UINT nSectors = count < BOUNCE_SECTORS ? count : BOUNCE_SECTORS;
+		unsigned nSize = nSectors * SECTOR_SIZE;
+
+		memcpy (pBounceBuffer, buff, nSize);
+
+		pDevice->Seek (offset);
+
+		if (pDevice->Write (pBounceBuffer, nSize) < 0)
+		{
+			return RES_ERROR;
+		}
+
+		buff += nSize;
+		offset += nSize;
+		count -= nSectors;
+	}
+
 	return RES_OK;
 }
 
@@ -371,6 +371,12 @@ void* ff_memalloc (UINT msize);			/* Allocate memory block */
 void ff_memfree (void* mblock);			/* Free memory block */
 #endif
 
+/* Fast seek support (defined in ffsystem.cpp) */
+#if FF_USE_FASTSEEK
+FRESULT ff_enable_fastseek (FIL* fp);	/* Create cluster link map table for an opened file */
+void ff_disable_fastseek (FIL* fp);		/* Free cluster link map table, call before f_close() */
+#endif
+
 /* Sync functions */
 #if FF_FS_REENTRANT
 int ff_cre_syncobj (BYTE vol, FF_SYNC_t* sobj);	/* Create a sync object */
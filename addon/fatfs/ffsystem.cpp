@@ -175,6 +175,74 @@ void ff_memfree (
 
 
 
+#if FF_USE_FASTSEEK
+/*------------------------------------------------------------------------*/
+/* Enable Fast Seek Mode                                                  */
+/*------------------------------------------------------------------------*/
+/* Allocates the cluster link map table (CLMT) for an opened file, so that
+/  f_lseek() and f_read() do not need to follow the cluster chain in the
+/  FAT. The file size cannot be expanded in this mode.
+*/
+
+FRESULT ff_enable_fastseek (
+	FIL* fp			/* Pointer to the opened file object */
+)
+{
+	assert (fp != 0);
+	assert (fp->cltbl == 0);
+
+	UINT nItems = 32;		/* Sufficient for 15 fragments */
+	for (unsigned i = 1; i <= 2; i++)
+	{
+		DWORD *pTable = (DWORD *) malloc (nItems * sizeof (DWORD));
+		if (pTable == 0)
+		{
+			return FR_NOT_ENOUGH_CORE;
+		}
+
+		pTable[0] = nItems;
+		fp->cltbl = pTable;
+
+		FRESULT res = f_lseek (fp, CREATE_LINKMAP);
+		if (res == FR_OK)
+		{
+			return FR_OK;
+		}
+
+		fp->cltbl = 0;
+
+		nItems = pTable[0];	/* Required size on FR_NOT_ENOUGH_CORE */
+		free (pTable);
+
+		if (res != FR_NOT_ENOUGH_CORE)
+		{
+			return res;
+		}
+	}
+
+	return FR_NOT_ENOUGH_CORE;
+}
+
+
+/*------------------------------------------------------------------------*/
+/* Disable Fast Seek Mode                                                 */
+/*------------------------------------------------------------------------*/
+
+void ff_disable_fastseek (
+	FIL* fp			/* Pointer to the file object */
+)
+{
+	assert (fp != 0);
+
+	free (fp->cltbl);
+	fp->cltbl = 0;
+}
+
+#endif
+
+
+
+
 #if !FF_FS_READONLY && !FF_FS_NORTC
 /*------------------------------------------------------------------------*/
 /* RTC function                                                           */
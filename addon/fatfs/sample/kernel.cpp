@@ -2,7 +2,7 @@
 // kernel.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,13 +18,23 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include "kernel.h"
+#include <circle/pseudorandom.h>
 #include <circle/string.h>
+#include <assert.h>
 
 #define DRIVE		"SD:"
 //#define DRIVE		"USB:"
 
 #define FILENAME	"/circle.txt"
 
+#define STREAM_FILENAME	"/stream.dat"
+#define STREAM_SIZE	(8 * 1024 * 1024)
+#define STREAM_BLOCK	(32 * 1024)	// sequential request size
+#define SEEK_BLOCK	4096		// request size after a seek
+#define SEEKS		500
+
+static u32 s_Buffer[STREAM_BLOCK / sizeof (u32)];	// word aligned for direct transfers
+
 static const char FromKernel[] = "kernel";
 
 CKernel::CKernel (void)
@@ -181,6 +191,8 @@ TShutdownMode CKernel::Run (void)
 		m_Logger.Write (FromKernel, LogPanic, "Cannot close file");
 	}
 
+	StreamTest ();
+
 	// Unmount file system
 	if (f_mount (0, DRIVE, 0) != FR_OK)
 	{
@@ -189,3 +201,144 @@ TShutdownMode CKernel::Run (void)
 
 	return ShutdownHalt;
 }
+
+// Creates a larger file and streams it with and without fast seek mode,
+// sequentially and with random seeks (e.g. like a media player)
+void CKernel::StreamTest (void)
+{
+	FIL File;
+	if (f_open (&File, DRIVE STREAM_FILENAME, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot create file: %s", STREAM_FILENAME);
+
+		return;
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Writing %u KB to %s",
+			STREAM_SIZE / 1024, STREAM_FILENAME);
+
+	// the first word of each sector holds its offset in the file
+	for (unsigned nOffset = 0; nOffset < STREAM_SIZE; nOffset += STREAM_BLOCK)
+	{
+		for (unsigned i = 0; i < STREAM_BLOCK / sizeof (u32); i++)
+		{
+			s_Buffer[i] = nOffset + i * sizeof (u32);
+		}
+
+		unsigned nBytesWritten;
+		if (   f_write (&File, s_Buffer, STREAM_BLOCK, &nBytesWritten) != FR_OK
+		    || nBytesWritten != STREAM_BLOCK)
+		{
+			m_Logger.Write (FromKernel, LogError, "Write error");
+
+			f_close (&File);
+
+			return;
+		}
+	}
+
+	if (f_close (&File) != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot close file");
+
+		return;
+	}
+
+	if (StreamRead (FALSE))
+	{
+		StreamRead (TRUE);
+	}
+
+	f_unlink (DRIVE STREAM_FILENAME);
+}
+
+boolean CKernel::StreamRead (boolean bFastSeek)
+{
+	FIL File;
+	if (f_open (&File, DRIVE STREAM_FILENAME, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot open file: %s", STREAM_FILENAME);
+
+		return FALSE;
+	}
+
+	if (bFastSeek)
+	{
+		FRESULT Result = ff_enable_fastseek (&File);
+		if (Result != FR_OK)
+		{
+			m_Logger.Write (FromKernel, LogError, "Cannot enable fast seek (%d)", Result);
+
+			f_close (&File);
+
+			return FALSE;
+		}
+	}
+
+	boolean bOK = TRUE;
+	CPseudoRandomNumberGenerator Random;	// same offsets in both modes
+
+	// stream the whole file, the time spent polling in the SD card driver is idle time
+	unsigned nWaitStart = m_EMMC.GetWaitTicks ();
+	unsigned nStart = CTimer::GetClockTicks ();
+	for (unsigned nOffset = 0; bOK && nOffset < STREAM_SIZE; nOffset += STREAM_BLOCK)
+	{
+		unsigned nBytesRead;
+		if (   f_read (&File, s_Buffer, STREAM_BLOCK, &nBytesRead) != FR_OK
+		    || nBytesRead != STREAM_BLOCK
+		    || s_Buffer[0] != nOffset)
+		{
+			m_Logger.Write (FromKernel, LogError, "Read error at offset %u", nOffset);
+
+			bOK = FALSE;
+		}
+	}
+	unsigned nStreamTime = CTimer::GetClockTicks () - nStart;
+	unsigned nIdleTime = m_EMMC.GetWaitTicks () - nWaitStart;
+
+	// seek to random sectors and read a block there
+	nStart = CTimer::GetClockTicks ();
+	for (unsigned i = 0; bOK && i < SEEKS; i++)
+	{
+		unsigned nOffset = (Random.GetNumber () % ((STREAM_SIZE - SEEK_BLOCK) / 512)) * 512;
+
+		unsigned nBytesRead;
+		if (   f_lseek (&File, nOffset) != FR_OK
+		    || f_read (&File, s_Buffer, SEEK_BLOCK, &nBytesRead) != FR_OK
+		    || nBytesRead != SEEK_BLOCK
+		    || s_Buffer[0] != nOffset)
+		{
+			m_Logger.Write (FromKernel, LogError, "Seek error at offset %u", nOffset);
+
+			bOK = FALSE;
+		}
+	}
+	unsigned nSeekTime = CTimer::GetClockTicks () - nStart;
+
+	if (bFastSeek)
+	{
+		ff_disable_fastseek (&File);
+	}
+
+	f_close (&File);
+
+	if (bOK)
+	{
+		if (nStreamTime == 0)
+		{
+			nStreamTime = 1;
+		}
+
+		unsigned nRate = (unsigned) (STREAM_SIZE * 1000ULL / nStreamTime);
+
+		assert (nIdleTime <= nStreamTime);
+		unsigned nCPULoad = (unsigned) ((nStreamTime - nIdleTime) * 100ULL / nStreamTime);
+
+		m_Logger.Write (FromKernel, LogNotice,
+				"Fast seek %s: streaming %u.%03u MB/s (CPU %u%%), seek and read %u KB %u us",
+				bFastSeek ? "on" : "off", nRate / 1000, nRate % 1000, nCPULoad,
+				SEEK_BLOCK / 1024, nSeekTime / SEEKS);
+	}
+
+	return bOK;
+}
@@ -2,7 +2,7 @@
 // kernel.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2017  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -52,6 +52,10 @@ public:
 
 	TShutdownMode Run (void);
 	
+private:
+	void StreamTest (void);
+	boolean StreamRead (boolean bFastSeek);
+
 private:
 	// do not change this order
 	CMemorySystem		m_Memory;
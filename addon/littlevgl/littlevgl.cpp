@@ -152,6 +152,13 @@ void CLittlevGL::Update (void)
 {
 	lv_task_handler ();
 
+	// display the changed regions of a double buffered screen
+	if (   m_pScreen != 0
+	    && m_pScreen->GetBufferCount () > 1)
+	{
+		m_pScreen->Update ();
+	}
+
 	unsigned nTicks = CTimer::Get ()->GetClockTicks ();
 	if (nTicks - m_nLastUpdate >= CLOCKHZ/1000)
 	{
@@ -189,6 +196,18 @@ void CLittlevGL::DisplayFlush (lv_disp_drv_t *pDriver, const lv_area_t *pArea, l
 	assert (y1 <= y2);
 	assert (pBuffer != 0);
 
+	// a double buffered screen is updated from its shadow buffer in RAM
+	CScreenDevice *pScreen = s_pThis->m_pScreen;
+	if (   pScreen != 0
+	    && pScreen->GetBufferCount () > 1)
+	{
+		pScreen->SetArea (x1, y1, x2, y2, (const TScreenColor *) pBuffer);
+
+		lv_disp_flush_ready (pDriver);
+
+		return;
+	}
+
 	assert (s_pThis->m_pFrameBuffer != 0);
 	void *pDestination = (void *) (uintptr) (  s_pThis->m_pFrameBuffer->GetBuffer ()
 						 + y1*s_pThis->m_pFrameBuffer->GetPitch ()
@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+#
+# tftpbench.py - TFTP transfer benchmark for the tftpfileserver sample
+#
+# Usage: python3 tftpbench.py [HOST] [-p PORT] [-s SIZE_KB] [-t BLKSIZE:WINDOWSIZE ...]
+#
+# Puts a file with random data to the TFTP server, gets it back, compares it and
+# displays the throughput of both directions for each block size and window size.
+# The TFTP client is implemented here, because most TFTP clients do not support
+# the option "windowsize" (RFC 7440).
+#
+
+import argparse
+import os
+import socket
+import struct
+import time
+
+OP_RRQ = 1
+OP_WRQ = 2
+OP_DATA = 3
+OP_ACK = 4
+OP_ERROR = 5
+OP_OACK = 6
+
+TIMEOUT = 1.0		# seconds until retransmission
+RETRIES = 10
+
+parser = argparse.ArgumentParser(description="TFTP transfer benchmark")
+parser.add_argument("host", nargs="?", default="localhost",
+		    help="IP address of the Raspberry Pi (default localhost for QEMU)")
+parser.add_argument("-p", "--port", type=int, default=6969,
+		    help="UDP port of the server (default 6969, forwarded by QEMU to port 69)")
+parser.add_argument("-s", "--size", type=int, default=4096, help="file size in KB")
+parser.add_argument("-f", "--file", default="BENCH.DAT", help="name of the file on the server")
+parser.add_argument("-t", "--test", action="append",
+		    help="block size and window size (e.g. 1468:8), can be repeated")
+args = parser.parse_args()
+
+tests = args.test or ["512:1", "1468:1", "1468:4", "1468:8", "1468:32"]
+
+class TFTPError(Exception):
+	pass
+
+class Transfer:
+	def __init__(self, blksize, windowsize):
+		self.server = (args.host, args.port)
+		self.peer = None	# address of the transfer socket of the server (TID)
+		self.blksize = blksize
+		self.windowsize = windowsize
+		self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+		self.sock.settimeout(TIMEOUT)
+
+	def close(self):
+		self.sock.close()
+
+	def request(self, opcode, filename, tsize):
+		packet = struct.pack("!H", opcode) + filename.encode() + b"\0octet\0"
+		options = {"blksize": self.blksize, "windowsize": self.windowsize, "tsize": tsize}
+		for name, value in options.items():
+			packet += name.encode() + b"\0" + str(value).encode() + b"\0"
+		self.request_packet = packet
+		self.sock.sendto(packet, self.server)
+
+	def send(self, packet):
+		self.sock.sendto(packet, self.peer)
+
+	def send_ack(self, block):
+		self.send(struct.pack("!HH", OP_ACK, block & 0xFFFF))
+
+	# returns (opcode, packet) or None on time-out
+	def receive(self):
+		while True:
+			try:
+				packet, address = self.sock.recvfrom(65536)
+			except socket.timeout:
+				return None
+
+			if self.peer is None:
+				self.peer = address
+			elif address != self.peer:
+				continue	# not from our server
+
+			if len(packet) < 4:
+				continue
+
+			opcode = struct.unpack("!H", packet[:2])[0]
+			if opcode == OP_ERROR:
+				raise TFTPError("Server error %u: %s" % (struct.unpack("!H", packet[2:4])[0],
+						packet[4:].split(b"\0")[0].decode(errors="replace")))
+
+			return opcode, packet
+
+	def parse_oack(self, packet):
+		fields = packet[2:].split(b"\0")
+		self.blksize = 512
+		self.windowsize = 1
+		for i in range(0, len(fields)-1, 2):
+			name = fields[i].decode().lower()
+			if name == "blksize":
+				self.blksize = int(fields[i+1])
+			elif name == "windowsize":
+				self.windowsize = int(fields[i+1])
+
+	def get(self, filename):
+		data = bytearray()
+		next_block = 1
+		window_blocks = 0
+		gap_acknowledged = False
+		options_acknowledged = False
+		retries = 0
+
+		self.request(OP_RRQ, filename, 0)
+		while True:
+			response = self.receive()
+			if response is None:
+				retries += 1
+				if retries > RETRIES:
+					raise TFTPError("Transfer timed out")
+				if self.peer is None:
+					self.sock.sendto(self.request_packet, self.server)
+				else:
+					self.send_ack(next_block-1)	# the last ACK may have been lost
+					window_blocks = 0
+				continue
+
+			opcode, packet = response
+			if opcode == OP_OACK and next_block == 1:
+				self.parse_oack(packet)
+				options_acknowledged = True
+				self.send_ack(0)
+				retries = 0
+				continue
+
+			if opcode != OP_DATA:
+				continue
+
+			if next_block == 1 and not options_acknowledged:
+				self.blksize = 512		# server does not support options
+				self.windowsize = 1
+				options_acknowledged = True
+
+			block = struct.unpack("!H", packet[2:4])[0]
+			if block != next_block & 0xFFFF:
+				# acknowledge the last block, which has been received in sequence (once only)
+				if not gap_acknowledged:
+					self.send_ack(next_block-1)
+					window_blocks = 0
+					gap_acknowledged = True
+				continue
+
+			gap_acknowledged = False
+			retries = 0
+			data += packet[4:]
+
+			last_block = len(packet)-4 < self.blksize
+			window_blocks += 1
+			if last_block or window_blocks == self.windowsize:
+				self.send_ack(next_block)
+				window_blocks = 0
+
+			next_block += 1
+			if last_block:
+				return bytes(data)
+
+	def put(self, filename, data):
+		self.request(OP_WRQ, filename, len(data))
+
+		retries = 0
+		while True:
+			response = self.receive()
+			if response is None:
+				retries += 1
+				if retries > RETRIES:
+					raise TFTPError("Request timed out")
+				self.sock.sendto(self.request_packet, self.server)
+				continue
+
+			opcode, packet = response
+			if opcode == OP_OACK:
+				self.parse_oack(packet)
+				break
+			if opcode == OP_ACK and struct.unpack("!H", packet[2:4])[0] == 0:
+				self.blksize = 512		# server does not support options
+				self.windowsize = 1
+				break
+
+		blocks = len(data) // self.blksize + 1		# the last block is shorter (may be empty)
+		base_block = 1					# first block, which is not acknowledged
+		retries = 0
+		while base_block <= blocks:
+			window_end = min(base_block + self.windowsize, blocks+1)
+			for block in range(base_block, window_end):
+				offset = (block-1) * self.blksize
+				self.send(struct.pack("!HH", OP_DATA, block & 0xFFFF)
+					  + data[offset:offset+self.blksize])
+
+			# wait for an ACK, which acknowledges at least one block of the window,
+			# duplicate ACKs of the previous window do not extend the time-out
+			acknowledged = 0
+			deadline = time.monotonic() + TIMEOUT
+			while acknowledged == 0 and time.monotonic() < deadline:
+				self.sock.settimeout(max(deadline - time.monotonic(), 0.001))
+				response = self.receive()
+				if response is None:
+					break
+				opcode, packet = response
+				if opcode != OP_ACK:
+					continue
+				# number of blocks acknowledged in this window (block numbers wrap)
+				count = (struct.unpack("!H", packet[2:4])[0] - (base_block-1)) & 0xFFFF
+				if count <= window_end - base_block:
+					acknowledged = count
+
+			self.sock.settimeout(TIMEOUT)
+
+			if acknowledged == 0:
+				retries += 1
+				if retries > RETRIES:
+					raise TFTPError("Transfer timed out")
+				continue
+
+			retries = 0
+			base_block += acknowledged
+
+def run_test(test, data):
+	blksize, windowsize = (int(value) for value in test.split(":"))
+
+	transfer = Transfer(blksize, windowsize)
+	start = time.monotonic()
+	transfer.put(args.file, data)
+	put_time = time.monotonic() - start
+	negotiated = (transfer.blksize, transfer.windowsize)
+	transfer.close()
+
+	transfer = Transfer(blksize, windowsize)
+	start = time.monotonic()
+	received = transfer.get(args.file)
+	get_time = time.monotonic() - start
+	transfer.close()
+
+	if received != data:
+		raise TFTPError("Data mismatch (received %u bytes)" % len(received))
+
+	print("blksize %4u, windowsize %2u: put %8.1f KB/s, get %8.1f KB/s"
+		% (negotiated[0], negotiated[1],
+		   len(data) / put_time / 1000, len(data) / get_time / 1000))
+
+data = os.urandom(args.size * 1024)
+
+print("Transferring %u KB to and from %s:%u" % (args.size, args.host, args.port))
+for test in tests:
+	try:
+		run_test(test, data)
+	except TFTPError as e:
+		print("blksize:windowsize %s: %s" % (test, str(e)))
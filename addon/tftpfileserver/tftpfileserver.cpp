@@ -2,7 +2,7 @@
 // tftpfileserver.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -85,3 +85,12 @@ int CTFTPFileServer::FileWrite (const void *pBuffer, unsigned nCount)
 	assert (nCount > 0);
 	return (int) m_pFileSystem->FileWrite (m_hFile, pBuffer, nCount);
 }
+
+int CTFTPFileServer::FileSize (void)
+{
+	assert (m_pFileSystem != 0);
+	assert (m_hFile != 0);
+	unsigned nSize = m_pFileSystem->FileGetSize (m_hFile);
+
+	return nSize <= 0x7FFFFFFFU ? (int) nSize : -1;
+}
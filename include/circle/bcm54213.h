@@ -69,6 +69,19 @@ struct TGEnetRxRing			// ring of Rx buffers
  	void		(*int_enable)(TGEnetRxRing *);
 };
 
+struct TGEnetStatistics
+{
+	unsigned	nRxInterrupts;		// RX interrupts (in interrupt mode only)
+	unsigned	nTxInterrupts;		// TX interrupts (buffer reclaim)
+	unsigned	nRxPolls;		// accesses to the RX ring by ReceiveFrames()
+	unsigned	nRxPolledFrames;	// frames returned by ReceiveFrames()
+	unsigned	nRxOverruns;		// frames discarded by HW, RX ring was full
+	unsigned	nRxErrors;		// frames dropped because of RX errors
+	unsigned	nTxRingFull;		// SendFrames() stopped, TX ring was full
+	unsigned	nModeSwitches;		// switches from polling to interrupt mode
+	boolean		bInterruptMode;		// currently waiting for RX interrupt
+};
+
 class CBcm54213Device : public CNetDevice	/// Driver for BCM54213PE Gigabit Ethernet Transceiver
 {
 public:
@@ -83,9 +96,13 @@ public:
 	boolean IsSendFrameAdvisable (void);
 
 	boolean SendFrame (const void *pBuffer, unsigned nLength);
+	// updates the TX producer index once per burst
+	unsigned SendFrames (const void *const *ppBuffer, const unsigned *pLength, unsigned nCount);
 
 	// pBuffer must have size FRAME_BUFFER_SIZE
 	boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength);
+	// updates the RX consumer index once per burst
+	unsigned ReceiveFrames (void *const *ppBuffer, unsigned *pResultLength, unsigned nMaxCount);
 
 	// returns TRUE if PHY link is up
 	boolean IsLinkUp (void);
@@ -95,6 +112,19 @@ public:
 	// update device settings according to PHY status
 	boolean UpdatePHY (void);
 
+	// interrupt moderation: the RX interrupt is raised, when nRxFrames frames have been
+	// received or nRxTimeoutMicros after the first frame (0 disables the timeout),
+	// the TX interrupt (buffer reclaim) after nTxFrames frames have been sent
+	void SetInterruptModeration (unsigned nRxFrames, unsigned nRxTimeoutMicros,
+				     unsigned nTxFrames);
+
+	// NAPI-like operation: the RX ring is polled, until nIdlePolls calls of ReceiveFrames()
+	// returned nothing, then the driver waits for the RX interrupt, before it accesses
+	// the ring again (0: always poll the RX ring)
+	void SetRxIdlePolls (unsigned nIdlePolls);
+
+	void GetStatistics (TGEnetStatistics *pStatistics) const;
+
 private:
 	// UMAC
 	void reset_umac(void);
@@ -108,6 +138,9 @@ private:
 	void enable_rx_intr(void);
 	void link_intr_enable(void);
 
+	void set_coalesce(void);
+	void rx_intr_mode(bool enable);
+
 	static void tx_ring16_int_enable(TGEnetTxRing *ring);
 	static void tx_ring_int_enable(TGEnetTxRing *ring);
 	static void rx_ring16_int_enable(TGEnetRxRing *ring);
@@ -196,6 +229,18 @@ private:
 	int m_old_pause;
 
 	CSpinLock m_TxSpinLock;
+
+	// interrupt moderation and RX mode
+	unsigned m_nRxCoalesceFrames;
+	unsigned m_nRxCoalesceMicros;
+	unsigned m_nTxCoalesceFrames;
+	unsigned m_nRxIdlePolls;
+
+	boolean m_bRxInterruptMode;		// waiting for RX interrupt
+	volatile boolean m_bRxPending;		// RX interrupt occurred
+	unsigned m_nRxIdleCount;		// polls without frame
+
+	TGEnetStatistics m_Statistics;
 };
 
 #endif
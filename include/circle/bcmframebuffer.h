@@ -2,7 +2,7 @@
 // bcmframebuffer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -38,8 +38,11 @@ struct TBcmFrameBufferInitTags
 class CBcmFrameBuffer
 {
 public:
+	// nBuffers > 1 allocates a virtual height of nHeight * nBuffers for page flipping,
+	// nVirtualWidth and nVirtualHeight are ignored then
 	CBcmFrameBuffer (unsigned nWidth, unsigned nHeight, unsigned nDepth,
-			 unsigned nVirtualWidth = 0, unsigned nVirtualHeight = 0);
+			 unsigned nVirtualWidth = 0, unsigned nVirtualHeight = 0,
+			 unsigned nBuffers = 1);
 	~CBcmFrameBuffer (void);
 
 	void SetPalette (u8 nIndex, u16 nRGB565);	// with Depth <= 8 only
@@ -56,6 +59,12 @@ public:
 	u32 GetBuffer (void) const;
 	u32 GetSize (void) const;
 
+	// page flipping (falls back to one buffer, if the GPU refuses the virtual size)
+	unsigned GetBufferCount (void) const;
+	unsigned GetBackBufferIndex (void) const;
+	u32 GetBackBuffer (void) const;			// buffer to be drawn, not displayed
+	boolean Flip (boolean bWaitForVSync = TRUE);	// display the back buffer
+
 	boolean UpdatePalette (void);			// with Depth <= 8 only
 
 	boolean SetVirtualOffset (u32 nOffsetX, u32 nOffsetY);
@@ -79,6 +88,9 @@ private:
 	u32 m_nBufferSize;
 	u32 m_nPitch;
 
+	unsigned m_nBuffers;
+	unsigned m_nFrontBuffer;
+
 	TPropertyTagSetPalette *m_pTagSetPalette;	// with Depth <= 8 only (256 entries)
 
 	TBcmFrameBufferInitTags m_InitTags;
@@ -149,6 +149,15 @@ extern TFIQData FIQData;
 
 extern uintptr IRQReturnAddress;		// for profiling
 
+// called on return from IRQ (with PREEMPTIVE_SCHEDULER only), may switch the task
+typedef void TPreemptionHandler (void);
+
+extern TPreemptionHandler *PreemptionHandler;
+
+// set if a task switch is requested on a core (only [0] used without MULTI_CORE_SCHEDULER),
+// PreemptionHandler is called on return from IRQ only, when the flag is set for this core
+extern volatile u32 PreemptionRequest[];
+
 #ifdef __cplusplus
 }
 #endif
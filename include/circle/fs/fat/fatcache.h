@@ -2,7 +2,7 @@
 // fatcache.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -98,7 +98,31 @@ public:
 	 */
 	void MarkDirty (TFATBuffer *pBuffer);
 
+	/*
+	 * Read consecutive sectors directly from disk, bypassing the buffer cache
+	 *
+	 * Params:  nSector	First sector number
+	 *	    pBuffer	Buffer to copy data to (4-byte aligned)
+	 *	    nCount	Number of sectors (1..FAT_MAX_TRANSFER)
+	 * Returns: Nonzero on success
+	 */
+	int ReadSectors (unsigned nSector, void *pBuffer, unsigned nCount);
+
+	/*
+	 * Write consecutive sectors directly to disk, bypassing the buffer cache
+	 *
+	 * Params:  nSector	First sector number
+	 *	    pBuffer	Buffer to copy data from (4-byte aligned)
+	 *	    nCount	Number of sectors (1..FAT_MAX_TRANSFER)
+	 * Returns: Nonzero on success
+	 */
+	int WriteSectors (unsigned nSector, const void *pBuffer, unsigned nCount);
+
 private:
+	TFATBuffer *FindBuffer (unsigned nSector);
+	TFATBuffer *AllocateBuffer (int bSpeculative);
+	int WriteBack (TFATBuffer *pBuffer);
+
 	void MoveBufferFirst (TFATBuffer *pBuffer);
 	void MoveBufferLast (TFATBuffer *pBuffer);
 
@@ -109,6 +133,10 @@ private:
 	void		*m_pBufferMem;
 	TFATBufferList	 m_BufferList;
 
+	unsigned char	*m_pTransferBuffer;	// FAT_READ_AHEAD_MAX sectors
+	unsigned	 m_nNextSector;		// expected on sequential access
+	unsigned	 m_nReadAhead;		// current read-ahead window (sectors)
+
 	CSpinLock m_BufferListLock;
 	CSpinLock m_DiskLock;
 };
@@ -2,7 +2,7 @@
 // fatfs.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -144,6 +144,15 @@ public:
 	*/
 	unsigned FileWrite (unsigned hFile, const void *pBuffer, unsigned nCount);
 
+	/*
+	* Get size of file
+	*
+	* Params:  hFile	File handle
+	* Returns: Current size of the file in bytes
+	*	    0xFFFFFFFF	General failure
+	*/
+	unsigned FileGetSize (unsigned hFile);
+
 	/*
 	* Delete all root entries for title
 	*
@@ -154,6 +163,11 @@ public:
 	*/
 	int FileDelete (const char *pTitle);
 
+private:
+	// sector at the current file position, switches to next cluster if required
+	unsigned GetReadSector (TFile *pFile);		// returns 0 at end of cluster chain
+	unsigned GetWriteSector (TFile *pFile);		// returns 0 if disk is full
+
 private:
 	CFATCache	m_Cache;
 	CFATInfo	m_FATInfo;
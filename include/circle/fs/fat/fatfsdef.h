@@ -10,6 +10,9 @@
 #define FAT_SECTOR_SIZE		512
 
 #define FAT_BUFFERS		100
+
+#define FAT_READ_AHEAD_MAX	32		// sectors, maximum read-ahead window
+#define FAT_MAX_TRANSFER	128		// sectors, maximum direct device transfer
 #define FAT_FILES		40
 
 #define FAT_MAX_FILESIZE	0xFFFFFFFF
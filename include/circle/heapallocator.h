@@ -22,6 +22,7 @@
 
 #include <circle/spinlock.h>
 #include <circle/sysconfig.h>
+#include <circle/memorymap.h>
 #include <circle/macros.h>
 #include <circle/types.h>
 
@@ -36,6 +37,7 @@ struct THeapBlockHeader
 {
 	u32			 nMagic;
 #define HEAP_BLOCK_MAGIC	0x424C4D43
+#define HEAP_BLOCK_FREE_MAGIC	0x424C4D46		// free large block (HEAP_SLAB_ALLOCATOR)
 	u32			 nSize;
 	THeapBlockHeader	*pNext;
 #if AARCH == 32
@@ -46,6 +48,8 @@ struct THeapBlockHeader
 }
 PACKED;
 
+#ifndef HEAP_SLAB_ALLOCATOR
+
 struct THeapBlockBucket
 {
 	u32			 nSize;
@@ -56,6 +60,41 @@ struct THeapBlockBucket
 	THeapBlockHeader	*pFreeList;
 };
 
+#else
+
+#define HEAP_SLAB_CLASSES	28		// size classes from 16 to 4096 bytes
+#define HEAP_SLAB_MAX_SIZE	4096		// larger blocks are allocated directly
+#define HEAP_SLAB_SIZE		0x10000		// memory carved into blocks of one class
+#define HEAP_MAGAZINE_SIZE	16		// blocks cached per core and size class
+#define HEAP_LARGE_MIN_SPLIT	256		// minimum remaining size to split a large block
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#define HEAP_MAGAZINE_CORES	CORES
+#else
+	#define HEAP_MAGAZINE_CORES	1
+#endif
+
+struct THeapSizeClass
+{
+	u32			 nSize;
+	THeapBlockHeader	*pFreeList;		// blocks not cached by a core
+	u8			*pSlabNext;		// next block to be carved
+	u8			*pSlabLimit;
+#ifdef HEAP_DEBUG
+	unsigned		 nCount;
+	unsigned		 nMaxCount;
+#endif
+	CSpinLock		 SpinLock;
+};
+
+struct THeapMagazine		// used by one core only
+{
+	unsigned		 nCount;
+	THeapBlockHeader	*pBlock[HEAP_MAGAZINE_SIZE];
+};
+
+#endif
+
 class CHeapAllocator	/// Allocates blocks from a flat memory region
 {
 public:
@@ -87,22 +126,48 @@ public:
 
 	/// \param pBlock Memory block to be freed
 	/// \note Memory space of blocks, which are bigger than the largest bucket size,\n
-	///	  cannot be returned to a free list and is lost.
+	///	  cannot be returned to a free list and is lost (not with HEAP_SLAB_ALLOCATOR).
 	void Free (void *pBlock);
 
 #ifdef HEAP_DEBUG
 	void DumpStatus (void);
 #endif
 
+private:
+	void OutOfMemory (void);
+
+#ifdef HEAP_SLAB_ALLOCATOR
+	void RefillMagazine (unsigned nClass, THeapMagazine *pMagazine);
+	void FlushMagazine (unsigned nClass, THeapMagazine *pMagazine);
+
+	void *AllocateLarge (size_t nSize);		// returns 0 if heap is full
+	void FreeLarge (THeapBlockHeader *pBlockHeader);
+
+	static unsigned GetSizeClass (size_t nSize);
+	static u32 GetClassSize (unsigned nClass);
+#endif
+
 private:
 	const char	*m_pHeapName;
 	u8		*m_pNext;
 	u8		*m_pLimit;
 	size_t	 	 m_nReserve;
+#ifndef HEAP_SLAB_ALLOCATOR
 	THeapBlockBucket m_Bucket[HEAP_BLOCK_MAX_BUCKETS+1];
+#else
+	THeapSizeClass	 m_SizeClass[HEAP_SLAB_CLASSES];
+	THeapMagazine	 m_Magazine[HEAP_MAGAZINE_CORES][HEAP_SLAB_CLASSES];
+	THeapBlockHeader *m_pLargeFreeList;		// ordered by address
+#ifdef HEAP_DEBUG
+	unsigned	 m_nLargeCount;
+	unsigned	 m_nLargeMaxCount;
+#endif
+#endif
 	CSpinLock	 m_SpinLock;
 
+#ifndef HEAP_SLAB_ALLOCATOR
 	static u32 s_nBucketSize[];
+#endif
 };
 
 #endif
@@ -24,6 +24,8 @@
 #include <circle/cputhrottle.h>
 #include <circle/types.h>
 
+#define MAX_APP_OPTIONS		20
+
 class CKernelOptions
 {
 public:
@@ -47,6 +49,9 @@ public:
 	TCPUSpeed GetCPUSpeed (void) const;
 	unsigned GetSoCMaxTemp (void) const;
 
+	// returns value of an option, which is not known by Circle, pDefault if it is not given
+	const char *GetAppOptionString (const char *pOption, const char *pDefault = 0) const;
+
 	static CKernelOptions *Get (void);
 
 private:
@@ -77,6 +82,14 @@ private:
 	TCPUSpeed m_CPUSpeed;
 	unsigned m_nSoCMaxTemp;
 
+	struct
+	{
+		const char *pOption;
+		const char *pValue;
+	}
+	m_AppOption[MAX_APP_OPTIONS];
+	unsigned m_nAppOptions;
+
 	static CKernelOptions *s_pThis;
 };
 
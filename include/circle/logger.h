@@ -30,6 +30,7 @@
 #define LOG_MAX_SOURCE		50
 #define LOG_MAX_MESSAGE		200
 #define LOG_QUEUE_SIZE		50
+#define LOG_RECORD_COUNT	64		// deferred output, must be a power of 2
 
 enum TLogSeverity
 {
@@ -41,6 +42,7 @@ enum TLogSeverity
 };
 
 struct TLogEvent;
+struct TLogRecord;
 
 typedef void TLogEventNotificationHandler (void);
 typedef void TLogPanicHandler (void);
@@ -63,6 +65,16 @@ public:
 
 	int Read (void *pBuffer, unsigned nCount);
 
+	// messages are queued by Write() and are written to the target by Update(),
+	// which has to be called repeatedly then (e.g. from CLoggerTask),
+	// LogPanic messages are still written immediately (after pending messages),
+	// queued messages are truncated to LOG_MAX_SOURCE-1 / LOG_MAX_MESSAGE-1 chars
+	boolean EnableDeferredOutput (void);	// returns FALSE if out of memory
+	// writes all pending messages, returns TRUE if something has been written
+	boolean Update (void);
+	// returns the number of messages lost, because the record queue was full
+	unsigned GetOverflowCount (void) const;
+
 	// returns FALSE if event is not available
 	boolean ReadEvent (TLogSeverity *pSeverity, char *pSource, char *pMessage,
 			   time_t *pTime, unsigned *pHundredthTime, int *pTimeZone);
@@ -77,7 +89,13 @@ public:
 private:
 	void Write (const char *pString);
 
-	void WriteEvent (const char *pSource, TLogSeverity Severity, const char *pMessage);
+	void SetupEvent (TLogEvent *pEvent, const char *pSource, TLogSeverity Severity,
+			 const char *pMessage);
+	void WriteEvent (const TLogEvent *pEvent);
+	void WriteOutput (TLogSeverity Severity, const char *pSource, const char *pMessage,
+			  time_t Time, unsigned nHundredthTime);
+
+	void QueueRecord (const char *pSource, TLogSeverity Severity, const char *pMessage);
 
 private:
 	unsigned m_nLogLevel;
@@ -95,6 +113,13 @@ private:
 	unsigned m_nEventOutPtr;
 	CSpinLock m_EventSpinLock;
 
+	TLogRecord *m_pRecords;			// lock-free multi-producer queue
+	volatile unsigned m_nRecordInPtr;	// increments only, wraps at 2^32
+	unsigned m_nRecordOutPtr;
+	volatile boolean m_bUpdating;		// allows a single consumer only
+	volatile unsigned m_nOverflowCount;
+	unsigned m_nOverflowReported;
+
 	TLogEventNotificationHandler *m_pEventNotificationHandler;
 	TLogPanicHandler *m_pPanicHandler;
 
@@ -2,7 +2,7 @@
 // multicore.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -29,6 +29,7 @@
 
 // inter-processor interrupt (IPI)
 #define IPI_HALT_CORE		0		// halt target core
+#define IPI_RESCHEDULE		1		// used by the multi-core scheduler
 #define IPI_USER		10		// first user defineable IPI
 #if RASPPI <= 3
 #define IPI_MAX			31
@@ -2,7 +2,7 @@
 // checksumcalculator.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -48,10 +48,20 @@ public:
 	
 	u16 Calculate (const void *pBuffer, unsigned nLength);
 
+	// copies nDataLength bytes from pSource to pDest and returns the checksum over the
+	// pseudo header, the header at pHeader (nHeaderLength must be even) and the data
+	u16 CopyAndCalculate (const void *pHeader, unsigned nHeaderLength,
+			      void *pDest, const void *pSource, unsigned nDataLength);
+
 	static u16 SimpleCalculate (const void *pBuffer, unsigned nLength);
 
 private:
 	static u32 CalculateChunk (const void *pBuffer, unsigned nLength, u32 nChecksum);
+	static u32 CopyAndCalculateChunk (void *pDest, const void *pSource, unsigned nLength,
+					  u32 nChecksum);
+
+	static u64 CalculateWords (const void *pBuffer, unsigned nLength);
+	static u64 CopyAndCalculateWords (void *pDest, const void *pSource, unsigned nLength);
 
 	static u16 FoldResult (u32 nChecksum);
 	
@@ -2,7 +2,7 @@
 // httpdaemon.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -26,20 +26,36 @@
 #include <circle/net/socket.h>
 #include <circle/types.h>
 
+class CHTTPContentProducer		// delivers content, which is sent in parts
+{
+public:
+	virtual ~CHTTPContentProducer (void) {}
+
+	// returns the content length or -1 if unknown (chunked transfer coding is used then)
+	virtual int GetContentLength (void)	{ return -1; }
+
+	// returns the number of bytes copied to pBuffer, 0 at end of content, < 0 on error
+	virtual int GetContentPart (u8 *pBuffer, unsigned nBufSize) = 0;
+};
+
+struct THTTPConnection;
+
 class CHTTPDaemon : public CTask
 {
 public:
 	CHTTPDaemon (CNetSubSystem *pNetSubSystem,
 		     CSocket	   *pSocket	    = 0,	// is 0 for 1st created instance (listener)
-		     unsigned	    nMaxContentSize = 0,	// buffer size for worker
+		     unsigned	    nMaxContentSize = 0,	// buffer size for worker (or event loop)
 		     u16	    nPort	    = HTTP_PORT,
-		     unsigned	    nMaxMultipartSize = 0);	// buffer size for multipart form data
+		     unsigned	    nMaxMultipartSize = 0,	// buffer size for multipart form data
+		     unsigned	    nMaxConnections = 0);	// > 0 to serve all connections from
+								// this task (event loop, keep-alive)
 	~CHTTPDaemon (void);
 
 	void Run (void);
 
-	// creates an instance of your derived webserver class
-	virtual CHTTPDaemon *CreateWorker (CNetSubSystem *pNetSubSystem, CSocket *pSocket) = 0;
+	// creates an instance of your derived webserver class (not used with nMaxConnections > 0)
+	virtual CHTTPDaemon *CreateWorker (CNetSubSystem *pNetSubSystem, CSocket *pSocket);
 
 	// define this to provide your content
 	virtual THTTPStatus GetContent (const char  *pPath,	// path of the file to be sent
@@ -49,6 +65,13 @@ public:
 				        unsigned    *pLength,	// in: buffer size, out: content length
 				        const char **ppContentType) = 0; // set this if not "text/html"
 
+	// define this to send content in parts (with nMaxConnections > 0 only),
+	// is called before GetContent(), return 0 to use GetContent() for this request
+	virtual CHTTPContentProducer *GetContentProducer (const char  *pPath,
+							  const char  *pParams,
+							  const char  *pFormData,
+							  const char **ppContentType); // as above
+
 protected:
 	// returns the next part from multipart form data (TRUE if available)
 	// data is not available after returning from GetContent() any more
@@ -57,10 +80,24 @@ protected:
 				      unsigned	  *pLength);	// returns part data length
 
 private:
+	boolean CreateListenSocket (void);
 	void Listener (void);			// accepts incoming connections and creates worker task
 	void Worker (void);			// processes a connection
 
+	void EventLoop (void);			// accepts and processes all connections
+	void ProcessConnection (THTTPConnection *pConnection);
+	void CloseConnection (THTTPConnection *pConnection);
+	boolean SendContentPart (THTTPConnection *pConnection);	// returns FALSE on error
+
+	// returns FALSE if the connection has to be closed
+	boolean SendResponse (CSocket *pSocket, THTTPStatus Status, boolean bKeepAlive,
+			      CHTTPContentProducer **ppProducer = 0);
+
 	THTTPStatus ParseRequest (void);
+	void ResetRequest (void);
+	boolean ParseData (const char *pData, unsigned nLength,		// returns TRUE when
+			   unsigned *pConsumed);			// request is complete
+	THTTPStatus FinishRequest (void);
 	THTTPStatus ParseMethod (char *pLine);
 	THTTPStatus ParseHeaderField (char *pLine);
 
@@ -73,11 +110,22 @@ private:
 	unsigned       m_nMaxContentSize;
 	u16	       m_nPort;
 	unsigned       m_nMaxMultipartSize;
+	unsigned       m_nMaxConnections;
 	
 	u8 *m_pContentBuffer;
 
+	THTTPConnection *m_pConnections;		// for event loop only
+
+	// parser state
+	THTTPStatus m_ParseStatus;
+	unsigned m_nParseState;
+	unsigned m_nParseLine;
+	unsigned m_nParseChar;
+	char m_ParseLine[HTTP_MAX_REQUEST_LINE+1];
+
 	// from request
 	THTTPRequestMethod m_RequestMethod;
+	boolean m_bConnectionClose;			// "Connection: close" received
 
 	char m_RequestURI[HTTP_MAX_URI+1];		// the URI without host
 	char m_RequestPath[HTTP_MAX_PATH+1];		// the path without parameters
@@ -0,0 +1,51 @@
+//
+// httpfileproducer.h
+//
+// Sends a file from the root directory of a FAT file system with CHTTPDaemon
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_httpfileproducer_h
+#define _circle_net_httpfileproducer_h
+
+#include <circle/net/httpdaemon.h>
+#include <circle/fs/fat/fatfs.h>
+#include <circle/types.h>
+
+class CHTTPFileProducer : public CHTTPContentProducer
+{
+public:
+	CHTTPFileProducer (CFATFileSystem *pFileSystem);
+	~CHTTPFileProducer (void);
+
+	// pPath is "/FILENAME.EXT" (8.3 name in the root directory), returns FALSE if not found
+	boolean Open (const char *pPath);
+
+	int GetContentLength (void);
+	int GetContentPart (u8 *pBuffer, unsigned nBufSize);
+
+	// returns the MIME type for the extension of pPath ("application/octet-stream" if unknown)
+	static const char *GetContentType (const char *pPath);
+
+private:
+	CFATFileSystem *m_pFileSystem;
+
+	unsigned m_hFile;
+	unsigned m_nSize;
+};
+
+#endif
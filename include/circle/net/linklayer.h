@@ -26,6 +26,7 @@
 #include <circle/net/ipaddress.h>
 #include <circle/macaddress.h>
 #include <circle/net/netqueue.h>
+#include <circle/net/netbuffer.h>
 #include <circle/macros.h>
 #include <circle/types.h>
 
@@ -39,6 +40,8 @@ struct TEthernetHeader
 }
 PACKED;
 
+#define LINK_LAYER_HEADROOM	sizeof (TEthernetHeader)
+
 class CNetworkLayer;
 
 class CLinkLayer
@@ -54,6 +57,14 @@ public:
 
 	void Process (void);
 
+	// pIPPacket must have at least LINK_LAYER_HEADROOM bytes of headroom,
+	// takes over the reference to pIPPacket
+	boolean Send (const CIPAddress &rReceiver, CNetBuffer *pIPPacket);
+
+	// returns 0 if nothing received, caller has to Release() the returned buffer
+	CNetBuffer *Receive (void);
+
+	// compatibility interface, which copies the data
 	boolean Send (const CIPAddress &rReceiver, const void *pIPPacket, unsigned nLength);
 
 	// pBuffer must have size FRAME_BUFFER_SIZE
@@ -0,0 +1,110 @@
+//
+// netbuffer.h
+//
+// Reference counted frame buffers from a preallocated pool
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_netbuffer_h
+#define _circle_net_netbuffer_h
+
+#include <circle/netdevice.h>
+#include <circle/spinlock.h>
+#include <circle/macros.h>
+#include <circle/types.h>
+
+// NET_BUFFER_POOL_SIZE is the number of frame buffers, which are preallocated
+// for the network subsystem. If the pool is exhausted, additional buffers are
+// allocated from the heap.
+
+#ifndef NET_BUFFER_POOL_SIZE
+#define NET_BUFFER_POOL_SIZE	128
+#endif
+
+class CNetBufferPool;
+
+class CNetBuffer		// a frame buffer, owned by the holder(s) of a reference
+{
+public:
+	// returns buffer with reference count 1 and length 0
+	// nHeadroom bytes are reserved in front of the data for headers to be added later
+	static CNetBuffer *Alloc (unsigned nHeadroom = 0);
+
+	void AddRef (void);
+	void Release (void);			// frees the buffer, when the last reference is gone
+
+	u8 *GetData (void);			// start of the valid data
+	const u8 *GetData (void) const;
+	unsigned GetLength (void) const;	// length of the valid data
+	unsigned GetSize (void) const;		// maximum length of the data from GetData()
+
+	// both return FALSE and leave the buffer unchanged, if nLength exceeds GetSize()
+	boolean SetLength (unsigned nLength);
+	boolean SetData (const void *pData, unsigned nLength);	// copies data into the buffer
+
+	// remove nLength bytes from the front of the data without moving it
+	void RemoveHeader (unsigned nLength);
+	// prepend nLength bytes to the data (must fit into the headroom), returns their address
+	void *AddHeader (unsigned nLength);
+
+private:
+	CNetBuffer (void);
+	~CNetBuffer (void);
+
+	void Reset (unsigned nHeadroom);
+
+	friend class CNetBufferPool;
+	friend class CNetQueue;
+
+private:
+	u8		m_Buffer[FRAME_BUFFER_SIZE] ALIGN(4);	// DMA buffer
+	unsigned	m_nOffset;
+	unsigned	m_nLength;
+	unsigned	m_nRefCount;
+	CNetBufferPool *m_pPool;			// 0 if allocated from heap
+
+	CNetBuffer	*m_pNext;			// free list or queue link
+	CNetBuffer	*m_pPrev;			// queue link
+	void		*m_pParam;			// queue private data
+
+	static CSpinLock s_SpinLock;			// protects m_nRefCount
+};
+
+class CNetBufferPool
+{
+public:
+	CNetBufferPool (unsigned nBuffers = NET_BUFFER_POOL_SIZE);
+	~CNetBufferPool (void);
+
+	CNetBuffer *Allocate (void);		// returns 0 if pool is exhausted
+	void Free (CNetBuffer *pBuffer);
+
+	unsigned GetFreeCount (void) const;
+
+	static CNetBufferPool *Get (void);	// returns 0 if no pool exists
+
+private:
+	CNetBuffer *m_pBuffers;
+	CNetBuffer *m_pFreeList;
+	unsigned m_nFreeCount;
+
+	CSpinLock m_SpinLock;
+
+	static CNetBufferPool *s_pThis;
+};
+
+#endif
@@ -2,7 +2,7 @@
 // netconnection.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -60,6 +60,9 @@ public:
 
 	virtual boolean IsConnected (void) const = 0;
 	virtual boolean IsTerminated (void) const = 0;
+
+	// returns TRUE if packets from any foreign host/port may be accepted
+	virtual boolean IsListening (void) const;
 	
 	virtual void Process (void) = 0;
 
@@ -83,6 +86,15 @@ protected:
 	int m_nProtocol;
 
 	CChecksumCalculator m_Checksum;
+
+private:
+	friend class CTransportLayer;		// maintains the following demultiplexing state
+	CNetConnection *m_pNextHashed;
+	boolean m_bHashed;
+	boolean m_bHashedAsListener;
+	u32 m_nHashedForeignIP;
+	u16 m_nHashedForeignPort;
+	unsigned m_nHashBucket;
 };
 
 #endif
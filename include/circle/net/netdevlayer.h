@@ -23,9 +23,12 @@
 #include <circle/net/netconfig.h>
 #include <circle/netdevice.h>
 #include <circle/net/netqueue.h>
+#include <circle/net/netbuffer.h>
 #include <circle/bcm54213.h>
 #include <circle/types.h>
 
+#define NETDEV_BURST_SIZE	8		// max. frames per SendFrames() / ReceiveFrames()
+
 class CNetDeviceLayer
 {
 public:
@@ -38,6 +41,12 @@ public:
 
 	const CMACAddress *GetMACAddress (void) const;
 
+	// takes over the reference to pBuffer
+	void Send (CNetBuffer *pBuffer);
+	// returns 0 if nothing received, caller has to Release() the returned buffer
+	CNetBuffer *Receive (void);
+
+	// compatibility interface, which copies the data
 	void Send (const void *pBuffer, unsigned nLength);
 	boolean Receive (void *pBuffer, unsigned *pResultLength);
 
@@ -49,6 +58,8 @@ private:
 	CNetQueue m_TxQueue;
 	CNetQueue m_RxQueue;
 
+	CNetBuffer *m_pRxBuffer[NETDEV_BURST_SIZE];	// preallocated for ReceiveFrames()
+
 #if RASPPI >= 4
 	CBcm54213Device m_Bcm54213;
 #endif
@@ -2,7 +2,7 @@
 // netqueue.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -20,11 +20,10 @@
 #ifndef _circle_net_netqueue_h
 #define _circle_net_netqueue_h
 
+#include <circle/net/netbuffer.h>
 #include <circle/spinlock.h>
 #include <circle/types.h>
 
-struct TNetQueueEntry;
-
 class CNetQueue
 {
 public:
@@ -35,14 +34,24 @@ public:
 	
 	void Flush (void);
 	
+	// takes over the reference to pBuffer, which may be in one queue only at a time
+	void Enqueue (CNetBuffer *pBuffer, void *pParam = 0);
+
+	// returns 0 if queue is empty, caller has to Release() the returned buffer
+	CNetBuffer *Dequeue (void **ppParam = 0);
+
+	// puts a buffer, which has been dequeued before, back to the front of the queue
+	void Requeue (CNetBuffer *pBuffer, void *pParam = 0);
+
+	// compatibility interface, which copies the data
 	void Enqueue (const void *pBuffer, unsigned nLength, void *pParam = 0);
 
 	// returns length (0 if queue is empty)
 	unsigned Dequeue (void *pBuffer, void **ppParam = 0);
 
 private:
-	volatile TNetQueueEntry *m_pFirst;
-	volatile TNetQueueEntry *m_pLast;
+	CNetBuffer * volatile m_pFirst;
+	CNetBuffer * volatile m_pLast;
 
 	CSpinLock m_SpinLock;
 };
@@ -21,6 +21,7 @@
 #define _circle_net_netsubsystem_h
 
 #include <circle/net/netconfig.h>
+#include <circle/net/netbuffer.h>
 #include <circle/net/netdevlayer.h>
 #include <circle/net/linklayer.h>
 #include <circle/net/networklayer.h>
@@ -59,6 +60,7 @@ public:
 private:
 	CString		m_Hostname;
 
+	CNetBufferPool	m_BufferPool;			// must be constructed before the layers
 	CNetConfig	m_Config;
 	CNetDeviceLayer	m_NetDevLayer;
 	CLinkLayer	m_LinkLayer;
@@ -23,6 +23,7 @@
 #include <circle/net/netconfig.h>
 #include <circle/net/linklayer.h>
 #include <circle/net/netqueue.h>
+#include <circle/net/netbuffer.h>
 #include <circle/net/ipaddress.h>
 #include <circle/net/icmphandler.h>
 #include <circle/net/routecache.h>
@@ -75,6 +76,9 @@ public:
 
 	boolean Send (const CIPAddress &rReceiver, const void *pPacket, unsigned nLength, int nProtocol);
 
+	// returns 0 if nothing received, caller has to Release() the returned buffer
+	CNetBuffer *Receive (CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol);
+
 	// pBuffer must have size FRAME_BUFFER_SIZE
 	boolean Receive (void *pBuffer, unsigned *pResultLength,
 			 CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol);
@@ -2,7 +2,7 @@
 // retransmissionqueue.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -35,6 +35,9 @@ public:
 
 	unsigned GetBytesAvailable (void) const;
 	void Read (void *pBuffer, unsigned nLength);
+	// read from position nOffset relative to the first unacknowledged byte,
+	// without changing the read pointer, returns number of bytes read
+	unsigned ReadAt (unsigned nOffset, void *pBuffer, unsigned nLength) const;
 	void Advance (unsigned nBytes);
 	void Reset (void);
 
@@ -2,7 +2,7 @@
 // socket.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -59,8 +59,10 @@ public:
 	/// \brief Accept an incoming connection (TCP only, must call Listen() before)
 	/// \param pForeignIP	IP address of the remote host will be returned here
 	/// \param pForeignPort	Remote port number will be returned here
-	/// \return Newly created socket to be used to communicate with the remote host (0 on error)
-	CSocket *Accept (CIPAddress *pForeignIP, u16 *pForeignPort);
+	/// \param nFlags	MSG_DONTWAIT (non-blocking operation) or 0 (blocking operation)
+	/// \return Newly created socket to be used to communicate with the remote host\n
+	/// (0 on error or with MSG_DONTWAIT if no connection is established yet)
+	CSocket *Accept (CIPAddress *pForeignIP, u16 *pForeignPort, int nFlags = 0);
 
 	/// \brief Send a message to a remote host
 	/// \param pBuffer Pointer to the message
@@ -108,6 +110,11 @@ public:
 	/// \return Pointer to IP address (four bytes, 0-pointer if not connected)
 	const u8 *GetForeignIP (void) const;
 
+	/// \brief Get congestion control state and retransmission counters of a TCP connection
+	/// \param pStatistics Statistics will be returned here (see circle/net/tcpconnection.h)
+	/// \return Operation successful? (FALSE if not a connected TCP socket)
+	boolean GetTCPStatistics (TTCPStatistics *pStatistics) const;
+
 private:
 	CSocket (CSocket &rSocket, int hConnection);
 
@@ -0,0 +1,122 @@
+//
+// tcpcongestioncontrol.h
+//
+// Pluggable TCP congestion control (RFC 5681, RFC 6582, RFC 8312)
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_tcpcongestioncontrol_h
+#define _circle_net_tcpcongestioncontrol_h
+
+#include <circle/types.h>
+
+enum TTCPCongestionControl
+{
+	TCPCongestionControlNewReno,
+	TCPCongestionControlCUBIC,
+	TCPCongestionControlUnknown
+};
+
+class CTCPCongestionControl		// all window sizes in bytes
+{
+public:
+	CTCPCongestionControl (void);
+	virtual ~CTCPCongestionControl (void);
+
+	virtual TTCPCongestionControl GetType (void) const = 0;
+
+	// called when the connection is established and the MSS is known
+	virtual void Initialize (unsigned nMSS);
+
+	unsigned GetCongestionWindow (void) const;
+	unsigned GetSlowStartThreshold (void) const;
+
+	// new data has been acknowledged (not called in fast recovery)
+	virtual void DataAcknowledged (unsigned nBytesAcked) = 0;
+
+	// loss detected by duplicate ACKs or SACK, fast recovery starts
+	virtual void LossDetected (unsigned nFlightSize) = 0;
+
+	// all data outstanding at the start of fast recovery has been acknowledged
+	virtual void RecoveryFinished (void);
+
+	// retransmission timer expired
+	virtual void RetransmissionTimeout (unsigned nFlightSize) = 0;
+
+	// returns a new object of the default type
+	static CTCPCongestionControl *Create (void);
+	static CTCPCongestionControl *Create (TTCPCongestionControl Type);
+
+	// sets the algorithm used for connections created afterwards
+	static void SetDefault (TTCPCongestionControl Type);
+
+protected:
+	unsigned m_nMSS;
+	unsigned m_nCongestionWindow;
+	unsigned m_nSlowStartThreshold;
+
+	static TTCPCongestionControl s_DefaultType;
+};
+
+class CTCPNewReno : public CTCPCongestionControl	// RFC 5681 and RFC 6582
+{
+public:
+	CTCPNewReno (void);
+	~CTCPNewReno (void);
+
+	TTCPCongestionControl GetType (void) const;
+
+	void Initialize (unsigned nMSS);
+
+	void DataAcknowledged (unsigned nBytesAcked);
+	void LossDetected (unsigned nFlightSize);
+	void RetransmissionTimeout (unsigned nFlightSize);
+
+private:
+	unsigned m_nBytesAcked;		// for congestion avoidance
+};
+
+class CTCPCubic : public CTCPCongestionControl		// RFC 8312
+{
+public:
+	CTCPCubic (void);
+	~CTCPCubic (void);
+
+	TTCPCongestionControl GetType (void) const;
+
+	void Initialize (unsigned nMSS);
+
+	void DataAcknowledged (unsigned nBytesAcked);
+	void LossDetected (unsigned nFlightSize);
+	void RetransmissionTimeout (unsigned nFlightSize);
+
+private:
+	void ReduceWindow (void);
+
+	static u64 CubeRoot (u64 nValue);
+
+private:
+	unsigned m_nWindowMax;		// window before last reduction
+	unsigned m_nLastWindowMax;	// for fast convergence
+	unsigned m_nOriginPoint;	// W_max or current window, if greater
+	unsigned m_nEstimatedWindow;	// W_est for the TCP-friendly region
+	boolean  m_bEpochStarted;
+	unsigned m_nEpochStart;		// in ticks
+	unsigned m_nK;			// in milliseconds
+};
+
+#endif
@@ -2,7 +2,7 @@
 // tcpconnection.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,6 +27,7 @@
 #include <circle/net/netqueue.h>
 #include <circle/net/retransmissionqueue.h>
 #include <circle/net/retranstimeoutcalc.h>
+#include <circle/net/tcpcongestioncontrol.h>
 #include <circle/sched/synchronizationevent.h>
 #include <circle/timer.h>
 #include <circle/spinlock.h>
@@ -55,6 +56,31 @@ enum TTCPTimer
 	TCPTimerUnknown
 };
 
+struct TTCPStatistics
+{
+	TTCPCongestionControl	CongestionControl;
+	unsigned		nCongestionWindow;	// bytes
+	unsigned		nSlowStartThreshold;	// bytes
+	unsigned		nSendWindow;		// bytes, as announced by peer
+	unsigned		nReceiveWindow;		// bytes
+	unsigned		nSendMSS;
+	boolean			bWindowScale;		// RFC 7323 window scaling negotiated
+	boolean			bSACKPermitted;		// RFC 2018 SACK negotiated
+	unsigned		nRetransmissions;	// segments retransmitted (all reasons)
+	unsigned		nFastRetransmissions;	// number of fast recovery phases
+	unsigned		nTimeouts;		// retransmission timer expirations
+	boolean			bSendQueueEmpty;	// all data passed to retransmission queue
+};
+
+#define TCP_MAX_SACK_BLOCKS	4		// in one segment
+#define TCP_SACK_SCOREBOARD	8		// maximum number of SACKed ranges
+
+struct TTCPSACKBlock
+{
+	u32	nLeft;
+	u32	nRight;
+};
+
 struct TTCPHeader;
 
 class CTCPConnection : public CNetConnection
@@ -82,8 +108,11 @@ public:
 
 	int SetOptionBroadcast (boolean bAllowed);
 
+	void GetStatistics (TTCPStatistics *pStatistics) const;
+
 	boolean IsConnected (void) const;
 	boolean IsTerminated (void) const;
+	boolean IsListening (void) const;
 	
 	void Process (void);
 	
@@ -102,6 +131,16 @@ private:
 			     const void *pData = 0, unsigned nDataLength = 0);
 
 	void ScanOptions (TTCPHeader *pHeader);
+
+	void InitializeTransmission (void);	// on entering ESTABLISHED state
+	u32 GetSendWindowLeft (void) const;
+
+	void DuplicateACKReceived (void);
+	boolean RetransmitHole (void);
+
+	void UpdateScoreboard (void);
+	void PruneScoreboard (void);
+	u32 GetSACKedBytes (void) const;
 	
 	u32 CalculateISN (void);
 	
@@ -157,6 +196,31 @@ private:
 
 	// Other Variables
 	u16 m_nSND_MSS;		// send maximum segment size
+	u32 m_nSND_MAX;		// highest sequence number sent
+
+	// RFC 7323 window scaling and RFC 2018 selective acknowledgment
+	boolean m_bWindowScale;
+	unsigned m_nSND_WindowShift;	// as requested by peer
+	unsigned m_nRCV_WindowShift;	// our shift count
+	boolean m_bSACKPermitted;
+
+	unsigned m_nSACKBlocks;		// received with the current segment
+	TTCPSACKBlock m_SACKBlock[TCP_MAX_SACK_BLOCKS];
+	unsigned m_nScoreboardEntries;	// ordered, non-overlapping
+	TTCPSACKBlock m_Scoreboard[TCP_SACK_SCOREBOARD];
+
+	// Congestion control and loss recovery
+	CTCPCongestionControl *m_pCongestionControl;
+	unsigned m_nDuplicateACKs;
+	boolean m_bInRecovery;
+	u32 m_nRecoveryPoint;		// SND_NXT when recovery started
+	u32 m_nHighRxt;			// highest sequence number retransmitted in recovery
+	unsigned m_nWindowInflation;	// NewReno without SACK
+	boolean m_bFastRetransmit;	// retransmit next hole on Process()
+
+	unsigned m_nRetransmissions;
+	unsigned m_nFastRetransmissions;
+	unsigned m_nTimeouts;
 
 	CRetransmissionTimeoutCalculator m_RTOCalculator;
 
@@ -2,7 +2,7 @@
 // tftpdaemon.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -40,10 +40,29 @@ public:
 	virtual int FileRead (void *pBuffer, unsigned nCount) = 0;
 	virtual int FileWrite (const void *pBuffer, unsigned nCount) = 0;
 
+	// returns the size of the file opened with FileOpen(), or < 0 if unknown,
+	// the "tsize" option is not acknowledged on read requests then
+	virtual int FileSize (void);
+
 private:
 	boolean DoRead (const char *pFileName);
 	boolean DoWrite (const char *pFileName);
 
+	boolean SendFile (u8 *pBuffer, unsigned nBufferSize);
+	boolean ReceiveFile (u8 *pBuffer, unsigned nBufferSize);
+
+	// parse options (RFC 2347) of the request, pEnd points behind the last option
+	void ParseOptions (const char *pOptions, const char *pEnd);
+	boolean HasOptions (void) const;
+	boolean SendOptionAck (void);
+
+	// in the handshake (block number 0) an OACK is sent instead, if options have been accepted,
+	// block number 0 after the wrap-around is acknowledged with a normal ACK
+	boolean SendAck (u16 usBlockNumber, boolean bHandshake = FALSE);
+
+	// returns length of received packet, 0 on timeout or < 0 on error
+	int ReceivePacket (void *pBuffer, unsigned nTimeout);
+
 	// use m_pRequestSocket, if pSendTo/nPort are given; m_pTransferSocket otherwise
 	void SendError (u16 usErrorCode, const char *pErrorMessage,
 			CIPAddress *pSendTo = 0, u16 usPort = 0);
@@ -53,6 +72,14 @@ private:
 
 	CSocket *m_pRequestSocket;
 	CSocket *m_pTransferSocket;
+
+	// negotiated options of the current transfer
+	unsigned m_nBlockSize;
+	unsigned m_nWindowSize;
+	boolean m_bBlockSizeOption;
+	boolean m_bWindowSizeOption;
+	boolean m_bTransferSizeOption;
+	unsigned m_nTransferSize;
 };
 
 #endif
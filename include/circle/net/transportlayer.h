@@ -2,7 +2,7 @@
 // transportlayer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -30,6 +30,14 @@
 #include <circle/spinlock.h>
 #include <circle/types.h>
 
+#define OWN_PORT_MIN		60000		// for dynamic port assignment
+#define OWN_PORT_MAX		60999
+
+#define TRANSPORT_HASH_SIZE	512		// buckets for connected sockets, must be power of 2
+#define TRANSPORT_LISTEN_HASH_SIZE 64		// buckets for listening sockets, must be power of 2
+
+struct TTCPStatistics;
+
 class CTransportLayer
 {
 public:
@@ -68,6 +76,30 @@ public:
 	boolean IsConnected (int hConnection) const;
 	const u8 *GetForeignIP (int hConnection) const;		// returns 0 if not connected
 
+	// returns FALSE if not a TCP connection
+	boolean GetTCPStatistics (TTCPStatistics *pStatistics, int hConnection) const;
+
+private:
+	// returns FALSE if the packet was not consumed by a connection
+	boolean DeliverPacket (const void *pPacket, unsigned nLength,
+			       CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol);
+	boolean DeliverNotification (TICMPNotificationType Type,
+				     CIPAddress &rSenderIP, CIPAddress &rReceiverIP,
+				     u16 nSendPort, u16 nReceivePort, int nProtocol);
+
+	// maintain the demultiplexing tables
+	void AddConnection (CNetConnection *pConnection);	// m_SpinLock must be acquired
+	void RemoveConnection (CNetConnection *pConnection);
+	void UpdateConnection (CNetConnection *pConnection);	// foreign address may have changed
+
+	void InsertHashed (CNetConnection *pConnection);
+	void RemoveHashed (CNetConnection *pConnection);
+
+	static unsigned HashTuple (int nProtocol, u32 nForeignIP, u16 nForeignPort, u16 nOwnPort);
+	static unsigned HashPort (int nProtocol, u16 nOwnPort);
+
+	u16 *GetOwnPortUsage (int nProtocol, u16 nOwnPort);	// returns 0 if not dynamic port
+
 private:
 	CNetConfig    *m_pNetConfig;
 	CNetworkLayer *m_pNetworkLayer;
@@ -76,6 +108,11 @@ private:
 	u16 m_nOwnPort;
 	CSpinLock m_SpinLock;
 
+	CNetConnection *m_pTupleHash[TRANSPORT_HASH_SIZE];		// by protocol and 4-tuple
+	CNetConnection *m_pListenHash[TRANSPORT_LISTEN_HASH_SIZE];	// by protocol and own port
+
+	u16 m_OwnPortUsage[2][OWN_PORT_MAX-OWN_PORT_MIN+1];		// TCP, UDP
+
 	CTCPRejector m_TCPRejector;
 };
 
@@ -2,7 +2,7 @@
 // udpconnection.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -55,6 +55,7 @@ public:
 	int SetOptionBroadcast (boolean bAllowed);
 
 	boolean IsConnected (void) const;
+	boolean IsListening (void) const;
 	boolean IsTerminated (void) const;
 	
 	void Process (void);
@@ -73,6 +73,25 @@ public:
 	/// \return TRUE if a frame is returned in buffer, FALSE if nothing has been received
 	virtual boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength) = 0;
 
+	/// \brief Send multiple valid Ethernet frames to the network
+	/// \param ppBuffer Array of pointers to the frames, do not contain FCS
+	/// \param pLength Array of frame lengths in bytes, do not need to be padded
+	/// \param nCount Number of frames in the arrays
+	/// \return Number of frames from the start of the arrays, which have been sent
+	/// \note The default implementation calls SendFrame() for each frame. Drivers override\n
+	///	  this to amortize the per-frame cost (e.g. one doorbell or USB transfer per burst).
+	virtual unsigned SendFrames (const void *const *ppBuffer, const unsigned *pLength,
+				     unsigned nCount);
+
+	/// \brief Poll for multiple received Ethernet frames
+	/// \param ppBuffer Array of pointers to the buffers, each must have size FRAME_BUFFER_SIZE
+	/// \param pResultLength Array of variables, which receive the valid frame lengths
+	/// \param nMaxCount Maximum number of frames to be returned (size of the arrays)
+	/// \return Number of frames returned (0 if nothing has been received)
+	/// \note The default implementation calls ReceiveFrame() until it returns FALSE.
+	virtual unsigned ReceiveFrames (void *const *ppBuffer, unsigned *pResultLength,
+					unsigned nMaxCount);
+
 	/// \return TRUE if PHY link is up
 	virtual boolean IsLinkUp (void)			{ return TRUE; }
 
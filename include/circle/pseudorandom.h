@@ -0,0 +1,44 @@
+//
+// pseudorandom.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_pseudorandom_h
+#define _circle_pseudorandom_h
+
+#include <circle/types.h>
+
+class CPseudoRandomNumberGenerator	/// Reproducible sequence of pseudo random numbers (xorshift32)
+{
+public:
+	/// \param nSeed Start value of the sequence (must not be 0, default from Marsaglia's paper)
+	CPseudoRandomNumberGenerator (u32 nSeed = 2463534242U);
+	~CPseudoRandomNumberGenerator (void);
+
+	/// \return Next pseudo random number (32-bit)
+	u32 GetNumber (void);
+
+	/// \brief Fill a buffer with pseudo random bytes
+	/// \param pBuffer Pointer to the buffer
+	/// \param nLength Size of the buffer in bytes
+	void Fill (void *pBuffer, size_t nLength);
+
+private:
+	u32 m_nState;
+};
+
+#endif
@@ -2,7 +2,7 @@
 // pwmsoundbasedevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -45,9 +45,12 @@ public:
 	/// \param nSampleRate	sample rate in Hz
 	/// \param nChunkSize	twice the number of samples (words) to be handled\n
 	///			with one call to GetChunk() (one word per stereo channel)
+	/// \param nPeriods	number of DMA buffers (periods) of nChunkSize words\n
+	///			(2..SOUND_MAX_PERIODS, at least 3 for zero-copy operation)
 	CPWMSoundBaseDevice (CInterruptSystem *pInterrupt,
 			     unsigned	       nSampleRate = 44100,
-			     unsigned	       nChunkSize  = 2048);
+			     unsigned	       nChunkSize  = 2048,
+			     unsigned	       nPeriods    = 2);
 
 	virtual ~CPWMSoundBaseDevice (void);
 
@@ -68,6 +71,28 @@ public:
 	/// \return Is PWM and DMA operation running?
 	boolean IsActive (void) const;
 
+	/// \brief Enables zero-copy operation, must be called before Start()
+	/// \note The application renders directly into the DMA buffers using\n
+	///	  GetPeriodBuffer() and QueuePeriod(), GetChunk() is not called then.
+	void EnableZeroCopy (void);
+
+	/// \param pPlayTime	returns the time (CTimer::GetClockTicks()), when the\n
+	///			period will start to play (0 if not running)
+	/// \return Buffer of the next free period (nChunkSize words), 0 if none is free
+	/// \note May be called before Start() to pre-fill the periods.
+	u32 *GetPeriodBuffer (unsigned *pPlayTime = 0);
+
+	/// \brief Hands the buffer returned by GetPeriodBuffer() over to the DMA
+	void QueuePeriod (void);
+
+	/// \param pPeriod	returns the number of the period, which is playing\n
+	///			(counted from 0 since Start())
+	/// \return Time (CTimer::GetClockTicks()), when this period started to play
+	unsigned GetPeriodTimestamp (unsigned *pPeriod);
+
+	/// \return Number of periods replaced by silence, because they were not queued in time
+	unsigned GetUnderrunCount (void) const;
+
 protected:
 	/// \brief May overload this to provide the sound samples!
 	/// \param pBuffer	buffer where the samples have to be placed
@@ -88,10 +113,16 @@ private:
 	static void InterruptStub (void *pParam);
 
 	void SetupDMAControlBlock (unsigned nID);
+	void LinkControlBlocks (void);
+
+	void FillSilence (unsigned nPeriod);
+	void TerminateAfter (unsigned nLastPeriod, boolean bDMAActive);	// spin lock held
 
 private:
 	CInterruptSystem *m_pInterruptSystem;
 	unsigned m_nChunkSize;
+	unsigned m_nPeriods;
+	unsigned m_nPeriodUsecs;
 	unsigned m_nRange;
 
 	CGPIOPin   m_Audio1;
@@ -102,11 +133,22 @@ private:
 	volatile TPWMSoundState m_State;
 
 	unsigned m_nDMAChannel;
-	u32 *m_pDMABuffer[2];
-	u8 *m_pControlBlockBuffer[2];
-	TDMAControlBlock *m_pControlBlock[2];
-
-	unsigned m_nNextBuffer;			// 0 or 1
+	u32 *m_pDMABuffer[SOUND_MAX_PERIODS];
+	u8 *m_pControlBlockBuffer[SOUND_MAX_PERIODS];
+	TDMAControlBlock *m_pControlBlock[SOUND_MAX_PERIODS];
+
+	unsigned m_nNextBuffer;			// 0..m_nPeriods-1
+	unsigned m_nPlayPeriod;			// buffer currently played by the DMA
+	unsigned m_nLastPeriod;			// last buffer to be played while terminating
+
+	unsigned m_nPeriodsPlayed;		// since Start()
+	unsigned m_nPeriodStartTicks;		// of the period currently playing
+
+	boolean m_bZeroCopy;
+	unsigned m_nPeriodsQueued;		// by QueuePeriod() or as silence
+	unsigned m_nReservedPeriod;		// returned by GetPeriodBuffer()
+	boolean m_bPeriodReserved;
+	unsigned m_nUnderruns;
 
 	CSpinLock m_SpinLock;
 };
@@ -0,0 +1,528 @@
+//
+// ringbuffer.h
+//
+// Lock-free ring buffers for communication between tasks, interrupt handlers and cores
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_ringbuffer_h
+#define _circle_ringbuffer_h
+
+#include <circle/synchronize.h>
+#include <circle/util.h>
+#include <circle/types.h>
+#include <assert.h>
+
+#if RASPPI == 1
+	#define RING_BUFFER_CACHE_LINE	32
+#else
+	#define RING_BUFFER_CACHE_LINE	64
+#endif
+
+#define RING_BUFFER_MAX_SIZE	0x40000000U
+
+///
+/// \brief Lock-free ring buffer with a single producer and a single consumer
+///
+/// \tparam T Type of the entries, must be a plain data type (is copied with memcpy())
+///
+/// \note The producer and the consumer can run in any context (task, IRQ, FIQ)\n
+///	  and on different cores. Multiple producers or multiple consumers\n
+///	  have to be serialized by the caller.
+/// \note The indices of the producer and the consumer live in different cache lines.
+///
+template <class T>
+class CSPSCRingBuffer
+{
+public:
+	/// \param nSize Maximum number of entries (0 to call Initialize() later)
+	CSPSCRingBuffer (unsigned nSize = 0)
+	:	m_pBuffer (0),
+		m_nSize (0),
+		m_nMask (0),
+		m_nIn (0),
+		m_nOutCache (0),
+		m_nOut (0),
+		m_nInCache (0)
+	{
+		if (nSize > 0)
+		{
+			Initialize (nSize);
+		}
+	}
+
+	~CSPSCRingBuffer (void)
+	{
+		delete [] m_pBuffer;
+		m_pBuffer = 0;
+	}
+
+	/// \param nSize Maximum number of entries (need not be a power of 2)
+	/// \return Operation successful?
+	boolean Initialize (unsigned nSize)
+	{
+		assert (m_pBuffer == 0);
+		assert (0 < nSize && nSize <= RING_BUFFER_MAX_SIZE);
+
+		unsigned nAllocSize = 1;
+		while (nAllocSize < nSize)
+		{
+			nAllocSize <<= 1;
+		}
+
+		m_pBuffer = new T[nAllocSize];
+		if (m_pBuffer == 0)
+		{
+			return FALSE;
+		}
+
+		m_nMask = nAllocSize-1;
+		m_nSize = nSize;
+
+		return TRUE;
+	}
+
+	/// \return Has the buffer been successfully initialized?
+	boolean IsValid (void) const
+	{
+		return m_pBuffer != 0;
+	}
+
+	/// \return Maximum number of entries
+	unsigned GetSize (void) const
+	{
+		return m_nSize;
+	}
+
+	/// \brief Producer: Append one entry
+	/// \return FALSE if the buffer is full
+	boolean Enqueue (const T &Entry)
+	{
+		assert (m_pBuffer != 0);
+
+		unsigned nIn = m_nIn;
+		if (nIn - m_nOutCache >= m_nSize)
+		{
+			m_nOutCache = LoadAcquire (&m_nOut);
+			if (nIn - m_nOutCache >= m_nSize)
+			{
+				return FALSE;
+			}
+		}
+
+		m_pBuffer[nIn & m_nMask] = Entry;
+
+		StoreRelease (&m_nIn, nIn+1);
+
+		return TRUE;
+	}
+
+	/// \brief Producer: Append multiple entries
+	/// \param pEntries Pointer to the entries
+	/// \param nCount Number of entries
+	/// \return Number of entries appended (may be less than nCount, if the buffer gets full)
+	unsigned EnqueueMultiple (const T *pEntries, unsigned nCount)
+	{
+		assert (m_pBuffer != 0);
+		assert (pEntries != 0);
+
+		unsigned nIn = m_nIn;
+		unsigned nFree = m_nSize - (nIn - m_nOutCache);
+		if (nFree < nCount)
+		{
+			m_nOutCache = LoadAcquire (&m_nOut);
+			nFree = m_nSize - (nIn - m_nOutCache);
+
+			if (nCount > nFree)
+			{
+				nCount = nFree;
+			}
+		}
+
+		if (nCount > 0)
+		{
+			unsigned nIndex = nIn & m_nMask;
+			unsigned nFirst = m_nMask+1 - nIndex;
+			if (nFirst >= nCount)
+			{
+				memcpy (&m_pBuffer[nIndex], pEntries, nCount * sizeof (T));
+			}
+			else
+			{
+				memcpy (&m_pBuffer[nIndex], pEntries, nFirst * sizeof (T));
+				memcpy (m_pBuffer, pEntries+nFirst, (nCount-nFirst) * sizeof (T));
+			}
+
+			StoreRelease (&m_nIn, nIn+nCount);
+		}
+
+		return nCount;
+	}
+
+	/// \brief Consumer: Remove one entry
+	/// \param pEntry Pointer to the destination of the entry
+	/// \return FALSE if the buffer is empty
+	boolean Dequeue (T *pEntry)
+	{
+		assert (m_pBuffer != 0);
+		assert (pEntry != 0);
+
+		unsigned nOut = m_nOut;
+		if (nOut == m_nInCache)
+		{
+			m_nInCache = LoadAcquire (&m_nIn);
+			if (nOut == m_nInCache)
+			{
+				return FALSE;
+			}
+		}
+
+		*pEntry = m_pBuffer[nOut & m_nMask];
+
+		StoreRelease (&m_nOut, nOut+1);
+
+		return TRUE;
+	}
+
+	/// \brief Consumer: Remove multiple entries
+	/// \param pEntries Pointer to the destination of the entries
+	/// \param nCount Maximum number of entries
+	/// \return Number of entries removed
+	unsigned DequeueMultiple (T *pEntries, unsigned nCount)
+	{
+		assert (m_pBuffer != 0);
+		assert (pEntries != 0);
+
+		unsigned nOut = m_nOut;
+		unsigned nAvail = m_nInCache - nOut;
+		if (nAvail < nCount)
+		{
+			m_nInCache = LoadAcquire (&m_nIn);
+			nAvail = m_nInCache - nOut;
+
+			if (nCount > nAvail)
+			{
+				nCount = nAvail;
+			}
+		}
+
+		if (nCount > 0)
+		{
+			unsigned nIndex = nOut & m_nMask;
+			unsigned nFirst = m_nMask+1 - nIndex;
+			if (nFirst >= nCount)
+			{
+				memcpy (pEntries, &m_pBuffer[nIndex], nCount * sizeof (T));
+			}
+			else
+			{
+				memcpy (pEntries, &m_pBuffer[nIndex], nFirst * sizeof (T));
+				memcpy (pEntries+nFirst, m_pBuffer, (nCount-nFirst) * sizeof (T));
+			}
+
+			StoreRelease (&m_nOut, nOut+nCount);
+		}
+
+		return nCount;
+	}
+
+	/// \brief Consumer: Get the next entry without removing it
+	/// \param pEntry Pointer to the destination of the entry
+	/// \return FALSE if the buffer is empty
+	boolean Peek (T *pEntry)
+	{
+		assert (m_pBuffer != 0);
+		assert (pEntry != 0);
+
+		unsigned nOut = m_nOut;
+		if (nOut == m_nInCache)
+		{
+			m_nInCache = LoadAcquire (&m_nIn);
+			if (nOut == m_nInCache)
+			{
+				return FALSE;
+			}
+		}
+
+		*pEntry = m_pBuffer[nOut & m_nMask];
+
+		return TRUE;
+	}
+
+	/// \brief Consumer: Remove all entries
+	void Flush (void)
+	{
+		m_nInCache = LoadAcquire (&m_nIn);
+
+		StoreRelease (&m_nOut, m_nInCache);
+	}
+
+	/// \return Number of entries, which can be appended
+	/// \note Exact for the producer, a lower bound for the consumer
+	unsigned GetFree (void) const
+	{
+		return m_nSize - (m_nIn - LoadAcquire (&m_nOut));
+	}
+
+	/// \return Number of entries, which can be removed
+	/// \note Exact for the consumer, a lower bound for the producer
+	unsigned GetAvail (void) const
+	{
+		return LoadAcquire (&m_nIn) - m_nOut;
+	}
+
+private:
+	static unsigned LoadAcquire (const volatile unsigned *pIndex)
+	{
+		unsigned nIndex = *pIndex;
+		DataMemBarrier ();
+
+		return nIndex;
+	}
+
+	static void StoreRelease (volatile unsigned *pIndex, unsigned nIndex)
+	{
+		DataMemBarrier ();
+		*pIndex = nIndex;
+	}
+
+private:
+	T *m_pBuffer;
+	unsigned m_nSize;
+	unsigned m_nMask;
+
+	u8 m_Padding0[RING_BUFFER_CACHE_LINE];
+
+	// written by the producer only, indices increment only and wrap at 2^32
+	volatile unsigned m_nIn;
+	unsigned m_nOutCache;
+
+	u8 m_Padding1[RING_BUFFER_CACHE_LINE - 2*sizeof (unsigned)];
+
+	// written by the consumer only
+	volatile unsigned m_nOut;
+	unsigned m_nInCache;
+
+	u8 m_Padding2[RING_BUFFER_CACHE_LINE - 2*sizeof (unsigned)];
+};
+
+///
+/// \brief Lock-free ring buffer with multiple producers and a single consumer
+///
+/// \tparam T Type of the entries, must be a plain data type
+///
+/// \note The producers and the consumer can run in any context (task, IRQ, FIQ)\n
+///	  and on different cores. Multiple consumers have to be serialized by the caller.
+/// \note Producers never wait for each other. An entry, which is not completely\n
+///	  written yet, blocks the consumer at this position until it is published.
+///
+template <class T>
+class CMPSCRingBuffer
+{
+public:
+	/// \param nSize Maximum number of entries (0 to call Initialize() later)
+	CMPSCRingBuffer (unsigned nSize = 0)
+	:	m_pSlot (0),
+		m_nSize (0),
+		m_nMask (0),
+		m_nIn (0),
+		m_nOut (0)
+	{
+		if (nSize > 0)
+		{
+			Initialize (nSize);
+		}
+	}
+
+	~CMPSCRingBuffer (void)
+	{
+		delete [] m_pSlot;
+		m_pSlot = 0;
+	}
+
+	/// \param nSize Maximum number of entries (need not be a power of 2)
+	/// \return Operation successful?
+	boolean Initialize (unsigned nSize)
+	{
+		assert (m_pSlot == 0);
+		assert (0 < nSize && nSize <= RING_BUFFER_MAX_SIZE);
+
+		unsigned nAllocSize = 1;
+		while (nAllocSize < nSize)
+		{
+			nAllocSize <<= 1;
+		}
+
+		m_pSlot = new TSlot[nAllocSize];
+		if (m_pSlot == 0)
+		{
+			return FALSE;
+		}
+
+		// slot i is published for position i, when its sequence is i+1
+		for (unsigned i = 0; i < nAllocSize; i++)
+		{
+			m_pSlot[i].nSequence = i;
+		}
+
+		m_nMask = nAllocSize-1;
+		m_nSize = nSize;
+
+		DataMemBarrier ();
+
+		return TRUE;
+	}
+
+	/// \return Has the buffer been successfully initialized?
+	boolean IsValid (void) const
+	{
+		return m_pSlot != 0;
+	}
+
+	/// \return Maximum number of entries
+	unsigned GetSize (void) const
+	{
+		return m_nSize;
+	}
+
+	/// \brief Producer: Append one entry
+	/// \return FALSE if the buffer is full
+	boolean Enqueue (const T &Entry)
+	{
+		return EnqueueMultiple (&Entry, 1) == 1;
+	}
+
+	/// \brief Producer: Append multiple entries as one contiguous block
+	/// \param pEntries Pointer to the entries
+	/// \param nCount Number of entries
+	/// \return Number of entries appended (may be less than nCount, if the buffer gets full)
+	unsigned EnqueueMultiple (const T *pEntries, unsigned nCount)
+	{
+		assert (m_pSlot != 0);
+		assert (pEntries != 0);
+
+		// claim the positions, nIn is reloaded on failure
+		unsigned nIn = __atomic_load_n (&m_nIn, __ATOMIC_RELAXED);
+		unsigned nClaim;
+		do
+		{
+			unsigned nFree = m_nSize - (nIn - __atomic_load_n (&m_nOut, __ATOMIC_ACQUIRE));
+
+			nClaim = nCount;
+			if (nClaim > nFree)
+			{
+				nClaim = nFree;
+			}
+
+			if (nClaim == 0)
+			{
+				return 0;
+			}
+		}
+		while (!__atomic_compare_exchange_n (&m_nIn, &nIn, nIn+nClaim, TRUE,
+						     __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+		for (unsigned i = 0; i < nClaim; i++)
+		{
+			TSlot *pSlot = &m_pSlot[(nIn+i) & m_nMask];
+
+			pSlot->Entry = pEntries[i];
+
+			__atomic_store_n (&pSlot->nSequence, nIn+i+1, __ATOMIC_RELEASE);
+		}
+
+		return nClaim;
+	}
+
+	/// \brief Consumer: Remove one entry
+	/// \param pEntry Pointer to the destination of the entry
+	/// \return FALSE if the buffer is empty
+	boolean Dequeue (T *pEntry)
+	{
+		return DequeueMultiple (pEntry, 1) == 1;
+	}
+
+	/// \brief Consumer: Remove multiple entries
+	/// \param pEntries Pointer to the destination of the entries
+	/// \param nCount Maximum number of entries
+	/// \return Number of entries removed
+	unsigned DequeueMultiple (T *pEntries, unsigned nCount)
+	{
+		assert (m_pSlot != 0);
+		assert (pEntries != 0);
+
+		unsigned nOut = m_nOut;
+
+		unsigned i;
+		for (i = 0; i < nCount; i++)
+		{
+			TSlot *pSlot = &m_pSlot[(nOut+i) & m_nMask];
+			if (__atomic_load_n (&pSlot->nSequence, __ATOMIC_ACQUIRE) != nOut+i+1)
+			{
+				break;
+			}
+
+			pEntries[i] = pSlot->Entry;
+		}
+
+		if (i > 0)
+		{
+			__atomic_store_n (&m_nOut, nOut+i, __ATOMIC_RELEASE);
+		}
+
+		return i;
+	}
+
+	/// \return Number of entries, which can be appended (a snapshot)
+	unsigned GetFree (void) const
+	{
+		return m_nSize - GetAvail ();
+	}
+
+	/// \return Number of claimed entries (a snapshot, some may not be published yet)
+	unsigned GetAvail (void) const
+	{
+		unsigned nOut = __atomic_load_n (&m_nOut, __ATOMIC_ACQUIRE);
+
+		return __atomic_load_n (&m_nIn, __ATOMIC_ACQUIRE) - nOut;
+	}
+
+private:
+	struct TSlot
+	{
+		unsigned nSequence;
+		T	 Entry;
+	};
+
+	TSlot *m_pSlot;
+	unsigned m_nSize;
+	unsigned m_nMask;
+
+	u8 m_Padding0[RING_BUFFER_CACHE_LINE];
+
+	// claimed by the producers, increments only and wraps at 2^32
+	unsigned m_nIn;
+
+	u8 m_Padding1[RING_BUFFER_CACHE_LINE - sizeof (unsigned)];
+
+	// written by the consumer only
+	unsigned m_nOut;
+
+	u8 m_Padding2[RING_BUFFER_CACHE_LINE - sizeof (unsigned)];
+};
+
+#endif
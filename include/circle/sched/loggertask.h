@@ -0,0 +1,44 @@
+//
+// loggertask.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_sched_loggertask_h
+#define _circle_sched_loggertask_h
+
+#include <circle/sched/task.h>
+#include <circle/logger.h>
+
+#define LOGGER_TASK_INTERVAL_MS		10
+
+// Writes the deferred output of the logger, so that the time for the screen or
+// serial output is not spent in the task or interrupt handler, which logs a message.
+// The default priority is not lower, because the net task never waits.
+
+class CLoggerTask : public CTask
+{
+public:
+	CLoggerTask (CLogger *pLogger, unsigned nPriority = TASK_PRIORITY_DEFAULT);
+	~CLoggerTask (void);
+
+	void Run (void);
+
+private:
+	CLogger *m_pLogger;
+};
+
+#endif
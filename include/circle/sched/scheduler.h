@@ -2,7 +2,7 @@
 // scheduler.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,12 +21,33 @@
 #define _circle_sched_scheduler_h
 
 #include <circle/sched/task.h>
+#include <circle/spinlock.h>
 #include <circle/sysconfig.h>
 #include <circle/types.h>
 
+#if defined (MULTI_CORE_SCHEDULER) && defined (ARM_ALLOW_MULTI_CORE)
+	#define SCHEDULER_CORES		CORES
+#else
+	#define SCHEDULER_CORES		1
+#endif
+
 typedef void TSchedulerTaskHandler (CTask *pTask);
 
-class CScheduler				// simple cooperative (non-preemtive) scheduler
+struct TSchedulerCore			// scheduler state of one CPU core
+{
+	CTask *pCurrent;
+	CTask *pPrevious;			// its registers may not have been saved yet
+
+	CTask *pReadyHead[TASK_PRIORITY_LEVELS];	// FIFO for each priority
+	CTask *pReadyTail[TASK_PRIORITY_LEVELS];
+	volatile u32 nReadyMask;		// bit set if ready queue is not empty
+
+	// the preemption request flag is PreemptionRequest[] in the exception stub
+	volatile boolean bIdle;			// waiting for a task to get ready
+	unsigned nTimeSliceTicks;
+};
+
+class CScheduler				// priority scheduler (optionally preemptive and multi-core)
 {
 public:
 	CScheduler (void);
@@ -43,6 +64,17 @@ public:
 	void RegisterTaskSwitchHandler (TSchedulerTaskHandler *pHandler);
 	void RegisterTaskTerminationHandler (TSchedulerTaskHandler *pHandler);
 
+	// code, which is not safe to be preempted, must be enclosed in these calls,
+	// they can be nested and have no effect in the cooperative mode
+	void DisablePreemption (void);
+	void EnablePreemption (void);
+
+#if SCHEDULER_CORES > 1
+	// call this from CMultiCoreSupport::Run() on a secondary core to execute tasks there,
+	// does not return
+	void RunTasks (void);
+#endif
+
 	static CScheduler *Get (void);
 
 	static boolean IsActive (void)
@@ -52,21 +84,49 @@ public:
 
 private:
 	void AddTask (CTask *pTask);
+	void SetTaskPriority (CTask *pTask, unsigned nPriority);
+	void SetTaskAffinity (CTask *pTask, u32 nAffinity);
+	void FinishTaskSwitch (void);		// must be called first after a task switch
 	friend class CTask;
 
-	void BlockTask (CTask **ppTask);
+	void BlockTask (CTask **ppTask, const volatile boolean *pWakeCondition = 0);
 	void WakeTask (CTask **ppTask);		// can be called from interrupt context
 	friend class CSynchronizationEvent;
 
 	void RemoveTask (CTask *pTask);
-	unsigned GetNextTask (void);		// returns index into m_pTask or MAX_TASKS if no task was found
+
+	uintptr Lock (void);			// disables IRQs, returns previous state
+	void Unlock (uintptr nFlags);
+
+	// the following methods must be called with the scheduler locked
+	void Schedule (boolean bPreempted = FALSE);	// switch to the next ready task
+	void EnqueueReady (CTask *pTask);
+	void DequeueReady (CTask *pTask);
+	boolean IsQueued (CTask *pTask) const;
+	CTask *GetNextTask (unsigned nCore);	// returns 0 if no task is ready
+	CTask *StealTask (unsigned nCore);	// from the ready queue of another core
+	void CheckPreemption (CTask *pTask);	// pTask got ready
+	void WakeSleepingTasks (void);
+
+	boolean IsWorkPending (unsigned nCore);	// lock-free hint for the idle loop
+
+	void ReapTerminatedTasks (void);
+
+#ifdef PREEMPTIVE_SCHEDULER
+	static void TimerHandler (void);
+	static void PreemptionPoint (void);	// called on return from IRQ
+#endif
 
 private:
-	CTask *m_pTask[MAX_TASKS];
 	unsigned m_nTasks;
 
-	CTask *m_pCurrent;
-	unsigned m_nCurrent;			// index into m_pTask
+	TSchedulerCore m_Core[SCHEDULER_CORES];
+
+	CTask *m_pSleeping;			// ordered by wake ticks
+	volatile unsigned m_nNextWakeTicks;	// of first sleeping task
+	CTask *m_pTerminated;			// to be deleted
+
+	CSpinLock m_SpinLock;			// protects the scheduler state against other cores
 
 	TSchedulerTaskHandler *m_pTaskSwitchHandler;
 	TSchedulerTaskHandler *m_pTaskTerminationHandler;
@@ -31,9 +31,22 @@ enum TTaskState
 	TaskStateBlocked,
 	TaskStateSleeping,
 	TaskStateTerminated,
+	TaskStateNew,				// not started yet
 	TaskStateUnknown
 };
 
+#define TASK_PRIORITY_LEVELS		32
+#define TASK_PRIORITY_LOWEST		0
+#define TASK_PRIORITY_DEFAULT		16
+#define TASK_PRIORITY_HIGHEST		(TASK_PRIORITY_LEVELS-1)
+
+#define TASK_AFFINITY_CORE(core)	(1U << (core))
+#if RASPPI == 1
+	#define TASK_AFFINITY_ANY	1U
+#else
+	#define TASK_AFFINITY_ANY	((1U << CORES) - 1)
+#endif
+
 class CScheduler;
 
 class CTask
@@ -53,6 +66,16 @@ public:
 	void SetUserData (void *pData, unsigned nSlot);
 	void *GetUserData (unsigned nSlot);
 
+	// a ready task with a higher priority is always run first, tasks with the same
+	// priority are run round-robin (and time-sliced with PREEMPTIVE_SCHEDULER)
+	void SetPriority (unsigned nPriority);	// TASK_PRIORITY_LOWEST..TASK_PRIORITY_HIGHEST
+	unsigned GetPriority (void) const	{ return m_nPriority; }
+
+	// the cores, on which this task may run with MULTI_CORE_SCHEDULER (bit mask),
+	// a new task inherits the affinity of the task, which created it
+	void SetAffinity (u32 nAffinity);	// TASK_AFFINITY_CORE(n) or TASK_AFFINITY_ANY
+	u32 GetAffinity (void) const		{ return m_nAffinity; }
+
 private:
 	TTaskState GetState (void) const	{ return m_State; }
 	void SetState (TTaskState State)	{ m_State = State; }
@@ -62,6 +85,9 @@ private:
 
 	TTaskRegisters *GetRegs (void)		{ return &m_Regs; }
 
+	CTask *GetNext (void) const		{ return m_pNext; }
+	void SetNext (CTask *pTask)		{ m_pNext = pTask; }
+
 	friend class CScheduler;
 
 private:
@@ -72,6 +98,13 @@ private:
 private:
 	volatile TTaskState m_State;
 	unsigned	    m_nWakeTicks;
+	unsigned	    m_nPriority;
+	volatile unsigned   m_nPreemptDisable;
+	u32		    m_nAffinity;
+	unsigned	    m_nCore;		// whose ready queue is used
+	volatile boolean    m_bRunning;		// registers are in use by a core
+	CTask		   *m_pNext;		// link in ready, sleeping, terminated or created list
+	CTask		   *m_pCreatedTasks;	// created by this task, not started yet
 	TTaskRegisters	    m_Regs;
 	unsigned	    m_nStackSize;
 	u8		   *m_pStack;
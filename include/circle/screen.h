@@ -2,7 +2,7 @@
 // screen.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -31,6 +31,8 @@
 
 #define DEPTH	16		// can be: 8, 16 or 32
 
+#define SCREEN_MAX_BUFFERS	3
+
 // really ((green) & 0x3F) << 5, but to have a 0-31 range for all colors
 #define COLOR16(red, green, blue)	  (((red) & 0x1F) << 11 \
 					| ((green) & 0x1F) << 6 \
@@ -87,13 +89,24 @@ struct TScreenStatus
 	boolean		bUpdated;
 };
 
+struct TScreenRect		// a rectangle is empty, if nPosX1 >= nPosX2
+{
+	unsigned	nPosX1;
+	unsigned	nPosY1;
+	unsigned	nPosX2;		// exclusive
+	unsigned	nPosY2;		// exclusive
+};
+
 class CScreenDevice : public CDevice	/// Writing characters to screen
 {
 public:
 	/// \param nWidth   Screen width in pixels (0 for default resolution)
 	/// \param nHeight  Screen height in pixels (0 for default resolution)
 	/// \param bVirtual FALSE for physical screen, TRUE for virtual screen buffer
-	CScreenDevice (unsigned nWidth, unsigned nHeight, boolean bVirtual = FALSE);
+	/// \param nBuffers 1 to draw directly into the frame buffer,\n
+	///		    2 or 3 to draw into a shadow buffer, which is displayed by Update()
+	CScreenDevice (unsigned nWidth, unsigned nHeight, boolean bVirtual = FALSE,
+		       unsigned nBuffers = 1);
 
 	~CScreenDevice (void);
 
@@ -139,11 +152,28 @@ public:
 	/// \return The requested color value (depends on screen DEPTH)
 	TScreenColor GetPixel (unsigned nPosX, unsigned nPosY);
 
+	/// \brief Write a rectangle of pixels to the screen
+	/// \param nPosX1 X-Position of the upper left pixel (based on 0)
+	/// \param nPosY1 Y-Position of the upper left pixel (based on 0)
+	/// \param nPosX2 X-Position of the lower right pixel (inclusive)
+	/// \param nPosY2 Y-Position of the lower right pixel (inclusive)
+	/// \param pPixels Color values of the rectangle, row by row
+	void SetArea (unsigned nPosX1, unsigned nPosY1, unsigned nPosX2, unsigned nPosY2,
+		      const TScreenColor *pPixels);
+
 	/// \brief Displays rotating symbols in the upper right corner of the screen
 	/// \param nIndex Index of the rotor to be displayed (0..3)
 	/// \param nCount Phase (angle) of the current rotor symbol (0..3)
 	void Rotor (unsigned nIndex, unsigned nCount);
 
+	/// \return Number of frame buffers (> 1, if a shadow buffer is used)
+	unsigned GetBufferCount (void) const;
+
+	/// \brief Copy the changed regions of the shadow buffer to the back buffer and display it
+	/// \param bWaitForVSync Wait for the vertical sync, so that the next Update() cannot tear
+	/// \note Has to be called regularly (e.g. from the main loop), if nBuffers > 1 was given
+	void Update (boolean bWaitForVSync = TRUE);
+
 private:
 #ifndef SCREEN_HEADLESS
 	void Write (char chChar);
@@ -171,10 +201,21 @@ private:
 	void Tabulator (void);
 
 	void Scroll (void) MAXOPT;
+#ifdef SCREEN_HW_SCROLL
+	void ScrollWindow (unsigned nLines);
+	// set the virtual offset of the frame buffer to the window (TASK_LEVEL only)
+	void UpdateWindowOffset (void);
+#endif
+	void CopyLines (void *pTo, const void *pFrom, unsigned nSize);
 
 	void DisplayChar (char chChar, unsigned nPosX, unsigned nPosY, TScreenColor Color);
 	void EraseChar (unsigned nPosX, unsigned nPosY);
 	void InvertCursor (void);
+
+	void PutPixel (unsigned nPosX, unsigned nPosY, TScreenColor Color);
+
+	// mark a region of the shadow buffer as changed (exclusive end coordinates)
+	void AddDirty (unsigned nPosX1, unsigned nPosY1, unsigned nPosX2, unsigned nPosY2);
 #endif
 
 private:
@@ -182,7 +223,18 @@ private:
 	unsigned	 m_nInitHeight;
 #ifndef SCREEN_HEADLESS
 	boolean		 m_bVirtual;
+	unsigned	 m_nBuffers;
 	CBcmFrameBuffer	*m_pFrameBuffer;
+	boolean		 m_bShadowBuffer;	// m_pBuffer is a copy of the frame buffer in RAM
+	unsigned	 m_nFrameBufferPitch;	// in TScreenColor units
+	TScreenRect	 m_DirtyRect[SCREEN_MAX_BUFFERS];
+	CSpinLock	 m_DirtySpinLock;
+#ifdef SCREEN_HW_SCROLL
+	boolean		 m_bHWScroll;
+	unsigned	 m_nWindowOffset;	// first line of the window, m_pBuffer points to
+	unsigned	 m_nDisplayOffset;	// first line of the window, set in the GPU
+	CSpinLock	 m_WindowSpinLock;	// serializes UpdateWindowOffset()
+#endif
 #endif
 	CCharGenerator	 m_CharGen;
 #ifndef SCREEN_HEADLESS
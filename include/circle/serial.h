@@ -24,6 +24,7 @@
 #include <circle/interrupt.h>
 #include <circle/gpiopin.h>
 #include <circle/spinlock.h>
+#include <circle/ringbuffer.h>
 #include <circle/sysconfig.h>
 #include <circle/types.h>
 
@@ -51,8 +52,7 @@
 	#define SERIAL_DEVICES		6
 #endif
 
-#define SERIAL_BUF_SIZE		2048			// must be a power of 2
-#define SERIAL_BUF_MASK		(SERIAL_BUF_SIZE-1)
+#define SERIAL_BUF_SIZE		2048
 
 // serial options
 #define SERIAL_OPTION_ONLCR	(1 << 0)	///< Translate NL to NL+CR on output (default)
@@ -88,6 +88,7 @@ public:
 	/// \param pBuffer Pointer to buffer for received data
 	/// \param nCount Maximum number of bytes to be received
 	/// \return Number of bytes received (0 no data available, < 0 on error)
+	/// \note With interrupt driver only one task or core may read at a time.
 	int Read (void *pBuffer, size_t nCount);
 
 	/// \return Serial options mask (see serial options)
@@ -138,14 +139,10 @@ private:
 	CGPIOPin m_TxDPin;
 	CGPIOPin m_RxDPin;
 
-	u8 m_RxBuffer[SERIAL_BUF_SIZE];
-	volatile unsigned m_nRxInPtr;
-	volatile unsigned m_nRxOutPtr;
+	CSPSCRingBuffer<u8> m_RxQueue;		// interrupt handler -> Read()
 	volatile int m_nRxStatus;
 
-	u8 m_TxBuffer[SERIAL_BUF_SIZE];
-	volatile unsigned m_nTxInPtr;
-	volatile unsigned m_nTxOutPtr;
+	CMPSCRingBuffer<u8> m_TxQueue;		// Write() (any context) -> interrupt handler
 
 	unsigned m_nOptions;
 
@@ -22,18 +22,25 @@
 
 #include <circle/device.h>
 #include <circle/spinlock.h>
+#include <circle/ringbuffer.h>
 #include <circle/types.h>
 
 #define SOUND_HW_CHANNELS	2
 #define SOUND_MAX_SAMPLE_SIZE	(sizeof (u32))
 #define SOUND_MAX_FRAME_SIZE	(SOUND_HW_CHANNELS * SOUND_MAX_SAMPLE_SIZE)
 
+#define SOUND_CONVERT_FRAMES	256		// frames converted at once by Write()
+
+#define SOUND_MAX_PERIODS	8		// DMA buffers of the PWM and I2S devices
+
 enum TSoundFormat			/// All supported formats are interleaved little endian
 {
 	SoundFormatUnsigned8,		/// Not supported as hardware format
 	SoundFormatSigned16,
 	SoundFormatSigned24,
 	SoundFormatUnsigned32,		/// Not supported as write format
+	SoundFormatSigned32,		/// Not supported as hardware format
+	SoundFormatFloat,		/// 32-bit float (-1.0..1.0), not supported as hardware format
 	SoundFormatUnknown
 };
 
@@ -127,14 +134,12 @@ protected:
 	virtual unsigned GetChunk (u32 *pBuffer, unsigned nChunkSize);
 
 private:
-	void ConvertSoundFormat (void *pTo, const void *pFrom);
+	unsigned ConvertFrames (const void *pFrom, unsigned nFrames);
 
 	unsigned GetChunkInternal (void *pBuffer, unsigned nChunkSize);
 
-	unsigned GetQueueBytesFree (void);
-	unsigned GetQueueBytesAvail (void);
-	void Enqueue (const void *pBuffer, unsigned nCount);
-	void Dequeue (void *pBuffer, unsigned nCount);
+	typedef void TSampleDecoder (s32 *pTo, const void *pFrom, unsigned nSamples);
+	typedef void TSampleEncoder (void *pTo, const s32 *pFrom, unsigned nSamples, u32 nRange);
 
 private:
 	TSoundFormat m_HWFormat;
@@ -155,14 +160,17 @@ private:
 	unsigned m_nWriteSampleSize;
 	unsigned m_nWriteFrameSize;
 
-	u8 *m_pQueue;			// Ring buffer
-	unsigned m_nInPtr;
-	unsigned m_nOutPtr;
+	TSampleDecoder *m_pDecoder;
+	TSampleEncoder *m_pEncoder;
+	s32 m_ConvertSamples[SOUND_CONVERT_FRAMES * SOUND_HW_CHANNELS];
+	u8 m_ConvertFrames[SOUND_CONVERT_FRAMES * SOUND_MAX_FRAME_SIZE];
+
+	CSPSCRingBuffer<u8> m_Queue;	// Write() -> GetChunk()
 
 	TSoundNeedDataCallback *m_pCallback;
 	void *m_pCallbackParam;
 
-	CSpinLock m_SpinLock;
+	CSpinLock m_SpinLock;		// serializes the callers of Write()
 };
 
 #endif
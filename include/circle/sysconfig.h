@@ -81,6 +81,16 @@
 #define HEAP_BLOCK_BUCKET_SIZES	0x40,0x400,0x1000,0x4000,0x10000,0x40000,0x80000
 #endif
 
+// HEAP_SLAB_ALLOCATOR selects an alternative implementation of the heap
+// allocator. Small blocks (up to 4 KByte) are allocated from slabs in
+// 28 fine-grained size classes and are cached per core, so that the
+// cores do not compete for a global lock on each allocation. Larger
+// blocks are managed in an address ordered free list and neighbouring
+// free blocks are coalesced, so that their memory space is not lost.
+// HEAP_BLOCK_BUCKET_SIZES is ignored, if this option is defined.
+
+//#define HEAP_SLAB_ALLOCATOR
+
 ///////////////////////////////////////////////////////////////////////
 //
 // Raspberry Pi 1 and Zero
@@ -190,6 +200,19 @@
 #define SCREEN_DMA_BURST_LENGTH	2
 #endif
 
+// SCREEN_HW_SCROLL enables scrolling the screen contents by moving the
+// displayed window down in a frame buffer with double virtual height,
+// which is used as a ring buffer. Only the new line has to be cleared
+// then, instead of copying the whole scroll region for each new line.
+// The lines are copied only, when the window reaches the end of the
+// frame buffer, or if a scroll region smaller than the screen has
+// been set, or if the screen is written from an IRQ handler. If the
+// GPU refuses the virtual size or offset, the screen is scrolled by
+// copying as before. Applications, which access the frame
+// buffer of the screen directly, should not use this option.
+
+//#define SCREEN_HW_SCROLL
+
 // CALIBRATE_DELAY activates the calibration of the delay loop. Because
 // this loop is normally not used any more in Circle, the only use of
 // this option is that the "SpeedFactor" of your system is displayed.
@@ -205,10 +228,12 @@
 //
 ///////////////////////////////////////////////////////////////////////
 
-// MAX_TASKS is the maximum number of tasks in the system.
+// MAX_TASKS is the maximum number of tasks in the system. The task
+// management does not use fixed size tables, so this is a limit only
+// to detect runaway task creation. 0 means no limit.
 
 #ifndef MAX_TASKS
-#define MAX_TASKS		20
+#define MAX_TASKS		0
 #endif
 
 // TASK_STACK_SIZE is the stack size for each task.
@@ -217,6 +242,37 @@
 #define TASK_STACK_SIZE		0x8000
 #endif
 
+// PREEMPTIVE_SCHEDULER lets the scheduler switch tasks on return from
+// an IRQ, when a task with a higher priority has been woken or the time
+// slice of the current task has elapsed and another task with the same
+// priority is ready. Otherwise tasks are switched only, when they call
+// the scheduler (e.g. Yield()). Most Circle classes have been written
+// for the cooperative mode, so code, which accesses shared data from
+// multiple tasks, must be enclosed in calls to DisablePreemption() and
+// EnablePreemption() of CScheduler then. On AArch64 SAVE_VFP_REGS_ON_IRQ
+// is defined automatically with this option.
+
+//#define PREEMPTIVE_SCHEDULER
+
+// SCHEDULER_TIME_SLICE is the number of timer ticks (HZ), after which
+// a task is preempted in favour of a task with the same priority.
+
+#ifndef SCHEDULER_TIME_SLICE
+#define SCHEDULER_TIME_SLICE	2
+#endif
+
+// MULTI_CORE_SCHEDULER lets the scheduler run tasks on all CPU cores,
+// which call CScheduler::RunTasks() from CMultiCoreSupport::Run().
+// Each core has its own ready queues and idle cores steal ready tasks
+// from other cores. ARM_ALLOW_MULTI_CORE must be defined too. A new
+// task inherits the core affinity of its creator and the main task is
+// bound to core 0, so all tasks run on core 0 by default. Only tasks,
+// which do not use classes, which are not multi-core safe (e.g. the
+// TCP/IP network stack), should be allowed to run on other cores with
+// CTask::SetAffinity().
+
+//#define MULTI_CORE_SCHEDULER
+
 ///////////////////////////////////////////////////////////////////////
 //
 // USB keyboard
@@ -292,6 +348,10 @@
 
 //#define SAVE_VFP_REGS_ON_IRQ
 
+#if defined (PREEMPTIVE_SCHEDULER) && AARCH == 64 && !defined (SAVE_VFP_REGS_ON_IRQ)
+#define SAVE_VFP_REGS_ON_IRQ
+#endif
+
 // SAVE_VFP_REGS_ON_FIQ enables saving the floating point registers
 // on entry when an FIQ occurs and will restore these registers on exit
 // from the FIQ handler. This has to be defined, if the FIQ handler
@@ -37,6 +37,23 @@ typedef void TKernelTimerHandler (TKernelTimerHandle hTimer, void *pParam, void
 
 typedef void TPeriodicTimerHandler (void);
 
+#define KERNEL_TIMER_WHEEL_BITS		6		// hierarchical timing wheel
+#define KERNEL_TIMER_WHEEL_SIZE		(1 << KERNEL_TIMER_WHEEL_BITS)
+#define KERNEL_TIMER_WHEEL_LEVELS	4		// covers 2^24 ticks (46 hours)
+
+#define KERNEL_TIMER_BLOCK_SIZE		64		// timers allocated at once
+#ifndef KERNEL_TIMER_MAX_BLOCKS
+#define KERNEL_TIMER_MAX_BLOCKS		256		// limits number of pending timers (<= 1023)
+#endif
+
+struct TKernelTimer;
+
+struct TKernelTimerLink		// intrusive doubly-linked list, circular with list head
+{
+	TKernelTimerLink	*pNext;
+	TKernelTimerLink	*pPrev;
+};
+
 class CTimer	/// Manages the system clock, supports kernel timers and a calibrated delay loop
 {
 public:
@@ -92,6 +109,11 @@ public:
 	/// resulting CString object must be deleted by caller\n
 	/// Current time according to our time zone
 	CString *GetTimeString (void);
+	/// \param nTime	Local time in seconds (see GetTime())
+	/// \param nHundredthTime Hundredth seconds part of the time
+	/// \return "[MMM dD ]HH:MM:SS.ss",\n
+	/// resulting CString object must be deleted by caller
+	static CString *GetTimeString (unsigned nTime, unsigned nHundredthTime);
 
 	/// \brief Starts a kernel timer which elapses after a given delay,\n
 	/// a timer handler gets called then
@@ -100,6 +122,8 @@ public:
 	/// \param pParam	First user defined parameter to hand over to the handler
 	/// \param pContext	Second user defined parameter to hand over to the handler
 	/// \return Timer handle (cannot be 0)
+	/// \note Causes a system panic, if more than KERNEL_TIMER_MAX_BLOCKS *\n
+	///	  KERNEL_TIMER_BLOCK_SIZE timers are pending or no memory is available.
 	TKernelTimerHandle StartKernelTimer (unsigned nDelay,
 					     TKernelTimerHandler *pHandler,
 					     void *pParam   = 0,
@@ -132,6 +156,13 @@ public:
 private:
 	void PollKernelTimers (void);
 
+	// m_KernelTimerSpinLock must be acquired for the following methods
+	TKernelTimer *AllocateKernelTimer (void);
+	void FreeKernelTimer (TKernelTimer *pTimer);
+	TKernelTimer *GetKernelTimer (TKernelTimerHandle hTimer);	// 0 if not pending
+	void InsertKernelTimer (TKernelTimer *pTimer);
+	void CascadeKernelTimers (unsigned nLevel, unsigned nSlot);
+
 	void InterruptHandler (void);
 	static void InterruptHandler (void *pParam);
 
@@ -155,7 +186,11 @@ private:
 
 	int			 m_nMinutesDiff;		// diff to UTC
 
-	CPtrList		 m_KernelTimerList;
+	TKernelTimerLink	 m_KernelTimerWheel[KERNEL_TIMER_WHEEL_LEVELS][KERNEL_TIMER_WHEEL_SIZE];
+	unsigned		 m_nKernelTimerWheelTicks;	// next tick to be processed
+	TKernelTimer		*m_pKernelTimerBlock[KERNEL_TIMER_MAX_BLOCKS];
+	unsigned		 m_nKernelTimerBlocks;
+	TKernelTimer		*m_pFreeKernelTimer;
 	CSpinLock		 m_KernelTimerSpinLock;
 
 	unsigned		 m_nMsDelay;
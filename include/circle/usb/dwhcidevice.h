@@ -2,7 +2,7 @@
 // dwhcidevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -37,6 +37,24 @@
 
 #define DWHCI_WAIT_BLOCKS	DWHCI_MAX_CHANNELS
 
+#define DWHCI_MAX_PENDING_STAGES	32	// per queue, stages waiting for a free channel
+
+struct TDWHCIStatistics
+{
+	unsigned	nChannels;
+	struct
+	{
+		unsigned	nStages;		// transfer stages started on this channel
+		unsigned	nTransactions;		// (split) transactions started
+		u64		nBusyTime;		// microseconds allocated
+	}
+	Channel[DWHCI_MAX_CHANNELS];
+	unsigned	nPendingStages;			// stages, which had to wait for a channel
+	unsigned	nPendingMax;			// maximum number of waiting stages
+	u64		nElapsedTime;			// microseconds since reset of statistics,
+							// utilization is nBusyTime / nElapsedTime
+};
+
 class CDWHCIDevice : public CUSBHostController
 {
 public:
@@ -50,6 +68,9 @@ public:
 	boolean SubmitBlockingRequest (CUSBRequest *pURB, unsigned nTimeoutMs = USB_TIMEOUT_NONE);
 	boolean SubmitAsyncRequest (CUSBRequest *pURB, unsigned nTimeoutMs = USB_TIMEOUT_NONE);
 
+	void GetStatistics (TDWHCIStatistics *pStatistics);
+	void ResetStatistics (void);
+
 private:
 	TUSBSpeed GetPortSpeed (void);
 	boolean OvercurrentDetected (void);
@@ -86,6 +107,17 @@ private:
 	void QueueDelayedTransaction (CDWHCITransferStageData *pStageData);
 #endif
 
+	void PrepareStage (CDWHCITransferStageData *pStageData);
+
+#ifndef USE_USB_SOF_INTR
+	// starts the stage on a free channel or queues it, until a channel becomes free
+	boolean ScheduleStage (CDWHCITransferStageData *pStageData);
+	void StartStage (CDWHCITransferStageData *pStageData, unsigned nChannel);
+
+	// releases the channel while waiting for the next interval
+	void DelayPeriodicStage (CDWHCITransferStageData *pStageData);
+#endif
+
 	void StartTransaction (CDWHCITransferStageData *pStageData);
 	void StartChannel (CDWHCITransferStageData *pStageData);
 
@@ -102,7 +134,12 @@ private:
 #endif
 
 	unsigned AllocateChannel (void);
-	void FreeChannel (unsigned nChannel);
+	void FreeChannel (unsigned nChannel);		// may start a pending stage on this channel
+
+	// called with m_ChannelSpinLock acquired
+	unsigned AllocateChannelLocked (void);
+	boolean EnqueuePendingStage (CDWHCITransferStageData *pStageData);
+	CDWHCITransferStageData *DequeuePendingStage (void);
 
 	unsigned AllocateWaitBlock (void);
 	void FreeWaitBlock (unsigned nWaitBlock);
@@ -125,6 +162,21 @@ private:
 	volatile unsigned m_nChannelAllocated;		// one bit per channel, set if allocated
 	CSpinLock m_ChannelSpinLock;
 
+	struct TPendingQueue				// FIFO, protected by m_ChannelSpinLock
+	{
+		CDWHCITransferStageData *pStageData[DWHCI_MAX_PENDING_STAGES];
+		unsigned nIn;
+		unsigned nOut;
+		unsigned nCount;
+	};
+	TPendingQueue m_PendingQueue[2];		// periodic stages are served first
+#define DWHCI_QUEUE_PERIODIC	0
+#define DWHCI_QUEUE_NON_PERIODIC	1
+
+	TDWHCIStatistics m_Statistics;			// protected by m_ChannelSpinLock
+	unsigned m_nChannelStartTicks[DWHCI_MAX_CHANNELS];
+	unsigned m_nStatisticsStartTicks;
+
 #ifdef USE_USB_SOF_INTR
 	CDWHCITransactionQueue m_TransactionQueue;
 #endif
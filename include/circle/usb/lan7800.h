@@ -2,7 +2,7 @@
 // lan7800.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2018-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2018-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -39,9 +39,13 @@ public:
 	const CMACAddress *GetMACAddress (void) const;
 
 	boolean SendFrame (const void *pBuffer, unsigned nLength);
+	// sends the frames with one bulk transfer (as much as fit into it)
+	unsigned SendFrames (const void *const *ppBuffer, const unsigned *pLength, unsigned nCount);
 	
 	// pBuffer must have size FRAME_BUFFER_SIZE
 	boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength);
+	// returns the frames from one bulk transfer, remaining frames are kept for the next call
+	unsigned ReceiveFrames (void *const *ppBuffer, unsigned *pResultLength, unsigned nMaxCount);
 
 	// returns TRUE if PHY link is up
 	boolean IsLinkUp (void);
@@ -69,6 +73,12 @@ private:
 	CUSBEndpoint *m_pEndpointBulkOut;
 
 	CMACAddress m_MACAddress;
+
+	u8 *m_pRxBuffer;		// DMA buffer, holds multiple frames
+	unsigned m_nRxOffset;		// of next RX header
+	unsigned m_nRxLength;		// valid bytes in m_pRxBuffer
+
+	u8 *m_pTxBuffer;		// DMA buffer
 };
 
 #endif
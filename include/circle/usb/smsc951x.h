@@ -2,7 +2,7 @@
 // smsc951x.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -41,6 +41,8 @@ public:
 	
 	// pBuffer must have size FRAME_BUFFER_SIZE
 	boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength);
+	// returns the frames from one bulk transfer, remaining frames are kept for the next call
+	unsigned ReceiveFrames (void *const *ppBuffer, unsigned *pResultLength, unsigned nMaxCount);
 	
 	// returns TRUE if PHY link is up
 	boolean IsLinkUp (void);
@@ -65,6 +67,10 @@ private:
 	CUSBEndpoint *m_pEndpointBulkOut;
 
 	CMACAddress m_MACAddress;
+
+	u8 *m_pRxBuffer;		// DMA buffer, holds multiple frames
+	unsigned m_nRxOffset;		// of next RX status
+	unsigned m_nRxLength;		// valid bytes in m_pRxBuffer
 };
 
 #endif
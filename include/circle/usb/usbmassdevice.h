@@ -2,7 +2,7 @@
 // usbmassdevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -31,6 +31,9 @@
 
 #define UMSD_MAX_OFFSET		0x1FFFFFFFFFFULL		// 2TB
 
+#define UMSD_MAX_TRANSFER_BLOCKS	256		// blocks per SCSI command (128 KB)
+#define UMSD_READ_AHEAD_MAX		64		// blocks, maximum read-ahead window
+
 class CUSBBulkOnlyMassStorageDevice : public CUSBFunction
 {
 public:
@@ -47,8 +50,11 @@ public:
 	unsigned GetCapacity (void) const;
 
 private:
-	int TryRead (void *pBuffer, size_t nCount);
-	int TryWrite (const void *pBuffer, size_t nCount);
+	// read or write nBlocks blocks with retries, splits into commands of limited size
+	int Transfer (u32 nBlockAddress, void *pBuffer, unsigned nBlocks, boolean bWrite);
+
+	int TryRead (u32 nBlockAddress, void *pBuffer, unsigned nBlocks);
+	int TryWrite (u32 nBlockAddress, const void *pBuffer, unsigned nBlocks);
 
 	int Command (void *pCmdBlk, size_t nCmdBlkLen, void *pBuffer, size_t nBufLen, boolean bIn);
 
@@ -62,6 +68,12 @@ private:
 	unsigned m_nBlockCount;
 	u64 m_ullOffset;
 
+	u8 *m_pReadAheadBuffer;			// UMSD_READ_AHEAD_MAX blocks
+	u32 m_nReadAheadBlock;			// first block in read-ahead buffer
+	unsigned m_nReadAheadCount;		// number of valid blocks in it
+	unsigned m_nReadAhead;			// current read-ahead window (blocks)
+	u32 m_nNextBlock;			// block following the last read
+
 	CPartitionManager *m_pPartitionManager;
 
 	static unsigned s_nDeviceNumberMap;
@@ -2,7 +2,7 @@
 // xhci.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -357,8 +357,11 @@ PACKED;
 #define XHCI_CMD_TRB_EVALUATE_CONTEXT_CONTROL_SLOTID__MASK	(0xFF << 24)
 
 // Transfer TRB
+#define XHCI_TRANSFER_TRB_STATUS_TRB_TRANSFER_LENGTH__MASK	0x1FFFF
+	#define XHCI_TRANSFER_TRB_MAX_LENGTH				0x10000		// must not cross 64K
 #define XHCI_TRANSFER_TRB_STATUS_TD_SIZE__SHIFT			17
 #define XHCI_TRANSFER_TRB_STATUS_TD_SIZE__MASK			(0x1F << 17)
+	#define XHCI_TRANSFER_TRB_TD_SIZE_MAX				31
 #define XHCI_TRANSFER_TRB_STATUS_INTERRUPTER_TARGET__SHIFT	22
 #define XHCI_TRANSFER_TRB_STATUS_INTERRUPTER_TARGET__MASK	(0x3FF << 22)
 	#define XHCI_INTERRUPTER_TARGET_DEFAULT				0
@@ -370,6 +373,7 @@ PACKED;
 	#define XHCI_TRANSFER_TRB_CONTROL_TRT_IN			3
 
 #define XHCI_TRANSFER_TRB_CONTROL_ISP				(1 << 2)
+#define XHCI_TRANSFER_TRB_CONTROL_CH				(1 << 4)
 #define XHCI_TRANSFER_TRB_CONTROL_IOC				(1 << 5)
 #define XHCI_TRANSFER_TRB_CONTROL_IDT				(1 << 6)
 #define XHCI_TRANSFER_TRB_CONTROL_DIR_IN			(1 << 16)
@@ -2,7 +2,7 @@
 // xhciconfig.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -37,16 +37,24 @@
 #define XHCI_CONFIG_MAX_SLOTS		32
 #define XHCI_CONFIG_MAX_PORTS		5
 
-#define XHCI_CONFIG_EVENT_RING_SIZE	64
+#define XHCI_RING_SEGMENT_SIZE		64		// TRBs, one shared memory block
+#define XHCI_RING_MAX_SEGMENTS		16
+
+#define XHCI_CONFIG_EVENT_RING_SIZE	256		// reduced, if ERST Max is lower
 #define XHCI_CONFIG_CMD_RING_SIZE	64
-#define XHCI_CONFIG_TRANSFER_RING_SIZE	64
+#define XHCI_CONFIG_TRANSFER_RING_SIZE	64		// initial size, rings grow on demand
+
+#define XHCI_CONFIG_QUEUE_DEPTH		8		// default outstanding TDs per endpoint
+#define XHCI_CONFIG_MAX_QUEUE_DEPTH	16
+#define XHCI_CONFIG_MAX_TRBS_PER_TD	4		// for bulk and interrupt TDs
 
 #define XHCI_CONFIG_IMODI		500		// defines maximum interrupt rate
+							// (default, in 250ns units)
 
 #define XHCI_PAGE_SHIFT			12
 #define XHCI_PAGE_SIZE			(1 << XHCI_PAGE_SHIFT)
 
-#define XHCI_CONFIG_MAX_REQUESTS	(XHCI_CONFIG_MAX_SLOTS * 8)
+#define XHCI_CONFIG_MAX_REQUESTS	(XHCI_CONFIG_MAX_SLOTS * 16)
 
 //
 // Port Configuration (from Extended Capabilities "Protocol")
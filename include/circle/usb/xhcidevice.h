@@ -47,6 +47,9 @@ public:
 	boolean SubmitBlockingRequest (CUSBRequest *pURB, unsigned nTimeoutMs = USB_TIMEOUT_NONE);
 	boolean SubmitAsyncRequest (CUSBRequest *pURB, unsigned nTimeoutMs = USB_TIMEOUT_NONE);
 
+	// maximum interrupt rate is 1 / (nInterval * 250ns), 0 to disable moderation
+	void SetInterruptModeration (unsigned nInterval);
+
 public:
 	CXHCIMMIOSpace *GetMMIOSpace (void);
 	CXHCISlotManager *GetSlotManager (void);
@@ -2,7 +2,7 @@
 // xhciendpoint.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,10 +22,25 @@
 
 #include <circle/usb/xhcimmiospace.h>
 #include <circle/usb/xhciring.h>
+#include <circle/usb/xhciconfig.h>
 #include <circle/usb/xhci.h>
 #include <circle/usb/usb.h>
+#include <circle/spinlock.h>
 #include <circle/types.h>
 
+struct TXHCIEndpointStatistics
+{
+	unsigned	nTransfers;		// completed TDs
+	unsigned	nErrors;		// TDs completed with error
+	u64		nBytes;			// transferred bytes
+	unsigned	nMaxQueued;		// maximum number of outstanding TDs
+	unsigned	nLatencyMin;		// from submission to completion (microseconds)
+	unsigned	nLatencyMax;
+	u64		nLatencySum;		// divide by nTransfers for average
+	u64		nBusyTime;		// microseconds with TDs outstanding,
+						// nBytes / nBusyTime is the throughput in MB/s
+};
+
 class CXHCIDevice;
 class CXHCIUSBDevice;
 class CUSBRequest;
@@ -47,7 +62,14 @@ public:
 	boolean Transfer (CUSBRequest *pURB, unsigned nTimeoutMs);
 	boolean TransferAsync (CUSBRequest *pURB, unsigned nTimeoutMs);
 
-	void TransferEvent (u8 uchCompletionCode, u32 nTransferLength);
+	void TransferEvent (u8 uchCompletionCode, u32 nTransferLength, TXHCITRB *pTRB);
+
+	// maximum number of outstanding TDs (1..XHCI_CONFIG_MAX_QUEUE_DEPTH)
+	void SetQueueDepth (unsigned nDepth);
+	unsigned GetQueueDepth (void) const;
+
+	void GetStatistics (TXHCIEndpointStatistics *pStatistics);
+	void ResetStatistics (void);
 
 #ifndef NDEBUG
 	void DumpStatus (void);
@@ -57,8 +79,14 @@ private:
 	static void CompletionRoutine (CUSBRequest *pURB, void *pParam, void *pContext);
 
 	// Cycle bit and Interrupter Target are set automatically
-	boolean EnqueueTRB (u32 nControl, u32 nStatus = 0,
-			    u32 nParameter1 = 0, u32 nParameter2 = 0);
+	TXHCITRB *EnqueueTRB (u32 nControl, u32 nStatus = 0,
+			      u32 nParameter1 = 0, u32 nParameter2 = 0);
+
+	// reserves ring space for nTRBs, expands the transfer ring if required and allowed
+	boolean ReserveTRBs (unsigned nTRBs, boolean bMayExpand);
+
+	void RetireTD (void);
+	void UpdateStatistics (const CUSBRequest *pURB, unsigned nStartTicks);
 
 	TXHCIInputContext *GetInputContextSetMaxPacketSize (void);
 	TXHCIInputContext *GetInputContextConfigureEndpoint (void);
@@ -83,8 +111,31 @@ private:
 	u8		 m_uchEndpointID;
 	u8		 m_uchEndpointType;
 
-	CUSBRequest	*m_pURB;
-	volatile boolean m_bTransferCompleted;
+	struct TTransferDescriptor
+	{
+		CUSBRequest	*pURB;
+		unsigned	 nTRBs;			// number of TRBs on ring
+		unsigned	 nDataTRBs;		// number of entries in pDataTRB[]
+		TXHCITRB	*pDataTRB[XHCI_CONFIG_MAX_TRBS_PER_TD];	// bulk and interrupt only
+		u32		 nDataLength[XHCI_CONFIG_MAX_TRBS_PER_TD];
+		TXHCITRB	*pLastTRB;		// TRB with IOC flag
+		TXHCITRB	*pNextTRB;		// enqueue TRB after this TD
+		unsigned	 nStartTicks;
+		boolean		 bCompleted;		// early on short packet, waiting for last event
+	};
+
+	TTransferDescriptor m_TD[XHCI_CONFIG_MAX_QUEUE_DEPTH];	// outstanding TDs (FIFO)
+	unsigned	 m_nTDIn;
+	unsigned	 m_nTDOut;
+	unsigned	 m_nTDCount;
+	unsigned	 m_nQueueDepth;
+
+	volatile boolean m_bTransferCompleted;		// for synchronous transfers
+
+	TXHCIEndpointStatistics m_Statistics;
+	unsigned	 m_nBusyStartTicks;
+
+	CSpinLock	 m_SpinLock;
 
 	u8		*m_pInputContextBuffer;
 };
@@ -2,7 +2,7 @@
 // xhcieventmanager.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -37,15 +37,20 @@ public:
 
 	boolean HandleEvents (void);
 
+	void SetInterruptModeration (unsigned nInterval);	// in 250ns units, 0 to disable
+
 #ifndef NDEBUG
 	void DumpStatus (void);
 #endif
 
+private:
+	static unsigned GetEventRingSize (CXHCIMMIOSpace *pMMIO);
+
 private:
 	CXHCIDevice	*m_pXHCIDevice;
 	CXHCIMMIOSpace	*m_pMMIO;
 	CXHCIRing	 m_EventRing;
-	TXHCIERSTEntry	*m_pERST;
+	TXHCIERSTEntry	*m_pERST;		// one entry per ring segment
 };
 
 #endif
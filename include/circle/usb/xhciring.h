@@ -2,7 +2,7 @@
 // xhciring.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@
 #define _circle_usb_xhciring_h
 
 #include <circle/usb/xhci.h>
+#include <circle/usb/xhciconfig.h>
 #include <circle/types.h>
 
 enum TXHCIRingType
@@ -36,12 +37,15 @@ class CXHCIDevice;
 class CXHCIRing		/// Encapsulates a transfer, command or event ring
 {
 public:
+	// nTRBCount must be a multiple of XHCI_RING_SEGMENT_SIZE
 	CXHCIRing (TXHCIRingType Type, unsigned nTRBCount, CXHCIDevice *pAllocator);
 	~CXHCIRing (void);
 
 	boolean IsValid (void) const;
 
 	unsigned GetTRBCount (void) const;
+	unsigned GetSegmentCount (void) const;
+	TXHCITRB *GetSegment (unsigned nSegment);
 
 	TXHCITRB *GetFirstTRB (void);
 	TXHCITRB *GetDequeueTRB (void);		// returns 0 if empty
@@ -52,19 +56,38 @@ public:
 
 	u32 GetCycleState (void) const;
 
+	// transfer rings only:
+	TXHCITRB *GetEnqueuePosition (void);	// also if the ring is full
+	unsigned GetFreeTRBs (void) const;
+	// inserts a segment after the enqueue segment, returns FALSE if not possible now
+	boolean Expand (void);
+	// a TD with nTRBs TRBs has been completed, pNextTRB follows its last TRB
+	void FreeTRBs (unsigned nTRBs, TXHCITRB *pNextTRB);
+
 #ifndef NDEBUG
 	void DumpStatus (const char *pFrom = 0);
 #endif
 
+private:
+	TXHCITRB *AllocateSegment (void);
+	void InitLinkTRB (unsigned nSegment);
+
+	int FindSegment (const TXHCITRB *pTRB) const;		// returns -1 if not found
+
 private:
 	TXHCIRingType	 m_Type;
-	unsigned	 m_nTRBCount;
 	CXHCIDevice	*m_pAllocator;
 
-	TXHCITRB	*m_pFirstTRB;
+	unsigned	 m_nSegments;
+	TXHCITRB	*m_pSegment[XHCI_RING_MAX_SEGMENTS];	// in ring order
+
+	unsigned	 m_nEnqueueSegment;
 	unsigned	 m_nEnqueueIndex;
+	unsigned	 m_nDequeueSegment;
 	unsigned	 m_nDequeueIndex;
 	u32		 m_nCycleState;
+
+	unsigned	 m_nFreeTRBs;		// transfer rings only
 };
 
 #endif
@@ -30,7 +30,7 @@
 // 248	64	4K	 1		Scatchpad Buffer Array
 // 264	64	4K	 1		DCBAA
 // 1024	64	4K	 <=32		Device Context
-// 1024	64	64K	 <=2+32*EPs	TRB Ring (EPs = number of endpoints per device)
+// 1024	64	64K	 <=5+32*EPs	TRB Ring Segment (EPs = endpoints per device, rings may grow)
 // 124K	4K	4K	 1		Scatchpad Buffers
 
 // We only maintain blocks with the following specification. Other blocks, which do not
@@ -2,7 +2,7 @@
 // xhciusbdevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -46,7 +46,8 @@ public:
 
 	void RegisterEndpoint (u8 uchEndpointID, CXHCIEndpoint *pEndpoint);
 
-	void TransferEvent (u8 uchCompletionCode, u32 nTransferLength, u8 uchEndpointID);
+	void TransferEvent (u8 uchCompletionCode, u32 nTransferLength, TXHCITRB *pTRB,
+			    u8 uchEndpointID);
 
 #ifndef NDEBUG
 	void DumpStatus (void);
@@ -80,6 +80,12 @@
 
 #define TX_RING_INDEX			1	// using highest TX priority queue
 
+// interrupt moderation defaults (see SetInterruptModeration())
+#define RX_COALESCE_FRAMES		1
+#define RX_COALESCE_USECS		0
+#define TX_COALESCE_FRAMES		10
+#define RX_IDLE_POLLS			100	// see SetRxIdlePolls()
+
 // Tx/Rx DMA register offset, skip 256 descriptors
 #define GENET_TDMA_REG_OFF		(TDMA_OFFSET + TOTAL_DESC * DMA_DESC_SIZE)
 #define GENET_RDMA_REG_OFF		(RDMA_OFFSET + TOTAL_DESC * DMA_DESC_SIZE)
@@ -581,9 +587,18 @@ CBcm54213Device::CBcm54213Device (void)
 :	m_pTimer (CTimer::Get ()),
 	m_bInterruptConnected (FALSE),
 	m_tx_cbs (0),
-	m_rx_cbs (0)
+	m_rx_cbs (0),
+	m_nRxCoalesceFrames (RX_COALESCE_FRAMES),
+	m_nRxCoalesceMicros (RX_COALESCE_USECS),
+	m_nTxCoalesceFrames (TX_COALESCE_FRAMES),
+	m_nRxIdlePolls (RX_IDLE_POLLS),
+	m_bRxInterruptMode (FALSE),
+	m_bRxPending (FALSE),
+	m_nRxIdleCount (0)
 {
 	assert (m_pTimer != 0);
+
+	memset (&m_Statistics, 0, sizeof m_Statistics);
 }
 
 CBcm54213Device::~CBcm54213Device (void)
@@ -711,8 +726,21 @@ boolean CBcm54213Device::IsSendFrameAdvisable (void)
 
 boolean CBcm54213Device::SendFrame (const void *pBuffer, unsigned nLength)
 {
-	assert (pBuffer != 0);
-	assert (nLength > 0);
+	if (SendFrames (&pBuffer, &nLength, 1) == 0)
+	{
+		CLogger::Get ()->Write (FromBcm54213, LogWarning, "TX frame dropped");
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+unsigned CBcm54213Device::SendFrames (const void *const *ppBuffer, const unsigned *pLength,
+				      unsigned nCount)
+{
+	assert (ppBuffer != 0);
+	assert (pLength != 0);
 
 	// Mapping strategy:
 	// index = 0, unclassified, packet xmited through ring16
@@ -730,59 +758,86 @@ boolean CBcm54213Device::SendFrame (const void *pBuffer, unsigned nLength)
 
 	m_TxSpinLock.Acquire ();
 
-	if (ring->free_bds < 2)				// is there room for this frame?
+	unsigned nFrames;
+	for (nFrames = 0; nFrames < nCount; nFrames++)
 	{
-		CLogger::Get ()->Write (FromBcm54213, LogWarning, "TX frame dropped");
+		if (ring->free_bds < 2)			// is there room for this frame?
+		{
+			m_Statistics.nTxRingFull++;
 
-		m_TxSpinLock.Release ();
+			break;
+		}
 
-		return FALSE;
-	}
+		const void *pBuffer = ppBuffer[nFrames];
+		unsigned nLength = pLength[nFrames];
+		assert (pBuffer != 0);
+		assert (nLength > 0);
 
-	u8 *pTxBuffer = new u8[ENET_MAX_MTU_SIZE];	// allocate and fill DMA buffer
-	memcpy (pTxBuffer, pBuffer, nLength);
-	if (nLength < ETH_ZLEN)				// pad frame if necessary
-	{
-		memset (pTxBuffer+nLength, 0, ETH_ZLEN-nLength);
-		nLength = ETH_ZLEN;
-	}
+		u8 *pTxBuffer = new u8[ENET_MAX_MTU_SIZE];	// allocate and fill DMA buffer
+		memcpy (pTxBuffer, pBuffer, nLength);
+		if (nLength < ETH_ZLEN)				// pad frame if necessary
+		{
+			memset (pTxBuffer+nLength, 0, ETH_ZLEN-nLength);
+			nLength = ETH_ZLEN;
+		}
 
-	TGEnetCB *tx_cb_ptr = get_txcb (ring);		// get Tx control block from ring
-	assert (tx_cb_ptr != 0);
+		TGEnetCB *tx_cb_ptr = get_txcb (ring);		// get Tx control block from ring
+		assert (tx_cb_ptr != 0);
 
-	// prepare for DMA
-	CleanAndInvalidateDataCacheRange ((u32) (uintptr) pTxBuffer, nLength);
+		// prepare for DMA
+		CleanAndInvalidateDataCacheRange ((u32) (uintptr) pTxBuffer, nLength);
 
-	tx_cb_ptr->buffer = pTxBuffer;			// set DMA buffer in Tx control block
+		tx_cb_ptr->buffer = pTxBuffer;			// set DMA buffer in Tx control block
 
-	// set DMA descriptor and start transfer
-	dmadesc_set (tx_cb_ptr->bd_addr, pTxBuffer,   (nLength << DMA_BUFLENGTH_SHIFT)
-						    | (QTAG_MASK << DMA_TX_QTAG_SHIFT)
-						    | DMA_TX_APPEND_CRC | DMA_SOP | DMA_EOP);
+		// set DMA descriptor
+		dmadesc_set (tx_cb_ptr->bd_addr, pTxBuffer,   (nLength << DMA_BUFLENGTH_SHIFT)
+							    | (QTAG_MASK << DMA_TX_QTAG_SHIFT)
+							    | DMA_TX_APPEND_CRC | DMA_SOP | DMA_EOP);
 
-	// decrement total BD count and advance our write pointer
-	ring->free_bds--;
-	ring->prod_index++;
-	ring->prod_index &= DMA_P_INDEX_MASK;
+		// decrement total BD count and advance our write pointer
+		ring->free_bds--;
+		ring->prod_index++;
+		ring->prod_index &= DMA_P_INDEX_MASK;
+	}
 
-	// packets are ready, update producer index
-	tdma_ring_writel(ring->index, ring->prod_index, TDMA_PROD_INDEX);
+	// packets are ready, update producer index once for the whole burst
+	if (nFrames > 0)
+	{
+		tdma_ring_writel(ring->index, ring->prod_index, TDMA_PROD_INDEX);
+	}
 
 	m_TxSpinLock.Release ();
 
-	return TRUE;
+	return nFrames;
 }
 
 boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 {
-	assert (pBuffer != 0);
+	return ReceiveFrames (&pBuffer, pResultLength, 1) == 1;
+}
+
+unsigned CBcm54213Device::ReceiveFrames (void *const *ppBuffer, unsigned *pResultLength,
+					 unsigned nMaxCount)
+{
+	assert (ppBuffer != 0);
 	assert (pResultLength != 0);
 
 	TGEnetRxRing *ring = &m_rx_rings[GENET_DESC_INDEX];	// the only supported Rx queue
 
-	// clear status before servicing to reduce spurious interrupts
-	// NOTE: Rx interrupts are not used
-	//intrl2_0_writel (UMAC_IRQ_RXDMA_DONE, INTRL2_CPU_CLEAR);
+	// in interrupt mode do not access the ring, until the RX interrupt occurred
+	if (m_bRxInterruptMode)
+	{
+		if (!m_bRxPending)
+		{
+			return 0;
+		}
+
+		m_bRxPending = FALSE;
+		m_bRxInterruptMode = FALSE;	// RX interrupt has been masked by the handler
+		m_nRxIdleCount = 0;
+	}
+
+	m_Statistics.nRxPolls++;
 
 	unsigned p_index = rdma_ring_readl (ring->index, RDMA_PROD_INDEX);
 
@@ -793,6 +848,8 @@ boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 		discards = discards - ring->old_discards;
 		ring->old_discards += discards;
 
+		m_Statistics.nRxOverruns += discards;
+
 		// clear HW register when we reach 75% of maximum 0xFFFF
 		if (ring->old_discards >= 0xC000)
 		{
@@ -803,10 +860,28 @@ boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 
 	p_index &= DMA_P_INDEX_MASK;
 
-	boolean bResult = FALSE;
+	unsigned nFrames = 0;
 
 	unsigned rxpkttoprocess = (p_index - ring->c_index) & DMA_C_INDEX_MASK;
-	if (rxpkttoprocess > 0)
+	if (rxpkttoprocess == 0)
+	{
+		// switch to interrupt mode, if the ring was idle for a while
+		if (   m_nRxIdlePolls > 0
+		    && ++m_nRxIdleCount >= m_nRxIdlePolls)
+		{
+			rx_intr_mode (true);
+		}
+
+		return 0;
+	}
+
+	m_nRxIdleCount = 0;
+
+	// process all descriptors, which are ready (up to nMaxCount frames),
+	// the consumer index is updated once at the end
+	for (unsigned rxpktprocessed = 0;
+	     rxpktprocessed < rxpkttoprocess && nFrames < nMaxCount;
+	     rxpktprocessed++)
 	{
 		u32 dma_length_status;
 		u32 dma_flag;
@@ -819,7 +894,7 @@ boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 		{
 			CLogger::Get ()->Write (FromBcm54213, LogWarning, "Missing RX buffer!");
 
-			goto out;
+			goto next;
 		}
 
 		dma_length_status = dmadesc_get_length_status (cb->bd_addr);
@@ -834,7 +909,7 @@ boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 
 			delete [] pRxBuffer;
 
-			goto out;
+			goto next;
 		}
 
 		// report errors
@@ -843,9 +918,11 @@ boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 			CLogger::Get ()->Write (FromBcm54213, LogWarning, "RX error (0x%x)",
 						(unsigned) dma_flag);
 
+			m_Statistics.nRxErrors++;
+
 			delete [] pRxBuffer;
 
-			goto out;
+			goto next;
 		}
 
 #define LEADING_PAD	2
@@ -856,18 +933,16 @@ boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 			nLength -= ETH_FCS_LEN;
 		}
 
-
 		assert (nLength > 0);
 		assert (nLength <= FRAME_BUFFER_SIZE);
-		memcpy (pBuffer, pRxBuffer+LEADING_PAD, nLength);
+		assert (ppBuffer[nFrames] != 0);
+		memcpy (ppBuffer[nFrames], pRxBuffer+LEADING_PAD, nLength);
 
-		*pResultLength = nLength;
+		pResultLength[nFrames++] = nLength;
 
 		delete [] pRxBuffer;
 
-		bResult = TRUE;
-
-out:
+next:
 		if (ring->read_ptr < ring->end_ptr)
 		{
 			ring->read_ptr++;
@@ -878,10 +953,36 @@ out:
 		}
 
 		ring->c_index = (ring->c_index + 1) & DMA_C_INDEX_MASK;
-		rdma_ring_writel (ring->index, ring->c_index, RDMA_CONS_INDEX);
 	}
 
-	return bResult;
+	rdma_ring_writel (ring->index, ring->c_index, RDMA_CONS_INDEX);
+
+	m_Statistics.nRxPolledFrames += nFrames;
+
+	return nFrames;
+}
+
+void CBcm54213Device::SetInterruptModeration (unsigned nRxFrames, unsigned nRxTimeoutMicros,
+					      unsigned nTxFrames)
+{
+	m_nRxCoalesceFrames = nRxFrames;
+	m_nRxCoalesceMicros = nRxTimeoutMicros;
+	m_nTxCoalesceFrames = nTxFrames;
+
+	set_coalesce ();
+}
+
+void CBcm54213Device::SetRxIdlePolls (unsigned nIdlePolls)
+{
+	m_nRxIdlePolls = nIdlePolls;
+}
+
+void CBcm54213Device::GetStatistics (TGEnetStatistics *pStatistics) const
+{
+	assert (pStatistics != 0);
+	memcpy (pStatistics, &m_Statistics, sizeof *pStatistics);
+
+	pStatistics->bInterruptMode = m_bRxInterruptMode;
 }
 
 boolean CBcm54213Device::IsLinkUp (void)
@@ -1016,6 +1117,75 @@ void CBcm54213Device::enable_rx_intr(void)
 	ring->int_enable(ring);
 }
 
+// program the interrupt moderation thresholds of the used rings
+void CBcm54213Device::set_coalesce(void)
+{
+	unsigned frames = m_nRxCoalesceFrames;
+	if (frames < 1)
+		frames = 1;
+	if (frames > DMA_INTR_THRESHOLD_MASK)
+		frames = DMA_INTR_THRESHOLD_MASK;
+
+	rdma_ring_writel(GENET_DESC_INDEX, frames, DMA_MBUF_DONE_THRESH);
+
+	// timeout is specified in units of 8.192 us, it is required with more than one
+	// frame, otherwise the last frames of a burst would not raise an interrupt
+	unsigned timeout = (m_nRxCoalesceMicros * 1000 + 8191) / 8192;
+	if (frames > 1 && timeout == 0)
+		timeout = 1;
+	if (timeout > DMA_TIMEOUT_MASK)
+		timeout = DMA_TIMEOUT_MASK;
+
+	u32 reg = rdma_readl(DMA_RING0_TIMEOUT + GENET_DESC_INDEX);
+	reg &= ~DMA_TIMEOUT_MASK;
+	reg |= timeout;
+	rdma_writel(reg, DMA_RING0_TIMEOUT + GENET_DESC_INDEX);
+
+	frames = m_nTxCoalesceFrames;
+	if (frames < 1)
+		frames = 1;
+	if (frames > DMA_INTR_THRESHOLD_MASK)
+		frames = DMA_INTR_THRESHOLD_MASK;
+
+	for (unsigned i = 0; i < TX_QUEUES; i++)
+		tdma_ring_writel(i, frames, DMA_MBUF_DONE_THRESH);
+
+	tdma_ring_writel(GENET_DESC_INDEX, frames, DMA_MBUF_DONE_THRESH);
+}
+
+// switch RX between polling and interrupt mode
+void CBcm54213Device::rx_intr_mode(bool enable)
+{
+	if (!enable) {
+		intrl2_0_writel(UMAC_IRQ_RXDMA_DONE, INTRL2_CPU_MASK_SET);
+
+		m_bRxInterruptMode = FALSE;
+
+		return;
+	}
+
+	if (!m_bInterruptConnected)
+		return;
+
+	m_bRxPending = FALSE;
+	m_bRxInterruptMode = TRUE;
+
+	// clear status before enabling to prevent a spurious interrupt
+	intrl2_0_writel(UMAC_IRQ_RXDMA_DONE, INTRL2_CPU_CLEAR);
+	enable_rx_intr();
+
+	// a frame may have been received in the meantime without interrupt
+	TGEnetRxRing *ring = &m_rx_rings[GENET_DESC_INDEX];
+	unsigned p_index = rdma_ring_readl(ring->index, RDMA_PROD_INDEX) & DMA_P_INDEX_MASK;
+	if (p_index != ring->c_index) {
+		rx_intr_mode(false);
+
+		return;
+	}
+
+	m_Statistics.nModeSwitches++;
+}
+
 void CBcm54213Device::link_intr_enable(void)
 {
 	intrl2_0_writel(UMAC_IRQ_LINK_EVENT, INTRL2_CPU_MASK_CLEAR);
@@ -1126,7 +1296,9 @@ void CBcm54213Device::hfb_init(void)
 // Start the network engine
 void CBcm54213Device::netif_start(void)
 {
-	//enable_rx_intr();		// NOTE: Rx interrupts are not needed
+	// NOTE: Rx interrupts are enabled on demand (see rx_intr_mode())
+
+	set_coalesce();
 
 	umac_enable_set(CMD_TX_EN | CMD_RX_EN, true);
 
@@ -1329,7 +1501,7 @@ void CBcm54213Device::init_tx_ring(unsigned index, unsigned size,
 
 	tdma_ring_writel(index, 0, TDMA_PROD_INDEX);
 	tdma_ring_writel(index, 0, TDMA_CONS_INDEX);
-	tdma_ring_writel(index, 10, DMA_MBUF_DONE_THRESH);
+	tdma_ring_writel(index, TX_COALESCE_FRAMES, DMA_MBUF_DONE_THRESH);
 	// Disable rate control for now
 	tdma_ring_writel(index, flow_period_val, TDMA_FLOW_PERIOD);
 	tdma_ring_writel(index, ((size << DMA_RING_SIZE_SHIFT) | RX_BUF_LENGTH), DMA_RING_BUF_SIZE);
@@ -1559,7 +1731,18 @@ void CBcm54213Device::InterruptHandler0 (void)
 	// clear interrupts
 	intrl2_0_writel(status, INTRL2_CPU_CLEAR);
 
+	if (status & UMAC_IRQ_RXDMA_DONE) {
+		// mask RX interrupt, ReceiveFrames() polls the ring again
+		intrl2_0_writel(UMAC_IRQ_RXDMA_DONE, INTRL2_CPU_MASK_SET);
+
+		m_bRxPending = TRUE;
+
+		m_Statistics.nRxInterrupts++;
+	}
+
 	if (status & UMAC_IRQ_TXDMA_DONE) {
+		m_Statistics.nTxInterrupts++;
+
 		m_TxSpinLock.Acquire ();
 
 		TGEnetTxRing *tx_ring = &m_tx_rings[GENET_DESC_INDEX];
@@ -1579,6 +1762,8 @@ void CBcm54213Device::InterruptHandler1 (void)
 	// clear interrupts
 	intrl2_1_writel(status, INTRL2_CPU_CLEAR);
 
+	m_Statistics.nTxInterrupts++;
+
 	m_TxSpinLock.Acquire ();
 
 	// Check Tx priority queue interrupts
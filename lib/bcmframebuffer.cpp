@@ -2,7 +2,7 @@
 // bcmframebuffer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -19,6 +19,7 @@
 //
 #include <circle/bcmframebuffer.h>
 #include <circle/util.h>
+#include <assert.h>
 
 TBcmFrameBufferInitTags CBcmFrameBuffer::s_InitTags =
 {
@@ -31,7 +32,8 @@ TBcmFrameBufferInitTags CBcmFrameBuffer::s_InitTags =
 };
 
 CBcmFrameBuffer::CBcmFrameBuffer (unsigned nWidth, unsigned nHeight, unsigned nDepth,
-				  unsigned nVirtualWidth, unsigned nVirtualHeight)
+				  unsigned nVirtualWidth, unsigned nVirtualHeight,
+				  unsigned nBuffers)
 :	m_nWidth (nWidth),
 	m_nHeight (nHeight),
 	m_nVirtualWidth (nVirtualWidth),
@@ -40,8 +42,12 @@ CBcmFrameBuffer::CBcmFrameBuffer (unsigned nWidth, unsigned nHeight, unsigned nD
 	m_nBufferPtr (0),
 	m_nBufferSize (0),
 	m_nPitch (0),
+	m_nBuffers (nBuffers),
+	m_nFrontBuffer (0),
 	m_pTagSetPalette (0)
 {
+	assert (m_nBuffers >= 1);
+
 	if (   m_nWidth  == 0
 	    || m_nHeight == 0)
 	{
@@ -69,8 +75,13 @@ CBcmFrameBuffer::CBcmFrameBuffer (unsigned nWidth, unsigned nHeight, unsigned nD
 		}
 	}
 
-	if (   m_nVirtualWidth  == 0
-	    || m_nVirtualHeight == 0)
+	if (m_nBuffers > 1)
+	{
+		m_nVirtualWidth  = m_nWidth;
+		m_nVirtualHeight = m_nHeight * m_nBuffers;
+	}
+	else if (   m_nVirtualWidth  == 0
+		 || m_nVirtualHeight == 0)
 	{
 		m_nVirtualWidth  = m_nWidth;
 		m_nVirtualHeight = m_nHeight;
@@ -123,20 +134,37 @@ void CBcmFrameBuffer::SetPalette32 (u8 nIndex, u32 nRGBA)
 
 boolean CBcmFrameBuffer::Initialize (void)
 {
-	CBcmPropertyTags Tags;
-	if (!Tags.GetTags (&m_InitTags, sizeof m_InitTags))
-	{
-		return FALSE;
-	}
+	TBcmFrameBufferInitTags InitTags;
+	memcpy (&InitTags, &m_InitTags, sizeof InitTags);
 
-	if (   m_InitTags.SetPhysWidthHeight.nWidth         == 0
+	CBcmPropertyTags Tags;
+	if (   !Tags.GetTags (&m_InitTags, sizeof m_InitTags)
+	    || m_InitTags.SetPhysWidthHeight.nWidth         == 0
 	    || m_InitTags.SetPhysWidthHeight.nHeight        == 0
 	    || m_InitTags.SetVirtWidthHeight.nWidth         == 0
 	    || m_InitTags.SetVirtWidthHeight.nHeight        == 0
 	    || m_InitTags.SetDepth.nValue                   == 0
-	    || m_InitTags.AllocateBuffer.nBufferBaseAddress == 0)
+	    || m_InitTags.AllocateBuffer.nBufferBaseAddress == 0
+	    || (   m_nBuffers > 1
+		&& (   m_InitTags.SetVirtWidthHeight.nHeight < m_nVirtualHeight
+		    || m_InitTags.AllocateBuffer.nBufferSize
+			< m_InitTags.GetPitch.nValue * m_nVirtualHeight)))
 	{
-		return FALSE;
+		if (m_nBuffers <= 1)
+		{
+			return FALSE;
+		}
+
+		// the GPU refused the virtual size, retry with one buffer
+		m_nBuffers = 1;
+		m_nVirtualWidth  = m_nWidth;
+		m_nVirtualHeight = m_nHeight;
+
+		memcpy (&m_InitTags, &InitTags, sizeof m_InitTags);
+		m_InitTags.SetVirtWidthHeight.nWidth  = m_nVirtualWidth;
+		m_InitTags.SetVirtWidthHeight.nHeight = m_nVirtualHeight;
+
+		return Initialize ();
 	}
 
 	m_nBufferPtr  = m_InitTags.AllocateBuffer.nBufferBaseAddress & 0x3FFFFFFF;
@@ -186,6 +214,43 @@ u32 CBcmFrameBuffer::GetSize (void) const
 	return m_nBufferSize;
 }
 
+unsigned CBcmFrameBuffer::GetBufferCount (void) const
+{
+	return m_nBuffers;
+}
+
+unsigned CBcmFrameBuffer::GetBackBufferIndex (void) const
+{
+	return m_nBuffers > 1 ? (m_nFrontBuffer + 1) % m_nBuffers : 0;
+}
+
+u32 CBcmFrameBuffer::GetBackBuffer (void) const
+{
+	return m_nBufferPtr + GetBackBufferIndex () * m_nHeight * m_nPitch;
+}
+
+boolean CBcmFrameBuffer::Flip (boolean bWaitForVSync)
+{
+	if (m_nBuffers > 1)
+	{
+		unsigned nBackBuffer = GetBackBufferIndex ();
+		if (!SetVirtualOffset (0, nBackBuffer * m_nHeight))
+		{
+			return FALSE;
+		}
+
+		m_nFrontBuffer = nBackBuffer;
+	}
+
+	// the previous front buffer may be displayed until the next vertical sync
+	if (bWaitForVSync)
+	{
+		return WaitForVerticalSync ();
+	}
+
+	return TRUE;
+}
+
 boolean CBcmFrameBuffer::UpdatePalette (void)
 {
 	if (m_nDepth <= 8)
@@ -2,7 +2,7 @@
 // fatcache.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2017  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -20,6 +20,7 @@
 #include <circle/fs/fat/fatcache.h>
 #include <circle/alloc.h>
 #include <circle/logger.h>
+#include <circle/util.h>
 #include <assert.h>
 
 #define BUFFER_MAGIC		0x4641544D
@@ -32,6 +33,9 @@
 CFATCache::CFATCache (void)
 :	m_pPartition (0),
 	m_pBufferMem (0),
+	m_pTransferBuffer (0),
+	m_nNextSector (BUFFER_NOSECTOR),
+	m_nReadAhead (0),
 	m_BufferListLock (TASK_LEVEL),
 	m_DiskLock (TASK_LEVEL)
 {
@@ -57,6 +61,16 @@ int CFATCache::Open (CDevice *pPartition)
 		return 0;
 	}
 
+	assert (m_pTransferBuffer == 0);
+	m_pTransferBuffer = (unsigned char *) malloc (FAT_SECTOR_SIZE*FAT_READ_AHEAD_MAX);
+	if (!m_pTransferBuffer)
+	{
+		free (m_pBufferMem);
+		m_pBufferMem = 0;
+
+		return 0;
+	}
+
 	for (pBuffer = (TFATBuffer *) m_pBufferMem, i = 1; i <= FAT_BUFFERS; pBuffer++, i++)
 	{
 		pBuffer->nMagic    = BUFFER_MAGIC;
@@ -64,6 +78,7 @@ int CFATCache::Open (CDevice *pPartition)
 		pBuffer->pPrev     = (i == 1 ? 0 : pBuffer - 1);
 		pBuffer->nSector    = BUFFER_NOSECTOR;
 		pBuffer->nUseCount = 0;
+		pBuffer->bDirty    = 0;
 		
 		if (i == 1)
 		{
@@ -75,6 +90,9 @@ int CFATCache::Open (CDevice *pPartition)
 		}
 	}
 
+	m_nNextSector = BUFFER_NOSECTOR;
+	m_nReadAhead = 0;
+
 	return 1;
 }
 
@@ -85,6 +103,10 @@ void CFATCache::Close (void)
 	m_BufferList.pFirst = 0;
 	m_BufferList.pLast = 0;
 
+	assert (m_pTransferBuffer != 0);
+	free (m_pTransferBuffer);
+	m_pTransferBuffer = 0;
+
 	assert (m_pBufferMem != 0);
 	free (m_pBufferMem);
 	m_pBufferMem = 0;
@@ -104,17 +126,7 @@ void CFATCache::Flush (void)
 		{
 			if (pBuffer->bDirty)
 			{
-				m_DiskLock.Acquire ();
-
-				m_pPartition->Seek (pBuffer->nSector * FAT_SECTOR_SIZE);
-				if (m_pPartition->Write (pBuffer->Data, FAT_SECTOR_SIZE) != FAT_SECTOR_SIZE)
-				{
-					Fault (FAULT_WRITE_ERROR);
-				}
-
-				m_DiskLock.Release ();
-
-				pBuffer->bDirty = 0;
+				WriteBack (pBuffer);
 			}
 		}
 	}
@@ -128,16 +140,7 @@ TFATBuffer *CFATCache::GetSector (unsigned nSector, int bWriteOnly)
 
 	m_BufferListLock.Acquire ();
 
-	for (pBuffer = m_BufferList.pFirst; pBuffer != 0; pBuffer = pBuffer->pNext)
-	{
-		assert (pBuffer->nMagic == BUFFER_MAGIC);
-
-		if (pBuffer->nSector == nSector)
-		{
-			break;
-		}
-	}
-
+	pBuffer = FindBuffer (nSector);
 	if (pBuffer != 0)
 	{
 		MoveBufferFirst (pBuffer);
@@ -149,78 +152,94 @@ TFATBuffer *CFATCache::GetSector (unsigned nSector, int bWriteOnly)
 		return pBuffer;
 	}
 
-
-	for (pBuffer = m_BufferList.pLast; pBuffer != 0; pBuffer = pBuffer->pPrev)
+	pBuffer = AllocateBuffer (0);
+	if (pBuffer == 0)
 	{
-		assert (pBuffer->nMagic == BUFFER_MAGIC);
-
-		if (pBuffer->nSector == BUFFER_NOSECTOR)
-		{
-			break;
-		}
+		Fault (FAULT_NO_BUFFER);
+		m_BufferListLock.Release ();
+		return 0;
 	}
 
-	if (pBuffer == 0)
+	pBuffer->nUseCount = 1;
+	assert (pBuffer->nSector == BUFFER_NOSECTOR);
+	pBuffer->nSector = nSector;
+	pBuffer->bDirty = 0;
+
+	if (!bWriteOnly)
 	{
-		for (pBuffer = m_BufferList.pLast; pBuffer != 0; pBuffer = pBuffer->pPrev)
+		// double the read-ahead window on each sequential miss, reset it otherwise
+		if (nSector == m_nNextSector)
 		{
-			assert (pBuffer->nMagic == BUFFER_MAGIC);
-
-			if (pBuffer->nUseCount == 0)
+			m_nReadAhead = m_nReadAhead*2 + 1;
+			if (m_nReadAhead > FAT_READ_AHEAD_MAX-1)
 			{
-				break;
+				m_nReadAhead = FAT_READ_AHEAD_MAX-1;
 			}
 		}
-
-		if (pBuffer == 0)
+		else
 		{
-			Fault (FAULT_NO_BUFFER);
-			m_BufferListLock.Release ();
-			return 0;
+			m_nReadAhead = 0;
 		}
 
-		if (pBuffer->bDirty)
+		unsigned nCount = 1 + m_nReadAhead;
+
+		m_DiskLock.Acquire ();
+
+		if (nCount > 1)
 		{
-			m_DiskLock.Acquire ();
+			// may fail at the end of the partition, read the sector alone then
+			m_pPartition->Seek ((u64) nSector * FAT_SECTOR_SIZE);
+			if (m_pPartition->Read (m_pTransferBuffer, nCount * FAT_SECTOR_SIZE)
+			    == (int) (nCount * FAT_SECTOR_SIZE))
+			{
+				memcpy (pBuffer->Data, m_pTransferBuffer, FAT_SECTOR_SIZE);
+			}
+			else
+			{
+				nCount = 1;
+				m_nReadAhead = 0;
+			}
+		}
 
-			m_pPartition->Seek (pBuffer->nSector * FAT_SECTOR_SIZE);
-			if (m_pPartition->Write (pBuffer->Data, FAT_SECTOR_SIZE) != FAT_SECTOR_SIZE)
+		if (nCount == 1)
+		{
+			m_pPartition->Seek ((u64) nSector * FAT_SECTOR_SIZE);
+			if (m_pPartition->Read (pBuffer->Data, FAT_SECTOR_SIZE) != FAT_SECTOR_SIZE)
 			{
-				Fault (FAULT_WRITE_ERROR);
+				pBuffer->nUseCount--;
+				pBuffer->nSector = BUFFER_NOSECTOR;
+
+				Fault (FAULT_READ_ERROR);
 				m_DiskLock.Release ();
 				m_BufferListLock.Release ();
 				return 0;
 			}
-
-			m_DiskLock.Release ();
 		}
 
-		pBuffer->nSector = BUFFER_NOSECTOR;
-		assert (pBuffer->nUseCount == 0);
-	}
+		m_DiskLock.Release ();
 
-	pBuffer->nUseCount = 1;
-	assert (pBuffer->nSector == BUFFER_NOSECTOR);
-	pBuffer->nSector = nSector;
-	pBuffer->bDirty = 0;
+		// put the following sectors into the cache, cached sectors are always valid
+		for (unsigned i = 1; i < nCount; i++)
+		{
+			if (FindBuffer (nSector + i) != 0)
+			{
+				continue;
+			}
 
-	if (!bWriteOnly)
-	{
-		m_DiskLock.Acquire ();
+			TFATBuffer *pReadAhead = AllocateBuffer (1);
+			if (pReadAhead == 0)
+			{
+				break;
+			}
 
-		m_pPartition->Seek (nSector * FAT_SECTOR_SIZE);
-		if (m_pPartition->Read (pBuffer->Data, FAT_SECTOR_SIZE) != FAT_SECTOR_SIZE)
-		{
-			pBuffer->nUseCount--;
-			pBuffer->nSector = BUFFER_NOSECTOR;
+			pReadAhead->nSector = nSector + i;
+			pReadAhead->bDirty = 0;
+			memcpy (pReadAhead->Data, m_pTransferBuffer + i*FAT_SECTOR_SIZE, FAT_SECTOR_SIZE);
 
-			Fault (FAULT_READ_ERROR);
-			m_DiskLock.Release ();
-			m_BufferListLock.Release ();
-			return 0;
+			MoveBufferFirst (pReadAhead);
 		}
 
-		m_DiskLock.Release ();
+		m_nNextSector = nSector + nCount;
 	}
 
 	MoveBufferFirst (pBuffer);
@@ -274,6 +293,215 @@ void CFATCache::MarkDirty (TFATBuffer *pBuffer)
 	pBuffer->bDirty = 1;
 }
 
+int CFATCache::ReadSectors (unsigned nSector, void *pBuffer, unsigned nCount)
+{
+	assert (pBuffer != 0);
+	assert (((uintptr) pBuffer & 3) == 0);
+	assert (0 < nCount && nCount <= FAT_MAX_TRANSFER);
+
+	m_BufferListLock.Acquire ();
+
+	m_DiskLock.Acquire ();
+
+	m_pPartition->Seek ((u64) nSector * FAT_SECTOR_SIZE);
+	if (m_pPartition->Read (pBuffer, nCount * FAT_SECTOR_SIZE) != (int) (nCount * FAT_SECTOR_SIZE))
+	{
+		Fault (FAULT_READ_ERROR);
+		m_DiskLock.Release ();
+		m_BufferListLock.Release ();
+		return 0;
+	}
+
+	m_DiskLock.Release ();
+
+	// modified sectors, which have not been written back yet, are valid in the cache only
+	for (TFATBuffer *pCached = m_BufferList.pFirst; pCached != 0; pCached = pCached->pNext)
+	{
+		assert (pCached->nMagic == BUFFER_MAGIC);
+
+		if (   pCached->bDirty
+		    && pCached->nSector != BUFFER_NOSECTOR
+		    && pCached->nSector - nSector < nCount)
+		{
+			memcpy ((unsigned char *) pBuffer + (pCached->nSector - nSector) * FAT_SECTOR_SIZE,
+				pCached->Data, FAT_SECTOR_SIZE);
+		}
+	}
+
+	m_nNextSector = nSector + nCount;
+
+	m_BufferListLock.Release ();
+
+	return 1;
+}
+
+int CFATCache::WriteSectors (unsigned nSector, const void *pBuffer, unsigned nCount)
+{
+	assert (pBuffer != 0);
+	assert (((uintptr) pBuffer & 3) == 0);
+	assert (0 < nCount && nCount <= FAT_MAX_TRANSFER);
+
+	m_BufferListLock.Acquire ();
+
+	m_DiskLock.Acquire ();
+
+	m_pPartition->Seek ((u64) nSector * FAT_SECTOR_SIZE);
+	if (m_pPartition->Write (pBuffer, nCount * FAT_SECTOR_SIZE) != (int) (nCount * FAT_SECTOR_SIZE))
+	{
+		Fault (FAULT_WRITE_ERROR);
+		m_DiskLock.Release ();
+		m_BufferListLock.Release ();
+		return 0;
+	}
+
+	m_DiskLock.Release ();
+
+	// keep cached copies of these sectors up to date
+	for (TFATBuffer *pCached = m_BufferList.pFirst; pCached != 0; pCached = pCached->pNext)
+	{
+		assert (pCached->nMagic == BUFFER_MAGIC);
+
+		if (   pCached->nSector != BUFFER_NOSECTOR
+		    && pCached->nSector - nSector < nCount)
+		{
+			memcpy (pCached->Data,
+				(const unsigned char *) pBuffer + (pCached->nSector - nSector) * FAT_SECTOR_SIZE,
+				FAT_SECTOR_SIZE);
+			pCached->bDirty = 0;
+		}
+	}
+
+	m_BufferListLock.Release ();
+
+	return 1;
+}
+
+TFATBuffer *CFATCache::FindBuffer (unsigned nSector)
+{
+	TFATBuffer *pBuffer;
+
+	for (pBuffer = m_BufferList.pFirst; pBuffer != 0; pBuffer = pBuffer->pNext)
+	{
+		assert (pBuffer->nMagic == BUFFER_MAGIC);
+
+		if (pBuffer->nSector == nSector)
+		{
+			break;
+		}
+	}
+
+	return pBuffer;
+}
+
+// returns unused buffer with nSector == BUFFER_NOSECTOR, does not write back buffers if speculative
+TFATBuffer *CFATCache::AllocateBuffer (int bSpeculative)
+{
+	TFATBuffer *pBuffer;
+
+	for (pBuffer = m_BufferList.pLast; pBuffer != 0; pBuffer = pBuffer->pPrev)
+	{
+		assert (pBuffer->nMagic == BUFFER_MAGIC);
+
+		if (pBuffer->nSector == BUFFER_NOSECTOR)
+		{
+			return pBuffer;
+		}
+	}
+
+	for (pBuffer = m_BufferList.pLast; pBuffer != 0; pBuffer = pBuffer->pPrev)
+	{
+		assert (pBuffer->nMagic == BUFFER_MAGIC);
+
+		if (   pBuffer->nUseCount == 0
+		    && !(bSpeculative && pBuffer->bDirty))
+		{
+			break;
+		}
+	}
+
+	if (pBuffer == 0)
+	{
+		return 0;
+	}
+
+	if (   pBuffer->bDirty
+	    && !WriteBack (pBuffer))
+	{
+		return 0;
+	}
+
+	pBuffer->nSector = BUFFER_NOSECTOR;
+	assert (pBuffer->nUseCount == 0);
+
+	return pBuffer;
+}
+
+// writes the buffer together with the adjacent dirty sectors in one request
+int CFATCache::WriteBack (TFATBuffer *pBuffer)
+{
+	TFATBuffer *Run[FAT_READ_AHEAD_MAX];
+	unsigned nCount;
+
+	assert (pBuffer->bDirty);
+	assert (pBuffer->nSector != BUFFER_NOSECTOR);
+
+	TFATBuffer *pFirst = pBuffer;
+	for (nCount = 1; nCount < FAT_READ_AHEAD_MAX && pFirst->nSector > 0; nCount++)
+	{
+		TFATBuffer *pPrev = FindBuffer (pFirst->nSector - 1);
+		if (   pPrev == 0
+		    || !pPrev->bDirty)
+		{
+			break;
+		}
+
+		pFirst = pPrev;
+	}
+
+	Run[0] = pFirst;
+	for (nCount = 1; nCount < FAT_READ_AHEAD_MAX; nCount++)
+	{
+		TFATBuffer *pNext = FindBuffer (Run[nCount-1]->nSector + 1);
+		if (   pNext == 0
+		    || !pNext->bDirty)
+		{
+			break;
+		}
+
+		Run[nCount] = pNext;
+	}
+
+	const unsigned char *pData = pFirst->Data;
+	if (nCount > 1)
+	{
+		for (unsigned i = 0; i < nCount; i++)
+		{
+			memcpy (m_pTransferBuffer + i*FAT_SECTOR_SIZE, Run[i]->Data, FAT_SECTOR_SIZE);
+		}
+
+		pData = m_pTransferBuffer;
+	}
+
+	m_DiskLock.Acquire ();
+
+	m_pPartition->Seek ((u64) pFirst->nSector * FAT_SECTOR_SIZE);
+	if (m_pPartition->Write (pData, nCount * FAT_SECTOR_SIZE) != (int) (nCount * FAT_SECTOR_SIZE))
+	{
+		Fault (FAULT_WRITE_ERROR);
+		m_DiskLock.Release ();
+		return 0;
+	}
+
+	m_DiskLock.Release ();
+
+	for (unsigned i = 0; i < nCount; i++)
+	{
+		Run[i]->bDirty = 0;
+	}
+
+	return 1;
+}
+
 void CFATCache::MoveBufferFirst (TFATBuffer *pBuffer)
 {
 	if (m_BufferList.pFirst != pBuffer)
@@ -2,7 +2,7 @@
 // fatfs.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2017  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -273,24 +273,72 @@ unsigned CFATFileSystem::FileRead (unsigned hFile, void *pBuffer, unsigned ulByt
 			return ulBytesRead;
 		}
 	
-		if (pFile->pBuffer == 0)
+		// read whole sectors directly into the caller buffer, if it is aligned
+		unsigned nSectors = (ulBytes < ulBytesLeft ? ulBytes : ulBytesLeft) / FAT_SECTOR_SIZE;
+		if (   pFile->pBuffer == 0
+		    && nSectors > 1
+		    && (pFile->nOffset % FAT_SECTOR_SIZE) == 0
+		    && ((uintptr) pBuffer & 3) == 0)
 		{
-			unsigned nSectorOffset = pFile->nOffset / FAT_SECTOR_SIZE;
-			unsigned nClusterOffset = nSectorOffset % m_FATInfo.GetSectorsPerCluster ();
-			if (nClusterOffset == 0)
+			unsigned nSector = GetReadSector (pFile);
+			if (nSector == 0)
+			{
+				m_FileTableLock.Release ();
+				return FS_ERROR;
+			}
+
+			// up to the end of the cluster or a following contiguous cluster
+			unsigned nSectorsPerCluster = m_FATInfo.GetSectorsPerCluster ();
+			unsigned nRun = nSectorsPerCluster - (pFile->nOffset / FAT_SECTOR_SIZE) % nSectorsPerCluster;
+			while (   nRun < nSectors
+			       && nRun < FAT_MAX_TRANSFER)
 			{
-				if (pFile->nOffset > 0)
+				unsigned nNextCluster = m_FAT.GetClusterEntry (pFile->nCluster);
+				if (nNextCluster != pFile->nCluster + 1)
 				{
-					pFile->nCluster = m_FAT.GetClusterEntry (pFile->nCluster);
-					if (m_FAT.IsEOC (pFile->nCluster))
-					{
-						m_FileTableLock.Release ();
-						return FS_ERROR;
-					}
+					break;
 				}
+
+				pFile->nCluster = nNextCluster;
+				nRun += nSectorsPerCluster;
 			}
 
-			unsigned nSector = m_FATInfo.GetFirstSector (pFile->nCluster) + nClusterOffset;
+			if (nRun > nSectors)
+			{
+				nRun = nSectors;
+			}
+
+			if (nRun > FAT_MAX_TRANSFER)
+			{
+				nRun = FAT_MAX_TRANSFER;
+			}
+
+			if (!m_Cache.ReadSectors (nSector, pBuffer, nRun))
+			{
+				m_FileTableLock.Release ();
+				return FS_ERROR;
+			}
+
+			ulCopyBytes = nRun * FAT_SECTOR_SIZE;
+
+			pBuffer = (void *) (((unsigned char *) pBuffer) + ulCopyBytes);
+
+			pFile->nOffset += ulCopyBytes;
+
+			ulBytes -= ulCopyBytes;
+			ulBytesRead += ulCopyBytes;
+
+			continue;
+		}
+
+		if (pFile->pBuffer == 0)
+		{
+			unsigned nSector = GetReadSector (pFile);
+			if (nSector == 0)
+			{
+				m_FileTableLock.Release ();
+				return FS_ERROR;
+			}
 
 			pFile->pBuffer = m_Cache.GetSector (nSector, 0);
 			assert (pFile->pBuffer != 0);
@@ -373,32 +421,61 @@ unsigned CFATFileSystem::FileWrite (unsigned hFile, const void *pBuffer, unsigne
 			return ulBytesWritten;
 		}
 	
-		if (pFile->pBuffer == 0)
+		// write whole sectors directly from the caller buffer, if it is aligned
+		unsigned nSectors = (ulBytes < ulBytesLeft ? ulBytes : ulBytesLeft) / FAT_SECTOR_SIZE;
+		if (   pFile->pBuffer == 0
+		    && nSectors > 1
+		    && (pFile->nOffset % FAT_SECTOR_SIZE) == 0
+		    && ((uintptr) pBuffer & 3) == 0)
 		{
-			unsigned nSectorOffset = pFile->nOffset / FAT_SECTOR_SIZE;
-			unsigned nClusterOffset = nSectorOffset % m_FATInfo.GetSectorsPerCluster ();
-			if (nClusterOffset == 0)
+			unsigned nSector = GetWriteSector (pFile);
+			if (nSector == 0)
 			{
-				unsigned nNextCluster = m_FAT.AllocateCluster ();
-				if (nNextCluster == 0)
-				{
-					m_FileTableLock.Release ();
-					return FS_ERROR;
-				}
-				
-				if (pFile->nFirstCluster == 0)
-				{
-					pFile->nFirstCluster = nNextCluster;
-				}
-				else
-				{
-					m_FAT.SetClusterEntry (pFile->nCluster, nNextCluster);
-				}
+				m_FileTableLock.Release ();
+				return FS_ERROR;
+			}
 
-				pFile->nCluster = nNextCluster;
+			// up to the end of the cluster
+			unsigned nSectorsPerCluster = m_FATInfo.GetSectorsPerCluster ();
+			unsigned nRun = nSectorsPerCluster - (pFile->nOffset / FAT_SECTOR_SIZE) % nSectorsPerCluster;
+			if (nRun > nSectors)
+			{
+				nRun = nSectors;
+			}
+
+			if (nRun > FAT_MAX_TRANSFER)
+			{
+				nRun = FAT_MAX_TRANSFER;
+			}
+
+			if (!m_Cache.WriteSectors (nSector, pBuffer, nRun))
+			{
+				m_FileTableLock.Release ();
+				return FS_ERROR;
 			}
 
-			unsigned nSector = m_FATInfo.GetFirstSector (pFile->nCluster) + nClusterOffset;
+			ulCopyBytes = nRun * FAT_SECTOR_SIZE;
+
+			pBuffer = (void *) (((unsigned char *) pBuffer) + ulCopyBytes);
+
+			pFile->nOffset += ulCopyBytes;
+			pFile->nSize += ulCopyBytes;
+			assert (pFile->nSize == pFile->nOffset);
+
+			ulBytes -= ulCopyBytes;
+			ulBytesWritten += ulCopyBytes;
+
+			continue;
+		}
+
+		if (pFile->pBuffer == 0)
+		{
+			unsigned nSector = GetWriteSector (pFile);
+			if (nSector == 0)
+			{
+				m_FileTableLock.Release ();
+				return FS_ERROR;
+			}
 
 			pFile->pBuffer = m_Cache.GetSector (nSector, 1);
 			assert (pFile->pBuffer != 0);
@@ -450,6 +527,30 @@ unsigned CFATFileSystem::FileWrite (unsigned hFile, const void *pBuffer, unsigne
 	return ulBytesWritten;
 }
 
+unsigned CFATFileSystem::FileGetSize (unsigned hFile)
+{
+	if (!(   1 <= hFile
+	      && hFile <= FAT_FILES))
+	{
+		return FS_ERROR;
+	}
+
+	m_FileTableLock.Acquire ();
+
+	TFile *pFile = &FILE (hFile);
+	if (!pFile->nUseCount)
+	{
+		m_FileTableLock.Release ();
+		return FS_ERROR;
+	}
+
+	unsigned nSize = pFile->nSize;
+
+	m_FileTableLock.Release ();
+
+	return nSize;
+}
+
 int CFATFileSystem::FileDelete (const char *pTitle)
 {
 	assert (pTitle != 0);
@@ -478,3 +579,53 @@ int CFATFileSystem::FileDelete (const char *pTitle)
 
 	return 1;
 }
+
+unsigned CFATFileSystem::GetReadSector (TFile *pFile)
+{
+	assert (pFile != 0);
+
+	unsigned nSectorOffset = pFile->nOffset / FAT_SECTOR_SIZE;
+	unsigned nClusterOffset = nSectorOffset % m_FATInfo.GetSectorsPerCluster ();
+	if (nClusterOffset == 0)
+	{
+		if (pFile->nOffset > 0)
+		{
+			pFile->nCluster = m_FAT.GetClusterEntry (pFile->nCluster);
+			if (m_FAT.IsEOC (pFile->nCluster))
+			{
+				return 0;
+			}
+		}
+	}
+
+	return m_FATInfo.GetFirstSector (pFile->nCluster) + nClusterOffset;
+}
+
+unsigned CFATFileSystem::GetWriteSector (TFile *pFile)
+{
+	assert (pFile != 0);
+
+	unsigned nSectorOffset = pFile->nOffset / FAT_SECTOR_SIZE;
+	unsigned nClusterOffset = nSectorOffset % m_FATInfo.GetSectorsPerCluster ();
+	if (nClusterOffset == 0)
+	{
+		unsigned nNextCluster = m_FAT.AllocateCluster ();
+		if (nNextCluster == 0)
+		{
+			return 0;
+		}
+
+		if (pFile->nFirstCluster == 0)
+		{
+			pFile->nFirstCluster = nNextCluster;
+		}
+		else
+		{
+			m_FAT.SetClusterEntry (pFile->nCluster, nNextCluster);
+		}
+
+		pFile->nCluster = nNextCluster;
+	}
+
+	return m_FATInfo.GetFirstSector (pFile->nCluster) + nClusterOffset;
+}
@@ -19,9 +19,19 @@
 //
 #include <circle/heapallocator.h>
 #include <circle/logger.h>
+#include <circle/synchronize.h>
 #include <circle/util.h>
 #include <assert.h>
 
+#if defined (HEAP_SLAB_ALLOCATOR) && defined (ARM_ALLOW_MULTI_CORE)
+	#include <circle/multicore.h>
+	#define THIS_CORE()	CMultiCoreSupport::ThisCore ()
+#else
+	#define THIS_CORE()	0
+#endif
+
+#ifndef HEAP_SLAB_ALLOCATOR
+
 u32 CHeapAllocator::s_nBucketSize[] = { HEAP_BLOCK_BUCKET_SIZES };
 
 CHeapAllocator::CHeapAllocator (const char *pHeapName)
@@ -44,6 +54,8 @@ CHeapAllocator::CHeapAllocator (const char *pHeapName)
 	}
 }
 
+#endif
+
 CHeapAllocator::~CHeapAllocator (void)
 {
 }
@@ -60,6 +72,8 @@ size_t CHeapAllocator::GetFreeSpace (void) const
 	return m_pLimit - m_pNext;
 }
 
+#ifndef HEAP_SLAB_ALLOCATOR
+
 void *CHeapAllocator::Allocate (size_t nSize)
 {
 	if (m_pNext == 0)
@@ -104,26 +118,9 @@ void *CHeapAllocator::Allocate (size_t nSize)
 		if (   pNextBlock <= m_pNext			// may have wrapped
 		    || pNextBlock > m_pLimit-m_nReserve)
 		{
-			if (m_nReserve == 0)
-			{
-				m_SpinLock.Release ();
-
-				return 0;
-			}
-
-			m_nReserve = 0;
-
 			m_SpinLock.Release ();
 
-#ifdef HEAP_DEBUG
-			DumpStatus ();
-#endif
-#if STDLIB_SUPPORT == 3
-			// C++ exception should be thrown after returning 0
-			CLogger::Get ()->WriteNoAlloc (m_pHeapName, LogWarning, "Out of memory");
-#else
-			CLogger::Get ()->Write (m_pHeapName, LogPanic, "Out of memory");
-#endif
+			OutOfMemory ();
 
 			return 0;
 		}
@@ -144,6 +141,8 @@ void *CHeapAllocator::Allocate (size_t nSize)
 	return pResult;
 }
 
+#endif
+
 void *CHeapAllocator::ReAllocate (void *pBlock, size_t nSize)
 {
 	if (pBlock == 0)
@@ -179,6 +178,8 @@ void *CHeapAllocator::ReAllocate (void *pBlock, size_t nSize)
 	return pNewBlock;
 }
 
+#ifndef HEAP_SLAB_ALLOCATOR
+
 void CHeapAllocator::Free (void *pBlock)
 {
 	if (pBlock == 0)
@@ -227,3 +228,423 @@ void CHeapAllocator::DumpStatus (void)
 }
 
 #endif
+
+#else	// #ifndef HEAP_SLAB_ALLOCATOR
+
+CHeapAllocator::CHeapAllocator (const char *pHeapName)
+:	m_pHeapName (pHeapName),
+	m_pNext (0),
+	m_pLimit (0),
+	m_nReserve (0),
+	m_pLargeFreeList (0)
+#ifdef HEAP_DEBUG
+	, m_nLargeCount (0),
+	m_nLargeMaxCount (0)
+#endif
+{
+	for (unsigned i = 0; i < HEAP_SLAB_CLASSES; i++)
+	{
+		THeapSizeClass *pClass = &m_SizeClass[i];
+
+		pClass->nSize = GetClassSize (i);
+		pClass->pFreeList = 0;
+		pClass->pSlabNext = 0;
+		pClass->pSlabLimit = 0;
+#ifdef HEAP_DEBUG
+		pClass->nCount = 0;
+		pClass->nMaxCount = 0;
+#endif
+	}
+
+	memset (m_Magazine, 0, sizeof m_Magazine);
+}
+
+void *CHeapAllocator::Allocate (size_t nSize)
+{
+	if (m_pNext == 0)
+	{
+		return 0;
+	}
+
+	if (nSize > HEAP_SLAB_MAX_SIZE)
+	{
+		void *pResult = AllocateLarge (nSize);
+		if (pResult == 0)
+		{
+			OutOfMemory ();
+		}
+
+		return pResult;
+	}
+
+	unsigned nClass = GetSizeClass (nSize);
+	assert (nClass < HEAP_SLAB_CLASSES);
+
+	// the magazine is used by this core only, disabling IRQs is sufficient
+	EnterCritical ();
+
+	THeapMagazine *pMagazine = &m_Magazine[THIS_CORE ()][nClass];
+	if (pMagazine->nCount == 0)
+	{
+		RefillMagazine (nClass, pMagazine);
+
+		if (pMagazine->nCount == 0)
+		{
+			LeaveCritical ();
+
+			OutOfMemory ();
+
+			return 0;
+		}
+	}
+
+	THeapBlockHeader *pBlockHeader = pMagazine->pBlock[--pMagazine->nCount];
+
+	LeaveCritical ();
+
+	assert (pBlockHeader->nMagic == HEAP_BLOCK_MAGIC);
+	assert (pBlockHeader->nSize == m_SizeClass[nClass].nSize);
+	pBlockHeader->pNext = 0;
+
+#ifdef HEAP_DEBUG
+	THeapSizeClass *pClass = &m_SizeClass[nClass];
+	pClass->SpinLock.Acquire ();
+
+	if (++pClass->nCount > pClass->nMaxCount)
+	{
+		pClass->nMaxCount = pClass->nCount;
+	}
+
+	pClass->SpinLock.Release ();
+#endif
+
+	void *pResult = pBlockHeader->Data;
+	assert (((uintptr) pResult & HEAP_ALIGN_MASK) == 0);
+
+	return pResult;
+}
+
+void CHeapAllocator::Free (void *pBlock)
+{
+	if (pBlock == 0)
+	{
+		return;
+	}
+
+	THeapBlockHeader *pBlockHeader =
+		(THeapBlockHeader *) ((uintptr) pBlock - sizeof (THeapBlockHeader));
+	assert (pBlockHeader->nMagic == HEAP_BLOCK_MAGIC);
+
+	if (pBlockHeader->nSize > HEAP_SLAB_MAX_SIZE)
+	{
+		FreeLarge (pBlockHeader);
+
+		return;
+	}
+
+	unsigned nClass = GetSizeClass (pBlockHeader->nSize);
+	assert (nClass < HEAP_SLAB_CLASSES);
+	assert (pBlockHeader->nSize == m_SizeClass[nClass].nSize);
+
+#ifdef HEAP_DEBUG
+	THeapSizeClass *pClass = &m_SizeClass[nClass];
+	pClass->SpinLock.Acquire ();
+	pClass->nCount--;
+	pClass->SpinLock.Release ();
+#endif
+
+	EnterCritical ();
+
+	THeapMagazine *pMagazine = &m_Magazine[THIS_CORE ()][nClass];
+	if (pMagazine->nCount == HEAP_MAGAZINE_SIZE)
+	{
+		FlushMagazine (nClass, pMagazine);
+	}
+
+	assert (pMagazine->nCount < HEAP_MAGAZINE_SIZE);
+	pMagazine->pBlock[pMagazine->nCount++] = pBlockHeader;
+
+	LeaveCritical ();
+}
+
+#ifdef HEAP_DEBUG
+
+void CHeapAllocator::DumpStatus (void)
+{
+	for (unsigned i = 0; i < HEAP_SLAB_CLASSES; i++)
+	{
+		THeapSizeClass *pClass = &m_SizeClass[i];
+		if (pClass->nMaxCount == 0)
+		{
+			continue;
+		}
+
+		CLogger::Get ()->Write (m_pHeapName, LogDebug, "malloc(%u): %u blocks (max %u)",
+					pClass->nSize, pClass->nCount, pClass->nMaxCount);
+	}
+
+	m_SpinLock.Acquire ();
+
+	size_t nLargeFree = 0;
+	for (THeapBlockHeader *pBlock = m_pLargeFreeList; pBlock != 0; pBlock = pBlock->pNext)
+	{
+		nLargeFree += pBlock->nSize;
+	}
+
+	m_SpinLock.Release ();
+
+	CLogger::Get ()->Write (m_pHeapName, LogDebug,
+				"malloc(>%u): %u blocks (max %u), %lu bytes free",
+				HEAP_SLAB_MAX_SIZE, m_nLargeCount, m_nLargeMaxCount,
+				(unsigned long) nLargeFree);
+}
+
+#endif
+
+// called with IRQs disabled
+void CHeapAllocator::RefillMagazine (unsigned nClass, THeapMagazine *pMagazine)
+{
+	THeapSizeClass *pClass = &m_SizeClass[nClass];
+	size_t nStride = sizeof (THeapBlockHeader) + pClass->nSize;
+
+	pClass->SpinLock.Acquire ();
+
+	while (pMagazine->nCount < HEAP_MAGAZINE_SIZE / 2)
+	{
+		THeapBlockHeader *pBlockHeader = pClass->pFreeList;
+		if (pBlockHeader != 0)
+		{
+			assert (pBlockHeader->nMagic == HEAP_BLOCK_MAGIC);
+			pClass->pFreeList = pBlockHeader->pNext;
+		}
+		else
+		{
+			if (   pClass->pSlabNext == 0
+			    || pClass->pSlabNext + nStride > pClass->pSlabLimit)
+			{
+				// the remaining space of the previous slab is too small and is lost
+				u8 *pSlab = (u8 *) AllocateLarge (HEAP_SLAB_SIZE);
+				if (pSlab == 0)
+				{
+					break;
+				}
+
+				pClass->pSlabNext = pSlab;
+				pClass->pSlabLimit = pSlab + HEAP_SLAB_SIZE;
+			}
+
+			pBlockHeader = (THeapBlockHeader *) pClass->pSlabNext;
+			pClass->pSlabNext += nStride;
+
+			pBlockHeader->nMagic = HEAP_BLOCK_MAGIC;
+			pBlockHeader->nSize = pClass->nSize;
+		}
+
+		pMagazine->pBlock[pMagazine->nCount++] = pBlockHeader;
+	}
+
+	pClass->SpinLock.Release ();
+}
+
+// called with IRQs disabled
+void CHeapAllocator::FlushMagazine (unsigned nClass, THeapMagazine *pMagazine)
+{
+	THeapSizeClass *pClass = &m_SizeClass[nClass];
+
+	pClass->SpinLock.Acquire ();
+
+	while (pMagazine->nCount > HEAP_MAGAZINE_SIZE / 2)
+	{
+		THeapBlockHeader *pBlockHeader = pMagazine->pBlock[--pMagazine->nCount];
+
+		pBlockHeader->pNext = pClass->pFreeList;
+		pClass->pFreeList = pBlockHeader;
+	}
+
+	pClass->SpinLock.Release ();
+}
+
+void *CHeapAllocator::AllocateLarge (size_t nSize)
+{
+	nSize = (nSize + HEAP_BLOCK_ALIGN-1) & ~HEAP_ALIGN_MASK;
+	if (nSize > 0xFFFFFFFFU - HEAP_BLOCK_ALIGN)
+	{
+		return 0;
+	}
+
+	m_SpinLock.Acquire ();
+
+	// first fit from the free list
+	THeapBlockHeader *pBlockHeader = 0;
+	THeapBlockHeader *pPrev = 0;
+	for (THeapBlockHeader *pBlock = m_pLargeFreeList; pBlock != 0; pPrev = pBlock, pBlock = pBlock->pNext)
+	{
+		assert (pBlock->nMagic == HEAP_BLOCK_FREE_MAGIC);
+		if (pBlock->nSize < nSize)
+		{
+			continue;
+		}
+
+		if (pBlock->nSize >= nSize + sizeof (THeapBlockHeader) + HEAP_LARGE_MIN_SPLIT)
+		{
+			THeapBlockHeader *pRest = (THeapBlockHeader *) (pBlock->Data + nSize);
+			pRest->nMagic = HEAP_BLOCK_FREE_MAGIC;
+			pRest->nSize = pBlock->nSize - nSize - sizeof (THeapBlockHeader);
+			pRest->pNext = pBlock->pNext;
+
+			pBlock->pNext = pRest;
+			pBlock->nSize = (u32) nSize;
+		}
+
+		if (pPrev != 0)
+		{
+			pPrev->pNext = pBlock->pNext;
+		}
+		else
+		{
+			m_pLargeFreeList = pBlock->pNext;
+		}
+
+		pBlockHeader = pBlock;
+
+		break;
+	}
+
+	if (pBlockHeader == 0)
+	{
+		u8 *pNextBlock = m_pNext + sizeof (THeapBlockHeader) + nSize;
+
+		if (   pNextBlock <= m_pNext			// may have wrapped
+		    || pNextBlock > m_pLimit-m_nReserve)
+		{
+			m_SpinLock.Release ();
+
+			return 0;
+		}
+
+		pBlockHeader = (THeapBlockHeader *) m_pNext;
+		pBlockHeader->nSize = (u32) nSize;
+
+		m_pNext = pNextBlock;
+	}
+
+	pBlockHeader->nMagic = HEAP_BLOCK_MAGIC;
+	pBlockHeader->pNext = 0;
+
+#ifdef HEAP_DEBUG
+	if (++m_nLargeCount > m_nLargeMaxCount)
+	{
+		m_nLargeMaxCount = m_nLargeCount;
+	}
+#endif
+
+	m_SpinLock.Release ();
+
+	void *pResult = pBlockHeader->Data;
+	assert (((uintptr) pResult & HEAP_ALIGN_MASK) == 0);
+
+	return pResult;
+}
+
+void CHeapAllocator::FreeLarge (THeapBlockHeader *pBlockHeader)
+{
+	m_SpinLock.Acquire ();
+
+	pBlockHeader->nMagic = HEAP_BLOCK_FREE_MAGIC;
+
+#ifdef HEAP_DEBUG
+	m_nLargeCount--;
+#endif
+
+	THeapBlockHeader *pPrev = 0;
+	THeapBlockHeader *pNext = m_pLargeFreeList;
+	while (   pNext != 0
+	       && pNext < pBlockHeader)
+	{
+		pPrev = pNext;
+		pNext = pNext->pNext;
+	}
+
+	// coalesce with the following free block
+	if (   pNext != 0
+	    && pBlockHeader->Data + pBlockHeader->nSize == (u8 *) pNext)
+	{
+		pBlockHeader->nSize += sizeof (THeapBlockHeader) + pNext->nSize;
+		pNext = pNext->pNext;
+	}
+
+	pBlockHeader->pNext = pNext;
+
+	// coalesce with the preceding free block
+	if (   pPrev != 0
+	    && pPrev->Data + pPrev->nSize == (u8 *) pBlockHeader)
+	{
+		pPrev->nSize += sizeof (THeapBlockHeader) + pBlockHeader->nSize;
+		pPrev->pNext = pNext;
+	}
+	else if (pPrev != 0)
+	{
+		pPrev->pNext = pBlockHeader;
+	}
+	else
+	{
+		m_pLargeFreeList = pBlockHeader;
+	}
+
+	m_SpinLock.Release ();
+}
+
+// classes 0..7: 16..128 bytes in steps of 16 bytes
+// classes 8..27: 4 classes per power of two from 160 to 4096 bytes
+unsigned CHeapAllocator::GetSizeClass (size_t nSize)
+{
+	if (nSize <= 128)
+	{
+		return nSize > 0 ? (nSize-1) >> 4 : 0;
+	}
+
+	nSize--;
+	unsigned nLog2 = 31 - __builtin_clz ((u32) nSize);		// 7..11
+
+	return 8 + (nLog2-7)*4 + ((nSize >> (nLog2-2)) & 3);
+}
+
+u32 CHeapAllocator::GetClassSize (unsigned nClass)
+{
+	if (nClass < 8)
+	{
+		return (nClass+1) * 16;
+	}
+
+	unsigned nLog2 = 7 + (nClass-8) / 4;
+
+	return (1U << nLog2) + (((nClass-8) % 4 + 1) << (nLog2-2));
+}
+
+#endif
+
+void CHeapAllocator::OutOfMemory (void)
+{
+	m_SpinLock.Acquire ();
+
+	if (m_nReserve == 0)
+	{
+		m_SpinLock.Release ();
+
+		return;
+	}
+
+	m_nReserve = 0;
+
+	m_SpinLock.Release ();
+
+#ifdef HEAP_DEBUG
+	DumpStatus ();
+#endif
+#if STDLIB_SUPPORT == 3
+	// C++ exception should be thrown after returning 0
+	CLogger::Get ()->WriteNoAlloc (m_pHeapName, LogWarning, "Out of memory");
+#else
+	CLogger::Get ()->Write (m_pHeapName, LogPanic, "Out of memory");
+#endif
+}
@@ -123,27 +123,39 @@
 
 CI2SSoundBaseDevice::CI2SSoundBaseDevice (CInterruptSystem *pInterrupt,
 					  unsigned	    nSampleRate,
-					  unsigned	    nChunkSize)
+					  unsigned	    nChunkSize,
+					  unsigned	    nPeriods)
 :	CSoundBaseDevice (SoundFormatSigned24, 0, nSampleRate),
 	m_pInterruptSystem (pInterrupt),
 	m_nChunkSize (nChunkSize),
+	m_nPeriods (nPeriods),
+	m_nPeriodUsecs ((unsigned) ((u64) (nChunkSize / 2) * 1000000 / nSampleRate)),
 	m_PCMCLKPin (18, GPIOModeAlternateFunction0),
 	m_PCMFSPin (19, GPIOModeAlternateFunction0),
 	m_PCMDOUTPin (21, GPIOModeAlternateFunction0),
 	m_Clock (GPIOClockPCM, GPIOClockSourcePLLD),
 	m_bIRQConnected (FALSE),
 	m_State (I2SSoundIdle),
-	m_nDMAChannel (CMachineInfo::Get ()->AllocateDMAChannel (DMA_CHANNEL_LITE))
+	m_nDMAChannel (CMachineInfo::Get ()->AllocateDMAChannel (DMA_CHANNEL_LITE)),
+	m_nPlayPeriod (0),
+	m_nPeriodsPlayed (0),
+	m_nPeriodStartTicks (0),
+	m_bZeroCopy (FALSE),
+	m_nPeriodsQueued (0),
+	m_nReservedPeriod (0),
+	m_bPeriodReserved (FALSE),
+	m_nUnderruns (0)
 {
 	assert (m_pInterruptSystem != 0);
 	assert (m_nChunkSize >= 32);
 	assert ((m_nChunkSize & 1) == 0);
+	assert (2 <= m_nPeriods && m_nPeriods <= SOUND_MAX_PERIODS);
 
-	// setup and concatenate DMA buffers and control blocks
-	SetupDMAControlBlock (0);
-	SetupDMAControlBlock (1);
-	m_pControlBlock[0]->nNextControlBlockAddress = BUS_ADDRESS ((uintptr) m_pControlBlock[1]);
-	m_pControlBlock[1]->nNextControlBlockAddress = BUS_ADDRESS ((uintptr) m_pControlBlock[0]);
+	// setup DMA buffers and control blocks, they are concatenated in Start()
+	for (unsigned i = 0; i < m_nPeriods; i++)
+	{
+		SetupDMAControlBlock (i);
+	}
 
 	// start clock and I2S device
 	unsigned nClockFreq = CMachineInfo::Get ()->GetGPIOClockSourceRate (GPIOClockSourcePLLD);
@@ -219,17 +231,15 @@ CI2SSoundBaseDevice::~CI2SSoundBaseDevice (void)
 	CMachineInfo::Get ()->FreeDMAChannel (m_nDMAChannel);
 
 	// free buffers
-	m_pControlBlock[0] = 0;
-	m_pControlBlock[1] = 0;
-	delete [] m_pControlBlockBuffer[0];
-	m_pControlBlockBuffer[0] = 0;
-	delete [] m_pControlBlockBuffer[1];
-	m_pControlBlockBuffer[1] = 0;
-
-	delete [] m_pDMABuffer[0];
-	m_pDMABuffer[0] = 0;
-	delete [] m_pDMABuffer[1];
-	m_pDMABuffer[1] = 0;
+	for (unsigned i = 0; i < m_nPeriods; i++)
+	{
+		m_pControlBlock[i] = 0;
+		delete [] m_pControlBlockBuffer[i];
+		m_pControlBlockBuffer[i] = 0;
+
+		delete [] m_pDMABuffer[i];
+		m_pDMABuffer[i] = 0;
+	}
 }
 
 int CI2SSoundBaseDevice::GetRangeMin (void) const
@@ -246,12 +256,44 @@ boolean CI2SSoundBaseDevice::Start (void)
 {
 	assert (m_State == I2SSoundIdle);
 
-	// fill buffer 0
-	m_nNextBuffer = 0;
+	LinkControlBlocks ();
+
+	m_nPlayPeriod = 0;
+	m_nPeriodsPlayed = 0;
+
+	// fill all buffers before the DMA starts
+	boolean bTerminate = FALSE;
+	if (!m_bZeroCopy)
+	{
+		m_nNextBuffer = 0;
+
+		if (!GetNextChunk (TRUE))
+		{
+			return FALSE;
+		}
+
+		for (unsigned i = 1; i < m_nPeriods; i++)
+		{
+			if (!GetNextChunk ())
+			{
+				m_nLastPeriod = i-1;
+				bTerminate = TRUE;
 
-	if (!GetNextChunk (TRUE))
+				break;
+			}
+		}
+	}
+	else
 	{
-		return FALSE;
+		// the first two periods must be valid
+		m_SpinLock.Acquire ();
+
+		while (m_nPeriodsQueued < 2)
+		{
+			FillSilence (m_nPeriodsQueued++ % m_nPeriods);
+		}
+
+		m_SpinLock.Release ();
 	}
 
 	m_State = I2SSoundRunning;
@@ -280,6 +322,15 @@ boolean CI2SSoundBaseDevice::Start (void)
 
 	PeripheralExit ();
 
+	if (bTerminate)
+	{
+		m_SpinLock.Acquire ();
+
+		TerminateAfter (m_nLastPeriod, FALSE);
+
+		m_SpinLock.Release ();
+	}
+
 	// start DMA
 	PeripheralEntry ();
 
@@ -289,6 +340,8 @@ boolean CI2SSoundBaseDevice::Start (void)
 	assert (m_pControlBlock[0] != 0);
 	write32 (ARM_DMACHAN_CONBLK_AD (m_nDMAChannel), BUS_ADDRESS ((uintptr) m_pControlBlock[0]));
 
+	m_nPeriodStartTicks = CTimer::GetClockTicks ();
+
 	write32 (ARM_DMACHAN_CS (m_nDMAChannel),   CS_WAIT_FOR_OUTSTANDING_WRITES
 					         | (DEFAULT_PANIC_PRIORITY << CS_PANIC_PRIORITY_SHIFT)
 					         | (DEFAULT_PRIORITY << CS_PRIORITY_SHIFT)
@@ -296,41 +349,110 @@ boolean CI2SSoundBaseDevice::Start (void)
 
 	PeripheralExit ();
 
-	// fill buffer 1
-	if (!GetNextChunk ())
+	return TRUE;
+}
+
+void CI2SSoundBaseDevice::Cancel (void)
+{
+	m_SpinLock.Acquire ();
+
+	if (m_State == I2SSoundRunning)
 	{
-		m_SpinLock.Acquire ();
+		m_State = I2SSoundCancelled;
+	}
 
-		if (m_State == I2SSoundRunning)
-		{
-			PeripheralEntry ();
-			write32 (ARM_DMACHAN_NEXTCONBK (m_nDMAChannel), 0);
-			PeripheralExit ();
+	m_SpinLock.Release ();
+}
 
-			m_State = I2SSoundTerminating;
-		}
+boolean CI2SSoundBaseDevice::IsActive (void) const
+{
+	return m_State != I2SSoundIdle ? TRUE : FALSE;
+}
 
+void CI2SSoundBaseDevice::EnableZeroCopy (void)
+{
+	assert (m_State == I2SSoundIdle);
+	assert (m_nPeriods >= 3);
+
+	for (unsigned i = 0; i < m_nPeriods; i++)
+	{
+		assert (m_pControlBlock[i] != 0);
+		m_pControlBlock[i]->nTransferLength = m_nChunkSize * sizeof (u32);
+	}
+
+	m_bZeroCopy = TRUE;
+}
+
+u32 *CI2SSoundBaseDevice::GetPeriodBuffer (unsigned *pPlayTime)
+{
+	assert (m_bZeroCopy);
+
+	m_SpinLock.Acquire ();
+
+	// the period, which has been played last, may be re-used
+	unsigned nAhead = m_nPeriodsQueued - m_nPeriodsPlayed;
+	if (nAhead >= m_nPeriods)
+	{
 		m_SpinLock.Release ();
+
+		return 0;
 	}
 
-	return TRUE;
+	m_nReservedPeriod = m_nPeriodsQueued;
+	m_bPeriodReserved = TRUE;
+
+	if (pPlayTime != 0)
+	{
+		*pPlayTime = m_State != I2SSoundIdle ? m_nPeriodStartTicks + nAhead * m_nPeriodUsecs : 0;
+	}
+
+	u32 *pBuffer = m_pDMABuffer[m_nReservedPeriod % m_nPeriods];
+
+	m_SpinLock.Release ();
+
+	return pBuffer;
 }
 
-void CI2SSoundBaseDevice::Cancel (void)
+void CI2SSoundBaseDevice::QueuePeriod (void)
 {
+	assert (m_bZeroCopy);
+	assert (m_bPeriodReserved);
+
+	u32 *pBuffer = m_pDMABuffer[m_nReservedPeriod % m_nPeriods];
+	CleanAndInvalidateDataCacheRange ((uintptr) pBuffer, m_nChunkSize * sizeof (u32));
+
 	m_SpinLock.Acquire ();
 
-	if (m_State == I2SSoundRunning)
+	m_bPeriodReserved = FALSE;
+
+	// the period has not been replaced by silence in the meantime?
+	if (m_nReservedPeriod == m_nPeriodsQueued)
 	{
-		m_State = I2SSoundCancelled;
+		m_nPeriodsQueued++;
 	}
 
 	m_SpinLock.Release ();
 }
 
-boolean CI2SSoundBaseDevice::IsActive (void) const
+unsigned CI2SSoundBaseDevice::GetPeriodTimestamp (unsigned *pPeriod)
 {
-	return m_State != I2SSoundIdle ? TRUE : FALSE;
+	m_SpinLock.Acquire ();
+
+	if (pPeriod != 0)
+	{
+		*pPeriod = m_nPeriodsPlayed;
+	}
+
+	unsigned nTicks = m_nPeriodStartTicks;
+
+	m_SpinLock.Release ();
+
+	return nTicks;
+}
+
+unsigned CI2SSoundBaseDevice::GetUnderrunCount (void) const
+{
+	return m_nUnderruns;
 }
 
 boolean CI2SSoundBaseDevice::GetNextChunk (boolean bFirstCall)
@@ -361,7 +483,10 @@ boolean CI2SSoundBaseDevice::GetNextChunk (boolean bFirstCall)
 	CleanAndInvalidateDataCacheRange ((uintptr) m_pDMABuffer[m_nNextBuffer], nTransferLength);
 	CleanAndInvalidateDataCacheRange ((uintptr) m_pControlBlock[m_nNextBuffer], sizeof (TDMAControlBlock));
 
-	m_nNextBuffer ^= 1;
+	if (++m_nNextBuffer == m_nPeriods)
+	{
+		m_nNextBuffer = 0;
+	}
 
 	return TRUE;
 }
@@ -448,25 +573,62 @@ void CI2SSoundBaseDevice::InterruptHandler (void)
 
 	m_SpinLock.Acquire ();
 
+	// the DMA has completed a period and continues with the next one
+	unsigned nCompleted = m_nPlayPeriod;
+	if (++m_nPlayPeriod == m_nPeriods)
+	{
+		m_nPlayPeriod = 0;
+	}
+
+	m_nPeriodsPlayed++;
+	m_nPeriodStartTicks = CTimer::GetClockTicks ();
+
 	switch (m_State)
 	{
 	case I2SSoundRunning:
-		if (GetNextChunk ())
+		if (m_bZeroCopy)
 		{
-			break;
+			// the next period must be valid, before the DMA loads it
+			if (m_nPeriodsQueued - m_nPeriodsPlayed < 2)
+			{
+				FillSilence (m_nPeriodsQueued++ % m_nPeriods);
+
+				m_nUnderruns++;
+			}
 		}
-		// fall through
+		else
+		{
+			assert (m_nNextBuffer == nCompleted);
 
-	case I2SSoundCancelled:
-		PeripheralEntry ();
-		write32 (ARM_DMACHAN_NEXTCONBK (m_nDMAChannel), 0);
-		PeripheralExit ();
+			if (GetNextChunk ())
+			{
+				break;
+			}
 
-		m_State = I2SSoundTerminating;
+			// the buffer before the completed one is the last valid one
+			TerminateAfter ((nCompleted + m_nPeriods-1) % m_nPeriods, TRUE);
+		}
+		break;
+
+	case I2SSoundCancelled:
+		TerminateAfter (m_nPlayPeriod, TRUE);
 		break;
 
 	case I2SSoundTerminating:
-		m_State = I2SSoundIdle;
+		if (nCompleted == m_nLastPeriod)
+		{
+			m_State = I2SSoundIdle;
+
+			m_nPeriodsQueued = 0;
+			m_nPeriodsPlayed = 0;
+		}
+		else if (m_nPlayPeriod == m_nLastPeriod)
+		{
+			// the control block may have been loaded before it was modified
+			PeripheralEntry ();
+			write32 (ARM_DMACHAN_NEXTCONBK (m_nDMAChannel), 0);
+			PeripheralExit ();
+		}
 		break;
 
 	default:
@@ -487,7 +649,7 @@ void CI2SSoundBaseDevice::InterruptStub (void *pParam)
 
 void CI2SSoundBaseDevice::SetupDMAControlBlock (unsigned nID)
 {
-	assert (nID <= 1);
+	assert (nID < m_nPeriods);
 
 	m_pDMABuffer[nID] = new (HEAP_DMA30) u32[m_nChunkSize];
 	assert (m_pDMABuffer[nID] != 0);
@@ -509,3 +671,50 @@ void CI2SSoundBaseDevice::SetupDMAControlBlock (unsigned nID)
 	m_pControlBlock[nID]->nReserved[0]	       = 0;
 	m_pControlBlock[nID]->nReserved[1]	       = 0;
 }
+
+void CI2SSoundBaseDevice::LinkControlBlocks (void)
+{
+	for (unsigned i = 0; i < m_nPeriods; i++)
+	{
+		unsigned nNext = i+1 < m_nPeriods ? i+1 : 0;
+
+		assert (m_pControlBlock[i] != 0);
+		m_pControlBlock[i]->nNextControlBlockAddress =
+			BUS_ADDRESS ((uintptr) m_pControlBlock[nNext]);
+
+		CleanAndInvalidateDataCacheRange ((uintptr) m_pControlBlock[i], sizeof (TDMAControlBlock));
+	}
+}
+
+void CI2SSoundBaseDevice::FillSilence (unsigned nPeriod)
+{
+	assert (nPeriod < m_nPeriods);
+	u32 *pBuffer = m_pDMABuffer[nPeriod];
+	assert (pBuffer != 0);
+
+	memset (pBuffer, 0, m_nChunkSize * sizeof (u32));
+
+	CleanAndInvalidateDataCacheRange ((uintptr) pBuffer, m_nChunkSize * sizeof (u32));
+}
+
+void CI2SSoundBaseDevice::TerminateAfter (unsigned nLastPeriod, boolean bDMAActive)
+{
+	assert (nLastPeriod < m_nPeriods);
+	assert (m_pControlBlock[nLastPeriod] != 0);
+
+	m_pControlBlock[nLastPeriod]->nNextControlBlockAddress = 0;
+	CleanAndInvalidateDataCacheRange ((uintptr) m_pControlBlock[nLastPeriod],
+					  sizeof (TDMAControlBlock));
+
+	if (   bDMAActive
+	    && nLastPeriod == m_nPlayPeriod)
+	{
+		// the control block has already been loaded
+		PeripheralEntry ();
+		write32 (ARM_DMACHAN_NEXTCONBK (m_nDMAChannel), 0);
+		PeripheralExit ();
+	}
+
+	m_nLastPeriod = nLastPeriod;
+	m_State = I2SSoundTerminating;
+}
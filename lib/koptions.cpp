@@ -34,7 +34,8 @@ CKernelOptions::CKernelOptions (void)
 	m_bUSBFullSpeed (FALSE),
 	m_nSoundOption (0),
 	m_CPUSpeed (CPUSpeedLow),
-	m_nSoCMaxTemp (60)
+	m_nSoCMaxTemp (60),
+	m_nAppOptions (0)
 {
 	strcpy (m_LogDevice, "tty1");
 	strcpy (m_KeyMap, DEFAULT_KEYMAP);
@@ -144,6 +145,13 @@ CKernelOptions::CKernelOptions (void)
 				m_nSoCMaxTemp = nValue;
 			}
 		}
+		else if (   pValue != 0
+			 && m_nAppOptions < MAX_APP_OPTIONS)
+		{
+			m_AppOption[m_nAppOptions].pOption = pOption;
+			m_AppOption[m_nAppOptions].pValue = pValue;
+			m_nAppOptions++;
+		}
 	}
 }
 
@@ -207,6 +215,19 @@ unsigned CKernelOptions::GetSoCMaxTemp (void) const
 	return m_nSoCMaxTemp;
 }
 
+const char *CKernelOptions::GetAppOptionString (const char *pOption, const char *pDefault) const
+{
+	for (unsigned i = 0; i < m_nAppOptions; i++)
+	{
+		if (strcmp (m_AppOption[i].pOption, pOption) == 0)
+		{
+			return m_AppOption[i].pValue;
+		}
+	}
+
+	return pDefault;
+}
+
 CKernelOptions *CKernelOptions::Get (void)
 {
 	return s_pThis;
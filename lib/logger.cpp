@@ -27,6 +27,7 @@
 #include <circle/machineinfo.h>
 #include <circle/version.h>
 #include <circle/debug.h>
+#include <assert.h>
 
 #define LOGGER_BUFSIZE	0x4000
 
@@ -40,6 +41,12 @@ struct TLogEvent
 	int		nTimeZone;			// minutes diff to UTC
 };
 
+struct TLogRecord
+{
+	volatile unsigned nSequence;	// == index+1: filled, == index: free (for this round)
+	TLogEvent	Event;
+};
+
 CLogger *CLogger::s_pThis = 0;
 
 CLogger::CLogger (unsigned nLogLevel, CTimer *pTimer)
@@ -51,6 +58,12 @@ CLogger::CLogger (unsigned nLogLevel, CTimer *pTimer)
 	m_nOutPtr (0),
 	m_nEventInPtr (0),
 	m_nEventOutPtr (0),
+	m_pRecords (0),
+	m_nRecordInPtr (0),
+	m_nRecordOutPtr (0),
+	m_bUpdating (FALSE),
+	m_nOverflowCount (0),
+	m_nOverflowReported (0),
 	m_pEventNotificationHandler (0),
 	m_pPanicHandler (0)
 {
@@ -73,6 +86,9 @@ CLogger::~CLogger (void)
 		}
 	}
 
+	delete [] m_pRecords;
+	m_pRecords = 0;
+
 	delete [] m_pBuffer;
 	m_pBuffer = 0;
 
@@ -113,45 +129,25 @@ void CLogger::WriteV (const char *pSource, TLogSeverity Severity, const char *pM
 	CString Message;
 	Message.FormatV (pMessage, Args);
 
-	WriteEvent (pSource, Severity, Message);
-
-	if (Severity > m_nLogLevel)
-	{
-		return;
-	}
-
-	CString Buffer;
-
 	if (Severity == LogPanic)
 	{
-		Buffer = "\x1b[1m";
+		// write pending messages first
+		Update ();
 	}
-
-	if (m_pTimer != 0)
+	else if (m_pRecords != 0)
 	{
-		CString *pTimeString = m_pTimer->GetTimeString ();
-		if (pTimeString != 0)
-		{
-			Buffer.Append (*pTimeString);
-			Buffer.Append (" ");
+		QueueRecord (pSource, Severity, Message);
 
-			delete pTimeString;
-		}
+		return;
 	}
 
-	Buffer.Append (pSource);
-	Buffer.Append (": ");
-
-	Buffer.Append (Message);
-
-	if (Severity == LogPanic)
-	{
-		Buffer.Append ("\x1b[0m");
-	}
+	TLogEvent Event;
+	SetupEvent (&Event, pSource, Severity, Message);
 
-	Buffer.Append ("\n");
+	WriteEvent (&Event);
 
-	Write (Buffer);
+	// the event is truncated to the record size, the direct output is not
+	WriteOutput (Severity, pSource, Message, Event.Time, Event.nHundredthTime);
 
 	if (Severity == LogPanic)
 	{
@@ -287,14 +283,10 @@ int CLogger::Read (void *pBuffer, unsigned nCount)
 	return nResult;
 }
 
-void CLogger::WriteEvent (const char *pSource, TLogSeverity Severity, const char *pMessage)
+void CLogger::SetupEvent (TLogEvent *pEvent, const char *pSource, TLogSeverity Severity,
+			  const char *pMessage)
 {
-	TLogEvent *pEvent = new TLogEvent;
-	if (pEvent == 0)
-	{
-		return;
-	}
-
+	assert (pEvent != 0);
 	pEvent->Severity = Severity;
 
 	strncpy (pEvent->Source, pSource, LOG_MAX_SOURCE);
@@ -317,10 +309,23 @@ void CLogger::WriteEvent (const char *pSource, TLogSeverity Severity, const char
 		pEvent->nHundredthTime = 0;
 		pEvent->nTimeZone = 0;
 	}
+}
+
+void CLogger::WriteEvent (const TLogEvent *pEvent)
+{
+	assert (pEvent != 0);
+
+	TLogEvent *pNewEvent = new TLogEvent;
+	if (pNewEvent == 0)
+	{
+		return;
+	}
+
+	*pNewEvent = *pEvent;
 
 	m_EventSpinLock.Acquire ();
 
-	m_pEventQueue[m_nEventInPtr] = pEvent;
+	m_pEventQueue[m_nEventInPtr] = pNewEvent;
 
 	if (++m_nEventInPtr == LOG_QUEUE_SIZE)
 	{
@@ -352,6 +357,50 @@ void CLogger::WriteEvent (const char *pSource, TLogSeverity Severity, const char
 	}
 }
 
+void CLogger::WriteOutput (TLogSeverity Severity, const char *pSource, const char *pMessage,
+			   time_t Time, unsigned nHundredthTime)
+{
+	if (Severity > m_nLogLevel)
+	{
+		return;
+	}
+
+	CString Buffer;
+
+	if (Severity == LogPanic)
+	{
+		Buffer = "\x1b[1m";
+	}
+
+	// time is zero, if the timer has not been initialized yet
+	if (   Time != 0
+	    || nHundredthTime != 0)
+	{
+		CString *pTimeString = CTimer::GetTimeString (Time, nHundredthTime);
+		if (pTimeString != 0)
+		{
+			Buffer.Append (*pTimeString);
+			Buffer.Append (" ");
+
+			delete pTimeString;
+		}
+	}
+
+	Buffer.Append (pSource);
+	Buffer.Append (": ");
+
+	Buffer.Append (pMessage);
+
+	if (Severity == LogPanic)
+	{
+		Buffer.Append ("\x1b[0m");
+	}
+
+	Buffer.Append ("\n");
+
+	Write (Buffer);
+}
+
 boolean CLogger::ReadEvent (TLogSeverity *pSeverity, char *pSource, char *pMessage,
 			    time_t *pTime, unsigned *pHundredthTime, int *pTimeZone)
 {
@@ -394,3 +443,131 @@ void CLogger::RegisterPanicHandler (TLogPanicHandler *pHandler)
 {
 	m_pPanicHandler = pHandler;
 }
+
+boolean CLogger::EnableDeferredOutput (void)
+{
+	if (m_pRecords != 0)
+	{
+		return TRUE;
+	}
+
+	TLogRecord *pRecords = new TLogRecord[LOG_RECORD_COUNT];
+	if (pRecords == 0)
+	{
+		return FALSE;
+	}
+
+	for (unsigned i = 0; i < LOG_RECORD_COUNT; i++)
+	{
+		pRecords[i].nSequence = i;
+	}
+
+	m_nRecordInPtr = 0;
+	m_nRecordOutPtr = 0;
+
+	DataMemBarrier ();
+
+	m_pRecords = pRecords;
+
+	return TRUE;
+}
+
+boolean CLogger::Update (void)
+{
+	if (   m_pRecords == 0
+	    || __atomic_exchange_n (&m_bUpdating, TRUE, __ATOMIC_ACQUIRE))
+	{
+		return FALSE;
+	}
+
+	boolean bResult = FALSE;
+
+	while (1)
+	{
+		TLogRecord *pRecord = &m_pRecords[m_nRecordOutPtr & (LOG_RECORD_COUNT-1)];
+		if (__atomic_load_n (&pRecord->nSequence, __ATOMIC_ACQUIRE) != m_nRecordOutPtr+1)
+		{
+			break;
+		}
+
+		const TLogEvent *pEvent = &pRecord->Event;
+
+		WriteEvent (pEvent);
+
+		WriteOutput (pEvent->Severity, pEvent->Source, pEvent->Message,
+			     pEvent->Time, pEvent->nHundredthTime);
+
+		// release the record for the next round
+		__atomic_store_n (&pRecord->nSequence, m_nRecordOutPtr+LOG_RECORD_COUNT,
+				  __ATOMIC_RELEASE);
+		m_nRecordOutPtr++;
+
+		bResult = TRUE;
+	}
+
+	unsigned nOverflowCount = m_nOverflowCount;
+	if (nOverflowCount != m_nOverflowReported)
+	{
+		CString Message;
+		Message.Format ("%u message(s) lost", nOverflowCount - m_nOverflowReported);
+		m_nOverflowReported = nOverflowCount;
+
+		TLogEvent Event;
+		SetupEvent (&Event, "logger", LogWarning, Message);
+
+		WriteEvent (&Event);
+
+		WriteOutput (Event.Severity, Event.Source, Event.Message,
+			     Event.Time, Event.nHundredthTime);
+
+		bResult = TRUE;
+	}
+
+	__atomic_store_n (&m_bUpdating, FALSE, __ATOMIC_RELEASE);
+
+	return bResult;
+}
+
+unsigned CLogger::GetOverflowCount (void) const
+{
+	return m_nOverflowCount;
+}
+
+// can be called concurrently from any core and from interrupt context
+void CLogger::QueueRecord (const char *pSource, TLogSeverity Severity, const char *pMessage)
+{
+	assert (m_pRecords != 0);
+
+	TLogRecord *pRecord;
+	unsigned nPos = __atomic_load_n (&m_nRecordInPtr, __ATOMIC_RELAXED);
+	while (1)
+	{
+		pRecord = &m_pRecords[nPos & (LOG_RECORD_COUNT-1)];
+
+		int nDiff = (int) (__atomic_load_n (&pRecord->nSequence, __ATOMIC_ACQUIRE) - nPos);
+		if (nDiff == 0)
+		{
+			// claim the record, nPos is reloaded on failure
+			if (__atomic_compare_exchange_n (&m_nRecordInPtr, &nPos, nPos+1, TRUE,
+							 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				break;
+			}
+		}
+		else if (nDiff < 0)
+		{
+			// queue is full, record has not been written yet
+			__atomic_fetch_add (&m_nOverflowCount, 1, __ATOMIC_RELAXED);
+
+			return;
+		}
+		else
+		{
+			nPos = __atomic_load_n (&m_nRecordInPtr, __ATOMIC_RELAXED);
+		}
+	}
+
+	SetupEvent (&pRecord->Event, pSource, Severity, pMessage);
+
+	__atomic_store_n (&pRecord->nSequence, nPos+1, __ATOMIC_RELEASE);
+}
@@ -2,7 +2,7 @@
 // checksumcalculator.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,37 @@
 #include <circle/util.h>
 #include <assert.h>
 
+#if AARCH == 64 || RASPPI >= 2
+	#define CHECKSUM_NEON
+
+	#define CHECKSUM_NEON_MIN_LENGTH	128		// use NEON from this length on
+	#define CHECKSUM_NEON_BLOCK_SIZE	64
+	#define CHECKSUM_NEON_MAX_BLOCKS	16384		// per call
+
+extern "C"
+{
+	// see: checksum_fast.S
+	u64 ChecksumBlocksNEON (const void *pBuffer, unsigned nBlocks);
+	u64 ChecksumCopyBlocksNEON (void *pDest, const void *pSource, unsigned nBlocks);
+}
+#endif
+
+// one's complement addition, the carry is added back in
+static inline u64 AddWithCarry (u64 nSum, u64 nValue)
+{
+	nSum += nValue;
+
+	return nSum + (nSum < nValue ? 1 : 0);
+}
+
+static inline u32 Fold64 (u64 nSum)
+{
+	nSum = (nSum & 0xFFFFFFFF) + (nSum >> 32);
+	nSum = (nSum & 0xFFFFFFFF) + (nSum >> 32);
+
+	return (u32) nSum;
+}
+
 CChecksumCalculator::CChecksumCalculator (const CIPAddress &rSourceIP, int nProtocol)
 :	m_bDestAddressSet (FALSE)
 {
@@ -78,25 +109,297 @@ u16 CChecksumCalculator::SimpleCalculate (const void *pBuffer, unsigned nLength)
 	return ~FoldResult (nChecksum);
 }
 
+u16 CChecksumCalculator::CopyAndCalculate (const void *pHeader, unsigned nHeaderLength,
+					    void *pDest, const void *pSource, unsigned nDataLength)
+{
+	assert (m_bDestAddressSet);
+	assert (!(nHeaderLength & 1));
+
+	m_Header.nTCPLength = le2be16 (nHeaderLength + nDataLength);
+	u32 nChecksum = CalculateChunk (&m_Header, sizeof m_Header, 0);
+
+	if (nHeaderLength > 0)
+	{
+		assert (pHeader != 0);
+		nChecksum = CalculateChunk (pHeader, nHeaderLength, nChecksum);
+	}
+
+	if (nDataLength > 0)
+	{
+		nChecksum = CopyAndCalculateChunk (pDest, pSource, nDataLength, nChecksum);
+	}
+
+	return ~FoldResult (nChecksum);
+}
+
+// The buffer may start at an odd address. In this case the bytes of the sum of the
+// aligned words are swapped compared to the sum of the words of the chunk (RFC 1071).
 u32 CChecksumCalculator::CalculateChunk (const void *pBuffer, unsigned nLength, u32 nChecksum)
 {
-	u16 *pBuffer16 = (u16 *) pBuffer;
-	assert (pBuffer16 != 0);
+	const u8 *pBuffer8 = (const u8 *) pBuffer;
+	assert (pBuffer8 != 0);
 	assert (nLength > 0);
 
-	while (nLength >= 2)
+	u64 nSum = 0;
+
+	boolean bOdd = (uintptr) pBuffer8 & 1;
+	if (bOdd)
 	{
-		nChecksum += *pBuffer16++;
+		nSum = (u32) *pBuffer8++ << 8;
+		nLength--;
+	}
+
+	if (   ((uintptr) pBuffer8 & 2)
+	    && nLength >= 2)
+	{
+		nSum = AddWithCarry (nSum, *(const u16 *) pBuffer8);
+		pBuffer8 += 2;
+		nLength -= 2;
+	}
+
+	unsigned nWordsLength = nLength & ~3U;
+	if (nWordsLength > 0)
+	{
+		nSum = AddWithCarry (nSum, CalculateWords (pBuffer8, nWordsLength));
+		pBuffer8 += nWordsLength;
+		nLength -= nWordsLength;
+	}
+
+	if (nLength >= 2)
+	{
+		nSum = AddWithCarry (nSum, *(const u16 *) pBuffer8);
+		pBuffer8 += 2;
 		nLength -= 2;
 	}
 
 	assert (nLength <= 1);
 	if (nLength != 0)
 	{
-		nChecksum += *(u8 *) pBuffer16;
+		nSum = AddWithCarry (nSum, *pBuffer8);
 	}
-	
-	return nChecksum;
+
+	u32 nResult = FoldResult (Fold64 (nSum));
+	if (bOdd)
+	{
+		nResult = (nResult & 0xFF) << 8 | nResult >> 8;
+	}
+
+	return Fold64 ((u64) nChecksum + nResult);
+}
+
+u32 CChecksumCalculator::CopyAndCalculateChunk (void *pDest, const void *pSource, unsigned nLength,
+						u32 nChecksum)
+{
+	u8 *pDest8 = (u8 *) pDest;
+	const u8 *pSource8 = (const u8 *) pSource;
+	assert (pDest8 != 0);
+	assert (pSource8 != 0);
+	assert (nLength > 0);
+
+	if (((uintptr) pDest8 ^ (uintptr) pSource8) & 3)
+	{
+		// cannot copy words with different alignment, use two passes
+		memcpy (pDest8, pSource8, nLength);
+
+		return CalculateChunk (pDest8, nLength, nChecksum);
+	}
+
+	u64 nSum = 0;
+
+	boolean bOdd = (uintptr) pSource8 & 1;
+	if (bOdd)
+	{
+		nSum = (u32) (*pDest8++ = *pSource8++) << 8;
+		nLength--;
+	}
+
+	if (   ((uintptr) pSource8 & 2)
+	    && nLength >= 2)
+	{
+		nSum = AddWithCarry (nSum, *(u16 *) pDest8 = *(const u16 *) pSource8);
+		pDest8 += 2;
+		pSource8 += 2;
+		nLength -= 2;
+	}
+
+	unsigned nWordsLength = nLength & ~3U;
+	if (nWordsLength > 0)
+	{
+		nSum = AddWithCarry (nSum, CopyAndCalculateWords (pDest8, pSource8, nWordsLength));
+		pDest8 += nWordsLength;
+		pSource8 += nWordsLength;
+		nLength -= nWordsLength;
+	}
+
+	if (nLength >= 2)
+	{
+		nSum = AddWithCarry (nSum, *(u16 *) pDest8 = *(const u16 *) pSource8);
+		pDest8 += 2;
+		pSource8 += 2;
+		nLength -= 2;
+	}
+
+	assert (nLength <= 1);
+	if (nLength != 0)
+	{
+		nSum = AddWithCarry (nSum, *pDest8 = *pSource8);
+	}
+
+	u32 nResult = FoldResult (Fold64 (nSum));
+	if (bOdd)
+	{
+		nResult = (nResult & 0xFF) << 8 | nResult >> 8;
+	}
+
+	return Fold64 ((u64) nChecksum + nResult);
+}
+
+// pBuffer must be 4-byte aligned, nLength must be a multiple of 4
+u64 CChecksumCalculator::CalculateWords (const void *pBuffer, unsigned nLength)
+{
+	const u8 *pBuffer8 = (const u8 *) pBuffer;
+	assert (!((uintptr) pBuffer8 & 3));
+	assert (!(nLength & 3));
+
+	u64 nSum = 0;
+
+#ifdef CHECKSUM_NEON
+	u64 nSumNEON = 0;		// may use the whole 64-bit range
+	if (nLength >= CHECKSUM_NEON_MIN_LENGTH)
+	{
+		unsigned nBlocks = nLength / CHECKSUM_NEON_BLOCK_SIZE;
+		nLength %= CHECKSUM_NEON_BLOCK_SIZE;
+
+		while (nBlocks > 0)
+		{
+			unsigned nCount = nBlocks;
+			if (nCount > CHECKSUM_NEON_MAX_BLOCKS)
+			{
+				nCount = CHECKSUM_NEON_MAX_BLOCKS;
+			}
+
+			nSumNEON = AddWithCarry (nSumNEON, ChecksumBlocksNEON (pBuffer8, nCount));
+
+			pBuffer8 += nCount * CHECKSUM_NEON_BLOCK_SIZE;
+			nBlocks -= nCount;
+		}
+	}
+#endif
+
+#if AARCH == 64
+	if (   ((uintptr) pBuffer8 & 4)
+	    && nLength >= 4)
+	{
+		nSum += *(const u32 *) pBuffer8;
+		pBuffer8 += 4;
+		nLength -= 4;
+	}
+
+	const u64 *pBuffer64 = (const u64 *) pBuffer8;
+	for (; nLength >= 32; nLength -= 32, pBuffer64 += 4)
+	{
+		nSum = AddWithCarry (nSum, pBuffer64[0]);
+		nSum = AddWithCarry (nSum, pBuffer64[1]);
+		nSum = AddWithCarry (nSum, pBuffer64[2]);
+		nSum = AddWithCarry (nSum, pBuffer64[3]);
+	}
+
+	for (; nLength >= 8; nLength -= 8)
+	{
+		nSum = AddWithCarry (nSum, *pBuffer64++);
+	}
+
+	if (nLength != 0)
+	{
+		assert (nLength == 4);
+		nSum = AddWithCarry (nSum, *(const u32 *) pBuffer64);
+	}
+#else
+	// the 64-bit sum of 32-bit words (without NEON) cannot overflow with the possible lengths
+	const u32 *pBuffer32 = (const u32 *) pBuffer8;
+	for (; nLength >= 16; nLength -= 16, pBuffer32 += 4)
+	{
+		nSum += pBuffer32[0];
+		nSum += pBuffer32[1];
+		nSum += pBuffer32[2];
+		nSum += pBuffer32[3];
+	}
+
+	for (; nLength != 0; nLength -= 4)
+	{
+		nSum += *pBuffer32++;
+	}
+#endif
+
+#ifdef CHECKSUM_NEON
+	nSum = AddWithCarry (nSum, nSumNEON);
+#endif
+
+	return nSum;
+}
+
+// pDest and pSource must be 4-byte aligned, nLength must be a multiple of 4
+u64 CChecksumCalculator::CopyAndCalculateWords (void *pDest, const void *pSource, unsigned nLength)
+{
+	u8 *pDest8 = (u8 *) pDest;
+	const u8 *pSource8 = (const u8 *) pSource;
+	assert (!((uintptr) pDest8 & 3));
+	assert (!((uintptr) pSource8 & 3));
+	assert (!(nLength & 3));
+
+	u64 nSum = 0;
+
+#ifdef CHECKSUM_NEON
+	u64 nSumNEON = 0;		// may use the whole 64-bit range
+	if (nLength >= CHECKSUM_NEON_MIN_LENGTH)
+	{
+		unsigned nBlocks = nLength / CHECKSUM_NEON_BLOCK_SIZE;
+		nLength %= CHECKSUM_NEON_BLOCK_SIZE;
+
+		while (nBlocks > 0)
+		{
+			unsigned nCount = nBlocks;
+			if (nCount > CHECKSUM_NEON_MAX_BLOCKS)
+			{
+				nCount = CHECKSUM_NEON_MAX_BLOCKS;
+			}
+
+			nSumNEON = AddWithCarry (nSumNEON, ChecksumCopyBlocksNEON (pDest8, pSource8, nCount));
+
+			pDest8 += nCount * CHECKSUM_NEON_BLOCK_SIZE;
+			pSource8 += nCount * CHECKSUM_NEON_BLOCK_SIZE;
+			nBlocks -= nCount;
+		}
+	}
+#endif
+
+	u32 *pDest32 = (u32 *) pDest8;
+	const u32 *pSource32 = (const u32 *) pSource8;
+	for (; nLength >= 16; nLength -= 16, pDest32 += 4, pSource32 += 4)
+	{
+		u32 nWord0 = pSource32[0];
+		u32 nWord1 = pSource32[1];
+		u32 nWord2 = pSource32[2];
+		u32 nWord3 = pSource32[3];
+
+		pDest32[0] = nWord0;
+		pDest32[1] = nWord1;
+		pDest32[2] = nWord2;
+		pDest32[3] = nWord3;
+
+		nSum += (u64) nWord0 + nWord1 + nWord2 + nWord3;
+	}
+
+	for (; nLength != 0; nLength -= 4)
+	{
+		nSum += *pDest32++ = *pSource32++;
+	}
+
+#ifdef CHECKSUM_NEON
+	nSum = AddWithCarry (nSum, nSumNEON);
+#endif
+
+	return nSum;
 }
 
 u16 CChecksumCalculator::FoldResult (u32 nChecksum)
@@ -4,7 +4,7 @@
 // A simple HTTP webserver
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -20,35 +20,61 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/net/httpdaemon.h>
+#include <circle/net/tcpconnection.h>
 #include <circle/net/ipaddress.h>
 #include <circle/net/in.h>
+#include <circle/sched/scheduler.h>
 #include <circle/netdevice.h>
 #include <circle/sysconfig.h>
 #include <circle/logger.h>
+#include <circle/timer.h>
 #include <circle/string.h>
 #include <circle/util.h>
 #include <assert.h>
 
-#define HTTPD_VERSION		"0.02"
+#define HTTPD_VERSION		"0.03"
 #define SERVER			"CHTTPDaemon/" HTTPD_VERSION " (Circle)"
 
 #define MAX_CLIENTS		10
 
 #define HTTPD_STACK_SIZE	TASK_STACK_SIZE
 
+// event loop only
+#define HTTPD_REQUEST_BUFFER_SIZE	(HTTP_MAX_REQUEST_LINE+HTTP_MAX_FORM_DATA+4*FRAME_BUFFER_SIZE)
+#define HTTPD_KEEP_ALIVE_TIMEOUT	15		// seconds
+#define HTTPD_CHUNK_HEADER_SIZE		10		// "XXXXXXXX\r\n"
+#define HTTPD_CONTENT_OFFSET		16		// aligned, >= HTTPD_CHUNK_HEADER_SIZE
+#define HTTPD_CONTENT_BLOCK_SIZE	512		// content parts are requested in blocks
+
+struct THTTPConnection
+{
+	CSocket		     *pSocket;		// 0 if entry is free
+	char		     *pBuffer;		// received request data
+	unsigned	      nBufferSize;
+	unsigned	      nInLength;	// valid bytes in pBuffer
+	CHTTPContentProducer *pProducer;	// != 0 while content is sent in parts
+	int		      nContentRemaining; // -1 for chunked transfer coding
+	boolean		      bClose;		// close connection after content has been sent
+	unsigned	      nLastActivity;	// in ticks
+};
+
 static const char FromHTTPDaemon[] = "httpd";
 
 unsigned CHTTPDaemon::s_nInstanceCount = 0;
 
 CHTTPDaemon::CHTTPDaemon (CNetSubSystem *pNetSubSystem, CSocket *pSocket,
-			  unsigned nMaxContentSize, u16 nPort, unsigned nMaxMultipartSize)
+			  unsigned nMaxContentSize, u16 nPort, unsigned nMaxMultipartSize,
+			  unsigned nMaxConnections)
 :	CTask (HTTPD_STACK_SIZE),
 	m_pNetSubSystem (pNetSubSystem),
 	m_pSocket (pSocket),
 	m_nMaxContentSize (nMaxContentSize),
 	m_nPort (nPort),
 	m_nMaxMultipartSize (nMaxMultipartSize),
-	m_pContentBuffer (0)
+	m_nMaxConnections (nMaxConnections),
+	m_pContentBuffer (0),
+	m_pConnections (0),
+	m_pMultipartBuffer (0)
 {
 	s_nInstanceCount++;
 
@@ -63,6 +89,12 @@ CHTTPDaemon::~CHTTPDaemon (void)
 {
 	assert (m_pSocket == 0);
 
+	delete [] m_pConnections;
+	m_pConnections = 0;
+
+	delete [] m_pMultipartBuffer;
+	m_pMultipartBuffer = 0;
+
 	delete m_pContentBuffer;
 	m_pContentBuffer = 0;
 
@@ -75,7 +107,14 @@ void CHTTPDaemon::Run (void)
 {
 	if (m_pSocket == 0)
 	{
-		Listener ();
+		if (m_nMaxConnections > 0)
+		{
+			EventLoop ();
+		}
+		else
+		{
+			Listener ();
+		}
 	}
 	else
 	{
@@ -83,8 +122,30 @@ void CHTTPDaemon::Run (void)
 	}
 }
 
-void CHTTPDaemon::Listener (void)
+CHTTPDaemon *CHTTPDaemon::CreateWorker (CNetSubSystem *pNetSubSystem, CSocket *pSocket)
 {
+	assert (0);		// must be overwritten, if nMaxConnections == 0
+
+	return 0;
+}
+
+CHTTPContentProducer *CHTTPDaemon::GetContentProducer (const char  *pPath,
+						       const char  *pParams,
+						       const char  *pFormData,
+						       const char **ppContentType)
+{
+	return 0;		// use GetContent()
+}
+
+boolean CHTTPDaemon::CreateListenSocket (void)
+{
+	unsigned nBackLog = MAX_CLIENTS;
+	if (m_nMaxConnections > 0)
+	{
+		nBackLog =   m_nMaxConnections < SOCKET_MAX_LISTEN_BACKLOG
+			   ? m_nMaxConnections : SOCKET_MAX_LISTEN_BACKLOG;
+	}
+
 	assert (m_pNetSubSystem != 0);
 	m_pSocket = new CSocket (m_pNetSubSystem, IPPROTO_TCP);
 	assert (m_pSocket != 0);
@@ -96,16 +157,26 @@ void CHTTPDaemon::Listener (void)
 		delete m_pSocket;
 		m_pSocket = 0;
 
-		return;
+		return FALSE;
 	}
 
-	if (m_pSocket->Listen (MAX_CLIENTS) < 0)
+	if (m_pSocket->Listen (nBackLog) < 0)
 	{
 		CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot listen on socket");
 
 		delete m_pSocket;
 		m_pSocket = 0;
 
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void CHTTPDaemon::Listener (void)
+{
+	if (!CreateListenSocket ())
+	{
 		return;
 	}
 
@@ -140,28 +211,370 @@ void CHTTPDaemon::Worker (void)
 
 	// parse HTTP request
 	THTTPStatus Status = ParseRequest ();
-	if (Status == HTTPUnknownError)		// unknown error cannot be reported to client
+	if (Status != HTTPUnknownError)		// unknown error cannot be reported to client
 	{
-		delete m_pSocket;
-		m_pSocket = 0;
+		SendResponse (m_pSocket, Status, FALSE);
+	}
+
+	delete m_pSocket;		// closes connection
+	m_pSocket = 0;
+}
+
+void CHTTPDaemon::EventLoop (void)
+{
+	// the content buffer of this instance is shared by all connections
+	assert (m_nMaxContentSize > HTTPD_CONTENT_OFFSET+2);
+	assert (m_pContentBuffer != 0);
+
+	assert (m_nMaxConnections > 0);
+	assert (m_pConnections == 0);
+	m_pConnections = new THTTPConnection[m_nMaxConnections];
+	assert (m_pConnections != 0);
 
+	for (unsigned i = 0; i < m_nMaxConnections; i++)
+	{
+		m_pConnections[i].pSocket = 0;
+	}
+
+	if (!CreateListenSocket ())
+	{
 		return;
 	}
 
+	while (1)
+	{
+		// accept a new connection, if there is a free entry
+		THTTPConnection *pConnection = 0;
+		for (unsigned i = 0; i < m_nMaxConnections; i++)
+		{
+			if (m_pConnections[i].pSocket == 0)
+			{
+				pConnection = &m_pConnections[i];
+
+				break;
+			}
+		}
+
+		if (pConnection != 0)
+		{
+			CIPAddress ForeignIP;
+			u16 nForeignPort;
+			CSocket *pSocket = m_pSocket->Accept (&ForeignIP, &nForeignPort, MSG_DONTWAIT);
+			if (pSocket != 0)
+			{
+				pConnection->nBufferSize = HTTPD_REQUEST_BUFFER_SIZE + m_nMaxMultipartSize;
+				pConnection->pBuffer = new char[pConnection->nBufferSize];
+				if (pConnection->pBuffer != 0)
+				{
+					pConnection->pSocket = pSocket;
+					pConnection->nInLength = 0;
+					pConnection->pProducer = 0;
+					pConnection->nContentRemaining = 0;
+					pConnection->bClose = FALSE;
+					pConnection->nLastActivity = CTimer::Get ()->GetTicks ();
+				}
+				else
+				{
+					CLogger::Get ()->Write (FromHTTPDaemon, LogWarning, "Cannot allocate buffer");
+
+					delete pSocket;
+				}
+			}
+		}
+
+		for (unsigned i = 0; i < m_nMaxConnections; i++)
+		{
+			if (m_pConnections[i].pSocket != 0)
+			{
+				ProcessConnection (&m_pConnections[i]);
+			}
+		}
+
+		CScheduler::Get ()->Yield ();
+	}
+}
+
+void CHTTPDaemon::ProcessConnection (THTTPConnection *pConnection)
+{
+	assert (pConnection != 0);
+	CSocket *pSocket = pConnection->pSocket;
+	assert (pSocket != 0);
+
+	unsigned nTicks = CTimer::Get ()->GetTicks ();
+
+	boolean bParse = FALSE;
+
+	// continue to send content from producer
+	if (pConnection->pProducer != 0)
+	{
+		if (!SendContentPart (pConnection))
+		{
+			CloseConnection (pConnection);
+
+			return;
+		}
+
+		if (pConnection->pProducer != 0)
+		{
+			// peer does not receive any more?
+			if (nTicks - pConnection->nLastActivity > HTTPD_KEEP_ALIVE_TIMEOUT * HZ)
+			{
+				CloseConnection (pConnection);
+			}
+
+			return;
+		}
+
+		if (pConnection->bClose)
+		{
+			CloseConnection (pConnection);
+
+			return;
+		}
+
+		pConnection->nLastActivity = nTicks;
+
+		bParse = TRUE;			// pipelined requests may be waiting
+	}
+
+	// receive request data
+	unsigned nFree = pConnection->nBufferSize - pConnection->nInLength;
+	if (nFree >= FRAME_BUFFER_SIZE)
+	{
+		int nResult = pSocket->Receive (pConnection->pBuffer + pConnection->nInLength,
+						nFree, MSG_DONTWAIT);
+		if (nResult < 0)		// connection closed by peer
+		{
+			CloseConnection (pConnection);
+
+			return;
+		}
+
+		if (nResult > 0)
+		{
+			pConnection->nInLength += nResult;
+			pConnection->nLastActivity = nTicks;
+
+			bParse = TRUE;
+		}
+	}
+
+	if (!bParse)
+	{
+		if (nTicks - pConnection->nLastActivity > HTTPD_KEEP_ALIVE_TIMEOUT * HZ)
+		{
+			CloseConnection (pConnection);
+		}
+
+		return;
+	}
+
+	// process all complete requests in the buffer
+	while (pConnection->nInLength > 0)
+	{
+		ResetRequest ();
+
+		unsigned nConsumed;
+		if (!ParseData (pConnection->pBuffer, pConnection->nInLength, &nConsumed))
+		{
+			ResetRequest ();
+
+			if (pConnection->nBufferSize - pConnection->nInLength < FRAME_BUFFER_SIZE)
+			{
+				SendResponse (pSocket, HTTPRequestEntityTooLarge, FALSE);
+
+				CloseConnection (pConnection);
+			}
+
+			return;			// wait for more data
+		}
+
+		THTTPStatus Status = FinishRequest ();
+		if (Status == HTTPUnknownError)		// unknown error cannot be reported to client
+		{
+			CloseConnection (pConnection);
+
+			return;
+		}
+
+		boolean bKeepAlive = Status == HTTPOK && !m_bConnectionClose;
+
+		CHTTPContentProducer *pProducer = 0;
+		if (!SendResponse (pSocket, Status, bKeepAlive, &pProducer))
+		{
+			CloseConnection (pConnection);
+
+			return;
+		}
+
+		assert (nConsumed <= pConnection->nInLength);
+		pConnection->nInLength -= nConsumed;
+		memmove (pConnection->pBuffer, pConnection->pBuffer + nConsumed, pConnection->nInLength);
+
+		if (pProducer != 0)
+		{
+			pConnection->pProducer = pProducer;
+			pConnection->nContentRemaining = pProducer->GetContentLength ();
+			pConnection->bClose = !bKeepAlive;
+
+			return;			// further requests are processed after sending content
+		}
+
+		if (!bKeepAlive)
+		{
+			CloseConnection (pConnection);
+
+			return;
+		}
+	}
+}
+
+void CHTTPDaemon::CloseConnection (THTTPConnection *pConnection)
+{
+	assert (pConnection != 0);
+
+	delete pConnection->pProducer;
+	pConnection->pProducer = 0;
+
+	delete pConnection->pSocket;		// closes connection
+	pConnection->pSocket = 0;
+
+	delete [] pConnection->pBuffer;
+	pConnection->pBuffer = 0;
+}
+
+boolean CHTTPDaemon::SendContentPart (THTTPConnection *pConnection)
+{
+	assert (pConnection != 0);
+	CSocket *pSocket = pConnection->pSocket;
+	assert (pSocket != 0);
+	CHTTPContentProducer *pProducer = pConnection->pProducer;
+	assert (pProducer != 0);
+
+	// wait until the previous part has been passed to the TCP retransmission queue,
+	// so that the TX queue does not grow with fast producers
+	TTCPStatistics Statistics;
+	if (!pSocket->GetTCPStatistics (&Statistics))
+	{
+		return FALSE;
+	}
+
+	if (!Statistics.bSendQueueEmpty)
+	{
+		return TRUE;
+	}
+
+	boolean bChunked = pConnection->nContentRemaining < 0;
+
+	// leave space for chunk header and trailing CRLF, the content is placed at an
+	// aligned offset and is requested in whole blocks, so that a file producer
+	// can read whole sectors directly into the buffer
+	assert (m_pContentBuffer != 0);
+	u8 *pBuffer = m_pContentBuffer + HTTPD_CONTENT_OFFSET;
+	unsigned nBufSize = m_nMaxContentSize - HTTPD_CONTENT_OFFSET - 2;
+	if (nBufSize >= HTTPD_CONTENT_BLOCK_SIZE)
+	{
+		nBufSize -= nBufSize % HTTPD_CONTENT_BLOCK_SIZE;
+	}
+
+	if (   !bChunked
+	    && nBufSize > (unsigned) pConnection->nContentRemaining)
+	{
+		nBufSize = pConnection->nContentRemaining;
+	}
+
+	int nResult = 0;
+	if (nBufSize > 0)
+	{
+		nResult = pProducer->GetContentPart (pBuffer, nBufSize);
+		if (nResult < 0)
+		{
+			CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot get content");
+
+			return FALSE;
+		}
+
+		assert ((unsigned) nResult <= nBufSize);
+	}
+
+	if (nResult == 0)		// end of content
+	{
+		delete pProducer;
+		pConnection->pProducer = 0;
+
+		if (bChunked)
+		{
+			return pSocket->Send ("0\r\n\r\n", 5, MSG_DONTWAIT) >= 0;
+		}
+
+		return pConnection->nContentRemaining == 0;	// content too short?
+	}
+
+	unsigned nLength = nResult;
+	if (bChunked)
+	{
+		CString ChunkSize;
+		ChunkSize.Format ("%X\r\n", nLength);
+
+		unsigned nSizeLength = ChunkSize.GetLength ();
+		assert (nSizeLength <= HTTPD_CHUNK_HEADER_SIZE);
+		assert (nSizeLength <= HTTPD_CONTENT_OFFSET);
+
+		memcpy (pBuffer + nLength, "\r\n", 2);
+
+		pBuffer -= nSizeLength;
+		memcpy (pBuffer, (const char *) ChunkSize, nSizeLength);
+
+		nLength += nSizeLength + 2;
+	}
+	else
+	{
+		pConnection->nContentRemaining -= nResult;
+	}
+
+	if (pSocket->Send (pBuffer, nLength, MSG_DONTWAIT) < 0)
+	{
+		CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot send response");
+
+		return FALSE;
+	}
+
+	pConnection->nLastActivity = CTimer::Get ()->GetTicks ();
+
+	return TRUE;
+}
+
+boolean CHTTPDaemon::SendResponse (CSocket *pSocket, THTTPStatus Status, boolean bKeepAlive,
+				   CHTTPContentProducer **ppProducer)
+{
+	assert (pSocket != 0);
+
 	// process HTTP request
 	unsigned nContentLength = m_nMaxContentSize;
 	const char *pContentType = "text/html";
 
 	const char *pStatusMsg = "OK";
 
+	CHTTPContentProducer *pProducer = 0;
+
 	if (Status == HTTPOK)
 	{
-		// get content
-		assert (m_pContentBuffer != 0);
-		Status = GetContent (m_RequestPath, m_RequestParams, m_RequestFormData,
-				     m_pContentBuffer, &nContentLength, &pContentType);
-		assert (nContentLength <= m_nMaxContentSize);
-		assert (pContentType != 0);
+		if (ppProducer != 0)
+		{
+			pProducer = GetContentProducer (m_RequestPath, m_RequestParams, m_RequestFormData,
+							&pContentType);
+			assert (pContentType != 0);
+		}
+
+		if (pProducer == 0)
+		{
+			// get content
+			assert (m_pContentBuffer != 0);
+			Status = GetContent (m_RequestPath, m_RequestParams, m_RequestFormData,
+					     m_pContentBuffer, &nContentLength, &pContentType);
+			assert (nContentLength <= m_nMaxContentSize);
+			assert (pContentType != 0);
+		}
 
 		delete [] m_pMultipartBuffer;
 		m_pMultipartBuffer = 0;
@@ -197,16 +610,24 @@ void CHTTPDaemon::Worker (void)
 		assert (m_pContentBuffer != 0);
 		memcpy (m_pContentBuffer, (const char *) ErrorPage, nContentLength);
 		pContentType = "text/html";	// may has been changed by GetContent()
+
+		bKeepAlive = FALSE;		// connection is closed after errors
+	}
+
+	int nProducerLength = -1;
+	if (pProducer != 0)
+	{
+		nProducerLength = pProducer->GetContentLength ();
+		nContentLength = nProducerLength >= 0 ? nProducerLength : 0;
 	}
 
 	// write log line
-	const u8 *pClientIP = m_pSocket->GetForeignIP ();
+	const u8 *pClientIP = pSocket->GetForeignIP ();
 	if (pClientIP == 0)			// connection closed in the meantime?
 	{
-		delete m_pSocket;
-		m_pSocket = 0;
+		delete pProducer;
 
-		return;
+		return FALSE;
 	}
 	CIPAddress ClientIP (pClientIP);
 
@@ -229,46 +650,101 @@ void CHTTPDaemon::Worker (void)
 	CString Header;
 	Header.Format ("HTTP/1.1 %u %s\r\n"
 		       "Server: " SERVER "\r\n"
-		       "Content-Type: %s\r\n"
-		       "Content-Length: %u\r\n"
-		       "Connection: close\r\n"
-		       "\r\n", Status, pStatusMsg, pContentType, nContentLength);
+		       "Content-Type: %s\r\n", Status, pStatusMsg, pContentType);
 
-	if (m_pSocket->Send ((const char *) Header, Header.GetLength (), MSG_DONTWAIT) < 0)
+	if (   pProducer != 0
+	    && nProducerLength < 0)
+	{
+		Header.Append ("Transfer-Encoding: chunked\r\n");
+	}
+	else
+	{
+		CString ContentLength;
+		ContentLength.Format ("Content-Length: %u\r\n", nContentLength);
+		Header.Append (ContentLength);
+	}
+
+	if (!bKeepAlive)
+	{
+		Header.Append ("Connection: close\r\n");
+	}
+
+	Header.Append ("\r\n");
+
+	if (pSocket->Send ((const char *) Header, Header.GetLength (), MSG_DONTWAIT) < 0)
 	{
 		CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot send response header");
 
-		delete m_pSocket;
-		m_pSocket = 0;
+		delete pProducer;
 
-		return;
+		return FALSE;
+	}
+
+	if (m_RequestMethod == HTTPRequestMethodHead)
+	{
+		delete pProducer;
+
+		return TRUE;
+	}
+
+	// content is sent later in parts
+	if (pProducer != 0)
+	{
+		assert (ppProducer != 0);
+		*ppProducer = pProducer;
+
+		return TRUE;
 	}
 
 	// send response
-	if (   m_RequestMethod != HTTPRequestMethodHead
-	    && nContentLength > 0)
+	if (nContentLength > 0)
 	{
 		assert (m_pContentBuffer != 0);
-		if (m_pSocket->Send (m_pContentBuffer, nContentLength, MSG_DONTWAIT) < 0)
+		if (pSocket->Send (m_pContentBuffer, nContentLength, MSG_DONTWAIT) < 0)
 		{
 			CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot send response");
 
-			delete m_pSocket;
-			m_pSocket = 0;
-
-			return;
+			return FALSE;
 		}
 	}
 
-	delete m_pSocket;		// closes connection
-	m_pSocket = 0;
+	return TRUE;
 }
 
 THTTPStatus CHTTPDaemon::ParseRequest (void)
 {
-	THTTPStatus Status = HTTPOK;
+	ResetRequest ();
+
+	char Buffer[FRAME_BUFFER_SIZE];
+#if FRAME_BUFFER_SIZE+2000 > HTTPD_STACK_SIZE
+	#error Increase HTTPD_STACK_SIZE!
+#endif
+
+	boolean bComplete = FALSE;
+	int nResult;
 
+	assert (m_pSocket != 0);
+	while (   !bComplete
+	       && (nResult = m_pSocket->Receive (Buffer, sizeof Buffer, 0)) > 0)
+	{
+		unsigned nConsumed;
+		bComplete = ParseData (Buffer, nResult, &nConsumed);
+	}
+
+	if (nResult < 0)
+	{
+		CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Receive failed");
+
+		return HTTPUnknownError;
+	}
+
+	return FinishRequest ();
+}
+
+void CHTTPDaemon::ResetRequest (void)
+{
 	m_RequestMethod = HTTPRequestMethodUnknown;
+	m_bConnectionClose = FALSE;
 	m_RequestURI[0] = '\0';
 	m_RequestPath[0] = '\0';
 	m_RequestParams[0] = '\0';
@@ -278,156 +754,161 @@ THTTPStatus CHTTPDaemon::ParseRequest (void)
 	m_bMultipartFormDataAvailable = FALSE;
 	m_MultipartBoundary[0] = '\0';
 	m_nMultipartContentLength = 0;
-	m_pMultipartBuffer = 0;
 
-	char Buffer[FRAME_BUFFER_SIZE];
-	char Line[HTTP_MAX_REQUEST_LINE+1];
-#if HTTP_MAX_REQUEST_LINE+FRAME_BUFFER_SIZE+2000 > HTTPD_STACK_SIZE
-	#error Increase HTTPD_STACK_SIZE!
-#endif
+	delete [] m_pMultipartBuffer;
+	m_pMultipartBuffer = 0;
+	m_pMultipartPointer = 0;
 
-	unsigned nState = 0; // 0: parse header, 1: parse form data, 2: parse multipart data, 3: leave
-	unsigned nLine = 0;
-	unsigned nChar = 0;
+	m_ParseStatus = HTTPOK;
+	m_nParseState = 0; // 0: parse header, 1: parse form data, 2: parse multipart data, 3: leave
+	m_nParseLine = 0;
+	m_nParseChar = 0;
+}
 
-	int nResult;
+boolean CHTTPDaemon::ParseData (const char *pData, unsigned nLength, unsigned *pConsumed)
+{
+	assert (pData != 0);
+	assert (pConsumed != 0);
 
-	assert (m_pSocket != 0);
-	while (   nState < 3
-	       && (nResult = m_pSocket->Receive (Buffer, sizeof Buffer, 0)) > 0)
+	for (unsigned i = 0; i < nLength; i++)
 	{
-		for (unsigned i = 0; i < (unsigned) nResult; i++)
-		{
-			char chChar = Buffer[i];
+		char chChar = pData[i];
+
 
-			if (nState == 0)
+		if (m_nParseState == 0)
+		{
+			if (chChar == '\r')
 			{
-				if (chChar == '\r')
-				{
-					continue;
-				}
+				continue;
+			}
 
-				if (chChar == '\n')		// end of line
+			if (chChar == '\n')		// end of line
+			{
+				if (m_nParseChar == 0)		// empty line is end of header
 				{
-					if (nChar == 0)		// empty line is end of header
+					if (   m_bRequestFormDataAvailable
+					    && m_nRequestContentLength > 0)
 					{
-						if (   m_bRequestFormDataAvailable
-						    && m_nRequestContentLength > 0)
+						if (m_nRequestContentLength <= HTTP_MAX_FORM_DATA)
 						{
-							if (m_nRequestContentLength <= HTTP_MAX_FORM_DATA)
-							{
-								nChar = 0;
-								nState = 1;
-							}
-							else
-							{
-								Status = HTTPRequestEntityTooLarge;
-								nState = 3;
-							}
+							m_nParseChar = 0;
+							m_nParseState = 1;
 						}
-						else if (   m_bMultipartFormDataAvailable
-							 && m_nRequestContentLength > 0)
+						else
 						{
-							m_nMultipartContentLength = m_nRequestContentLength;
-							m_nRequestContentLength = 0;
+							m_ParseStatus = HTTPRequestEntityTooLarge;
+							m_nParseState = 3;
+						}
+					}
+					else if (   m_bMultipartFormDataAvailable
+						 && m_nRequestContentLength > 0)
+					{
+						m_nMultipartContentLength = m_nRequestContentLength;
+						m_nRequestContentLength = 0;
 
-							if (m_nMultipartContentLength <= m_nMaxMultipartSize)
+						if (m_nMultipartContentLength <= m_nMaxMultipartSize)
+						{
+							assert (m_pMultipartBuffer == 0);
+							m_pMultipartBuffer = new char[m_nMultipartContentLength];
+							if (m_pMultipartBuffer == 0)
 							{
-								assert (m_pMultipartBuffer == 0);
-								m_pMultipartBuffer = new char[m_nMultipartContentLength];
-								if (m_pMultipartBuffer == 0)
-								{
-									Status = HTTPInternalServerError;
-									nState = 3;
-								}
-								else
-								{
-									nChar = 0;
-									nState = 2;
-								}
+								m_ParseStatus = HTTPInternalServerError;
+								m_nParseState = 3;
 							}
 							else
 							{
-								Status = HTTPRequestEntityTooLarge;
-								nState = 3;
+								m_nParseChar = 0;
+								m_nParseState = 2;
 							}
 						}
 						else
 						{
-							nState = 3;
+							m_ParseStatus = HTTPRequestEntityTooLarge;
+							m_nParseState = 3;
 						}
 					}
 					else
 					{
-						if (nLine++ == 0)	// first line?
-						{
-							if (Status == HTTPOK)
-							{						
-								Status = ParseMethod (Line);
-							}
-						}
-						else
-						{
-							if (Status == HTTPOK)
-							{						
-								Status = ParseHeaderField (Line);
-							}
-						}
-
-						nChar = 0;
+						m_nParseState = 3;
 					}
 				}
 				else
 				{
-					// accumulate option line
-					if (nChar < sizeof Line-1)
+					if (m_nParseLine++ == 0)	// first line?
 					{
-						Line[nChar++] = chChar;
-						Line[nChar] = '\0';
+						if (m_ParseStatus == HTTPOK)
+						{						
+							m_ParseStatus = ParseMethod (m_ParseLine);
+						}
 					}
 					else
 					{
-						Status = HTTPRequestEntityTooLarge;
+						if (m_ParseStatus == HTTPOK)
+						{						
+							m_ParseStatus = ParseHeaderField (m_ParseLine);
+						}
 					}
+
+					m_nParseChar = 0;
 				}
 			}
-			else if (nState == 1)
+			else
 			{
-				m_RequestFormData[nChar++] = chChar;
-				m_RequestFormData[nChar] = '\0';
-
-				if (nChar >= m_nRequestContentLength)
+				// accumulate option line
+				if (m_nParseChar < sizeof m_ParseLine-1)
 				{
-					nState = 3;
+					m_ParseLine[m_nParseChar++] = chChar;
+					m_ParseLine[m_nParseChar] = '\0';
+				}
+				else
+				{
+					m_ParseStatus = HTTPRequestEntityTooLarge;
 				}
 			}
-			else if (nState == 2)
+		}
+		else if (m_nParseState == 1)
+		{
+			m_RequestFormData[m_nParseChar++] = chChar;
+			m_RequestFormData[m_nParseChar] = '\0';
+
+			if (m_nParseChar >= m_nRequestContentLength)
 			{
-				m_pMultipartBuffer[nChar++] = chChar;
+				m_nParseState = 3;
+			}
+		}
+		else if (m_nParseState == 2)
+		{
+			m_pMultipartBuffer[m_nParseChar++] = chChar;
 
-				if (nChar >= m_nMultipartContentLength)
-				{
-					m_pMultipartPointer = m_pMultipartBuffer;
+			if (m_nParseChar >= m_nMultipartContentLength)
+			{
+				m_pMultipartPointer = m_pMultipartBuffer;
 
-					nState = 3;
-				}
+				m_nParseState = 3;
 			}
 		}
-	}
 
-	if (nResult < 0)
-	{
-		CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Receive failed");
+		if (m_nParseState == 3)
+		{
+			*pConsumed = i+1;
 
-		return HTTPUnknownError;
+			return TRUE;
+		}
 	}
-	
-	if (Status != HTTPOK)
+
+	*pConsumed = nLength;
+
+	return FALSE;
+}
+
+THTTPStatus CHTTPDaemon::FinishRequest (void)
+{
+	if (m_ParseStatus != HTTPOK)
 	{
-		return Status;
+		return m_ParseStatus;
 	}
 	
-	if (nLine == 0)
+	if (m_nParseLine == 0)
 	{
 		return HTTPUnknownError;
 	}
@@ -547,6 +1028,14 @@ THTTPStatus CHTTPDaemon::ParseHeaderField (char *pLine)
 			strcpy (m_MultipartBoundary, pToken);
 		}
 	}
+	else if (strcmp (pToken, "Connection") == 0)
+	{
+		if (   (pToken = strtok_r (0, " ,", &pSavePtr)) != 0
+		    && strcasecmp (pToken, "close") == 0)
+		{
+			m_bConnectionClose = TRUE;
+		}
+	}
 	else if (strcmp (pToken, "Content-Length") == 0)
 	{
 		if ((pToken = strtok_r (0, " ", &pSavePtr)) == 0)
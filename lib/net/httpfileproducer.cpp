@@ -0,0 +1,161 @@
+//
+// httpfileproducer.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/httpfileproducer.h>
+#include <circle/fs/fsdef.h>
+#include <circle/util.h>
+#include <assert.h>
+
+static const struct
+{
+	const char *pExtension;
+	const char *pContentType;
+}
+s_ContentTypeMap[] =
+{
+	{"htm",		"text/html"},
+	{"html",	"text/html"},
+	{"txt",		"text/plain"},
+	{"css",		"text/css"},
+	{"js",		"application/javascript"},
+	{"jso",		"application/json"},
+	{"jsn",		"application/json"},
+	{"xml",		"application/xml"},
+	{"png",		"image/png"},
+	{"jpg",		"image/jpeg"},
+	{"gif",		"image/gif"},
+	{"ico",		"image/x-icon"},
+	{"svg",		"image/svg+xml"}
+};
+
+CHTTPFileProducer::CHTTPFileProducer (CFATFileSystem *pFileSystem)
+:	m_pFileSystem (pFileSystem),
+	m_hFile (0),
+	m_nSize (0)
+{
+}
+
+CHTTPFileProducer::~CHTTPFileProducer (void)
+{
+	if (m_hFile != 0)
+	{
+		assert (m_pFileSystem != 0);
+		m_pFileSystem->FileClose (m_hFile);
+		m_hFile = 0;
+	}
+
+	m_pFileSystem = 0;
+}
+
+boolean CHTTPFileProducer::Open (const char *pPath)
+{
+	assert (m_hFile == 0);
+
+	assert (pPath != 0);
+	if (*pPath == '/')
+	{
+		pPath++;
+	}
+
+	if (   *pPath == '\0'
+	    || strchr (pPath, '/') != 0)	// root directory only
+	{
+		return FALSE;
+	}
+
+	// find the file size in the directory
+	assert (m_pFileSystem != 0);
+	TDirentry Direntry;
+	TFindCurrentEntry CurrentEntry;
+	unsigned nEntry = m_pFileSystem->RootFindFirst (&Direntry, &CurrentEntry);
+	while (nEntry != 0)
+	{
+		if (strcasecmp (Direntry.chTitle, pPath) == 0)
+		{
+			break;
+		}
+
+		nEntry = m_pFileSystem->RootFindNext (&Direntry, &CurrentEntry);
+	}
+
+	if (   nEntry == 0
+	    || Direntry.nSize > 0x7FFFFFFF)
+	{
+		return FALSE;
+	}
+
+	m_hFile = m_pFileSystem->FileOpen (pPath);
+	if (m_hFile == 0)
+	{
+		return FALSE;
+	}
+
+	m_nSize = Direntry.nSize;
+
+	return TRUE;
+}
+
+int CHTTPFileProducer::GetContentLength (void)
+{
+	assert (m_hFile != 0);
+
+	return (int) m_nSize;
+}
+
+int CHTTPFileProducer::GetContentPart (u8 *pBuffer, unsigned nBufSize)
+{
+	assert (m_hFile != 0);
+	assert (m_pFileSystem != 0);
+
+	unsigned nResult = m_pFileSystem->FileRead (m_hFile, pBuffer, nBufSize);
+	if (nResult == 0xFFFFFFFF)
+	{
+		return -1;
+	}
+
+	return (int) nResult;
+}
+
+const char *CHTTPFileProducer::GetContentType (const char *pPath)
+{
+	assert (pPath != 0);
+	const char *pExtension = 0;
+	for (; *pPath != '\0'; pPath++)
+	{
+		if (*pPath == '.')
+		{
+			pExtension = pPath;
+		}
+	}
+
+	if (pExtension != 0)
+	{
+		pExtension++;
+
+		for (unsigned i = 0; i < sizeof s_ContentTypeMap / sizeof s_ContentTypeMap[0]; i++)
+		{
+			if (strcasecmp (pExtension, s_ContentTypeMap[i].pExtension) == 0)
+			{
+				return s_ContentTypeMap[i].pContentType;
+			}
+		}
+	}
+
+	return "application/octet-stream";
+}
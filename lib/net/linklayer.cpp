@@ -71,35 +71,39 @@ void CLinkLayer::Process (void)
 	assert (pOwnMACAddress != 0);
 
 	assert (m_pNetDevLayer != 0);
-	u8 Buffer[FRAME_BUFFER_SIZE];
-	unsigned nLength;
-	while (m_pNetDevLayer->Receive (Buffer, &nLength))
+	CNetBuffer *pBuffer;
+	while ((pBuffer = m_pNetDevLayer->Receive ()) != 0)
 	{
-		assert (nLength <= FRAME_BUFFER_SIZE);
-		if (nLength <= sizeof (TEthernetHeader))
+		assert (pBuffer->GetLength () <= FRAME_BUFFER_SIZE);
+		if (pBuffer->GetLength () <= sizeof (TEthernetHeader))
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
-		TEthernetHeader *pHeader = (TEthernetHeader *) Buffer;
+		TEthernetHeader *pHeader = (TEthernetHeader *) pBuffer->GetData ();
 
 		CMACAddress MACAddressReceiver (pHeader->MACReceiver);
 		if (    MACAddressReceiver != *pOwnMACAddress
 		    && !MACAddressReceiver.IsBroadcast ())
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 
-		nLength -= sizeof (TEthernetHeader);
-		assert (nLength > 0);
+		// the header stays valid in the buffer, only the data start is moved
+		pBuffer->RemoveHeader (sizeof (TEthernetHeader));
+		assert (pBuffer->GetLength () > 0);
 		
 		switch (pHeader->nProtocolType)
 		{
 		case BE (ETH_PROT_IP):
-			m_IPRxQueue.Enqueue (Buffer+sizeof (TEthernetHeader), nLength);
+			m_IPRxQueue.Enqueue (pBuffer);
 			break;
 
 		case BE (ETH_PROT_ARP):
-			m_ARPRxQueue.Enqueue (Buffer+sizeof (TEthernetHeader), nLength);
+			m_ARPRxQueue.Enqueue (pBuffer);
 			break;
 
 		default:
@@ -109,8 +113,11 @@ void CLinkLayer::Process (void)
 				assert (pParam != 0);
 				memcpy (pParam->MACSender, pHeader->MACSender, MAC_ADDRESS_SIZE);
 
-				m_RawRxQueue.Enqueue (Buffer+sizeof (TEthernetHeader),
-						      nLength, pParam);
+				m_RawRxQueue.Enqueue (pBuffer, pParam);
+			}
+			else
+			{
+				pBuffer->Release ();
 			}
 			break;
 		}
@@ -120,17 +127,20 @@ void CLinkLayer::Process (void)
 	m_pARPHandler->Process ();
 }
 
-boolean CLinkLayer::Send (const CIPAddress &rReceiver, const void *pIPPacket, unsigned nLength)
+boolean CLinkLayer::Send (const CIPAddress &rReceiver, CNetBuffer *pIPPacket)
 {
-	unsigned nFrameLength = sizeof (TEthernetHeader) + nLength;	// may wrap
-	if (   nFrameLength <= sizeof (TEthernetHeader)
-	    || nFrameLength > FRAME_BUFFER_SIZE)
+	assert (pIPPacket != 0);
+	assert (pIPPacket->GetLength () > 0);
+	if (pIPPacket->GetLength () > FRAME_BUFFER_SIZE - sizeof (TEthernetHeader))
 	{
+		pIPPacket->Release ();
+
 		return FALSE;
 	}
 
-	u8 FrameBuffer[nFrameLength];
-	TEthernetHeader *pHeader = (TEthernetHeader *) FrameBuffer;
+	TEthernetHeader *pHeader =
+		(TEthernetHeader *) pIPPacket->AddHeader (sizeof (TEthernetHeader));
+	assert (pHeader != 0);
 
 	assert (m_pNetDevLayer != 0);
 	const CMACAddress *pOwnMACAddress = m_pNetDevLayer->GetMACAddress ();
@@ -139,10 +149,6 @@ boolean CLinkLayer::Send (const CIPAddress &rReceiver, const void *pIPPacket, un
 
 	pHeader->nProtocolType = BE (ETH_PROT_IP);
 
-	assert (pIPPacket != 0);
-	assert (nLength > 0);
-	memcpy (FrameBuffer+sizeof (TEthernetHeader), pIPPacket, nLength);
-
 	assert (m_pNetConfig != 0);
 	assert (m_pARPHandler != 0);
 	CMACAddress MACAddressReceiver;
@@ -152,18 +158,45 @@ boolean CLinkLayer::Send (const CIPAddress &rReceiver, const void *pIPPacket, un
 		MACAddressReceiver.SetBroadcast ();
 	}
 	else if (!m_pARPHandler->Resolve (rReceiver, &MACAddressReceiver,
-					  FrameBuffer, nFrameLength))
+					  pIPPacket->GetData (), pIPPacket->GetLength ()))
 	{
+		pIPPacket->Release ();
+
 		return TRUE;		// packet will be retransmitted by ARP handler
 	}
 
 	MACAddressReceiver.CopyTo (pHeader->MACReceiver);
 
-	m_pNetDevLayer->Send (FrameBuffer, nFrameLength);
+	m_pNetDevLayer->Send (pIPPacket);
 
 	return TRUE;
 }
 
+CNetBuffer *CLinkLayer::Receive (void)
+{
+	return m_IPRxQueue.Dequeue ();
+}
+
+boolean CLinkLayer::Send (const CIPAddress &rReceiver, const void *pIPPacket, unsigned nLength)
+{
+	if (   nLength == 0
+	    || nLength > FRAME_BUFFER_SIZE - sizeof (TEthernetHeader))
+	{
+		return FALSE;
+	}
+
+	CNetBuffer *pBuffer = CNetBuffer::Alloc (LINK_LAYER_HEADROOM);
+	assert (pBuffer != 0);
+	if (!pBuffer->SetData (pIPPacket, nLength))
+	{
+		pBuffer->Release ();
+
+		return FALSE;
+	}
+
+	return Send (rReceiver, pBuffer);
+}
+
 boolean CLinkLayer::Receive (void *pBuffer, unsigned *pResultLength)
 {
 	assert (pBuffer != 0);
@@ -0,0 +1,248 @@
+//
+// netbuffer.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/netbuffer.h>
+#include <circle/util.h>
+#include <assert.h>
+
+CSpinLock CNetBuffer::s_SpinLock (TASK_LEVEL);
+
+CNetBuffer::CNetBuffer (void)
+:	m_nOffset (0),
+	m_nLength (0),
+	m_nRefCount (0),
+	m_pPool (0),
+	m_pNext (0),
+	m_pPrev (0),
+	m_pParam (0)
+{
+}
+
+CNetBuffer::~CNetBuffer (void)
+{
+	assert (m_nRefCount == 0);
+	m_pPool = 0;
+}
+
+CNetBuffer *CNetBuffer::Alloc (unsigned nHeadroom)
+{
+	CNetBuffer *pBuffer = 0;
+
+	CNetBufferPool *pPool = CNetBufferPool::Get ();
+	if (pPool != 0)
+	{
+		pBuffer = pPool->Allocate ();
+	}
+
+	if (pBuffer == 0)
+	{
+		pBuffer = new CNetBuffer;
+		assert (pBuffer != 0);
+	}
+
+	pBuffer->Reset (nHeadroom);
+
+	return pBuffer;
+}
+
+void CNetBuffer::AddRef (void)
+{
+	s_SpinLock.Acquire ();
+
+	assert (m_nRefCount > 0);
+	m_nRefCount++;
+
+	s_SpinLock.Release ();
+}
+
+void CNetBuffer::Release (void)
+{
+	s_SpinLock.Acquire ();
+
+	assert (m_nRefCount > 0);
+	unsigned nRefCount = --m_nRefCount;
+
+	s_SpinLock.Release ();
+
+	if (nRefCount > 0)
+	{
+		return;
+	}
+
+	if (m_pPool != 0)
+	{
+		m_pPool->Free (this);
+	}
+	else
+	{
+		delete this;
+	}
+}
+
+u8 *CNetBuffer::GetData (void)
+{
+	return m_Buffer + m_nOffset;
+}
+
+const u8 *CNetBuffer::GetData (void) const
+{
+	return m_Buffer + m_nOffset;
+}
+
+unsigned CNetBuffer::GetLength (void) const
+{
+	return m_nLength;
+}
+
+unsigned CNetBuffer::GetSize (void) const
+{
+	return FRAME_BUFFER_SIZE - m_nOffset;
+}
+
+boolean CNetBuffer::SetLength (unsigned nLength)
+{
+	if (nLength > GetSize ())
+	{
+		return FALSE;
+	}
+
+	m_nLength = nLength;
+
+	return TRUE;
+}
+
+boolean CNetBuffer::SetData (const void *pData, unsigned nLength)
+{
+	if (!SetLength (nLength))
+	{
+		return FALSE;
+	}
+
+	assert (pData != 0);
+	memcpy (GetData (), pData, nLength);
+
+	return TRUE;
+}
+
+void CNetBuffer::RemoveHeader (unsigned nLength)
+{
+	assert (nLength <= m_nLength);
+	m_nOffset += nLength;
+	m_nLength -= nLength;
+}
+
+void *CNetBuffer::AddHeader (unsigned nLength)
+{
+	assert (nLength <= m_nOffset);
+	m_nOffset -= nLength;
+	m_nLength += nLength;
+
+	return m_Buffer + m_nOffset;
+}
+
+void CNetBuffer::Reset (unsigned nHeadroom)
+{
+	assert (nHeadroom < FRAME_BUFFER_SIZE);
+	m_nOffset = nHeadroom;
+	m_nLength = 0;
+	m_nRefCount = 1;
+
+	m_pNext = 0;
+	m_pPrev = 0;
+	m_pParam = 0;
+}
+
+CNetBufferPool *CNetBufferPool::s_pThis = 0;
+
+CNetBufferPool::CNetBufferPool (unsigned nBuffers)
+:	m_pBuffers (0),
+	m_pFreeList (0),
+	m_nFreeCount (0),
+	m_SpinLock (TASK_LEVEL)
+{
+	assert (nBuffers > 0);
+	m_pBuffers = new CNetBuffer[nBuffers];
+	assert (m_pBuffers != 0);
+
+	for (unsigned i = 0; i < nBuffers; i++)
+	{
+		m_pBuffers[i].m_pPool = this;
+		m_pBuffers[i].m_pNext = m_pFreeList;
+		m_pFreeList = &m_pBuffers[i];
+	}
+
+	m_nFreeCount = nBuffers;
+
+	assert (s_pThis == 0);
+	s_pThis = this;
+}
+
+CNetBufferPool::~CNetBufferPool (void)
+{
+	s_pThis = 0;
+
+	m_pFreeList = 0;
+
+	delete [] m_pBuffers;
+	m_pBuffers = 0;
+}
+
+CNetBuffer *CNetBufferPool::Allocate (void)
+{
+	m_SpinLock.Acquire ();
+
+	CNetBuffer *pBuffer = m_pFreeList;
+	if (pBuffer != 0)
+	{
+		m_pFreeList = pBuffer->m_pNext;
+
+		assert (m_nFreeCount > 0);
+		m_nFreeCount--;
+	}
+
+	m_SpinLock.Release ();
+
+	return pBuffer;
+}
+
+void CNetBufferPool::Free (CNetBuffer *pBuffer)
+{
+	assert (pBuffer != 0);
+	assert (pBuffer->m_pPool == this);
+	assert (pBuffer->m_nRefCount == 0);
+
+	m_SpinLock.Acquire ();
+
+	pBuffer->m_pNext = m_pFreeList;
+	m_pFreeList = pBuffer;
+
+	m_nFreeCount++;
+
+	m_SpinLock.Release ();
+}
+
+unsigned CNetBufferPool::GetFreeCount (void) const
+{
+	return m_nFreeCount;
+}
+
+CNetBufferPool *CNetBufferPool::Get (void)
+{
+	return s_pThis;
+}
@@ -2,7 +2,7 @@
 // netconnection.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -32,7 +32,9 @@ CNetConnection::CNetConnection (CNetConfig	*pNetConfig,
 	m_nForeignPort (nForeignPort),
 	m_nOwnPort (nOwnPort),
 	m_nProtocol (nProtocol),
-	m_Checksum (*pNetConfig->GetIPAddress (), rForeignIP, nProtocol)
+	m_Checksum (*pNetConfig->GetIPAddress (), rForeignIP, nProtocol),
+	m_pNextHashed (0),
+	m_bHashed (FALSE)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pNetworkLayer != 0);
@@ -46,7 +48,10 @@ CNetConnection::CNetConnection (CNetConfig	*pNetConfig,
 	m_pNetworkLayer (pNetworkLayer),
 	m_nForeignPort (0),
 	m_nOwnPort (nOwnPort),
-	m_Checksum (*pNetConfig->GetIPAddress (), nProtocol)
+	m_nProtocol (nProtocol),
+	m_Checksum (*pNetConfig->GetIPAddress (), nProtocol),
+	m_pNextHashed (0),
+	m_bHashed (FALSE)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pNetworkLayer != 0);
@@ -73,3 +78,8 @@ int CNetConnection::GetProtocol (void) const
 {
 	return m_nProtocol;
 }
+
+boolean CNetConnection::IsListening (void) const
+{
+	return FALSE;
+}
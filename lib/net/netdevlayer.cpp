@@ -31,10 +31,23 @@ CNetDeviceLayer::CNetDeviceLayer (CNetConfig *pNetConfig, TNetDeviceType DeviceT
 	m_pNetConfig (pNetConfig),
 	m_pDevice (0)
 {
+	for (unsigned i = 0; i < NETDEV_BURST_SIZE; i++)
+	{
+		m_pRxBuffer[i] = 0;
+	}
 }
 
 CNetDeviceLayer::~CNetDeviceLayer (void)
 {
+	for (unsigned i = 0; i < NETDEV_BURST_SIZE; i++)
+	{
+		if (m_pRxBuffer[i] != 0)
+		{
+			m_pRxBuffer[i]->Release ();
+			m_pRxBuffer[i] = 0;
+		}
+	}
+
 	m_pDevice = 0;
 	m_pNetConfig = 0;
 }
@@ -91,23 +104,88 @@ void CNetDeviceLayer::Process (void)
 {
 	assert (m_pDevice != 0);
 
-	u8 Buffer[FRAME_BUFFER_SIZE] ALIGN(4);		// DMA buffer
-	unsigned nLength;
-	while (   m_pDevice->IsSendFrameAdvisable ()
-	       && (nLength = m_TxQueue.Dequeue (Buffer)) > 0)
+	// send queued frames in bursts
+	while (m_pDevice->IsSendFrameAdvisable ())
 	{
-		if (!m_pDevice->SendFrame (Buffer, nLength))
+		CNetBuffer *TxBuffer[NETDEV_BURST_SIZE];
+		const void *TxData[NETDEV_BURST_SIZE];
+		unsigned TxLength[NETDEV_BURST_SIZE];
+
+		unsigned nCount = 0;
+		CNetBuffer *pBuffer;
+		while (   nCount < NETDEV_BURST_SIZE
+		       && (pBuffer = m_TxQueue.Dequeue ()) != 0)
+		{
+			TxBuffer[nCount] = pBuffer;
+			TxData[nCount] = pBuffer->GetData ();
+			TxLength[nCount] = pBuffer->GetLength ();
+			nCount++;
+		}
+
+		if (nCount == 0)
+		{
+			break;
+		}
+
+		unsigned nSent = m_pDevice->SendFrames (TxData, TxLength, nCount);
+		assert (nSent <= nCount);
+
+		if (nSent == 0)
 		{
 			CLogger::Get ()->Write (FromNetDev, LogWarning, "Frame dropped");
 
+			nSent = 1;
+		}
+
+		for (unsigned i = 0; i < nSent; i++)
+		{
+			TxBuffer[i]->Release ();
+		}
+
+		if (nSent < nCount)
+		{
+			// put back the frames, which have not been sent, in the original order
+			for (unsigned i = nCount; i > nSent; i--)
+			{
+				m_TxQueue.Requeue (TxBuffer[i-1]);
+			}
+
 			break;
 		}
 	}
 
-	while (m_pDevice->ReceiveFrame (Buffer, &nLength))
+	// receive frames in bursts
+	while (TRUE)
 	{
-		assert (nLength > 0);
-		m_RxQueue.Enqueue (Buffer, nLength);
+		void *RxData[NETDEV_BURST_SIZE];
+		unsigned RxLength[NETDEV_BURST_SIZE];
+
+		for (unsigned i = 0; i < NETDEV_BURST_SIZE; i++)
+		{
+			if (m_pRxBuffer[i] == 0)
+			{
+				m_pRxBuffer[i] = CNetBuffer::Alloc ();
+				assert (m_pRxBuffer[i] != 0);
+			}
+
+			RxData[i] = m_pRxBuffer[i]->GetData ();
+		}
+
+		unsigned nCount = m_pDevice->ReceiveFrames (RxData, RxLength, NETDEV_BURST_SIZE);
+		assert (nCount <= NETDEV_BURST_SIZE);
+
+		for (unsigned i = 0; i < nCount; i++)
+		{
+			assert (RxLength[i] > 0);
+			m_pRxBuffer[i]->SetLength (RxLength[i]);
+			m_RxQueue.Enqueue (m_pRxBuffer[i]);
+			m_pRxBuffer[i] = 0;
+		}
+
+		if (nCount < NETDEV_BURST_SIZE)
+		{
+			break;
+		}
 	}
 }
 
@@ -117,6 +195,16 @@ const CMACAddress *CNetDeviceLayer::GetMACAddress (void) const
 	return m_pDevice->GetMACAddress ();
 }
 
+void CNetDeviceLayer::Send (CNetBuffer *pBuffer)
+{
+	m_TxQueue.Enqueue (pBuffer);
+}
+
+CNetBuffer *CNetDeviceLayer::Receive (void)
+{
+	return m_RxQueue.Dequeue ();
+}
+
 void CNetDeviceLayer::Send (const void *pBuffer, unsigned nLength)
 {
 	m_TxQueue.Enqueue (pBuffer, nLength);
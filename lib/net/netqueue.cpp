@@ -2,7 +2,7 @@
 // netqueue.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2017  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,15 +22,6 @@
 #include <circle/util.h>
 #include <assert.h>
 
-struct TNetQueueEntry
-{
-	volatile TNetQueueEntry *pPrev;
-	volatile TNetQueueEntry *pNext;
-	unsigned		 nLength;
-	unsigned char		 Buffer[FRAME_BUFFER_SIZE];
-	void			*pParam;
-};
-
 CNetQueue::CNetQueue (void)
 :	m_pFirst (0),
 	m_pLast (0),
@@ -50,101 +41,133 @@ boolean CNetQueue::IsEmpty (void) const
 
 void CNetQueue::Flush (void)
 {
-	while (m_pFirst != 0)
+	CNetBuffer *pBuffer;
+	while ((pBuffer = Dequeue ()) != 0)
 	{
-		m_SpinLock.Acquire ();
+		pBuffer->Release ();
+	}
+}
 
-		volatile TNetQueueEntry *pEntry = m_pFirst;
-		assert (pEntry != 0);
+void CNetQueue::Enqueue (CNetBuffer *pBuffer, void *pParam)
+{
+	assert (pBuffer != 0);
+	assert (pBuffer->GetLength () > 0);
+	assert (pBuffer->GetLength () <= FRAME_BUFFER_SIZE);
 
-		m_pFirst = pEntry->pNext;
-		if (m_pFirst != 0)
-		{
-			m_pFirst->pPrev = 0;
-		}
-		else
-		{
-			assert (m_pLast == pEntry);
-			m_pLast = 0;
-		}
+	pBuffer->m_pParam = pParam;
+
+	m_SpinLock.Acquire ();
 
-		m_SpinLock.Release ();
+	pBuffer->m_pPrev = m_pLast;
+	pBuffer->m_pNext = 0;
 
-		delete pEntry;
+	if (m_pFirst == 0)
+	{
+		m_pFirst = pBuffer;
 	}
-}
-	
-void CNetQueue::Enqueue (const void *pBuffer, unsigned nLength, void *pParam)
-{
-	TNetQueueEntry *pEntry = new TNetQueueEntry;
-	assert (pEntry != 0);
+	else
+	{
+		assert (m_pLast != 0);
+		assert (m_pLast->m_pNext == 0);
+		m_pLast->m_pNext = pBuffer;
+	}
+	m_pLast = pBuffer;
 
-	assert (nLength > 0);
-	assert (nLength <= FRAME_BUFFER_SIZE);
-	pEntry->nLength = nLength;
+	m_SpinLock.Release ();
+}
 
+void CNetQueue::Requeue (CNetBuffer *pBuffer, void *pParam)
+{
 	assert (pBuffer != 0);
-	memcpy (pEntry->Buffer, pBuffer, nLength);
+	assert (pBuffer->GetLength () > 0);
+	assert (pBuffer->GetLength () <= FRAME_BUFFER_SIZE);
 
-	pEntry->pParam = pParam;
+	pBuffer->m_pParam = pParam;
 
 	m_SpinLock.Acquire ();
 
-	pEntry->pPrev = m_pLast;
-	pEntry->pNext = 0;
+	pBuffer->m_pPrev = 0;
+	pBuffer->m_pNext = m_pFirst;
 
 	if (m_pFirst == 0)
 	{
-		m_pFirst = pEntry;
+		m_pLast = pBuffer;
 	}
 	else
 	{
-		assert (m_pLast != 0);
-		assert (m_pLast->pNext == 0);
-		m_pLast->pNext = pEntry;
+		assert (m_pFirst->m_pPrev == 0);
+		m_pFirst->m_pPrev = pBuffer;
 	}
-	m_pLast = pEntry;
+	m_pFirst = pBuffer;
 
 	m_SpinLock.Release ();
 }
 
-unsigned CNetQueue::Dequeue (void *pBuffer, void **ppParam)
+CNetBuffer *CNetQueue::Dequeue (void **ppParam)
 {
-	unsigned nResult = 0;
-	
-	if (m_pFirst != 0)
+	if (m_pFirst == 0)
 	{
-		m_SpinLock.Acquire ();
+		return 0;
+	}
 
-		volatile TNetQueueEntry *pEntry = m_pFirst;
-		assert (pEntry != 0);
+	m_SpinLock.Acquire ();
 
-		m_pFirst = pEntry->pNext;
+	CNetBuffer *pBuffer = m_pFirst;
+	if (pBuffer != 0)
+	{
+		m_pFirst = pBuffer->m_pNext;
 		if (m_pFirst != 0)
 		{
-			m_pFirst->pPrev = 0;
+			m_pFirst->m_pPrev = 0;
 		}
 		else
 		{
-			assert (m_pLast == pEntry);
+			assert (m_pLast == pBuffer);
 			m_pLast = 0;
 		}
 
-		m_SpinLock.Release ();
+		pBuffer->m_pNext = 0;
+	}
+
+	m_SpinLock.Release ();
 
-		nResult = pEntry->nLength;
-		assert (nResult > 0);
-		assert (nResult <= FRAME_BUFFER_SIZE);
+	if (   pBuffer != 0
+	    && ppParam != 0)
+	{
+		*ppParam = pBuffer->m_pParam;
+	}
 
-		memcpy (pBuffer, (const void *) pEntry->Buffer, nResult);
+	return pBuffer;
+}
 
-		if (ppParam != 0)
-		{
-			*ppParam = pEntry->pParam;
-		}
+void CNetQueue::Enqueue (const void *pBuffer, unsigned nLength, void *pParam)
+{
+	assert (nLength > 0);
+	assert (nLength <= FRAME_BUFFER_SIZE);
+
+	CNetBuffer *pNetBuffer = CNetBuffer::Alloc ();
+	assert (pNetBuffer != 0);
+	pNetBuffer->SetData (pBuffer, nLength);
+
+	Enqueue (pNetBuffer, pParam);
+}
 
-		delete pEntry;
+unsigned CNetQueue::Dequeue (void *pBuffer, void **ppParam)
+{
+	CNetBuffer *pNetBuffer = Dequeue (ppParam);
+	if (pNetBuffer == 0)
+	{
+		return 0;
 	}
 
+	unsigned nResult = pNetBuffer->GetLength ();
+	assert (nResult > 0);
+	assert (nResult <= FRAME_BUFFER_SIZE);
+
+	assert (pBuffer != 0);
+	memcpy (pBuffer, pNetBuffer->GetData (), nResult);
+
+	pNetBuffer->Release ();
+
 	return nResult;
 }
@@ -56,32 +56,40 @@ void CNetworkLayer::Process (void)
 	const CIPAddress *pOwnIPAddress = m_pNetConfig->GetIPAddress ();
 	assert (pOwnIPAddress != 0);
 
-	u8 Buffer[FRAME_BUFFER_SIZE];
-	unsigned nResultLength;
+	CNetBuffer *pBuffer;
 	assert (m_pLinkLayer != 0);
-	while (m_pLinkLayer->Receive (Buffer, &nResultLength))
+	while ((pBuffer = m_pLinkLayer->Receive ()) != 0)
 	{
+		unsigned nResultLength = pBuffer->GetLength ();
 		if (nResultLength <= sizeof (TIPHeader))
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
-		TIPHeader *pHeader = (TIPHeader *) Buffer;
+		TIPHeader *pHeader = (TIPHeader *) pBuffer->GetData ();
 
 		unsigned nHeaderLength = pHeader->nVersionIHL & 0xF;
 		if (   nHeaderLength < IP_HEADER_LENGTH_DWORD_MIN
 		    || nHeaderLength > IP_HEADER_LENGTH_DWORD_MAX)
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 		nHeaderLength *= 4;
 		if (nResultLength <= nHeaderLength)
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 
 		if (   CChecksumCalculator::SimpleCalculate (pHeader, nHeaderLength) != CHECKSUM_OK
 		    || (pHeader->nVersionIHL >> 4) != IP_VERSION)
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 
@@ -92,6 +100,8 @@ void CNetworkLayer::Process (void)
 			    && !IPAddressDestination.IsBroadcast ()
 			    && *m_pNetConfig->GetBroadcastAddress () != IPAddressDestination)
 			{
+				pBuffer->Release ();
+
 				continue;
 			}
 		}
@@ -99,6 +109,8 @@ void CNetworkLayer::Process (void)
 		{
 			if (!IPAddressDestination.IsBroadcast ())
 			{
+				pBuffer->Release ();
+
 				continue;
 			}
 		}
@@ -107,15 +119,19 @@ void CNetworkLayer::Process (void)
 		    ||    IP_FRAGMENT_OFFSET (le2be16 (pHeader->nFlagsFragmentOffset))
 		       != IP_FRAGMENT_OFFSET_FIRST)
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 		
 		unsigned nTotalLength = le2be16 (pHeader->nTotalLength);
 		if (nResultLength < nTotalLength)
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
-		nResultLength = nTotalLength;		// ignore padding
+		pBuffer->SetLength (nTotalLength);		// ignore padding
 
 		TNetworkPrivateData *pParam = new TNetworkPrivateData;
 		assert (pParam != 0);
@@ -123,15 +139,15 @@ void CNetworkLayer::Process (void)
 		memcpy (pParam->SourceAddress, pHeader->SourceAddress, IP_ADDRESS_SIZE);
 		memcpy (pParam->DestinationAddress, pHeader->DestinationAddress, IP_ADDRESS_SIZE);
 
-		nResultLength -= nHeaderLength;
+		pBuffer->RemoveHeader (nHeaderLength);
 
-		if (pHeader->nProtocol == IPPROTO_ICMP)
+		if (pParam->nProtocol == IPPROTO_ICMP)
 		{
-			m_ICMPRxQueue.Enqueue (Buffer+nHeaderLength, nResultLength, pParam);
+			m_ICMPRxQueue.Enqueue (pBuffer, pParam);
 		}
 		else
 		{
-			m_RxQueue.Enqueue (Buffer+nHeaderLength, nResultLength, pParam);
+			m_RxQueue.Enqueue (pBuffer, pParam);
 		}
 	}
 
@@ -143,13 +159,22 @@ boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, u
 {
 	unsigned nPacketLength = sizeof (TIPHeader) + nLength;		// may wrap
 	if (   nPacketLength <= sizeof (TIPHeader)
-	    || nPacketLength > FRAME_BUFFER_SIZE)
+	    || nPacketLength > FRAME_BUFFER_SIZE - LINK_LAYER_HEADROOM)
 	{
 		return FALSE;
 	}
 
-	u8 PacketBuffer[nPacketLength];
-	TIPHeader *pHeader = (TIPHeader *) PacketBuffer;
+	CNetBuffer *pBuffer = CNetBuffer::Alloc (LINK_LAYER_HEADROOM);
+	assert (pBuffer != 0);
+	if (!pBuffer->SetLength (nPacketLength))
+	{
+		pBuffer->Release ();
+
+		return FALSE;
+	}
+
+	u8 *pPacketBuffer = pBuffer->GetData ();
+	TIPHeader *pHeader = (TIPHeader *) pPacketBuffer;
 
 	pHeader->nVersionIHL          = IP_VERSION << 4 | IP_HEADER_LENGTH_DWORD_MIN;
 	pHeader->nTypeOfService       = IP_TOS_ROUTINE;
@@ -172,12 +197,13 @@ boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, u
 
 	assert (pPacket != 0);
 	assert (nLength > 0);
-	memcpy (PacketBuffer+sizeof (TIPHeader), pPacket, nLength);
+	memcpy (pPacketBuffer+sizeof (TIPHeader), pPacket, nLength);
 
 	if (   pOwnIPAddress->IsNull ()
 	    && !rReceiver.IsBroadcast ())
 	{
-		SendFailed (ICMP_CODE_DEST_NET_UNREACH, PacketBuffer, nPacketLength);
+		SendFailed (ICMP_CODE_DEST_NET_UNREACH, pPacketBuffer, nPacketLength);
+		pBuffer->Release ();
 
 		return FALSE;
 	}
@@ -198,7 +224,8 @@ boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, u
 			pNextHop = m_pNetConfig->GetDefaultGateway ();
 			if (pNextHop->IsNull ())
 			{
-				SendFailed (ICMP_CODE_DEST_NET_UNREACH, PacketBuffer, nPacketLength);
+				SendFailed (ICMP_CODE_DEST_NET_UNREACH, pPacketBuffer, nPacketLength);
+				pBuffer->Release ();
 
 				return FALSE;
 			}
@@ -207,19 +234,16 @@ boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, u
 	
 	assert (m_pLinkLayer != 0);
 	assert (pNextHop != 0);
-	return m_pLinkLayer->Send (*pNextHop, PacketBuffer, nPacketLength);
+	return m_pLinkLayer->Send (*pNextHop, pBuffer);
 }
 
-boolean CNetworkLayer::Receive (void *pBuffer, unsigned *pResultLength,
-				CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol)
+CNetBuffer *CNetworkLayer::Receive (CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol)
 {
 	void *pParam;
-	assert (pBuffer != 0);
-	assert (pResultLength != 0);
-	*pResultLength = m_RxQueue.Dequeue (pBuffer, &pParam);
-	if (*pResultLength == 0)
+	CNetBuffer *pBuffer = m_RxQueue.Dequeue (&pParam);
+	if (pBuffer == 0)
 	{
-		return FALSE;
+		return 0;
 	}
 	
 	TNetworkPrivateData *pData = (TNetworkPrivateData *) pParam;
@@ -237,6 +261,26 @@ boolean CNetworkLayer::Receive (void *pBuffer, unsigned *pResultLength,
 	delete pData;
 	pData = 0;
 	
+	return pBuffer;
+}
+
+boolean CNetworkLayer::Receive (void *pBuffer, unsigned *pResultLength,
+				CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol)
+{
+	CNetBuffer *pNetBuffer = Receive (pSender, pReceiver, pProtocol);
+	if (pNetBuffer == 0)
+	{
+		return FALSE;
+	}
+
+	assert (pResultLength != 0);
+	*pResultLength = pNetBuffer->GetLength ();
+
+	assert (pBuffer != 0);
+	memcpy (pBuffer, pNetBuffer->GetData (), *pResultLength);
+
+	pNetBuffer->Release ();
+	
 	return TRUE;
 }
 
@@ -2,7 +2,7 @@
 // retransmissionqueue.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2016  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -106,14 +106,51 @@ void CRetransmissionQueue::Read (void *pBuffer, unsigned nLength)
 	}
 }
 
+unsigned CRetransmissionQueue::ReadAt (unsigned nOffset, void *pBuffer, unsigned nLength) const
+{
+	assert (m_nSize > 1);
+	assert (m_nInPtr < m_nSize);
+	assert (m_nOutPtr < m_nSize);
+
+	unsigned nQueued = m_nInPtr >= m_nOutPtr ? m_nInPtr-m_nOutPtr : m_nSize+m_nInPtr-m_nOutPtr;
+	if (nOffset >= nQueued)
+	{
+		return 0;
+	}
+
+	nLength = nLength <= nQueued-nOffset ? nLength : nQueued-nOffset;
+
+	unsigned char *p = (unsigned char *) pBuffer;
+	assert (p != 0);
+	assert (m_pBuffer != 0);
+
+	unsigned nPtr = (m_nOutPtr+nOffset) % m_nSize;
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		*p++ = m_pBuffer[nPtr++];
+		nPtr %= m_nSize;
+	}
+
+	return nLength;
+}
+
 void CRetransmissionQueue::Advance (unsigned nBytes)
 {
 	assert (m_nSize > 1);
 	assert (m_nOutPtr < m_nSize);
 	assert (m_nPreOutPtr < m_nSize);
-	
+
+	// data may be acknowledged, which has not been re-sent after Reset()
+	unsigned nSent = m_nPreOutPtr >= m_nOutPtr ? m_nPreOutPtr-m_nOutPtr
+						   : m_nSize+m_nPreOutPtr-m_nOutPtr;
+
 	m_nOutPtr += nBytes;
 	m_nOutPtr %= m_nSize;
+
+	if (nBytes > nSent)
+	{
+		m_nPreOutPtr = m_nOutPtr;
+	}
 }
 
 void CRetransmissionQueue::Reset (void)
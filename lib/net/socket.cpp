@@ -2,7 +2,7 @@
 // socket.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -168,7 +168,7 @@ int CSocket::Listen (unsigned nBackLog)
 	return 0;
 }
 
-CSocket *CSocket::Accept (CIPAddress *pForeignIP, u16 *pForeignPort)
+CSocket *CSocket::Accept (CIPAddress *pForeignIP, u16 *pForeignPort, int nFlags)
 {
 	if (   m_nBackLog == 0
 	    || m_nOwnPort == 0)
@@ -203,6 +203,12 @@ CSocket *CSocket::Accept (CIPAddress *pForeignIP, u16 *pForeignPort)
 	assert (0 <= hConnection && hConnection < INT_MAX);
 	assert (nIndex < m_nBackLog);
 
+	if (   (nFlags & MSG_DONTWAIT)
+	    && !m_pTransportLayer->IsConnected (hConnection))
+	{
+		return 0;
+	}
+
 	CSocket *pNewSocket = 0;
 
 	assert (pForeignIP != 0);
@@ -358,3 +364,15 @@ const u8 *CSocket::GetForeignIP (void) const
 	assert (m_pTransportLayer != 0);
 	return m_pTransportLayer->GetForeignIP (m_hConnection);
 }
+
+boolean CSocket::GetTCPStatistics (TTCPStatistics *pStatistics) const
+{
+	if (   m_nProtocol != IPPROTO_TCP
+	    || m_hConnection < 0)
+	{
+		return FALSE;
+	}
+
+	assert (m_pTransportLayer != 0);
+	return m_pTransportLayer->GetTCPStatistics (pStatistics, m_hConnection);
+}
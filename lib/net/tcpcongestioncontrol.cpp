@@ -0,0 +1,309 @@
+//
+// tcpcongestioncontrol.cpp
+//
+// Pluggable TCP congestion control (RFC 5681, RFC 6582, RFC 8312)
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/tcpcongestioncontrol.h>
+#include <circle/timer.h>
+#include <assert.h>
+
+#define INITIAL_WINDOW		10		// segments (RFC 6928)
+#define MIN_WINDOW		2		// segments after loss
+
+// CUBIC constants: C = 0.4, beta = 0.7
+#define CUBIC_BETA_NUM		7
+#define CUBIC_BETA_DENOM	10
+#define CUBIC_FRIENDLY_NUM	9		// 3 * (1 - beta) / (1 + beta) ~= 9/17
+#define CUBIC_FRIENDLY_DENOM	17
+#define CUBIC_MAX_DELTA_T	60000		// ms, limits (t - K)^3 to fit into u64
+
+#define max(x, y)		((x) > (y) ? (x) : (y))
+#define min(x, y)		((x) < (y) ? (x) : (y))
+
+TTCPCongestionControl CTCPCongestionControl::s_DefaultType = TCPCongestionControlNewReno;
+
+CTCPCongestionControl::CTCPCongestionControl (void)
+:	m_nMSS (536),
+	m_nCongestionWindow (INITIAL_WINDOW * 536),
+	m_nSlowStartThreshold (0xFFFFFFFF)
+{
+}
+
+CTCPCongestionControl::~CTCPCongestionControl (void)
+{
+}
+
+void CTCPCongestionControl::Initialize (unsigned nMSS)
+{
+	assert (nMSS > 0);
+	m_nMSS = nMSS;
+
+	m_nCongestionWindow = INITIAL_WINDOW * m_nMSS;
+	m_nSlowStartThreshold = 0xFFFFFFFF;
+}
+
+unsigned CTCPCongestionControl::GetCongestionWindow (void) const
+{
+	return m_nCongestionWindow;
+}
+
+unsigned CTCPCongestionControl::GetSlowStartThreshold (void) const
+{
+	return m_nSlowStartThreshold;
+}
+
+void CTCPCongestionControl::RecoveryFinished (void)
+{
+	// deflate the window (RFC 6582 section 3.2 step 3)
+	m_nCongestionWindow = m_nSlowStartThreshold;
+}
+
+CTCPCongestionControl *CTCPCongestionControl::Create (void)
+{
+	return Create (s_DefaultType);
+}
+
+CTCPCongestionControl *CTCPCongestionControl::Create (TTCPCongestionControl Type)
+{
+	switch (Type)
+	{
+	case TCPCongestionControlCUBIC:
+		return new CTCPCubic;
+
+	case TCPCongestionControlNewReno:
+	default:
+		return new CTCPNewReno;
+	}
+}
+
+void CTCPCongestionControl::SetDefault (TTCPCongestionControl Type)
+{
+	assert (Type < TCPCongestionControlUnknown);
+	s_DefaultType = Type;
+}
+
+CTCPNewReno::CTCPNewReno (void)
+:	m_nBytesAcked (0)
+{
+}
+
+CTCPNewReno::~CTCPNewReno (void)
+{
+}
+
+TTCPCongestionControl CTCPNewReno::GetType (void) const
+{
+	return TCPCongestionControlNewReno;
+}
+
+void CTCPNewReno::Initialize (unsigned nMSS)
+{
+	CTCPCongestionControl::Initialize (nMSS);
+
+	m_nBytesAcked = 0;
+}
+
+void CTCPNewReno::DataAcknowledged (unsigned nBytesAcked)
+{
+	if (m_nCongestionWindow < m_nSlowStartThreshold)
+	{
+		// slow start
+		m_nCongestionWindow += min (nBytesAcked, m_nMSS);
+
+		return;
+	}
+
+	// congestion avoidance with appropriate byte counting (RFC 3465)
+	m_nBytesAcked += nBytesAcked;
+	if (m_nBytesAcked >= m_nCongestionWindow)
+	{
+		m_nBytesAcked -= m_nCongestionWindow;
+		m_nCongestionWindow += m_nMSS;
+	}
+}
+
+void CTCPNewReno::LossDetected (unsigned nFlightSize)
+{
+	m_nSlowStartThreshold = max (nFlightSize / 2, MIN_WINDOW * m_nMSS);
+	m_nCongestionWindow = m_nSlowStartThreshold;	// inflated by the caller, if required
+
+	m_nBytesAcked = 0;
+}
+
+void CTCPNewReno::RetransmissionTimeout (unsigned nFlightSize)
+{
+	m_nSlowStartThreshold = max (nFlightSize / 2, MIN_WINDOW * m_nMSS);
+	m_nCongestionWindow = m_nMSS;
+
+	m_nBytesAcked = 0;
+}
+
+CTCPCubic::CTCPCubic (void)
+:	m_nWindowMax (0),
+	m_nLastWindowMax (0),
+	m_nOriginPoint (0),
+	m_nEstimatedWindow (0),
+	m_bEpochStarted (FALSE),
+	m_nEpochStart (0),
+	m_nK (0)
+{
+}
+
+CTCPCubic::~CTCPCubic (void)
+{
+}
+
+TTCPCongestionControl CTCPCubic::GetType (void) const
+{
+	return TCPCongestionControlCUBIC;
+}
+
+void CTCPCubic::Initialize (unsigned nMSS)
+{
+	CTCPCongestionControl::Initialize (nMSS);
+
+	m_nWindowMax = 0;
+	m_nLastWindowMax = 0;
+	m_bEpochStarted = FALSE;
+}
+
+void CTCPCubic::DataAcknowledged (unsigned nBytesAcked)
+{
+	if (m_nCongestionWindow < m_nSlowStartThreshold)
+	{
+		m_nCongestionWindow += min (nBytesAcked, m_nMSS);
+
+		return;
+	}
+
+	unsigned nTicks = CTimer::Get ()->GetTicks ();
+	if (!m_bEpochStarted)
+	{
+		m_bEpochStarted = TRUE;
+		m_nEpochStart = nTicks;
+
+		if (m_nCongestionWindow < m_nWindowMax)
+		{
+			// K = cbrt ((W_max - cwnd) / C), with C = 0.4 and t in milliseconds
+			u64 nDiff = m_nWindowMax - m_nCongestionWindow;
+			m_nK = (unsigned) CubeRoot (nDiff * 2500000000ULL / m_nMSS);
+			m_nOriginPoint = m_nWindowMax;
+		}
+		else
+		{
+			m_nK = 0;
+			m_nOriginPoint = m_nCongestionWindow;
+		}
+
+		m_nEstimatedWindow = m_nCongestionWindow;
+	}
+
+	unsigned nTime = (nTicks - m_nEpochStart) * (1000 / HZ);	// ms since epoch
+
+	// W_cubic (t) = C * (t - K)^3 + W_max
+	boolean bBelowOrigin = nTime < m_nK;
+	u64 nDeltaT = bBelowOrigin ? m_nK - nTime : nTime - m_nK;
+	nDeltaT = min (nDeltaT, (u64) CUBIC_MAX_DELTA_T);
+
+	u64 nDelta = nDeltaT * nDeltaT * nDeltaT / 1000000 * 4 * m_nMSS / 10000;
+
+	u64 nTarget;
+	if (bBelowOrigin)
+	{
+		nTarget = nDelta < m_nOriginPoint ? m_nOriginPoint - nDelta : m_nMSS;
+	}
+	else
+	{
+		nTarget = m_nOriginPoint + nDelta;
+	}
+
+	// do not grow faster than 1.5 * cwnd per RTT
+	nTarget = min (nTarget, (u64) m_nCongestionWindow + m_nCongestionWindow / 2);
+
+	// Reno-friendly estimate
+	m_nEstimatedWindow +=   (u64) CUBIC_FRIENDLY_NUM * m_nMSS * nBytesAcked
+			      / ((u64) CUBIC_FRIENDLY_DENOM * m_nCongestionWindow);
+	if (m_nEstimatedWindow > nTarget)
+	{
+		nTarget = m_nEstimatedWindow;
+	}
+
+	u64 nIncrement;
+	if (nTarget > m_nCongestionWindow)
+	{
+		nIncrement = (nTarget - m_nCongestionWindow) * nBytesAcked / m_nCongestionWindow;
+	}
+	else
+	{
+		nIncrement = (u64) m_nMSS * nBytesAcked / (100 * (u64) m_nCongestionWindow);
+	}
+
+	m_nCongestionWindow += (unsigned) min (nIncrement, (u64) nBytesAcked);
+}
+
+void CTCPCubic::LossDetected (unsigned nFlightSize)
+{
+	ReduceWindow ();
+}
+
+void CTCPCubic::RetransmissionTimeout (unsigned nFlightSize)
+{
+	ReduceWindow ();
+
+	m_nCongestionWindow = m_nMSS;
+}
+
+void CTCPCubic::ReduceWindow (void)
+{
+	m_bEpochStarted = FALSE;
+
+	// fast convergence
+	if (m_nCongestionWindow < m_nLastWindowMax)
+	{
+		m_nWindowMax =   (u64) m_nCongestionWindow * (CUBIC_BETA_DENOM + CUBIC_BETA_NUM)
+			       / (2 * CUBIC_BETA_DENOM);
+	}
+	else
+	{
+		m_nWindowMax = m_nCongestionWindow;
+	}
+	m_nLastWindowMax = m_nCongestionWindow;
+
+	m_nSlowStartThreshold = max ((u64) m_nCongestionWindow * CUBIC_BETA_NUM / CUBIC_BETA_DENOM,
+				     (u64) MIN_WINDOW * m_nMSS);
+	m_nCongestionWindow = m_nSlowStartThreshold;
+}
+
+u64 CTCPCubic::CubeRoot (u64 nValue)
+{
+	// bitwise integer cube root
+	u64 nResult = 0;
+	for (int nShift = 63; nShift >= 0; nShift -= 3)
+	{
+		nResult <<= 1;
+		u64 nTry = 3 * nResult * (nResult + 1) + 1;
+		if ((nValue >> nShift) >= nTry)
+		{
+			nValue -= nTry << nShift;
+			nResult++;
+		}
+	}
+
+	return nResult;
+}
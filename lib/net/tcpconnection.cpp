@@ -44,10 +44,14 @@
 
 #define TCP_CONFIG_MSS			(MSS_R - 20)
 #define TCP_CONFIG_WINDOW		(TCP_CONFIG_MSS * 10)
+#define TCP_CONFIG_WINDOW_SHIFT		2	// RFC 7323 window scale factor we offer
+#define TCP_CONFIG_WINDOW_SCALED	(TCP_CONFIG_MSS * 88)	// if window scaling was negotiated
 
-#define TCP_CONFIG_RETRANS_BUFFER_SIZE	0x10000	// should be greater than maximum send window size
+#define TCP_CONFIG_RETRANS_BUFFER_SIZE	0x20000	// limits amount of data in flight
 
 #define TCP_MAX_WINDOW			((u16) -1)	// without Window extension option
+#define TCP_MAX_WINDOW_SHIFT		14	// RFC 7323 section 2.3
+#define TCP_DUPACK_THRESHOLD		3	// RFC 5681 section 3.2
 #define TCP_QUIET_TIME			30	// seconds after crash before another connection starts
 
 #define HZ_TIMEWAIT			(60 * HZ)
@@ -90,6 +94,7 @@ struct TTCPOption
 #define TCP_OPTION_MSS		2	//	Maximum segment size (2 byte)
 #define TCP_OPTION_WINDOW_SCALE	3	//	Shift count (1 byte)
 #define TCP_OPTION_SACK_PERM	4	//	None
+#define TCP_OPTION_SACK		5	//	Left edge, right edge of SACK blocks (n*2*4 byte)
 #define TCP_OPTION_TIMESTAMP	8	//	Timestamp value, Timestamp echo reply (2*4 byte)
 	u8	nLength;
 	u8	Data[];
@@ -147,8 +152,24 @@ CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 	m_nRCV_NXT (0),
 	m_nRCV_WND (TCP_CONFIG_WINDOW),
 	m_nIRS (0),
-	m_nSND_MSS (536)	// RFC 1122 section 4.2.2.6
+	m_nSND_MSS (536),	// RFC 1122 section 4.2.2.6
+	m_bWindowScale (FALSE),
+	m_nSND_WindowShift (0),
+	m_nRCV_WindowShift (0),
+	m_bSACKPermitted (FALSE),
+	m_nSACKBlocks (0),
+	m_nScoreboardEntries (0),
+	m_pCongestionControl (CTCPCongestionControl::Create ()),
+	m_nDuplicateACKs (0),
+	m_bInRecovery (FALSE),
+	m_nWindowInflation (0),
+	m_bFastRetransmit (FALSE),
+	m_nRetransmissions (0),
+	m_nFastRetransmissions (0),
+	m_nTimeouts (0)
 {
+	assert (m_pCongestionControl != 0);
+
 	s_nConnections++;
 
 	for (unsigned nTimer = TCPTimerUser; nTimer < TCPTimerUnknown; nTimer++)
@@ -161,6 +182,7 @@ CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 
 	m_nSND_UNA = m_nISS;
 	m_nSND_NXT = m_nISS+1;
+	m_nSND_MAX = m_nSND_NXT;
 
 	if (SendSegment (TCP_FLAG_SYN, m_nISS))
 	{
@@ -190,8 +212,24 @@ CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 	m_nRCV_NXT (0),
 	m_nRCV_WND (TCP_CONFIG_WINDOW),
 	m_nIRS (0),
-	m_nSND_MSS (536)	// RFC 1122 section 4.2.2.6
+	m_nSND_MSS (536),	// RFC 1122 section 4.2.2.6
+	m_bWindowScale (FALSE),
+	m_nSND_WindowShift (0),
+	m_nRCV_WindowShift (0),
+	m_bSACKPermitted (FALSE),
+	m_nSACKBlocks (0),
+	m_nScoreboardEntries (0),
+	m_pCongestionControl (CTCPCongestionControl::Create ()),
+	m_nDuplicateACKs (0),
+	m_bInRecovery (FALSE),
+	m_nWindowInflation (0),
+	m_bFastRetransmit (FALSE),
+	m_nRetransmissions (0),
+	m_nFastRetransmissions (0),
+	m_nTimeouts (0)
 {
+	assert (m_pCongestionControl != 0);
+
 	s_nConnections++;
 
 	for (unsigned nTimer = TCPTimerUser; nTimer < TCPTimerUnknown; nTimer++)
@@ -213,6 +251,9 @@ CTCPConnection::~CTCPConnection (void)
 		StopTimer (nTimer);
 	}
 
+	delete m_pCongestionControl;
+	m_pCongestionControl = 0;
+
 	assert (s_nConnections > 0);
 	s_nConnections--;
 }
@@ -488,6 +529,25 @@ int CTCPConnection::SetOptionBroadcast (boolean bAllowed)
 	return 0;
 }
 
+void CTCPConnection::GetStatistics (TTCPStatistics *pStatistics) const
+{
+	assert (pStatistics != 0);
+	assert (m_pCongestionControl != 0);
+
+	pStatistics->CongestionControl	 = m_pCongestionControl->GetType ();
+	pStatistics->nCongestionWindow	 = m_pCongestionControl->GetCongestionWindow ();
+	pStatistics->nSlowStartThreshold = m_pCongestionControl->GetSlowStartThreshold ();
+	pStatistics->nSendWindow	 = m_nSND_WND;
+	pStatistics->nReceiveWindow	 = m_nRCV_WND;
+	pStatistics->nSendMSS		 = m_nSND_MSS;
+	pStatistics->bWindowScale	 = m_bWindowScale;
+	pStatistics->bSACKPermitted	 = m_bSACKPermitted;
+	pStatistics->nRetransmissions	 = m_nRetransmissions;
+	pStatistics->nFastRetransmissions = m_nFastRetransmissions;
+	pStatistics->nTimeouts		 = m_nTimeouts;
+	pStatistics->bSendQueueEmpty	 = m_TxQueue.IsEmpty ();
+}
+
 boolean CTCPConnection::IsConnected (void) const
 {
 	return     m_State > TCPStateSynSent
@@ -499,6 +559,11 @@ boolean CTCPConnection::IsTerminated (void) const
 	return m_State == TCPStateClosed;
 }
 
+boolean CTCPConnection::IsListening (void) const
+{
+	return m_State == TCPStateListen;
+}
+
 void CTCPConnection::Process (void)
 {
 	if (m_bTimedOut)
@@ -547,6 +612,10 @@ void CTCPConnection::Process (void)
 			SendSegment (TCP_FLAG_FIN | TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
 			m_RTOCalculator.SegmentSent (m_nSND_NXT);
 			m_nSND_NXT++;
+			if (gt (m_nSND_NXT, m_nSND_MAX))
+			{
+				m_nSND_MAX = m_nSND_NXT;
+			}
 			NEW_STATE (m_StateAfterFIN);
 			m_bFINQueued = FALSE;
 			StartTimer (TCPTimerRetransmission, m_RTOCalculator.GetRTO ());
@@ -572,14 +641,32 @@ void CTCPConnection::Process (void)
 		CLogger::Get ()->Write (FromTCP, LogDebug, "Retransmission (nxt %u, una %u)", m_nSND_NXT-m_nISS, m_nSND_UNA-m_nISS);
 #endif
 		m_bRetransmit = FALSE;
+
+		assert (m_pCongestionControl != 0);
+		m_pCongestionControl->RetransmissionTimeout (m_nSND_MAX-m_nSND_UNA);
+		m_nTimeouts++;
+
+		// RFC 6675 section 5.1: SACK information may be reneged after timeout
+		m_nScoreboardEntries = 0;
+		m_bInRecovery = FALSE;
+		m_bFastRetransmit = FALSE;
+		m_nDuplicateACKs = 0;
+		m_nWindowInflation = 0;
+
 		m_RetransmissionQueue.Reset ();
 		m_nSND_NXT = m_nSND_UNA;
 	}
+	else if (m_bFastRetransmit)
+	{
+		m_bFastRetransmit = FALSE;
+
+		RetransmitHole ();
+	}
 
 	u32 nBytesAvail;
 	u32 nWindowLeft;
 	while (   (nBytesAvail = m_RetransmissionQueue.GetBytesAvailable ()) > 0
-	       && (nWindowLeft = m_nSND_UNA+m_nSND_WND-m_nSND_NXT) > 0)
+	       && (nWindowLeft = GetSendWindowLeft ()) > 0)
 	{
 		nLength = min (nBytesAvail, nWindowLeft);
 		nLength = min (nLength, m_nSND_MSS);
@@ -600,7 +687,15 @@ void CTCPConnection::Process (void)
 
 		SendSegment (nFlags, m_nSND_NXT, m_nRCV_NXT, TempBuffer, nLength);
 		m_RTOCalculator.SegmentSent (m_nSND_NXT, nLength);
+		if (lt (m_nSND_NXT, m_nSND_MAX))
+		{
+			m_nRetransmissions++;
+		}
 		m_nSND_NXT += nLength;
+		if (gt (m_nSND_NXT, m_nSND_MAX))
+		{
+			m_nSND_MAX = m_nSND_NXT;
+		}
 		StartTimer (TCPTimerRetransmission, m_RTOCalculator.GetRTO ());
 	}
 }
@@ -676,6 +771,11 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 
 	ScanOptions (pHeader);
 
+	if (!(nFlags & TCP_FLAG_SYN))
+	{
+		nSEG_WND <<= m_nSND_WindowShift;	// RFC 7323 section 2.3
+	}
+
 #ifdef TCP_DEBUG
 	CLogger::Get ()->Write (FromTCP, LogDebug,
 				"rx %c%c%c%c%c%c, seq %u, ack %u, win %u, len %u",
@@ -772,6 +872,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			m_RTOCalculator.SegmentSent (m_nISS);
 
 			m_nSND_NXT = m_nISS+1;
+			m_nSND_MAX = m_nSND_NXT;
 			m_nSND_UNA = m_nISS;
 			
 			NEW_STATE (TCPStateSynReceived);
@@ -851,6 +952,8 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				m_nSND_WND = nSEG_WND;
 				m_nSND_WL1 = nSEG_SEQ;
 				m_nSND_WL2 = nSEG_ACK;
+
+				InitializeTransmission ();
 	
 				SendSegment (TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
 				
@@ -1029,6 +1132,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				m_RTOCalculator.SegmentAcknowledged (nSEG_ACK);
 
 				NEW_STATE (TCPStateEstablished);
+				InitializeTransmission ();
 
 				// next transmission starts with this count
 				m_nRetransmissionCount = MAX_RETRANSMISSIONS;
@@ -1044,14 +1148,19 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 		case TCPStateFinWait2:
 		case TCPStateCloseWait:
 		case TCPStateClosing:
-			if (bwh (m_nSND_UNA, nSEG_ACK, m_nSND_NXT))
+			if (bwh (m_nSND_UNA, nSEG_ACK, m_nSND_MAX))
 			{
 				m_RTOCalculator.SegmentAcknowledged (nSEG_ACK);
 
 				unsigned nBytesAck = nSEG_ACK-m_nSND_UNA;
 				m_nSND_UNA = nSEG_ACK;
 
-				if (nSEG_ACK == m_nSND_NXT)	// all segments are acknowledged
+				if (gt (nSEG_ACK, m_nSND_NXT))	// data sent before timeout has arrived
+				{
+					m_nSND_NXT = nSEG_ACK;
+				}
+
+				if (nSEG_ACK == m_nSND_MAX)	// all segments are acknowledged
 				{
 					StopTimer (TCPTimerRetransmission);
 
@@ -1088,10 +1197,51 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 					m_nSND_WL1 = nSEG_SEQ;
 					m_nSND_WL2 = nSEG_ACK;
 				}
+
+				UpdateScoreboard ();
+
+				assert (m_pCongestionControl != 0);
+				if (m_bInRecovery)
+				{
+					if (ge (nSEG_ACK, m_nRecoveryPoint))
+					{
+						// full acknowledgment (RFC 6582 section 3.2 step 3)
+						m_bInRecovery = FALSE;
+						m_nWindowInflation = 0;
+						m_pCongestionControl->RecoveryFinished ();
+					}
+					else
+					{
+						// partial acknowledgment, retransmit next hole
+						if (!m_bSACKPermitted)
+						{
+							m_nHighRxt = m_nSND_UNA;
+						}
+						m_nWindowInflation = 0;
+						m_bFastRetransmit = TRUE;
+					}
+				}
+				else if (nBytesAck > 0)
+				{
+					m_pCongestionControl->DataAcknowledged (nBytesAck);
+				}
+
+				m_nDuplicateACKs = 0;
 			}
 			else if (le (nSEG_ACK, m_nSND_UNA))	// RFC 1122 section 4.2.2.20 (g)
 			{
-				// ignore duplicate ACK ...
+				// duplicate ACK may indicate a lost segment (RFC 5681 section 3.2)
+				if (   nSEG_ACK == m_nSND_UNA
+				    && nDataLength == 0
+				    && !(nFlags & TCP_FLAG_FIN)
+				    && m_nSND_MAX != m_nSND_UNA
+				    && (   m_State == TCPStateEstablished
+					|| m_State == TCPStateCloseWait))
+				{
+					DuplicateACKReceived ();
+				}
+
+				// ignore duplicate ACK otherwise ...
 				
 				// RFC 1122 section 4.2.2.20 (g)
 				if (bwlh (m_nSND_UNA, nSEG_ACK, m_nSND_NXT))
@@ -1107,7 +1257,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 					}
 				}
 			}
-			else if (gt (nSEG_ACK, m_nSND_NXT))
+			else if (gt (nSEG_ACK, m_nSND_MAX))
 			{
 				SendSegment (TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
 				return 1;
@@ -1345,11 +1495,29 @@ int CTCPConnection::NotificationReceived (TICMPNotificationType  Type,
 boolean CTCPConnection::SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 nAcknowledgmentNumber,
 				     const void *pData, unsigned nDataLength)
 {
+	// options are offered on SYN, a SYN-ACK only confirms the options offered by the peer
+	boolean bOfferWindowScale = FALSE;
+	boolean bOfferSACK = FALSE;
+
 	unsigned nDataOffset = 5;
 	assert (nDataOffset * 4 == sizeof (TTCPHeader));
 	if (nFlags & TCP_FLAG_SYN)
 	{
 		nDataOffset++;
+
+		if (   !(nFlags & TCP_FLAG_ACK)
+		    || m_bWindowScale)
+		{
+			bOfferWindowScale = TRUE;
+			nDataOffset++;
+		}
+
+		if (   !(nFlags & TCP_FLAG_ACK)
+		    || m_bSACKPermitted)
+		{
+			bOfferSACK = TRUE;
+			nDataOffset++;
+		}
 	}
 	unsigned nHeaderLength = nDataOffset * 4;
 	
@@ -1365,7 +1533,8 @@ boolean CTCPConnection::SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 n
 	pHeader->nSequenceNumber 	= le2be32 (nSequenceNumber);
 	pHeader->nAcknowledgmentNumber	= nFlags & TCP_FLAG_ACK ? le2be32 (nAcknowledgmentNumber) : 0;
 	pHeader->nDataOffsetFlags	= (nDataOffset << TCP_DATA_OFFSET_SHIFT) | nFlags;
-	pHeader->nWindow		= le2be16 (m_nRCV_WND);
+	pHeader->nWindow		= le2be16 (nFlags & TCP_FLAG_SYN ? min (m_nRCV_WND, TCP_MAX_WINDOW)
+								 : m_nRCV_WND >> m_nRCV_WindowShift);
 	pHeader->nUrgentPointer		= le2be16 (m_nSND_UP);
 
 	if (nFlags & TCP_FLAG_SYN)
@@ -1376,16 +1545,41 @@ boolean CTCPConnection::SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 n
 		pOption->nLength = 4;
 		pOption->Data[0] = TCP_CONFIG_MSS >> 8;
 		pOption->Data[1] = TCP_CONFIG_MSS & 0xFF;
-	}
 
-	if (nDataLength > 0)
-	{
-		assert (pData != 0);
-		memcpy (TxBuffer+nHeaderLength, pData, nDataLength);
+		u8 *pNext = (u8 *) pOption + 4;
+
+		if (bOfferWindowScale)
+		{
+			pNext[0] = TCP_OPTION_NOP;
+
+			pOption = (TTCPOption *) (pNext+1);
+			pOption->nKind   = TCP_OPTION_WINDOW_SCALE;
+			pOption->nLength = 3;
+			pOption->Data[0] = TCP_CONFIG_WINDOW_SHIFT;
+
+			pNext += 4;
+		}
+
+		if (bOfferSACK)
+		{
+			pNext[0] = TCP_OPTION_NOP;
+			pNext[1] = TCP_OPTION_NOP;
+
+			pOption = (TTCPOption *) (pNext+2);
+			pOption->nKind   = TCP_OPTION_SACK_PERM;
+			pOption->nLength = 2;
+
+			pNext += 4;
+		}
+
+		assert (pNext == TxBuffer+nHeaderLength);
 	}
 
+	assert (nDataLength == 0 || pData != 0);
 	pHeader->nChecksum = 0;		// must be 0 for calculation
-	pHeader->nChecksum = m_Checksum.Calculate (TxBuffer, nPacketLength);
+	pHeader->nChecksum = m_Checksum.CopyAndCalculate (TxBuffer, nHeaderLength,
+							  TxBuffer+nHeaderLength,
+							  pData, nDataLength);
 
 #ifdef TCP_DEBUG
 	CLogger::Get ()->Write (FromTCP, LogDebug,
@@ -1412,6 +1606,20 @@ void CTCPConnection::ScanOptions (TTCPHeader *pHeader)
 	unsigned nDataOffset = TCP_DATA_OFFSET (pHeader->nDataOffsetFlags)*4;
 	u8 *pHeaderEnd = (u8 *) pHeader+nDataOffset;
 
+	// window scale and SACK-permitted are only valid in the SYN of the handshake
+	boolean bNegotiate =    (pHeader->nDataOffsetFlags & TCP_FLAG_SYN)
+			     && (   m_State == TCPStateListen
+				 || m_State == TCPStateSynSent);
+	if (bNegotiate)
+	{
+		m_bWindowScale = FALSE;
+		m_nSND_WindowShift = 0;
+		m_nRCV_WindowShift = 0;
+		m_bSACKPermitted = FALSE;
+	}
+
+	m_nSACKBlocks = 0;
+
 	TTCPOption *pOption = (TTCPOption *) pHeader->Options;
 	while ((u8 *) pOption+2 <= pHeaderEnd)
 	{
@@ -1441,12 +1649,310 @@ void CTCPConnection::ScanOptions (TTCPHeader *pHeader)
 			// fall through
 
 		default:
+		NextOption:
+			if (pOption->nLength < 2)	// malformed option
+			{
+				return;
+			}
 			pOption = (TTCPOption *) ((u8 *) pOption+pOption->nLength);
 			break;
+
+		case TCP_OPTION_WINDOW_SCALE:
+			if (   bNegotiate
+			    && pOption->nLength == 3
+			    && (u8 *) pOption+3 <= pHeaderEnd)
+			{
+				m_bWindowScale = TRUE;
+				m_nSND_WindowShift = min (pOption->Data[0], TCP_MAX_WINDOW_SHIFT);
+				m_nRCV_WindowShift = TCP_CONFIG_WINDOW_SHIFT;
+			}
+			goto NextOption;
+
+		case TCP_OPTION_SACK_PERM:
+			if (   bNegotiate
+			    && pOption->nLength == 2)
+			{
+				m_bSACKPermitted = TRUE;
+			}
+			goto NextOption;
+
+		case TCP_OPTION_SACK:
+			if (   m_bSACKPermitted
+			    && pOption->nLength >= 2+8
+			    && (pOption->nLength-2) % 8 == 0
+			    && (u8 *) pOption+pOption->nLength <= pHeaderEnd)
+			{
+				u8 *pData = pOption->Data;
+				for (unsigned i = 0; i < (pOption->nLength-2U) / 8U; i++, pData += 8)
+				{
+					if (m_nSACKBlocks >= TCP_MAX_SACK_BLOCKS)
+					{
+						break;
+					}
+
+					// options are not aligned
+					TTCPSACKBlock *pBlock = &m_SACKBlock[m_nSACKBlocks++];
+					pBlock->nLeft  =   (u32) pData[0] << 24 | (u32) pData[1] << 16
+							 | (u32) pData[2] << 8  | pData[3];
+					pBlock->nRight =   (u32) pData[4] << 24 | (u32) pData[5] << 16
+							 | (u32) pData[6] << 8  | pData[7];
+				}
+			}
+			goto NextOption;
 		}
 	}
 }
 
+void CTCPConnection::InitializeTransmission (void)
+{
+	if (m_bWindowScale)
+	{
+		m_nRCV_WND = TCP_CONFIG_WINDOW_SCALED;
+	}
+
+	assert (m_pCongestionControl != 0);
+	m_pCongestionControl->Initialize (m_nSND_MSS);
+
+	m_nScoreboardEntries = 0;
+	m_nDuplicateACKs = 0;
+	m_bInRecovery = FALSE;
+	m_nWindowInflation = 0;
+	m_bFastRetransmit = FALSE;
+}
+
+u32 CTCPConnection::GetSendWindowLeft (void) const
+{
+	// offered window of the receiver counts from SND.UNA
+	u32 nFlightSize = m_nSND_NXT-m_nSND_UNA;
+	if (m_nSND_WND <= nFlightSize)
+	{
+		return 0;
+	}
+	u32 nWindowLeft = m_nSND_WND-nFlightSize;
+
+	// congestion window counts data assumed to be in the network (RFC 6675 "pipe")
+	u32 nSACKed = GetSACKedBytes ();
+	u32 nPipe = nFlightSize > nSACKed ? nFlightSize-nSACKed : 0;
+
+	assert (m_pCongestionControl != 0);
+	u32 nCongestionWindow = m_pCongestionControl->GetCongestionWindow () + m_nWindowInflation;
+	if (nCongestionWindow <= nPipe)
+	{
+		return 0;
+	}
+
+	return min (nWindowLeft, nCongestionWindow-nPipe);
+}
+
+void CTCPConnection::DuplicateACKReceived (void)
+{
+	UpdateScoreboard ();
+
+	if (m_bInRecovery)
+	{
+		if (m_bSACKPermitted)
+		{
+			m_bFastRetransmit = TRUE;	// next hole, if any
+		}
+		else
+		{
+			m_nWindowInflation += m_nSND_MSS;
+		}
+
+		return;
+	}
+
+	if (++m_nDuplicateACKs < TCP_DUPACK_THRESHOLD)
+	{
+		return;
+	}
+
+	// enter fast recovery (RFC 6582 section 3.2 step 2, RFC 6675 section 5)
+	m_bInRecovery = TRUE;
+	m_nRecoveryPoint = m_nSND_MAX;
+	m_nHighRxt = m_nSND_UNA;
+
+	assert (m_pCongestionControl != 0);
+	m_pCongestionControl->LossDetected (m_nSND_MAX-m_nSND_UNA);
+
+	if (!m_bSACKPermitted)
+	{
+		m_nWindowInflation = TCP_DUPACK_THRESHOLD * m_nSND_MSS;
+	}
+
+	m_nFastRetransmissions++;
+	m_bFastRetransmit = TRUE;
+}
+
+boolean CTCPConnection::RetransmitHole (void)
+{
+	u32 nSequence = gt (m_nHighRxt, m_nSND_UNA) ? m_nHighRxt : m_nSND_UNA;
+
+	// skip data, which has been selectively acknowledged (scoreboard is ordered)
+	u32 nEnd = lt (m_nRecoveryPoint, m_nSND_NXT) ? m_nRecoveryPoint : m_nSND_NXT;
+	for (unsigned i = 0; i < m_nScoreboardEntries; i++)
+	{
+		if (bwl (m_Scoreboard[i].nLeft, nSequence, m_Scoreboard[i].nRight))
+		{
+			nSequence = m_Scoreboard[i].nRight;
+		}
+		else if (lt (nSequence, m_Scoreboard[i].nLeft))
+		{
+			if (lt (m_Scoreboard[i].nLeft, nEnd))
+			{
+				nEnd = m_Scoreboard[i].nLeft;
+			}
+
+			break;
+		}
+	}
+
+	if (!lt (nSequence, nEnd))
+	{
+		return FALSE;
+	}
+
+	unsigned nLength = min (nEnd-nSequence, m_nSND_MSS);
+
+	u8 TempBuffer[FRAME_BUFFER_SIZE];
+	assert (nLength <= FRAME_BUFFER_SIZE);
+	nLength = m_RetransmissionQueue.ReadAt (nSequence-m_nSND_UNA, TempBuffer, nLength);
+	if (nLength == 0)
+	{
+		return FALSE;
+	}
+
+#ifdef TCP_DEBUG
+	CLogger::Get ()->Write (FromTCP, LogDebug, "Fast retransmission (seq %u, len %u)", nSequence-m_nISS, nLength);
+#endif
+
+	SendSegment (TCP_FLAG_ACK, nSequence, m_nRCV_NXT, TempBuffer, nLength);
+	m_nHighRxt = nSequence+nLength;
+	m_nRetransmissions++;
+
+	StartTimer (TCPTimerRetransmission, m_RTOCalculator.GetRTO ());
+
+	return TRUE;
+}
+
+void CTCPConnection::UpdateScoreboard (void)
+{
+	for (unsigned i = 0; i < m_nSACKBlocks; i++)
+	{
+		u32 nLeft = m_SACKBlock[i].nLeft;
+		u32 nRight = m_SACKBlock[i].nRight;
+
+		// ignore invalid and D-SACK blocks (RFC 2883)
+		if (   !lt (nLeft, nRight)
+		    || !gt (nRight, m_nSND_UNA)
+		    || gt (nRight, m_nSND_MAX))
+		{
+			continue;
+		}
+
+		if (lt (nLeft, m_nSND_UNA))
+		{
+			nLeft = m_nSND_UNA;
+		}
+
+		// merge with overlapping or adjacent entries
+		unsigned j = 0;
+		while (j < m_nScoreboardEntries)
+		{
+			if (   le (m_Scoreboard[j].nLeft, nRight)
+			    && le (nLeft, m_Scoreboard[j].nRight))
+			{
+				if (lt (m_Scoreboard[j].nLeft, nLeft))
+				{
+					nLeft = m_Scoreboard[j].nLeft;
+				}
+
+				if (gt (m_Scoreboard[j].nRight, nRight))
+				{
+					nRight = m_Scoreboard[j].nRight;
+				}
+
+				m_nScoreboardEntries--;
+				for (unsigned k = j; k < m_nScoreboardEntries; k++)
+				{
+					m_Scoreboard[k] = m_Scoreboard[k+1];
+				}
+			}
+			else
+			{
+				j++;
+			}
+		}
+
+		// insert in order, if full the highest entry is dropped
+		unsigned nPos = 0;
+		while (   nPos < m_nScoreboardEntries
+		       && lt (m_Scoreboard[nPos].nLeft, nLeft))
+		{
+			nPos++;
+		}
+
+		if (m_nScoreboardEntries == TCP_SACK_SCOREBOARD)
+		{
+			if (nPos == m_nScoreboardEntries)
+			{
+				continue;
+			}
+
+			m_nScoreboardEntries--;
+		}
+
+		for (unsigned k = m_nScoreboardEntries; k > nPos; k--)
+		{
+			m_Scoreboard[k] = m_Scoreboard[k-1];
+		}
+
+		m_Scoreboard[nPos].nLeft = nLeft;
+		m_Scoreboard[nPos].nRight = nRight;
+		m_nScoreboardEntries++;
+	}
+
+	m_nSACKBlocks = 0;
+
+	PruneScoreboard ();
+}
+
+void CTCPConnection::PruneScoreboard (void)
+{
+	unsigned nAcked = 0;
+	while (   nAcked < m_nScoreboardEntries
+	       && le (m_Scoreboard[nAcked].nRight, m_nSND_UNA))
+	{
+		nAcked++;
+	}
+
+	if (nAcked > 0)
+	{
+		m_nScoreboardEntries -= nAcked;
+		for (unsigned i = 0; i < m_nScoreboardEntries; i++)
+		{
+			m_Scoreboard[i] = m_Scoreboard[i+nAcked];
+		}
+	}
+
+	if (   m_nScoreboardEntries > 0
+	    && lt (m_Scoreboard[0].nLeft, m_nSND_UNA))
+	{
+		m_Scoreboard[0].nLeft = m_nSND_UNA;
+	}
+}
+
+u32 CTCPConnection::GetSACKedBytes (void) const
+{
+	u32 nBytes = 0;
+	for (unsigned i = 0; i < m_nScoreboardEntries; i++)
+	{
+		nBytes += m_Scoreboard[i].nRight-m_Scoreboard[i].nLeft;
+	}
+
+	return nBytes;
+}
+
 u32 CTCPConnection::CalculateISN (void)
 {
 	assert (m_pTimer != 0);
@@ -1567,13 +2073,15 @@ void CTCPConnection::TimerStub (TKernelTimerHandle hTimer, void *pParam, void *p
 void CTCPConnection::DumpStatus (void)
 {
 	CLogger::Get ()->Write (FromTCP, LogDebug,
-				"sta %u, una %u, snx %u, swn %u, rnx %u, rwn %u, fprt %u",
+				"sta %u, una %u, snx %u, swn %u, rnx %u, rwn %u, cwn %u, sst %u, fprt %u",
 				m_State,
 				m_nSND_UNA-m_nISS,
 				m_nSND_NXT-m_nISS,
 				m_nSND_WND,
 				m_nRCV_NXT-m_nIRS,
 				m_nRCV_WND,
+				m_pCongestionControl->GetCongestionWindow (),
+				m_pCongestionControl->GetSlowStartThreshold (),
 				(unsigned) m_nForeignPort);
 }
 
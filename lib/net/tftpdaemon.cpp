@@ -2,7 +2,7 @@
 // tftpdaemon.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -20,9 +20,11 @@
 #include <circle/net/tftpdaemon.h>
 #include <circle/net/retranstimeoutcalc.h>
 #include <circle/net/in.h>
+#include <circle/netdevice.h>
 #include <circle/sched/scheduler.h>
 #include <circle/logger.h>
 #include <circle/timer.h>
+#include <circle/string.h>
 #include <circle/util.h>
 #include <circle/macros.h>
 #include <assert.h>
@@ -31,6 +33,14 @@
 
 #define RECEIVE_TIMEOUT_HZ	(5 * HZ)
 #define MAX_TIMEOUT_HZ		(25 * HZ)
+#define REACK_TIMEOUT_HZ	(1 * HZ)	// re-send last ACK, if sender is silent
+
+#define MIN_BLOCK_SIZE		8		// RFC 2348
+#define DEFAULT_BLOCK_SIZE	512
+#define MAX_BLOCK_SIZE		1468		// fits into an Ethernet frame without IP fragmentation
+#define MAX_WINDOW_SIZE		32		// RFC 7440
+
+#define WRITE_BUFFER_SIZE	0x10000		// received data is written to file in chunks of this size
 
 struct TTFTPReqPacket
 {
@@ -42,7 +52,8 @@ struct TTFTPReqPacket
 #define MAX_MODE_LEN		16
 #define MIN_FILENAME_MODE_LEN	(1+1+1+1)
 #define MAX_FILENAME_MODE_LEN	(MAX_FILENAME_LEN+1+MAX_MODE_LEN+1)
-	char	FileNameMode[MAX_FILENAME_MODE_LEN];
+#define MAX_OPTIONS_LEN		128
+	char	FileNameMode[MAX_FILENAME_MODE_LEN+MAX_OPTIONS_LEN];
 }
 PACKED;
 
@@ -52,8 +63,7 @@ struct TTFTPDataPacket
 #define OP_CODE_DATA		3
 
 	u16	BlockNumber;
-#define MAX_DATA_LEN		512
-	u8	Data[MAX_DATA_LEN];
+	u8	Data[MAX_BLOCK_SIZE];
 }
 PACKED;
 
@@ -80,12 +90,22 @@ struct TTFTPErrorPacket
 #define ERROR_CODE_INV_ID	5
 #define ERROR_CODE_EXISTS	6
 #define ERROR_CODE_INV_USER	7
+#define ERROR_CODE_OPTIONS	8
 
 #define MAX_ERRMSG_LEN		128
 	char	ErrMsg[MAX_ERRMSG_LEN];
 }
 PACKED;
 
+struct TTFTPOptionAckPacket
+{
+	u16	OpCode;
+#define OP_CODE_OACK		6
+
+	char	Options[MAX_OPTIONS_LEN];
+}
+PACKED;
+
 typedef unsigned TIMER;
 #define START_TIMER(timer)		((timer) = CTimer::Get ()->GetTicks ())
 #define TIMER_EXPIRED(timer, timeout)	(CTimer::Get ()->GetTicks () - (timer) >= (timeout))
@@ -95,7 +115,13 @@ static const char FromTFPTDaemon[] = "tftpd";
 CTFTPDaemon::CTFTPDaemon (CNetSubSystem *pNetSubSystem)
 :	m_pNetSubSystem (pNetSubSystem),
 	m_pRequestSocket (0),
-	m_pTransferSocket (0)
+	m_pTransferSocket (0),
+	m_nBlockSize (DEFAULT_BLOCK_SIZE),
+	m_nWindowSize (1),
+	m_bBlockSizeOption (FALSE),
+	m_bWindowSizeOption (FALSE),
+	m_bTransferSizeOption (FALSE),
+	m_nTransferSize (0)
 {
 }
 
@@ -177,12 +203,22 @@ void CTFTPDaemon::Run (void)
 			continue;
 		}
 
+		// options follow the mode
+		ParseOptions (pMode+strlen (pMode)+1, ReqPacket.FileNameMode+nLength);
+
 		CString IPString;
 		ForeignIP.Format (&IPString);
 		CLogger::Get ()->Write (FromTFPTDaemon, LogDebug, "Incoming %s request from %s",
 					usOpCode == OP_CODE_RRQ ? "read" : "write",
 					(const char *) IPString);
 
+		if (HasOptions ())
+		{
+			CLogger::Get ()->Write (FromTFPTDaemon, LogDebug,
+						"Block size %u, window size %u",
+						m_nBlockSize, m_nWindowSize);
+		}
+
 		assert (m_pTransferSocket == 0);
 		m_pTransferSocket = new CSocket (m_pNetSubSystem, IPPROTO_UDP);
 		assert (m_pTransferSocket != 0);
@@ -227,6 +263,11 @@ void CTFTPDaemon::Run (void)
 	}
 }
 
+int CTFTPDaemon::FileSize (void)
+{
+	return -1;
+}
+
 boolean CTFTPDaemon::DoRead (const char *pFileName)
 {
 	assert (m_pTransferSocket != 0);
@@ -239,124 +280,274 @@ boolean CTFTPDaemon::DoRead (const char *pFileName)
 		return FALSE;
 	}
 
-	CRetransmissionTimeoutCalculator RTCalc;
-	RTCalc.Initialize (0);
+	if (m_bTransferSizeOption)
+	{
+		int nSize = FileSize ();
+		if (nSize >= 0)
+		{
+			m_nTransferSize = (unsigned) nSize;
+		}
+		else
+		{
+			m_bTransferSizeOption = FALSE;
+		}
+	}
+
+	// holds the blocks of the current window, until they are acknowledged
+	unsigned nBufferSize = m_nBlockSize * m_nWindowSize;
+	u8 *pBuffer = new u8[nBufferSize];
+	assert (pBuffer != 0);
+
+	boolean bOK = SendFile (pBuffer, nBufferSize);
+
+	delete [] pBuffer;
+
+	FileClose ();
 
-	int nDataLength = MAX_DATA_LEN;
-	for (u16 usBlockNumber = 1; nDataLength == MAX_DATA_LEN; usBlockNumber++)
+	return bOK;
+}
+
+boolean CTFTPDaemon::DoWrite (const char *pFileName)
+{
+	assert (m_pTransferSocket != 0);
+
+	assert (pFileName != 0);
+	if (!FileCreate (pFileName))
 	{
-		TTFTPDataPacket DataPacket;
-		DataPacket.OpCode = BE (OP_CODE_DATA);
-		DataPacket.BlockNumber = le2be16 (usBlockNumber);
+		SendError (ERROR_CODE_ACCESS, "Access violation");
 
-		nDataLength = FileRead (DataPacket.Data, MAX_DATA_LEN);
-		if (nDataLength < 0)
-		{
-			CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot read");
+		return FALSE;
+	}
 
-			SendError (ERROR_CODE_OTHER, "Error reading file");
+	unsigned nBufferSize = WRITE_BUFFER_SIZE;
+	u8 *pBuffer = new u8[nBufferSize];
+	assert (pBuffer != 0);
 
-			FileClose ();
+	boolean bOK = ReceiveFile (pBuffer, nBufferSize);
 
-			return FALSE;
-		}
+	delete [] pBuffer;
+
+	FileClose ();
+
+	return bOK;
+}
+
+boolean CTFTPDaemon::SendFile (u8 *pBuffer, unsigned nBufferSize)
+{
+	assert (pBuffer != 0);
+	assert (nBufferSize == m_nBlockSize * m_nWindowSize);
 
-		unsigned nPacketLength =   sizeof DataPacket.OpCode
-					 + sizeof DataPacket.BlockNumber
-					 + nDataLength;
+	CRetransmissionTimeoutCalculator RTCalc;
+	RTCalc.Initialize (0);
 
+	u8 Packet[FRAME_BUFFER_SIZE];
+
+	// the OACK is acknowledged with block number 0
+	if (HasOptions ())
+	{
 		TIMER TransferTimer;
 		START_TIMER (TransferTimer);
-		while (!TIMER_EXPIRED (TransferTimer, MAX_TIMEOUT_HZ))
+
+		boolean bAcknowledged = FALSE;
+		while (!bAcknowledged)
 		{
-			if (m_pTransferSocket->Send (&DataPacket, nPacketLength, MSG_DONTWAIT) < 0)
+			if (TIMER_EXPIRED (TransferTimer, MAX_TIMEOUT_HZ))
 			{
-				CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot send data");
+				CLogger::Get ()->Write (FromTFPTDaemon, LogDebug, "Transfer timed out");
 
-				FileClose ();
+				return FALSE;
+			}
 
+			if (!SendOptionAck ())
+			{
 				return FALSE;
 			}
 
-			RTCalc.SegmentSent ((u32) (usBlockNumber-1) * MAX_DATA_LEN, nDataLength);
+			RTCalc.SegmentSent (0);
 
-			TIMER ReceiveTimer;
-			START_TIMER (ReceiveTimer);
-			while (!TIMER_EXPIRED (ReceiveTimer, RTCalc.GetRTO ()))
+			int nResult = ReceivePacket (Packet, RTCalc.GetRTO ());
+			if (nResult < 0)
 			{
-				CScheduler::Get ()->Yield ();
+				CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot receive ACK");
 
-				TTFTPAckPacket AckPacket;
-				int nResult = m_pTransferSocket->Receive (&AckPacket, sizeof AckPacket,
-									  MSG_DONTWAIT);
-				if (nResult < 0)
-				{
-					CLogger::Get ()->Write (FromTFPTDaemon, LogError,
-								"Cannot receive ACK");
+				return FALSE;
+			}
 
-					FileClose ();
+			if (nResult == 0)
+			{
+				RTCalc.RetransmissionTimerExpired ();
 
-					return FALSE;
-				}
+				continue;
+			}
 
-				if (   nResult == sizeof AckPacket
-				    || AckPacket.OpCode == BE (OP_CODE_ACK)
-				    || AckPacket.BlockNumber == le2be16 (usBlockNumber))
-				{
-					break;
-				}
+			TTFTPAckPacket *pAckPacket = (TTFTPAckPacket *) Packet;
+			if (pAckPacket->OpCode == BE (OP_CODE_ERROR))
+			{
+				CLogger::Get ()->Write (FromTFPTDaemon, LogDebug, "Options refused");
+
+				return FALSE;
+			}
+
+			if (   nResult >= (int) sizeof *pAckPacket
+			    && pAckPacket->OpCode == BE (OP_CODE_ACK)
+			    && pAckPacket->BlockNumber == 0)
+			{
+				RTCalc.SegmentAcknowledged (0);
+
+				bAcknowledged = TRUE;
 			}
+		}
+	}
+
+	u32 nBaseBlock = 1;		// number of the first block in the buffer
+	unsigned nBufferBytes = 0;	// valid bytes in the buffer
+	boolean bEOF = FALSE;
 
-			if (!TIMER_EXPIRED (ReceiveTimer, RTCalc.GetRTO ()))
+	TIMER TransferTimer;
+	START_TIMER (TransferTimer);
+
+	while (1)
+	{
+		// refill the buffer with large reads
+		while (   !bEOF
+		       && nBufferBytes < nBufferSize)
+		{
+			int nResult = FileRead (pBuffer + nBufferBytes, nBufferSize - nBufferBytes);
+			if (nResult < 0)
 			{
-				RTCalc.SegmentAcknowledged ((u32) (usBlockNumber-1) * MAX_DATA_LEN);
+				CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot read");
+
+				SendError (ERROR_CODE_OTHER, "Error reading file");
 
-				break;
+				return FALSE;
 			}
-			else
+
+			if (nResult == 0)
 			{
-				RTCalc.RetransmissionTimerExpired ();
+				bEOF = TRUE;
 			}
+
+			nBufferBytes += nResult;
 		}
 
-		if (TIMER_EXPIRED (TransferTimer, MAX_TIMEOUT_HZ))
+		// the last block is shorter than m_nBlockSize (may be empty)
+		unsigned nBlocks = nBufferBytes / m_nBlockSize;
+		if (bEOF)
 		{
-			CLogger::Get ()->Write (FromTFPTDaemon, LogDebug, "Transfer timed out");
+			nBlocks++;
+		}
 
-			FileClose ();
+		assert (1 <= nBlocks && nBlocks <= m_nWindowSize);
 
-			return FALSE;
+		// send the window
+		for (unsigned i = 0; i < nBlocks; i++)
+		{
+			unsigned nOffset = i * m_nBlockSize;
+			unsigned nDataLength = nBufferBytes - nOffset;
+			if (nDataLength > m_nBlockSize)
+			{
+				nDataLength = m_nBlockSize;
+			}
+
+			TTFTPDataPacket *pDataPacket = (TTFTPDataPacket *) Packet;
+			pDataPacket->OpCode = BE (OP_CODE_DATA);
+			pDataPacket->BlockNumber = le2be16 ((u16) (nBaseBlock + i));
+			memcpy (pDataPacket->Data, pBuffer + nOffset, nDataLength);
+
+			unsigned nPacketLength =   sizeof pDataPacket->OpCode
+						 + sizeof pDataPacket->BlockNumber
+						 + nDataLength;
+
+			if (m_pTransferSocket->Send (pDataPacket, nPacketLength, MSG_DONTWAIT) < 0)
+			{
+				CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot send data");
+
+				return FALSE;
+			}
 		}
-	}
 
-	FileClose ();
+		RTCalc.SegmentSent (nBaseBlock, nBlocks);
 
-	return TRUE;
-}
+		// wait for an ACK, which acknowledges at least one block of the window,
+		// the receiver acknowledges the last block, received in sequence
+		unsigned nAcknowledged = 0;
 
-boolean CTFTPDaemon::DoWrite (const char *pFileName)
-{
-	assert (m_pTransferSocket != 0);
+		TIMER ReceiveTimer;
+		START_TIMER (ReceiveTimer);
+		while (   nAcknowledged == 0
+		       && !TIMER_EXPIRED (ReceiveTimer, RTCalc.GetRTO ()))
+		{
+			int nResult = ReceivePacket (Packet, RTCalc.GetRTO ());
+			if (nResult < 0)
+			{
+				CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot receive ACK");
 
-	assert (pFileName != 0);
-	if (FileCreate (pFileName))
-	{
-		TTFTPAckPacket AckPacket;
-		AckPacket.OpCode = BE (OP_CODE_ACK);
-		AckPacket.BlockNumber = 0;
-		if (m_pTransferSocket->Send (&AckPacket, sizeof AckPacket, MSG_DONTWAIT) < 0)
+				return FALSE;
+			}
+
+			TTFTPAckPacket *pAckPacket = (TTFTPAckPacket *) Packet;
+			if (   nResult > 0
+			    && pAckPacket->OpCode == BE (OP_CODE_ERROR))
+			{
+				CLogger::Get ()->Write (FromTFPTDaemon, LogDebug, "Transfer aborted");
+
+				return FALSE;
+			}
+
+			if (   nResult >= (int) sizeof *pAckPacket
+			    && pAckPacket->OpCode == BE (OP_CODE_ACK))
+			{
+				u16 usAcknowledged =   be2le16 (pAckPacket->BlockNumber)
+						     - (u16) (nBaseBlock-1);
+				if (usAcknowledged <= nBlocks)
+				{
+					nAcknowledged = usAcknowledged;
+				}
+			}
+		}
+
+		if (nAcknowledged == 0)
 		{
-			CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot send ACK");
+			if (TIMER_EXPIRED (TransferTimer, MAX_TIMEOUT_HZ))
+			{
+				CLogger::Get ()->Write (FromTFPTDaemon, LogDebug, "Transfer timed out");
 
-			FileClose ();
+				return FALSE;
+			}
 
-			return FALSE;
+			RTCalc.RetransmissionTimerExpired ();
+
+			continue;
 		}
+
+		RTCalc.SegmentAcknowledged (nBaseBlock + nAcknowledged);
+		START_TIMER (TransferTimer);
+
+		if (   bEOF
+		    && nAcknowledged == nBlocks)
+		{
+			break;
+		}
+
+		// continue with the first block, which has not been acknowledged
+		unsigned nAcknowledgedBytes = nAcknowledged * m_nBlockSize;
+		assert (nAcknowledgedBytes <= nBufferBytes);
+		nBufferBytes -= nAcknowledgedBytes;
+		memmove (pBuffer, pBuffer + nAcknowledgedBytes, nBufferBytes);
+
+		nBaseBlock += nAcknowledged;
 	}
-	else
-	{
-		SendError (ERROR_CODE_ACCESS, "Access violation");
 
+	return TRUE;
+}
+
+boolean CTFTPDaemon::ReceiveFile (u8 *pBuffer, unsigned nBufferSize)
+{
+	assert (pBuffer != 0);
+	assert (nBufferSize >= m_nBlockSize);
+
+	if (!SendAck (0, TRUE))
+	{
 		return FALSE;
 	}
 
@@ -364,90 +555,148 @@ boolean CTFTPDaemon::DoWrite (const char *pFileName)
 	// After the first data packet has been received, use a longer time-out.
 	unsigned nTimeout = RECEIVE_TIMEOUT_HZ;
 
-	int nLength = MAX_DATA_LEN;
-	for (u16 usBlockNumber = 1; nLength == MAX_DATA_LEN; usBlockNumber++)
+	u8 Packet[FRAME_BUFFER_SIZE];
+	TTFTPDataPacket *pDataPacket = (TTFTPDataPacket *) Packet;
+
+	u16 usNextBlock = 1;		// wraps to 0 after block 65535
+	boolean bHandshake = TRUE;	// no data block received yet
+	unsigned nWindowBlocks = 0;	// blocks received in sequence since last ACK
+	boolean bGapAcknowledged = FALSE;
+	unsigned nBufferBytes = 0;	// data not written to file yet
+
+	TIMER TransferTimer;
+	START_TIMER (TransferTimer);
+
+	while (1)
 	{
-		TTFTPDataPacket DataPacket;
-		do
+		int nResult = ReceivePacket (Packet, REACK_TIMEOUT_HZ);
+		if (nResult < 0)
+		{
+			CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot receive data");
+
+			return FALSE;
+		}
+
+		if (nResult == 0)
 		{
-			do
+			if (TIMER_EXPIRED (TransferTimer, nTimeout))
 			{
-				TIMER ReceiveTimer;
-				START_TIMER (ReceiveTimer);
+				CLogger::Get ()->Write (FromTFPTDaemon, LogDebug, "Transfer timed out");
 
-				int nResult;
-				do
-				{
-					if (TIMER_EXPIRED (ReceiveTimer, nTimeout))
-					{
-						CLogger::Get ()->Write (FromTFPTDaemon, LogDebug,
-									"Transfer timed out");
+				return FALSE;
+			}
 
-						FileClose ();
+			// the last ACK may have been lost
+			if (!SendAck (usNextBlock-1, bHandshake))
+			{
+				return FALSE;
+			}
 
-						return FALSE;
-					}
+			nWindowBlocks = 0;
+			bGapAcknowledged = FALSE;
 
-					CScheduler::Get ()->Yield ();
+			continue;
+		}
 
-					nResult = m_pTransferSocket->Receive (&DataPacket,
-									      sizeof DataPacket,
-									      MSG_DONTWAIT);
-					if (nResult < 0)
-					{
-						CLogger::Get ()->Write (FromTFPTDaemon, LogError,
-									"Cannot receive data");
+		int nLength = nResult - (  sizeof pDataPacket->OpCode
+					 + sizeof pDataPacket->BlockNumber);
+		if (nLength < 0)
+		{
+			continue;
+		}
 
-						FileClose ();
+		if (pDataPacket->OpCode == BE (OP_CODE_ERROR))
+		{
+			CLogger::Get ()->Write (FromTFPTDaemon, LogDebug, "Transfer aborted");
+
+			return FALSE;
+		}
+
+		if (pDataPacket->OpCode != BE (OP_CODE_DATA))
+		{
+			continue;
+		}
 
-						return FALSE;
-					}
+		if (pDataPacket->BlockNumber != le2be16 (usNextBlock))
+		{
+			// a block has been lost or the sender retransmits, acknowledge the last
+			// block, which has been received in sequence (once only)
+			if (!bGapAcknowledged)
+			{
+				if (!SendAck (usNextBlock-1, bHandshake))
+				{
+					return FALSE;
 				}
-				while (nResult == 0);
 
-				nLength = nResult - (  sizeof DataPacket.OpCode
-						     + sizeof DataPacket.BlockNumber);
+				nWindowBlocks = 0;
+				bGapAcknowledged = TRUE;
 			}
-			while (   nLength < 0
-			       || DataPacket.OpCode != BE (OP_CODE_DATA));
 
-			if ((int) (usBlockNumber - be2le16 (DataPacket.BlockNumber)) >= 0)
+			continue;
+		}
+
+		if ((unsigned) nLength > m_nBlockSize)
+		{
+			SendError (ERROR_CODE_ILL_OPER, "Block too large");
+
+			return FALSE;
+		}
+
+		bGapAcknowledged = FALSE;
+		bHandshake = FALSE;
+		nTimeout = MAX_TIMEOUT_HZ;
+		START_TIMER (TransferTimer);
+
+		// stream data to file in large chunks
+		if (nBufferBytes + nLength > nBufferSize)
+		{
+			if (FileWrite (pBuffer, nBufferBytes) != (int) nBufferBytes)
 			{
-				TTFTPAckPacket AckPacket;
-				AckPacket.OpCode = BE (OP_CODE_ACK);
-				AckPacket.BlockNumber = DataPacket.BlockNumber;
-				if (m_pTransferSocket->Send (&AckPacket, sizeof AckPacket,
-							     MSG_DONTWAIT) < 0)
-				{
-					CLogger::Get ()->Write (FromTFPTDaemon, LogError,
-								"Cannot send ACK");
+				CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot write");
 
-					FileClose ();
+				SendError (ERROR_CODE_DISK_FULL, "Disk full");
 
-					return FALSE;
-				}
+				return FALSE;
 			}
+
+			nBufferBytes = 0;
 		}
-		while (DataPacket.BlockNumber != le2be16 (usBlockNumber));
 
-		if (nLength > 0)
+		memcpy (pBuffer + nBufferBytes, pDataPacket->Data, nLength);
+		nBufferBytes += nLength;
+
+		boolean bLastBlock = (unsigned) nLength < m_nBlockSize;
+		if (   bLastBlock
+		    && nBufferBytes > 0)
 		{
-			if (FileWrite (DataPacket.Data, (unsigned) nLength) != nLength)
+			if (FileWrite (pBuffer, nBufferBytes) != (int) nBufferBytes)
 			{
 				CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot write");
 
 				SendError (ERROR_CODE_DISK_FULL, "Disk full");
 
-				FileClose ();
+				return FALSE;
+			}
+		}
 
+		if (   bLastBlock
+		    || ++nWindowBlocks == m_nWindowSize)
+		{
+			if (!SendAck (usNextBlock))
+			{
 				return FALSE;
 			}
+
+			nWindowBlocks = 0;
 		}
 
-		nTimeout = MAX_TIMEOUT_HZ;
-	}
+		usNextBlock++;
 
-	FileClose ();
+		if (bLastBlock)
+		{
+			break;
+		}
+	}
 
 	return TRUE;
 }
@@ -471,3 +720,155 @@ void CTFTPDaemon::SendError (u16 usErrorCode, const char *pErrorMessage, CIPAddr
 		m_pTransferSocket->Send (&ErrorPacket, sizeof ErrorPacket, MSG_DONTWAIT);
 	}
 }
+
+void CTFTPDaemon::ParseOptions (const char *pOptions, const char *pEnd)
+{
+	m_nBlockSize = DEFAULT_BLOCK_SIZE;
+	m_nWindowSize = 1;
+	m_bBlockSizeOption = FALSE;
+	m_bWindowSizeOption = FALSE;
+	m_bTransferSizeOption = FALSE;
+	m_nTransferSize = 0;
+
+	// each option is a pair of 0-terminated name and value strings,
+	// unknown and invalid options are ignored
+	while (pOptions < pEnd)
+	{
+		const char *pName = pOptions;
+		const char *pValue = pName+strlen (pName)+1;
+		if (pValue >= pEnd)
+		{
+			break;
+		}
+
+		pOptions = pValue+strlen (pValue)+1;
+
+		char *pValueEnd;
+		unsigned long ulValue = strtoul (pValue, &pValueEnd, 10);
+		if (   *pValue == '\0'
+		    || *pValueEnd != '\0'
+		    || ulValue > 0xFFFFFFFFUL)
+		{
+			continue;
+		}
+
+		if (strcasecmp (pName, "blksize") == 0)
+		{
+			if (ulValue >= MIN_BLOCK_SIZE)
+			{
+				m_nBlockSize = ulValue < MAX_BLOCK_SIZE ? ulValue : MAX_BLOCK_SIZE;
+				m_bBlockSizeOption = TRUE;
+			}
+		}
+		else if (strcasecmp (pName, "windowsize") == 0)
+		{
+			if (ulValue >= 1)
+			{
+				m_nWindowSize = ulValue < MAX_WINDOW_SIZE ? ulValue : MAX_WINDOW_SIZE;
+				m_bWindowSizeOption = TRUE;
+			}
+		}
+		else if (strcasecmp (pName, "tsize") == 0)
+		{
+			m_nTransferSize = (unsigned) ulValue;
+			m_bTransferSizeOption = TRUE;
+		}
+	}
+}
+
+boolean CTFTPDaemon::HasOptions (void) const
+{
+	return m_bBlockSizeOption || m_bWindowSizeOption || m_bTransferSizeOption;
+}
+
+static char *AppendOption (char *pBuffer, const char *pName, unsigned nValue)
+{
+	CString Value;
+	Value.Format ("%u", nValue);
+
+	strcpy (pBuffer, pName);
+	pBuffer += strlen (pName)+1;
+
+	strcpy (pBuffer, Value);
+	pBuffer += Value.GetLength ()+1;
+
+	return pBuffer;
+}
+
+boolean CTFTPDaemon::SendOptionAck (void)
+{
+	TTFTPOptionAckPacket OptionAckPacket;
+	OptionAckPacket.OpCode = BE (OP_CODE_OACK);
+
+	char *pOption = OptionAckPacket.Options;
+	if (m_bBlockSizeOption)
+	{
+		pOption = AppendOption (pOption, "blksize", m_nBlockSize);
+	}
+
+	if (m_bWindowSizeOption)
+	{
+		pOption = AppendOption (pOption, "windowsize", m_nWindowSize);
+	}
+
+	if (m_bTransferSizeOption)
+	{
+		pOption = AppendOption (pOption, "tsize", m_nTransferSize);
+	}
+
+	unsigned nPacketLength = sizeof OptionAckPacket.OpCode + (pOption-OptionAckPacket.Options);
+	assert (nPacketLength <= sizeof OptionAckPacket);
+
+	assert (m_pTransferSocket != 0);
+	if (m_pTransferSocket->Send (&OptionAckPacket, nPacketLength, MSG_DONTWAIT) < 0)
+	{
+		CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot send OACK");
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+boolean CTFTPDaemon::SendAck (u16 usBlockNumber, boolean bHandshake)
+{
+	if (   bHandshake
+	    && HasOptions ())
+	{
+		return SendOptionAck ();
+	}
+
+	TTFTPAckPacket AckPacket;
+	AckPacket.OpCode = BE (OP_CODE_ACK);
+	AckPacket.BlockNumber = le2be16 (usBlockNumber);
+
+	assert (m_pTransferSocket != 0);
+	if (m_pTransferSocket->Send (&AckPacket, sizeof AckPacket, MSG_DONTWAIT) < 0)
+	{
+		CLogger::Get ()->Write (FromTFPTDaemon, LogError, "Cannot send ACK");
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+int CTFTPDaemon::ReceivePacket (void *pBuffer, unsigned nTimeout)
+{
+	assert (m_pTransferSocket != 0);
+
+	TIMER ReceiveTimer;
+	START_TIMER (ReceiveTimer);
+	while (!TIMER_EXPIRED (ReceiveTimer, nTimeout))
+	{
+		CScheduler::Get ()->Yield ();
+
+		int nResult = m_pTransferSocket->Receive (pBuffer, FRAME_BUFFER_SIZE, MSG_DONTWAIT);
+		if (nResult != 0)
+		{
+			return nResult;
+		}
+	}
+
+	return 0;
+}
@@ -2,7 +2,7 @@
 // transportlayer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,11 +22,9 @@
 #include <circle/net/udpconnection.h>
 #include <circle/net/in.h>
 #include <circle/macros.h>
+#include <circle/util.h>
 #include <assert.h>
 
-#define OWN_PORT_MIN	60000
-#define OWN_PORT_MAX	60999
-
 CTransportLayer::CTransportLayer (CNetConfig *pNetConfig, CNetworkLayer *pNetworkLayer)
 :	m_pNetConfig (pNetConfig),
 	m_pNetworkLayer (pNetworkLayer),
@@ -36,6 +34,18 @@ CTransportLayer::CTransportLayer (CNetConfig *pNetConfig, CNetworkLayer *pNetwor
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pNetworkLayer != 0);
+
+	for (unsigned i = 0; i < TRANSPORT_HASH_SIZE; i++)
+	{
+		m_pTupleHash[i] = 0;
+	}
+
+	for (unsigned i = 0; i < TRANSPORT_LISTEN_HASH_SIZE; i++)
+	{
+		m_pListenHash[i] = 0;
+	}
+
+	memset (m_OwnPortUsage, 0, sizeof m_OwnPortUsage);
 }
 
 CTransportLayer::~CTransportLayer (void)
@@ -51,35 +61,24 @@ boolean CTransportLayer::Initialize (void)
 
 void CTransportLayer::Process (void)
 {
-	unsigned nResultLength;
 	CIPAddress Sender;
 	CIPAddress Receiver;
 	int nProtocol;
 	assert (m_pNetworkLayer != 0);
-	u8 Buffer[FRAME_BUFFER_SIZE];
-	while (m_pNetworkLayer->Receive (Buffer, &nResultLength, &Sender, &Receiver, &nProtocol))
+	CNetBuffer *pBuffer;
+	while ((pBuffer = m_pNetworkLayer->Receive (&Sender, &Receiver, &nProtocol)) != 0)
 	{
-		unsigned i;
-		for (i = 0; i < m_pConnection.GetCount (); i++)
-		{
-			if (m_pConnection[i] == 0)
-			{
-				continue;
-			}
-
-			if (((CNetConnection *) m_pConnection[i])->PacketReceived (
-				Buffer, nResultLength, Sender, Receiver, nProtocol) != 0)
-			{
-				break;
-			}
-		}
+		const u8 *pPacket = pBuffer->GetData ();
+		unsigned nResultLength = pBuffer->GetLength ();
 
-		if (i >= m_pConnection.GetCount ())
+		if (!DeliverPacket (pPacket, nResultLength, Sender, Receiver, nProtocol))
 		{
 			// send RESET on not consumed TCP segment
-			m_TCPRejector.PacketReceived (Buffer, nResultLength,
+			m_TCPRejector.PacketReceived (pPacket, nResultLength,
 						      Sender, Receiver, nProtocol);
 		}
+
+		pBuffer->Release ();
 	}
 
 	TICMPNotificationType Type;
@@ -88,20 +87,7 @@ void CTransportLayer::Process (void)
 	while (m_pNetworkLayer->ReceiveNotification (&Type, &Sender, &Receiver,
 						     &nSendPort, &nReceivePort, &nProtocol))
 	{
-		unsigned i;
-		for (i = 0; i < m_pConnection.GetCount (); i++)
-		{
-			if (m_pConnection[i] == 0)
-			{
-				continue;
-			}
-
-			if (((CNetConnection *) m_pConnection[i])->NotificationReceived (
-				Type, Sender, Receiver, nSendPort, nReceivePort, nProtocol) != 0)
-			{
-				break;
-			}
-		}
+		DeliverNotification (Type, Sender, Receiver, nSendPort, nReceivePort, nProtocol);
 	}
 
 	for (unsigned i = 0; i < m_pConnection.GetCount (); i++)
@@ -114,6 +100,8 @@ void CTransportLayer::Process (void)
 			}
 			else
 			{
+				RemoveConnection ((CNetConnection *) m_pConnection[i]);
+
 				delete (CNetConnection *) m_pConnection[i];
 				m_pConnection[i] = 0;
 			}
@@ -175,6 +163,8 @@ int CTransportLayer::Bind (u16 nOwnPort, int nProtocol)
 	m_pConnection[i] = new CUDPConnection (m_pNetConfig, m_pNetworkLayer, nOwnPort);
 	assert (m_pConnection[i] != 0);
 
+	AddConnection ((CNetConnection *) m_pConnection[i]);
+
 	m_SpinLock.Release ();
 
 	return i;
@@ -200,7 +190,6 @@ int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, i
 
 	if (nOwnPort == 0)
 	{
-		unsigned j;
 		do
 		{
 			nOwnPort = m_nOwnPort;
@@ -208,18 +197,8 @@ int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, i
 			{
 				m_nOwnPort = OWN_PORT_MIN;
 			}
-
-			for (j = 0; j < m_pConnection.GetCount (); j++)
-			{
-				if (   m_pConnection[j] != 0
-				    && ((CNetConnection *) m_pConnection[j])->GetOwnPort () == nOwnPort
-				    && ((CNetConnection *) m_pConnection[j])->GetProtocol () == nProtocol)
-				{
-					break;
-				}
-			}
 		}
-		while (j < m_pConnection.GetCount ());
+		while (*GetOwnPortUsage (nProtocol, nOwnPort) != 0);
 	}
 
 	assert (m_pNetConfig != 0);
@@ -239,9 +218,11 @@ int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, i
 		return -1;
 	}
 
+	assert (m_pConnection[i] != 0);
+	AddConnection ((CNetConnection *) m_pConnection[i]);
+
 	m_SpinLock.Release ();
 
-	assert (m_pConnection[i] != 0);
 	int nResult = ((CNetConnection *) m_pConnection[i])->Connect ();
 	if (nResult < 0)
 	{
@@ -288,6 +269,8 @@ int CTransportLayer::Listen (u16 nOwnPort, int nProtocol)
 	m_pConnection[i] = new CTCPConnection (m_pNetConfig, m_pNetworkLayer, nOwnPort);
 	assert (m_pConnection[i] != 0);
 
+	AddConnection ((CNetConnection *) m_pConnection[i]);
+
 	m_SpinLock.Release ();
 
 	return i;
@@ -412,3 +395,260 @@ const u8 *CTransportLayer::GetForeignIP (int hConnection) const
 
 	return ((CNetConnection *) m_pConnection[hConnection])->GetForeignIP ();
 }
+
+boolean CTransportLayer::GetTCPStatistics (TTCPStatistics *pStatistics, int hConnection) const
+{
+	assert (hConnection >= 0);
+	if (   hConnection >= (int) m_pConnection.GetCount ()
+	    || m_pConnection[hConnection] == 0)
+	{
+		return FALSE;
+	}
+
+	CNetConnection *pConnection = (CNetConnection *) m_pConnection[hConnection];
+	if (pConnection->GetProtocol () != IPPROTO_TCP)
+	{
+		return FALSE;
+	}
+
+	((CTCPConnection *) pConnection)->GetStatistics (pStatistics);
+
+	return TRUE;
+}
+
+boolean CTransportLayer::DeliverPacket (const void *pPacket, unsigned nLength,
+					CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol)
+{
+	// TCP and UDP header start with source and destination port
+	if (nLength < 4)
+	{
+		return TRUE;		// invalid packet, ignore it
+	}
+
+	assert (pPacket != 0);
+	const u8 *pHeader = (const u8 *) pPacket;
+	u16 nSourcePort = (u16) pHeader[0] << 8 | pHeader[1];
+	u16 nDestPort   = (u16) pHeader[2] << 8 | pHeader[3];
+
+	// connected sockets first
+	u32 nSenderIP = rSenderIP;
+	CNetConnection *pConnection;
+	for (pConnection = m_pTupleHash[HashTuple (nProtocol, nSenderIP, nSourcePort, nDestPort)];
+	     pConnection != 0;
+	     pConnection = pConnection->m_pNextHashed)
+	{
+		if (   pConnection->m_nHashedForeignIP == nSenderIP
+		    && pConnection->m_nHashedForeignPort == nSourcePort
+		    && pConnection->m_nOwnPort == nDestPort
+		    && pConnection->m_nProtocol == nProtocol
+		    && pConnection->PacketReceived (pPacket, nLength, rSenderIP,
+						    rReceiverIP, nProtocol) != 0)
+		{
+			UpdateConnection (pConnection);
+
+			return TRUE;
+		}
+	}
+
+	for (pConnection = m_pListenHash[HashPort (nProtocol, nDestPort)];
+	     pConnection != 0;
+	     pConnection = pConnection->m_pNextHashed)
+	{
+		if (   pConnection->m_nOwnPort == nDestPort
+		    && pConnection->m_nProtocol == nProtocol
+		    && pConnection->PacketReceived (pPacket, nLength, rSenderIP,
+						    rReceiverIP, nProtocol) != 0)
+		{
+			UpdateConnection (pConnection);		// may be connected now
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+boolean CTransportLayer::DeliverNotification (TICMPNotificationType Type,
+					      CIPAddress &rSenderIP, CIPAddress &rReceiverIP,
+					      u16 nSendPort, u16 nReceivePort, int nProtocol)
+{
+	u32 nSenderIP = rSenderIP;
+	CNetConnection *pConnection;
+	for (pConnection = m_pTupleHash[HashTuple (nProtocol, nSenderIP, nSendPort, nReceivePort)];
+	     pConnection != 0;
+	     pConnection = pConnection->m_pNextHashed)
+	{
+		if (   pConnection->m_nHashedForeignIP == nSenderIP
+		    && pConnection->m_nHashedForeignPort == nSendPort
+		    && pConnection->m_nOwnPort == nReceivePort
+		    && pConnection->m_nProtocol == nProtocol
+		    && pConnection->NotificationReceived (Type, rSenderIP, rReceiverIP,
+							  nSendPort, nReceivePort, nProtocol) != 0)
+		{
+			return TRUE;
+		}
+	}
+
+	for (pConnection = m_pListenHash[HashPort (nProtocol, nReceivePort)];
+	     pConnection != 0;
+	     pConnection = pConnection->m_pNextHashed)
+	{
+		if (   pConnection->m_nOwnPort == nReceivePort
+		    && pConnection->m_nProtocol == nProtocol
+		    && pConnection->NotificationReceived (Type, rSenderIP, rReceiverIP,
+							  nSendPort, nReceivePort, nProtocol) != 0)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+void CTransportLayer::AddConnection (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+
+	u16 *pUsage = GetOwnPortUsage (pConnection->m_nProtocol, pConnection->m_nOwnPort);
+	if (pUsage != 0)
+	{
+		(*pUsage)++;
+	}
+
+	InsertHashed (pConnection);
+}
+
+void CTransportLayer::RemoveConnection (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+
+	m_SpinLock.Acquire ();
+
+	RemoveHashed (pConnection);
+
+	u16 *pUsage = GetOwnPortUsage (pConnection->m_nProtocol, pConnection->m_nOwnPort);
+	if (pUsage != 0)
+	{
+		assert (*pUsage > 0);
+		(*pUsage)--;
+	}
+
+	m_SpinLock.Release ();
+}
+
+void CTransportLayer::UpdateConnection (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+	assert (pConnection->m_bHashed);
+
+	boolean bListener =    pConnection->m_nForeignPort == 0
+			    || pConnection->IsListening ();
+	if (bListener)
+	{
+		if (pConnection->m_bHashedAsListener)
+		{
+			return;
+		}
+	}
+	else
+	{
+		if (   !pConnection->m_bHashedAsListener
+		    && pConnection->m_nHashedForeignPort == pConnection->m_nForeignPort
+		    && pConnection->m_nHashedForeignIP == (u32) pConnection->m_ForeignIP)
+		{
+			return;
+		}
+	}
+
+	m_SpinLock.Acquire ();
+
+	RemoveHashed (pConnection);
+	InsertHashed (pConnection);
+
+	m_SpinLock.Release ();
+}
+
+void CTransportLayer::InsertHashed (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+	assert (!pConnection->m_bHashed);
+
+	// a connection without foreign port has not been connected yet
+	if (   pConnection->m_nForeignPort == 0
+	    || pConnection->IsListening ())
+	{
+		pConnection->m_bHashedAsListener = TRUE;
+		pConnection->m_nHashedForeignIP = 0;
+		pConnection->m_nHashedForeignPort = 0;
+		pConnection->m_nHashBucket = HashPort (pConnection->m_nProtocol,
+						       pConnection->m_nOwnPort);
+
+		pConnection->m_pNextHashed = m_pListenHash[pConnection->m_nHashBucket];
+		m_pListenHash[pConnection->m_nHashBucket] = pConnection;
+	}
+	else
+	{
+		pConnection->m_bHashedAsListener = FALSE;
+		pConnection->m_nHashedForeignIP = pConnection->m_ForeignIP;
+		pConnection->m_nHashedForeignPort = pConnection->m_nForeignPort;
+		pConnection->m_nHashBucket = HashTuple (pConnection->m_nProtocol,
+							pConnection->m_nHashedForeignIP,
+							pConnection->m_nHashedForeignPort,
+							pConnection->m_nOwnPort);
+
+		pConnection->m_pNextHashed = m_pTupleHash[pConnection->m_nHashBucket];
+		m_pTupleHash[pConnection->m_nHashBucket] = pConnection;
+	}
+
+	pConnection->m_bHashed = TRUE;
+}
+
+void CTransportLayer::RemoveHashed (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+	if (!pConnection->m_bHashed)
+	{
+		return;
+	}
+
+	CNetConnection **ppLink = pConnection->m_bHashedAsListener
+				? &m_pListenHash[pConnection->m_nHashBucket]
+				: &m_pTupleHash[pConnection->m_nHashBucket];
+	while (*ppLink != pConnection)
+	{
+		assert (*ppLink != 0);
+		ppLink = &(*ppLink)->m_pNextHashed;
+	}
+
+	*ppLink = pConnection->m_pNextHashed;
+
+	pConnection->m_pNextHashed = 0;
+	pConnection->m_bHashed = FALSE;
+}
+
+unsigned CTransportLayer::HashTuple (int nProtocol, u32 nForeignIP, u16 nForeignPort, u16 nOwnPort)
+{
+	u32 nHash = nForeignIP ^ ((u32) nForeignPort << 16 | nOwnPort) ^ (u32) nProtocol;
+
+	nHash ^= nHash >> 16;
+	nHash *= 0x45D9F3B;
+	nHash ^= nHash >> 16;
+
+	return nHash & (TRANSPORT_HASH_SIZE-1);
+}
+
+unsigned CTransportLayer::HashPort (int nProtocol, u16 nOwnPort)
+{
+	return (nOwnPort ^ nOwnPort >> 8 ^ nProtocol) & (TRANSPORT_LISTEN_HASH_SIZE-1);
+}
+
+u16 *CTransportLayer::GetOwnPortUsage (int nProtocol, u16 nOwnPort)
+{
+	if (   nOwnPort < OWN_PORT_MIN
+	    || nOwnPort > OWN_PORT_MAX)
+	{
+		return 0;
+	}
+
+	return &m_OwnPortUsage[nProtocol == IPPROTO_TCP ? 0 : 1][nOwnPort-OWN_PORT_MIN];
+}
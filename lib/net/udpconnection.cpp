@@ -2,7 +2,7 @@
 // udpconnection.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -138,11 +138,11 @@ int CUDPConnection::Send (const void *pData, unsigned nLength, int nFlags)
 	
 	assert (pData != 0);
 	assert (nLength > 0);
-	memcpy (PacketBuffer+sizeof (TUDPHeader), pData, nLength);
-
 	m_Checksum.SetSourceAddress (*m_pNetConfig->GetIPAddress ());
 	m_Checksum.SetDestinationAddress (m_ForeignIP);
-	pHeader->nChecksum = m_Checksum.Calculate (PacketBuffer, nPacketLength);
+	pHeader->nChecksum = m_Checksum.CopyAndCalculate (pHeader, sizeof (TUDPHeader),
+							  PacketBuffer+sizeof (TUDPHeader),
+							  pData, nLength);
 
 	assert (m_pNetworkLayer != 0);
 	boolean bOK = m_pNetworkLayer->Send (m_ForeignIP, PacketBuffer, nPacketLength, IPPROTO_UDP);
@@ -243,11 +243,11 @@ int CUDPConnection::SendTo (const void *pData, unsigned nLength, int nFlags,
 	
 	assert (pData != 0);
 	assert (nLength > 0);
-	memcpy (PacketBuffer+sizeof (TUDPHeader), pData, nLength);
-
 	m_Checksum.SetSourceAddress (*m_pNetConfig->GetIPAddress ());
 	m_Checksum.SetDestinationAddress (rForeignIP);
-	pHeader->nChecksum = m_Checksum.Calculate (PacketBuffer, nPacketLength);
+	pHeader->nChecksum = m_Checksum.CopyAndCalculate (pHeader, sizeof (TUDPHeader),
+							  PacketBuffer+sizeof (TUDPHeader),
+							  pData, nLength);
 
 	assert (m_pNetworkLayer != 0);
 	boolean bOK = m_pNetworkLayer->Send (rForeignIP, PacketBuffer, nPacketLength, IPPROTO_UDP);
@@ -323,6 +323,19 @@ boolean CUDPConnection::IsTerminated (void) const
 {
 	return !m_bOpen;
 }
+
+boolean CUDPConnection::IsListening (void) const
+{
+	if (!m_bActiveOpen)
+	{
+		return TRUE;
+	}
+
+	// connected to a broadcast address, any sender is accepted
+	assert (m_pNetConfig != 0);
+	return    m_ForeignIP.IsBroadcast ()
+	       || m_ForeignIP == *m_pNetConfig->GetBroadcastAddress ();
+}
 	
 void CUDPConnection::Process (void)
 {
@@ -370,33 +383,51 @@ int CUDPConnection::PacketReceived (const void *pPacket, unsigned nLength,
 		return -1;
 	}
 	
+	if (   !m_bBroadcastsAllowed
+	    && (   rReceiverIP.IsBroadcast ()
+	        || rReceiverIP == *m_pNetConfig->GetBroadcastAddress ()))
+	{
+		return 1;
+	}
+
+	const u8 *pData = (const u8 *) pPacket + sizeof (TUDPHeader);
+	nLength -= sizeof (TUDPHeader);
+	assert (nLength > 0);
+
+	CNetBuffer *pBuffer = CNetBuffer::Alloc ();
+	assert (pBuffer != 0);
+	if (!pBuffer->SetLength (nLength))
+	{
+		pBuffer->Release ();
+
+		return -1;
+	}
+
+	// the checksum is verified, while the data is copied into the queue buffer
 	if (pHeader->nChecksum != UDP_CHECKSUM_NONE)
 	{
 		m_Checksum.SetSourceAddress (rSenderIP);
 		m_Checksum.SetDestinationAddress (rReceiverIP);
 
-		if (m_Checksum.Calculate (pPacket, nLength) != CHECKSUM_OK)
+		if (m_Checksum.CopyAndCalculate (pHeader, sizeof (TUDPHeader),
+						 pBuffer->GetData (), pData, nLength) != CHECKSUM_OK)
 		{
+			pBuffer->Release ();
+
 			return -1;
 		}
 	}
-
-	if (   !m_bBroadcastsAllowed
-	    && (   rReceiverIP.IsBroadcast ()
-	        || rReceiverIP == *m_pNetConfig->GetBroadcastAddress ()))
+	else
 	{
-		return 1;
+		memcpy (pBuffer->GetData (), pData, nLength);
 	}
 
-	nLength -= sizeof (TUDPHeader);
-	assert (nLength > 0);
-
-	TUDPPrivateData *pData = new TUDPPrivateData;
-	assert (pData != 0);
-	rSenderIP.CopyTo (pData->SourceAddress);
-	pData->nSourcePort = nSourcePort;
+	TUDPPrivateData *pPrivateData = new TUDPPrivateData;
+	assert (pPrivateData != 0);
+	rSenderIP.CopyTo (pPrivateData->SourceAddress);
+	pPrivateData->nSourcePort = nSourcePort;
 
-	m_RxQueue.Enqueue ((u8 *) pPacket + sizeof (TUDPHeader), nLength, pData);
+	m_RxQueue.Enqueue (pBuffer, pPrivateData);
 
 	m_Event.Set ();
 
@@ -18,6 +18,7 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/netdevice.h>
+#include <assert.h>
 
 const char *CNetDevice::s_SpeedString[NetDeviceSpeedUnknown] =
 {
@@ -41,6 +42,42 @@ void CNetDevice::AddNetDevice (void)
 	}
 }
 
+unsigned CNetDevice::SendFrames (const void *const *ppBuffer, const unsigned *pLength,
+				 unsigned nCount)
+{
+	assert (ppBuffer != 0);
+	assert (pLength != 0);
+
+	unsigned i;
+	for (i = 0; i < nCount; i++)
+	{
+		if (!SendFrame (ppBuffer[i], pLength[i]))
+		{
+			break;
+		}
+	}
+
+	return i;
+}
+
+unsigned CNetDevice::ReceiveFrames (void *const *ppBuffer, unsigned *pResultLength,
+				    unsigned nMaxCount)
+{
+	assert (ppBuffer != 0);
+	assert (pResultLength != 0);
+
+	unsigned i;
+	for (i = 0; i < nMaxCount; i++)
+	{
+		if (!ReceiveFrame (ppBuffer[i], &pResultLength[i]))
+		{
+			break;
+		}
+	}
+
+	return i;
+}
+
 const char *CNetDevice::GetSpeedString (TNetDeviceSpeed Speed)
 {
 	if (Speed >= NetDeviceSpeedUnknown)
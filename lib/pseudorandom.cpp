@@ -0,0 +1,53 @@
+//
+// pseudorandom.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/pseudorandom.h>
+#include <assert.h>
+
+CPseudoRandomNumberGenerator::CPseudoRandomNumberGenerator (u32 nSeed)
+:	m_nState (nSeed)
+{
+	assert (m_nState != 0);
+}
+
+CPseudoRandomNumberGenerator::~CPseudoRandomNumberGenerator (void)
+{
+}
+
+u32 CPseudoRandomNumberGenerator::GetNumber (void)
+{
+	u32 x = m_nState;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return m_nState = x;
+}
+
+void CPseudoRandomNumberGenerator::Fill (void *pBuffer, size_t nLength)
+{
+	u8 *p = (u8 *) pBuffer;
+	assert (p != 0);
+
+	while (nLength--)
+	{
+		*p++ = (u8) GetNumber ();
+	}
+}
@@ -149,29 +149,41 @@
 
 CPWMSoundBaseDevice::CPWMSoundBaseDevice (CInterruptSystem *pInterrupt,
 					  unsigned	    nSampleRate,
-					  unsigned	    nChunkSize)
+					  unsigned	    nChunkSize,
+					  unsigned	    nPeriods)
 :	CSoundBaseDevice (SoundFormatUnsigned32,
 			  (CLOCK_RATE + nSampleRate/2) / nSampleRate, nSampleRate,
 			  CMachineInfo::Get ()->ArePWMChannelsSwapped ()),
 	m_pInterruptSystem (pInterrupt),
 	m_nChunkSize (nChunkSize),
+	m_nPeriods (nPeriods),
+	m_nPeriodUsecs ((unsigned) ((u64) (nChunkSize / 2) * 1000000 / nSampleRate)),
 	m_nRange ((CLOCK_RATE + nSampleRate/2) / nSampleRate),
 	m_Audio1 (GPIOPinAudioLeft, GPIOModeAlternateFunction0),
 	m_Audio2 (GPIOPinAudioRight, GPIOModeAlternateFunction0),
 	m_Clock (GPIOClockPWM),
 	m_bIRQConnected (FALSE),
 	m_State (PWMSoundIdle),
-	m_nDMAChannel (CMachineInfo::Get ()->AllocateDMAChannel (DMA_CHANNEL_LITE))
+	m_nDMAChannel (CMachineInfo::Get ()->AllocateDMAChannel (DMA_CHANNEL_LITE)),
+	m_nPlayPeriod (0),
+	m_nPeriodsPlayed (0),
+	m_nPeriodStartTicks (0),
+	m_bZeroCopy (FALSE),
+	m_nPeriodsQueued (0),
+	m_nReservedPeriod (0),
+	m_bPeriodReserved (FALSE),
+	m_nUnderruns (0)
 {
 	assert (m_pInterruptSystem != 0);
 	assert (m_nChunkSize > 0);
 	assert ((m_nChunkSize & 1) == 0);
+	assert (2 <= m_nPeriods && m_nPeriods <= SOUND_MAX_PERIODS);
 
-	// setup and concatenate DMA buffers and control blocks
-	SetupDMAControlBlock (0);
-	SetupDMAControlBlock (1);
-	m_pControlBlock[0]->nNextControlBlockAddress = BUS_ADDRESS ((uintptr) m_pControlBlock[1]);
-	m_pControlBlock[1]->nNextControlBlockAddress = BUS_ADDRESS ((uintptr) m_pControlBlock[0]);
+	// setup DMA buffers and control blocks, they are concatenated in Start()
+	for (unsigned i = 0; i < m_nPeriods; i++)
+	{
+		SetupDMAControlBlock (i);
+	}
 
 	// start clock and PWM device
 	RunPWM ();
@@ -231,17 +243,15 @@ CPWMSoundBaseDevice::~CPWMSoundBaseDevice (void)
 	CMachineInfo::Get ()->FreeDMAChannel (m_nDMAChannel);
 
 	// free buffers
-	m_pControlBlock[0] = 0;
-	m_pControlBlock[1] = 0;
-	delete [] m_pControlBlockBuffer[0];
-	m_pControlBlockBuffer[0] = 0;
-	delete [] m_pControlBlockBuffer[1];
-	m_pControlBlockBuffer[1] = 0;
-
-	delete [] m_pDMABuffer[0];
-	m_pDMABuffer[0] = 0;
-	delete [] m_pDMABuffer[1];
-	m_pDMABuffer[1] = 0;
+	for (unsigned i = 0; i < m_nPeriods; i++)
+	{
+		m_pControlBlock[i] = 0;
+		delete [] m_pControlBlockBuffer[i];
+		m_pControlBlockBuffer[i] = 0;
+
+		delete [] m_pDMABuffer[i];
+		m_pDMABuffer[i] = 0;
+	}
 }
 
 int CPWMSoundBaseDevice::GetRangeMin (void) const
@@ -258,12 +268,44 @@ boolean CPWMSoundBaseDevice::Start (void)
 {
 	assert (m_State == PWMSoundIdle);
 
-	// fill buffer 0
-	m_nNextBuffer = 0;
+	LinkControlBlocks ();
 
-	if (!GetNextChunk ())
+	m_nPlayPeriod = 0;
+	m_nPeriodsPlayed = 0;
+
+	// fill all buffers before the DMA starts
+	boolean bTerminate = FALSE;
+	if (!m_bZeroCopy)
 	{
-		return FALSE;
+		m_nNextBuffer = 0;
+
+		if (!GetNextChunk ())
+		{
+			return FALSE;
+		}
+
+		for (unsigned i = 1; i < m_nPeriods; i++)
+		{
+			if (!GetNextChunk ())
+			{
+				m_nLastPeriod = i-1;
+				bTerminate = TRUE;
+
+				break;
+			}
+		}
+	}
+	else
+	{
+		// the first two periods must be valid
+		m_SpinLock.Acquire ();
+
+		while (m_nPeriodsQueued < 2)
+		{
+			FillSilence (m_nPeriodsQueued++ % m_nPeriods);
+		}
+
+		m_SpinLock.Release ();
 	}
 
 	m_State = PWMSoundRunning;
@@ -291,6 +333,15 @@ boolean CPWMSoundBaseDevice::Start (void)
 
 	PeripheralExit ();
 
+	if (bTerminate)
+	{
+		m_SpinLock.Acquire ();
+
+		TerminateAfter (m_nLastPeriod, FALSE);
+
+		m_SpinLock.Release ();
+	}
+
 	// start DMA
 	PeripheralEntry ();
 
@@ -300,6 +351,7 @@ boolean CPWMSoundBaseDevice::Start (void)
 	assert (m_pControlBlock[0] != 0);
 	write32 (ARM_DMACHAN_CONBLK_AD (m_nDMAChannel), BUS_ADDRESS ((uintptr) m_pControlBlock[0]));
 
+	m_nPeriodStartTicks = CTimer::GetClockTicks ();
 
 	write32 (ARM_DMACHAN_CS (m_nDMAChannel),   CS_WAIT_FOR_OUTSTANDING_WRITES
 					         | (DEFAULT_PANIC_PRIORITY << CS_PANIC_PRIORITY_SHIFT)
@@ -308,41 +360,110 @@ boolean CPWMSoundBaseDevice::Start (void)
 
 	PeripheralExit ();
 
-	// fill buffer 1
-	if (!GetNextChunk ())
+	return TRUE;
+}
+
+void CPWMSoundBaseDevice::Cancel (void)
+{
+	m_SpinLock.Acquire ();
+
+	if (m_State == PWMSoundRunning)
 	{
-		m_SpinLock.Acquire ();
+		m_State = PWMSoundCancelled;
+	}
 
-		if (m_State == PWMSoundRunning)
-		{
-			PeripheralEntry ();
-			write32 (ARM_DMACHAN_NEXTCONBK (m_nDMAChannel), 0);
-			PeripheralExit ();
+	m_SpinLock.Release ();
+}
 
-			m_State = PWMSoundTerminating;
-		}
+boolean CPWMSoundBaseDevice::IsActive (void) const
+{
+	return m_State != PWMSoundIdle ? TRUE : FALSE;
+}
+
+void CPWMSoundBaseDevice::EnableZeroCopy (void)
+{
+	assert (m_State == PWMSoundIdle);
+	assert (m_nPeriods >= 3);
 
+	for (unsigned i = 0; i < m_nPeriods; i++)
+	{
+		assert (m_pControlBlock[i] != 0);
+		m_pControlBlock[i]->nTransferLength = m_nChunkSize * sizeof (u32);
+	}
+
+	m_bZeroCopy = TRUE;
+}
+
+u32 *CPWMSoundBaseDevice::GetPeriodBuffer (unsigned *pPlayTime)
+{
+	assert (m_bZeroCopy);
+
+	m_SpinLock.Acquire ();
+
+	// the period, which has been played last, may be re-used
+	unsigned nAhead = m_nPeriodsQueued - m_nPeriodsPlayed;
+	if (nAhead >= m_nPeriods)
+	{
 		m_SpinLock.Release ();
+
+		return 0;
 	}
 
-	return TRUE;
+	m_nReservedPeriod = m_nPeriodsQueued;
+	m_bPeriodReserved = TRUE;
+
+	if (pPlayTime != 0)
+	{
+		*pPlayTime = m_State != PWMSoundIdle ? m_nPeriodStartTicks + nAhead * m_nPeriodUsecs : 0;
+	}
+
+	u32 *pBuffer = m_pDMABuffer[m_nReservedPeriod % m_nPeriods];
+
+	m_SpinLock.Release ();
+
+	return pBuffer;
 }
 
-void CPWMSoundBaseDevice::Cancel (void)
+void CPWMSoundBaseDevice::QueuePeriod (void)
 {
+	assert (m_bZeroCopy);
+	assert (m_bPeriodReserved);
+
+	u32 *pBuffer = m_pDMABuffer[m_nReservedPeriod % m_nPeriods];
+	CleanAndInvalidateDataCacheRange ((uintptr) pBuffer, m_nChunkSize * sizeof (u32));
+
 	m_SpinLock.Acquire ();
 
-	if (m_State == PWMSoundRunning)
+	m_bPeriodReserved = FALSE;
+
+	// the period has not been replaced by silence in the meantime?
+	if (m_nReservedPeriod == m_nPeriodsQueued)
 	{
-		m_State = PWMSoundCancelled;
+		m_nPeriodsQueued++;
 	}
 
 	m_SpinLock.Release ();
 }
 
-boolean CPWMSoundBaseDevice::IsActive (void) const
+unsigned CPWMSoundBaseDevice::GetPeriodTimestamp (unsigned *pPeriod)
 {
-	return m_State != PWMSoundIdle ? TRUE : FALSE;
+	m_SpinLock.Acquire ();
+
+	if (pPeriod != 0)
+	{
+		*pPeriod = m_nPeriodsPlayed;
+	}
+
+	unsigned nTicks = m_nPeriodStartTicks;
+
+	m_SpinLock.Release ();
+
+	return nTicks;
+}
+
+unsigned CPWMSoundBaseDevice::GetUnderrunCount (void) const
+{
+	return m_nUnderruns;
 }
 
 boolean CPWMSoundBaseDevice::GetNextChunk (void)
@@ -363,7 +484,10 @@ boolean CPWMSoundBaseDevice::GetNextChunk (void)
 	CleanAndInvalidateDataCacheRange ((uintptr) m_pDMABuffer[m_nNextBuffer], nTransferLength);
 	CleanAndInvalidateDataCacheRange ((uintptr) m_pControlBlock[m_nNextBuffer], sizeof (TDMAControlBlock));
 
-	m_nNextBuffer ^= 1;
+	if (++m_nNextBuffer == m_nPeriods)
+	{
+		m_nNextBuffer = 0;
+	}
 
 	return TRUE;
 }
@@ -434,30 +558,62 @@ void CPWMSoundBaseDevice::InterruptHandler (void)
 
 	m_SpinLock.Acquire ();
 
+	// the DMA has completed a period and continues with the next one
+	unsigned nCompleted = m_nPlayPeriod;
+	if (++m_nPlayPeriod == m_nPeriods)
+	{
+		m_nPlayPeriod = 0;
+	}
+
+	m_nPeriodsPlayed++;
+	m_nPeriodStartTicks = CTimer::GetClockTicks ();
+
 	switch (m_State)
 	{
 	case PWMSoundRunning:
-		if (GetNextChunk ())
+		if (m_bZeroCopy)
 		{
-			break;
+			// the next period must be valid, before the DMA loads it
+			if (m_nPeriodsQueued - m_nPeriodsPlayed < 2)
+			{
+				FillSilence (m_nPeriodsQueued++ % m_nPeriods);
+
+				m_nUnderruns++;
+			}
 		}
-		// fall through
+		else
+		{
+			assert (m_nNextBuffer == nCompleted);
 
-	case PWMSoundCancelled:
-		PeripheralEntry ();
-		write32 (ARM_DMACHAN_NEXTCONBK (m_nDMAChannel), 0);
-		PeripheralExit ();
+			if (GetNextChunk ())
+			{
+				break;
+			}
 
-		// avoid clicks
-		PeripheralEntry ();
-		write32 (PWM_CTL, read32 (PWM_CTL) | ARM_PWM_CTL_RPTL1 | ARM_PWM_CTL_RPTL2);
-		PeripheralExit ();
+			// the buffer before the completed one is the last valid one
+			TerminateAfter ((nCompleted + m_nPeriods-1) % m_nPeriods, TRUE);
+		}
+		break;
 
-		m_State = PWMSoundTerminating;
+	case PWMSoundCancelled:
+		TerminateAfter (m_nPlayPeriod, TRUE);
 		break;
 
 	case PWMSoundTerminating:
-		m_State = PWMSoundIdle;
+		if (nCompleted == m_nLastPeriod)
+		{
+			m_State = PWMSoundIdle;
+
+			m_nPeriodsQueued = 0;
+			m_nPeriodsPlayed = 0;
+		}
+		else if (m_nPlayPeriod == m_nLastPeriod)
+		{
+			// the control block may have been loaded before it was modified
+			PeripheralEntry ();
+			write32 (ARM_DMACHAN_NEXTCONBK (m_nDMAChannel), 0);
+			PeripheralExit ();
+		}
 		break;
 
 	default:
@@ -478,7 +634,7 @@ void CPWMSoundBaseDevice::InterruptStub (void *pParam)
 
 void CPWMSoundBaseDevice::SetupDMAControlBlock (unsigned nID)
 {
-	assert (nID <= 1);
+	assert (nID < m_nPeriods);
 
 	m_pDMABuffer[nID] = new (HEAP_DMA30) u32[m_nChunkSize];
 	assert (m_pDMABuffer[nID] != 0);
@@ -500,3 +656,59 @@ void CPWMSoundBaseDevice::SetupDMAControlBlock (unsigned nID)
 	m_pControlBlock[nID]->nReserved[0]	       = 0;
 	m_pControlBlock[nID]->nReserved[1]	       = 0;
 }
+
+void CPWMSoundBaseDevice::LinkControlBlocks (void)
+{
+	for (unsigned i = 0; i < m_nPeriods; i++)
+	{
+		unsigned nNext = i+1 < m_nPeriods ? i+1 : 0;
+
+		assert (m_pControlBlock[i] != 0);
+		m_pControlBlock[i]->nNextControlBlockAddress =
+			BUS_ADDRESS ((uintptr) m_pControlBlock[nNext]);
+
+		CleanAndInvalidateDataCacheRange ((uintptr) m_pControlBlock[i], sizeof (TDMAControlBlock));
+	}
+}
+
+void CPWMSoundBaseDevice::FillSilence (unsigned nPeriod)
+{
+	assert (nPeriod < m_nPeriods);
+	u32 *pBuffer = m_pDMABuffer[nPeriod];
+	assert (pBuffer != 0);
+
+	u32 nNull = m_nRange / 2;
+	for (unsigned i = 0; i < m_nChunkSize; i++)
+	{
+		pBuffer[i] = nNull;
+	}
+
+	CleanAndInvalidateDataCacheRange ((uintptr) pBuffer, m_nChunkSize * sizeof (u32));
+}
+
+void CPWMSoundBaseDevice::TerminateAfter (unsigned nLastPeriod, boolean bDMAActive)
+{
+	assert (nLastPeriod < m_nPeriods);
+	assert (m_pControlBlock[nLastPeriod] != 0);
+
+	m_pControlBlock[nLastPeriod]->nNextControlBlockAddress = 0;
+	CleanAndInvalidateDataCacheRange ((uintptr) m_pControlBlock[nLastPeriod],
+					  sizeof (TDMAControlBlock));
+
+	PeripheralEntry ();
+
+	if (   bDMAActive
+	    && nLastPeriod == m_nPlayPeriod)
+	{
+		// the control block has already been loaded
+		write32 (ARM_DMACHAN_NEXTCONBK (m_nDMAChannel), 0);
+	}
+
+	// avoid clicks
+	write32 (PWM_CTL, read32 (PWM_CTL) | ARM_PWM_CTL_RPTL1 | ARM_PWM_CTL_RPTL2);
+
+	PeripheralExit ();
+
+	m_nLastPeriod = nLastPeriod;
+	m_State = PWMSoundTerminating;
+}
@@ -2,7 +2,7 @@
 // scheduler.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,30 +18,89 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/sched/scheduler.h>
+#include <circle/exceptionstub.h>
+#include <circle/synchronize.h>
 #include <circle/timer.h>
 #include <circle/logger.h>
 #include <assert.h>
 
+#ifdef ARM_ALLOW_MULTI_CORE
+	#include <circle/multicore.h>
+#endif
+
+#if SCHEDULER_CORES > 1
+	#define THIS_CORE()	CMultiCoreSupport::ThisCore ()
+#else
+	#define THIS_CORE()	0
+#endif
+
+#if AARCH == 32
+	#define SaveAndDisableIRQs(flags)	asm volatile ("mrs %0, cpsr\n" \
+							      "cpsid i" : "=r" (flags) :: "memory")
+	#define RestoreIRQs(flags)		asm volatile ("msr cpsr_c, %0" :: "r" (flags) : "memory")
+#else
+	#define SaveAndDisableIRQs(flags)	asm volatile ("mrs %0, daif\n" \
+							      "msr daifset, #2" : "=r" (flags) :: "memory")
+	#define RestoreIRQs(flags)		asm volatile ("msr daif, %0" :: "r" (flags) : "memory")
+#endif
+
+#define IRQS_ENABLED(flags)	(!((flags) & 0x80))	// same bit in CPSR and DAIF
+
 static const char FromScheduler[] = "sched";
 
 CScheduler *CScheduler::s_pThis = 0;
 
 CScheduler::CScheduler (void)
 :	m_nTasks (0),
-	m_pCurrent (0),
-	m_nCurrent (0),
+	m_pSleeping (0),
+	m_nNextWakeTicks (0),
+	m_pTerminated (0),
+	m_SpinLock (TASK_LEVEL),
 	m_pTaskSwitchHandler (0),
 	m_pTaskTerminationHandler (0)
 {
 	assert (s_pThis == 0);
 	s_pThis = this;
 
-	m_pCurrent = new CTask (0);		// main task currently running
-	assert (m_pCurrent != 0);
+	for (unsigned nCore = 0; nCore < SCHEDULER_CORES; nCore++)
+	{
+		TSchedulerCore *pCore = &m_Core[nCore];
+
+		pCore->pCurrent = 0;
+		pCore->pPrevious = 0;
+
+		for (unsigned i = 0; i < TASK_PRIORITY_LEVELS; i++)
+		{
+			pCore->pReadyHead[i] = 0;
+			pCore->pReadyTail[i] = 0;
+		}
+
+		pCore->nReadyMask = 0;
+		PreemptionRequest[nCore] = FALSE;
+		pCore->bIdle = FALSE;
+		pCore->nTimeSliceTicks = SCHEDULER_TIME_SLICE;
+	}
+
+	// main task currently running, is registered as current task of core 0 in AddTask()
+	CTask *pMainTask = new CTask (0);
+	assert (pMainTask != 0);
+	assert (m_Core[0].pCurrent == pMainTask);
+
+#ifdef PREEMPTIVE_SCHEDULER
+	CTimer::Get ()->RegisterPeriodicHandler (TimerHandler);
+
+	DataSyncBarrier ();
+
+	PreemptionHandler = PreemptionPoint;
+#endif
 }
 
 CScheduler::~CScheduler (void)
 {
+#ifdef PREEMPTIVE_SCHEDULER
+	PreemptionHandler = 0;
+#endif
+
 	m_pTaskSwitchHandler = 0;
 	m_pTaskTerminationHandler = 0;
 
@@ -50,31 +109,13 @@ CScheduler::~CScheduler (void)
 
 void CScheduler::Yield (void)
 {
-	while ((m_nCurrent = GetNextTask ()) == MAX_TASKS)	// no task is ready
-	{
-		assert (m_nTasks > 0);
-	}
+	uintptr nFlags = Lock ();
 
-	assert (m_nCurrent < MAX_TASKS);
-	CTask *pNext = m_pTask[m_nCurrent];
-	assert (pNext != 0);
-	if (m_pCurrent == pNext)
-	{
-		return;
-	}
-	
-	TTaskRegisters *pOldRegs = m_pCurrent->GetRegs ();
-	m_pCurrent = pNext;
-	TTaskRegisters *pNewRegs = m_pCurrent->GetRegs ();
+	Schedule ();
 
-	if (m_pTaskSwitchHandler != 0)
-	{
-		(*m_pTaskSwitchHandler) (m_pCurrent);
-	}
+	Unlock (nFlags);
 
-	assert (pOldRegs != 0);
-	assert (pNewRegs != 0);
-	TaskSwitch (pOldRegs, pNewRegs);
+	ReapTerminatedTasks ();
 }
 
 void CScheduler::Sleep (unsigned nSeconds)
@@ -107,18 +148,46 @@ void CScheduler::usSleep (unsigned nMicroSeconds)
 
 		unsigned nStartTicks = CTimer::Get ()->GetClockTicks ();
 
-		assert (m_pCurrent != 0);
-		assert (m_pCurrent->GetState () == TaskStateReady);
-		m_pCurrent->SetWakeTicks (nStartTicks + nTicks);
-		m_pCurrent->SetState (TaskStateSleeping);
+		uintptr nFlags = Lock ();
 
-		Yield ();
+		CTask *pCurrent = m_Core[THIS_CORE ()].pCurrent;
+		assert (pCurrent != 0);
+		assert (pCurrent->GetState () == TaskStateReady);
+		pCurrent->SetWakeTicks (nStartTicks + nTicks);
+		pCurrent->SetState (TaskStateSleeping);
+
+		// insert into sleeping list, ordered by wake ticks
+		CTask *pPrev = 0;
+		CTask *pTask = m_pSleeping;
+		while (   pTask != 0
+		       && (int) (pTask->GetWakeTicks () - pCurrent->GetWakeTicks ()) <= 0)
+		{
+			pPrev = pTask;
+			pTask = pTask->GetNext ();
+		}
+
+		pCurrent->SetNext (pTask);
+		if (pPrev != 0)
+		{
+			pPrev->SetNext (pCurrent);
+		}
+		else
+		{
+			m_pSleeping = pCurrent;
+			m_nNextWakeTicks = pCurrent->GetWakeTicks ();
+		}
+
+		Schedule ();
+
+		Unlock (nFlags);
+
+		ReapTerminatedTasks ();
 	}
 }
 
 CTask *CScheduler::GetCurrentTask (void)
 {
-	return m_pCurrent;
+	return m_Core[THIS_CORE ()].pCurrent;
 }
 
 void CScheduler::RegisterTaskSwitchHandler (TSchedulerTaskHandler *pHandler)
@@ -135,65 +204,228 @@ void CScheduler::RegisterTaskTerminationHandler (TSchedulerTaskHandler *pHandler
 	assert (m_pTaskTerminationHandler != 0);
 }
 
+void CScheduler::DisablePreemption (void)
+{
+#ifdef PREEMPTIVE_SCHEDULER
+	CTask *pCurrent = GetCurrentTask ();
+	assert (pCurrent != 0);
+	pCurrent->m_nPreemptDisable++;
+#endif
+}
+
+void CScheduler::EnablePreemption (void)
+{
+#ifdef PREEMPTIVE_SCHEDULER
+	CTask *pCurrent = GetCurrentTask ();
+	assert (pCurrent != 0);
+	assert (pCurrent->m_nPreemptDisable > 0);
+	if (   --pCurrent->m_nPreemptDisable == 0
+	    && PreemptionRequest[THIS_CORE ()])
+	{
+		Yield ();
+	}
+#endif
+}
+
+#if SCHEDULER_CORES > 1
+
+void CScheduler::RunTasks (void)
+{
+	unsigned nCore = THIS_CORE ();
+	assert (nCore > 0);
+	assert (m_Core[nCore].pCurrent == 0);
+
+	// the current thread of execution becomes a task, which is bound to this core
+	CTask *pBootTask = new CTask (0);
+	assert (pBootTask != 0);
+	assert (m_Core[nCore].pCurrent == pBootTask);
+
+	// it never gets ready again, so that this core executes the tasks from the ready
+	// queues and steals tasks from other cores
+	uintptr nFlags = Lock ();
+
+	pBootTask->SetState (TaskStateBlocked);
+
+	Schedule ();
+
+	Unlock (nFlags);
+
+	assert (0);
+}
+
+#endif
+
 void CScheduler::AddTask (CTask *pTask)
 {
 	assert (pTask != 0);
 
-	unsigned i;
-	for (i = 0; i < m_nTasks; i++)
+	uintptr nFlags = Lock ();
+
+#if MAX_TASKS > 0
+	if (m_nTasks >= MAX_TASKS)
 	{
-		if (m_pTask[i] == 0)
-		{
-			m_pTask[i] = pTask;
+		Unlock (nFlags);
+
+		CLogger::Get ()->Write (FromScheduler, LogPanic, "System limit of tasks exceeded");
+	}
+#endif
+
+	m_nTasks++;
 
-			return;
+	unsigned nCore = THIS_CORE ();
+	TSchedulerCore *pCore = &m_Core[nCore];
+
+	pTask->m_nCore = nCore;
+
+	if (pCore->pCurrent == 0)
+	{
+		// main task or boot task of a secondary core, which is running already
+		pTask->m_nAffinity = TASK_AFFINITY_CORE (nCore);
+		pTask->m_bRunning = TRUE;
+
+		pCore->pCurrent = pTask;
+	}
+	else
+	{
+		pTask->m_nAffinity = pCore->pCurrent->m_nAffinity;
+
+		// The new task is started on the next Yield() of the creating task, because it
+		// must not run before the constructor of the derived class has been completed.
+		pTask->SetState (TaskStateNew);
+		pTask->SetNext (0);
+
+		// append to keep the order of creation
+		CTask **ppLast = &pCore->pCurrent->m_pCreatedTasks;
+		while (*ppLast != 0)
+		{
+			ppLast = &(*ppLast)->m_pNext;
 		}
+
+		*ppLast = pTask;
 	}
 
-	if (m_nTasks >= MAX_TASKS)
+	Unlock (nFlags);
+}
+
+void CScheduler::SetTaskPriority (CTask *pTask, unsigned nPriority)
+{
+	assert (pTask != 0);
+	assert (nPriority < TASK_PRIORITY_LEVELS);
+
+	uintptr nFlags = Lock ();
+
+	if (IsQueued (pTask))
 	{
-		CLogger::Get ()->Write (FromScheduler, LogPanic, "System limit of tasks exceeded");
+		DequeueReady (pTask);
+		pTask->m_nPriority = nPriority;
+		EnqueueReady (pTask);
+
+		CheckPreemption (pTask);
+	}
+	else
+	{
+		pTask->m_nPriority = nPriority;
 	}
 
-	m_pTask[m_nTasks++] = pTask;
+	Unlock (nFlags);
 }
 
-void CScheduler::RemoveTask (CTask *pTask)
+void CScheduler::SetTaskAffinity (CTask *pTask, u32 nAffinity)
 {
-	for (unsigned i = 0; i < m_nTasks; i++)
+	assert (pTask != 0);
+	nAffinity &= TASK_AFFINITY_ANY;
+	assert (nAffinity != 0);
+
+	uintptr nFlags = Lock ();
+
+	if (IsQueued (pTask))
 	{
-		if (m_pTask[i] == pTask)
-		{
-			m_pTask[i] = 0;
+		DequeueReady (pTask);
+		pTask->m_nAffinity = nAffinity;
+		EnqueueReady (pTask);		// moves the task to an allowed core
 
-			if (i == m_nTasks-1)
-			{
-				m_nTasks--;
-			}
+		CheckPreemption (pTask);
+	}
+	else
+	{
+		// a running task is moved on its next task switch
+		pTask->m_nAffinity = nAffinity;
+	}
 
-			return;
-		}
+	Unlock (nFlags);
+}
+
+void CScheduler::FinishTaskSwitch (void)
+{
+#if SCHEDULER_CORES > 1
+	TSchedulerCore *pCore = &m_Core[THIS_CORE ()];
+
+	CTask *pPrevious = pCore->pPrevious;
+	if (pPrevious != 0)
+	{
+		pCore->pPrevious = 0;
+
+		// the registers of the previous task have been saved now
+		DataMemBarrier ();
+		pPrevious->m_bRunning = FALSE;
 	}
+#endif
+}
 
-	assert (0);
+void CScheduler::RemoveTask (CTask *pTask)
+{
+	assert (pTask != 0);
+	assert (pTask->GetState () == TaskStateTerminated);
+
+	uintptr nFlags = Lock ();
+
+	assert (m_nTasks > 0);
+	m_nTasks--;
+
+	Unlock (nFlags);
 }
 
-void CScheduler::BlockTask (CTask **ppTask)
+void CScheduler::BlockTask (CTask **ppTask, const volatile boolean *pWakeCondition)
 {
 	assert (ppTask != 0);
-	*ppTask = m_pCurrent;
 
-	assert (m_pCurrent != 0);
-	assert (m_pCurrent->GetState () == TaskStateReady);
-	m_pCurrent->SetState (TaskStateBlocked);
+	uintptr nFlags = Lock ();
+
+	// the wake condition may have been set from interrupt context or
+	// from another core in the meantime
+	if (   pWakeCondition == 0
+	    || !*pWakeCondition)
+	{
+		CTask *pCurrent = m_Core[THIS_CORE ()].pCurrent;
+		*ppTask = pCurrent;
 
-	Yield ();
+		assert (pCurrent != 0);
+		assert (pCurrent->GetState () == TaskStateReady);
+		pCurrent->SetState (TaskStateBlocked);
+
+		Schedule ();
+	}
+
+	Unlock (nFlags);
+
+	ReapTerminatedTasks ();
 }
 
 void CScheduler::WakeTask (CTask **ppTask)
 {
 	assert (ppTask != 0);
+
+	uintptr nFlags = Lock ();
+
 	CTask *pTask = *ppTask;
+#if SCHEDULER_CORES > 1
+	if (pTask == 0)			// has been woken by another core
+	{
+		Unlock (nFlags);
+
+		return;
+	}
+#endif
 
 	*ppTask = 0;
 
@@ -201,6 +433,8 @@ void CScheduler::WakeTask (CTask **ppTask)
 	if (   pTask == 0
 	    || pTask->GetState () != TaskStateBlocked)
 	{
+		Unlock (nFlags);
+
 		CLogger::Get ()->Write (FromScheduler, LogPanic, "Tried to wake non-blocked task");
 	}
 #else
@@ -209,61 +443,487 @@ void CScheduler::WakeTask (CTask **ppTask)
 #endif
 
 	pTask->SetState (TaskStateReady);
+
+	EnqueueReady (pTask);
+
+	CheckPreemption (pTask);
+
+	Unlock (nFlags);
+
+#ifdef PREEMPTIVE_SCHEDULER
+	// on task level switch immediately to the woken task, if it has a higher priority
+	if (   IRQS_ENABLED (nFlags)
+	    && PreemptionRequest[THIS_CORE ()]
+	    && GetCurrentTask ()->m_nPreemptDisable == 0)
+	{
+		Yield ();
+	}
+#endif
 }
 
-unsigned CScheduler::GetNextTask (void)
+uintptr CScheduler::Lock (void)
 {
-	unsigned nTask = m_nCurrent < MAX_TASKS ? m_nCurrent : 0;
+	uintptr nFlags;
+	SaveAndDisableIRQs (nFlags);
 
-	unsigned nTicks = CTimer::Get ()->GetClockTicks ();
+	m_SpinLock.Acquire ();
+
+	return nFlags;
+}
 
-	for (unsigned i = 1; i <= m_nTasks; i++)
+void CScheduler::Unlock (uintptr nFlags)
+{
+	m_SpinLock.Release ();
+
+	RestoreIRQs (nFlags);
+}
+
+void CScheduler::Schedule (boolean bPreempted)
+{
+	unsigned nCore = THIS_CORE ();
+	TSchedulerCore *pCore = &m_Core[nCore];
+
+	CTask *pCurrent = pCore->pCurrent;
+	assert (pCurrent != 0);
+
+	if (!bPreempted)
 	{
-		if (++nTask >= m_nTasks)
+		// start the tasks, which have been created by the current task
+		CTask *pTask = pCurrent->m_pCreatedTasks;
+		pCurrent->m_pCreatedTasks = 0;
+
+		while (pTask != 0)
 		{
-			nTask = 0;
+			CTask *pNextTask = pTask->GetNext ();
+
+			assert (pTask->GetState () == TaskStateNew);
+			pTask->SetState (TaskStateReady);
+			EnqueueReady (pTask);
+
+			pTask = pNextTask;
 		}
+	}
 
-		CTask *pTask = m_pTask[nTask];
-		if (pTask == 0)
+	switch (pCurrent->GetState ())
+	{
+	case TaskStateReady:
+		EnqueueReady (pCurrent);
+		break;
+
+	case TaskStateTerminated:
+		pCurrent->SetNext (m_pTerminated);
+		m_pTerminated = pCurrent;
+		break;
+
+	default:
+		break;
+	}
+
+	CTask *pNext;
+	while (WakeSleepingTasks (), (pNext = GetNextTask (nCore)) == 0)	// no task is ready
+	{
+		assert (m_nTasks > 0);
+
+		// let interrupts wake a task
+		pCore->bIdle = TRUE;
+		m_SpinLock.Release ();
+
+		do
 		{
-			continue;
+			EnableIRQs ();
+			InstructionSyncBarrier ();
+			DisableIRQs ();
 		}
+		while (!IsWorkPending (nCore));		// do not congest the lock
+
+		m_SpinLock.Acquire ();
+		pCore->bIdle = FALSE;
+	}
+
+	PreemptionRequest[nCore] = FALSE;
+	pCore->nTimeSliceTicks = SCHEDULER_TIME_SLICE;
+
+	if (pCurrent == pNext)
+	{
+		return;
+	}
+
+#if SCHEDULER_CORES > 1
+	// the task may have been switched out on another core just before
+	while (pNext->m_bRunning)
+	{
+		DataMemBarrier ();
+	}
+	DataMemBarrier ();
+
+	pNext->m_bRunning = TRUE;
+	pNext->m_nCore = nCore;
 
-		switch (pTask->GetState ())
+	pCore->pPrevious = pCurrent;
+#endif
+
+	pCore->pCurrent = pNext;
+
+	if (m_pTaskSwitchHandler != 0)
+	{
+		(*m_pTaskSwitchHandler) (pNext);
+	}
+
+	TTaskRegisters *pOldRegs = pCurrent->GetRegs ();
+	TTaskRegisters *pNewRegs = pNext->GetRegs ();
+	assert (pOldRegs != 0);
+	assert (pNewRegs != 0);
+
+	// the lock is not needed for the switch itself
+	m_SpinLock.Release ();
+
+	TaskSwitch (pOldRegs, pNewRegs);
+
+	// we may continue on another core here
+	FinishTaskSwitch ();
+
+	m_SpinLock.Acquire ();
+}
+
+void CScheduler::EnqueueReady (CTask *pTask)
+{
+	assert (pTask != 0);
+	unsigned nPriority = pTask->m_nPriority;
+	assert (nPriority < TASK_PRIORITY_LEVELS);
+
+#if SCHEDULER_CORES > 1
+	// a task, which is still in use by a core, is moved on its next task switch
+	if (   !(pTask->m_nAffinity & TASK_AFFINITY_CORE (pTask->m_nCore))
+	    && !pTask->m_bRunning)
+	{
+		assert (pTask->m_nAffinity != 0);
+		pTask->m_nCore = __builtin_ctz (pTask->m_nAffinity);
+	}
+#endif
+
+	assert (pTask->m_nCore < SCHEDULER_CORES);
+	TSchedulerCore *pCore = &m_Core[pTask->m_nCore];
+
+	pTask->SetNext (0);
+
+	if (pCore->pReadyTail[nPriority] != 0)
+	{
+		pCore->pReadyTail[nPriority]->SetNext (pTask);
+	}
+	else
+	{
+		pCore->pReadyHead[nPriority] = pTask;
+		pCore->nReadyMask |= 1U << nPriority;
+	}
+
+	pCore->pReadyTail[nPriority] = pTask;
+}
+
+void CScheduler::DequeueReady (CTask *pTask)
+{
+	assert (pTask != 0);
+	unsigned nPriority = pTask->m_nPriority;
+	assert (nPriority < TASK_PRIORITY_LEVELS);
+
+	assert (pTask->m_nCore < SCHEDULER_CORES);
+	TSchedulerCore *pCore = &m_Core[pTask->m_nCore];
+
+	CTask *pPrev = 0;
+	CTask *pEntry = pCore->pReadyHead[nPriority];
+	while (pEntry != pTask)
+	{
+		assert (pEntry != 0);
+		pPrev = pEntry;
+		pEntry = pEntry->GetNext ();
+	}
+
+	if (pPrev != 0)
+	{
+		pPrev->SetNext (pTask->GetNext ());
+	}
+	else
+	{
+		pCore->pReadyHead[nPriority] = pTask->GetNext ();
+	}
+
+	if (pCore->pReadyTail[nPriority] == pTask)
+	{
+		pCore->pReadyTail[nPriority] = pPrev;
+	}
+
+	if (pCore->pReadyHead[nPriority] == 0)
+	{
+		pCore->nReadyMask &= ~(1U << nPriority);
+	}
+
+	pTask->SetNext (0);
+}
+
+boolean CScheduler::IsQueued (CTask *pTask) const
+{
+	assert (pTask != 0);
+
+	if (pTask->GetState () != TaskStateReady)
+	{
+		return FALSE;
+	}
+
+	for (unsigned nCore = 0; nCore < SCHEDULER_CORES; nCore++)
+	{
+		if (m_Core[nCore].pCurrent == pTask)
 		{
-		case TaskStateReady:
-			return nTask;
+			return FALSE;
+		}
+	}
 
-		case TaskStateBlocked:
-			continue;
+	return TRUE;
+}
+
+CTask *CScheduler::GetNextTask (unsigned nCore)
+{
+	TSchedulerCore *pCore = &m_Core[nCore];
+
+	if (pCore->nReadyMask == 0)
+	{
+		return StealTask (nCore);
+	}
+
+	unsigned nPriority = 31 - __builtin_clz (pCore->nReadyMask);
+
+	CTask *pTask = pCore->pReadyHead[nPriority];
+	assert (pTask != 0);
+
+	pCore->pReadyHead[nPriority] = pTask->GetNext ();
+	if (pCore->pReadyHead[nPriority] == 0)
+	{
+		pCore->pReadyTail[nPriority] = 0;
+		pCore->nReadyMask &= ~(1U << nPriority);
+	}
+
+	pTask->SetNext (0);
+
+	return pTask;
+}
+
+CTask *CScheduler::StealTask (unsigned nCore)
+{
+#if SCHEDULER_CORES > 1
+	for (unsigned i = 1; i < SCHEDULER_CORES; i++)
+	{
+		TSchedulerCore *pVictim = &m_Core[(nCore + i) % SCHEDULER_CORES];
+
+		// take the task with the highest priority, which is allowed to run here
+		u32 nMask = pVictim->nReadyMask;
+		while (nMask != 0)
+		{
+			unsigned nPriority = 31 - __builtin_clz (nMask);
+			nMask &= ~(1U << nPriority);
 
-		case TaskStateSleeping:
-			if ((int) (pTask->GetWakeTicks () - nTicks) > 0)
+			for (CTask *pTask = pVictim->pReadyHead[nPriority]; pTask != 0;
+			     pTask = pTask->GetNext ())
 			{
-				continue;
+				if (   (pTask->m_nAffinity & TASK_AFFINITY_CORE (nCore))
+				    && !pTask->m_bRunning)
+				{
+					DequeueReady (pTask);
+
+					return pTask;
+				}
 			}
-			pTask->SetState (TaskStateReady);
-			return nTask;
+		}
+	}
+#endif
 
-		case TaskStateTerminated:
-			if (m_pTaskTerminationHandler != 0)
+	return 0;
+}
+
+void CScheduler::CheckPreemption (CTask *pTask)
+{
+	assert (pTask != 0);
+	unsigned nCore = pTask->m_nCore;
+	TSchedulerCore *pCore = &m_Core[nCore];
+
+	if (   pCore->pCurrent != 0
+	    && pTask->m_nPriority > pCore->pCurrent->m_nPriority)
+	{
+		PreemptionRequest[nCore] = TRUE;
+
+#if defined (PREEMPTIVE_SCHEDULER) && SCHEDULER_CORES > 1
+		if (nCore != THIS_CORE ())
+		{
+			CMultiCoreSupport::SendIPI (nCore, IPI_RESCHEDULE);
+		}
+#endif
+	}
+}
+
+void CScheduler::WakeSleepingTasks (void)
+{
+	if (   m_pSleeping == 0
+	    || (int) (m_nNextWakeTicks - CTimer::Get ()->GetClockTicks ()) > 0)
+	{
+		return;
+	}
+
+	unsigned nTicks = CTimer::Get ()->GetClockTicks ();
+
+	while (   m_pSleeping != 0
+	       && (int) (m_pSleeping->GetWakeTicks () - nTicks) <= 0)
+	{
+		CTask *pTask = m_pSleeping;
+		m_pSleeping = pTask->GetNext ();
+
+		assert (pTask->GetState () == TaskStateSleeping);
+		pTask->SetState (TaskStateReady);
+
+		EnqueueReady (pTask);
+
+		CheckPreemption (pTask);
+	}
+
+	if (m_pSleeping != 0)
+	{
+		m_nNextWakeTicks = m_pSleeping->GetWakeTicks ();
+	}
+}
+
+boolean CScheduler::IsWorkPending (unsigned nCore)
+{
+#if SCHEDULER_CORES > 1
+	for (unsigned i = 0; i < SCHEDULER_CORES; i++)
+	{
+		if (m_Core[i].nReadyMask != 0)
+		{
+			return TRUE;
+		}
+	}
+
+	return    m_pSleeping != 0
+	       && (int) (m_nNextWakeTicks - CTimer::Get ()->GetClockTicks ()) <= 0;
+#else
+	return TRUE;
+#endif
+}
+
+void CScheduler::ReapTerminatedTasks (void)
+{
+	while (m_pTerminated != 0)
+	{
+		uintptr nFlags = Lock ();
+
+		// find a task, which does not use its stack any more
+		CTask *pPrev = 0;
+		CTask *pTask = m_pTerminated;
+		while (   pTask != 0
+		       && pTask->m_bRunning)
+		{
+			pPrev = pTask;
+			pTask = pTask->GetNext ();
+		}
+
+		if (pTask != 0)
+		{
+			if (pPrev != 0)
 			{
-				(*m_pTaskTerminationHandler) (pTask);
+				pPrev->SetNext (pTask->GetNext ());
 			}
-			RemoveTask (pTask);
-			delete pTask;
-			return MAX_TASKS;
+			else
+			{
+				m_pTerminated = pTask->GetNext ();
+			}
+		}
 
-		default:
-			assert (0);
+		Unlock (nFlags);
+
+		if (pTask == 0)
+		{
 			break;
 		}
+
+		if (m_pTaskTerminationHandler != 0)
+		{
+			(*m_pTaskTerminationHandler) (pTask);
+		}
+
+		RemoveTask (pTask);
+
+		delete pTask;
+	}
+}
+
+#ifdef PREEMPTIVE_SCHEDULER
+
+void CScheduler::TimerHandler (void)
+{
+	CScheduler *pThis = s_pThis;
+	if (pThis == 0)
+	{
+		return;
+	}
+
+	pThis->m_SpinLock.Acquire ();
+
+	pThis->WakeSleepingTasks ();
+
+	for (unsigned nCore = 0; nCore < SCHEDULER_CORES; nCore++)
+	{
+		TSchedulerCore *pCore = &pThis->m_Core[nCore];
+		if (   pCore->pCurrent == 0
+		    || pCore->bIdle)
+		{
+			continue;
+		}
+
+		if (pCore->nTimeSliceTicks > 0)
+		{
+			pCore->nTimeSliceTicks--;
+		}
+
+		// time slice elapsed and another task with same or higher priority is ready?
+		if (   pCore->nTimeSliceTicks == 0
+		    && (pCore->nReadyMask >> pCore->pCurrent->m_nPriority) != 0)
+		{
+			PreemptionRequest[nCore] = TRUE;
+
+#if SCHEDULER_CORES > 1
+			if (nCore != THIS_CORE ())
+			{
+				CMultiCoreSupport::SendIPI (nCore, IPI_RESCHEDULE);
+			}
+#endif
+		}
 	}
 
-	return MAX_TASKS;
+	pThis->m_SpinLock.Release ();
 }
 
+void CScheduler::PreemptionPoint (void)
+{
+	CScheduler *pThis = s_pThis;
+	if (pThis == 0)
+	{
+		return;
+	}
+
+	unsigned nCore = THIS_CORE ();
+	TSchedulerCore *pCore = &pThis->m_Core[nCore];
+	if (   !PreemptionRequest[nCore]
+	    || pCore->bIdle
+	    || pCore->pCurrent == 0			// core does not run tasks
+	    || pCore->pCurrent->m_nPreemptDisable > 0)
+	{
+		return;
+	}
+
+	pThis->m_SpinLock.Acquire ();
+
+	pThis->Schedule (TRUE);
+
+	pThis->m_SpinLock.Release ();
+}
+
+#endif
+
 CScheduler *CScheduler::Get (void)
 {
 	assert (s_pThis != 0);
@@ -2,7 +2,7 @@
 // synchronizationevent.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -59,10 +59,16 @@ void CSynchronizationEvent::Set (void)
 		DataSyncBarrier ();
 #endif
 
+#if SCHEDULER_CORES > 1
+		// the wait task may be registered on another core just now,
+		// WakeTask() checks it with the scheduler locked
+		CScheduler::Get ()->WakeTask (&m_pWaitTask);
+#else
 		if (m_pWaitTask != 0)
 		{
 			CScheduler::Get ()->WakeTask (&m_pWaitTask);
 		}
+#endif
 	}
 }
 
@@ -71,7 +77,7 @@ void CSynchronizationEvent::Wait (void)
 	if (!m_bState)
 	{
 		assert (m_pWaitTask == 0);
-		CScheduler::Get ()->BlockTask (&m_pWaitTask);
+		CScheduler::Get ()->BlockTask (&m_pWaitTask, &m_bState);
 
 		assert (m_bState);
 	}
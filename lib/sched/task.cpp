@@ -19,11 +19,19 @@
 //
 #include <circle/sched/task.h>
 #include <circle/sched/scheduler.h>
+#include <circle/synchronize.h>
 #include <circle/util.h>
 #include <assert.h>
 
 CTask::CTask (unsigned nStackSize)
 :	m_State (TaskStateReady),
+	m_nPriority (TASK_PRIORITY_DEFAULT),
+	m_nPreemptDisable (0),
+	m_nAffinity (TASK_AFFINITY_ANY),
+	m_nCore (0),
+	m_bRunning (FALSE),
+	m_pNext (0),
+	m_pCreatedTasks (0),
 	m_nStackSize (nStackSize),
 	m_pStack (0)
 {
@@ -65,6 +73,8 @@ void CTask::Run (void)		// dummy method which is never called
 
 void CTask::Terminate (void)
 {
+	CScheduler::Get ()->DisablePreemption ();	// until the task has been removed
+
 	m_State = TaskStateTerminated;
 	m_Event.Set ();
 	CScheduler::Get ()->Yield ();
@@ -87,6 +97,16 @@ void *CTask::GetUserData (unsigned nSlot)
 	return m_pUserData[nSlot];
 }
 
+void CTask::SetPriority (unsigned nPriority)
+{
+	CScheduler::Get ()->SetTaskPriority (this, nPriority);
+}
+
+void CTask::SetAffinity (u32 nAffinity)
+{
+	CScheduler::Get ()->SetTaskAffinity (this, nAffinity);
+}
+
 #if AARCH == 32
 
 void CTask::InitializeRegs (void)
@@ -131,8 +151,14 @@ void CTask::TaskEntry (void *pParam)
 	CTask *pThis = (CTask *) pParam;
 	assert (pThis != 0);
 
+	CScheduler::Get ()->FinishTaskSwitch ();
+
+	EnableIRQs ();			// tasks are switched with IRQs disabled
+
 	pThis->Run ();
 
+	CScheduler::Get ()->DisablePreemption ();	// until the task has been removed
+
 	pThis->m_State = TaskStateTerminated;
 	pThis->m_Event.Set ();
 	CScheduler::Get ()->Yield ();
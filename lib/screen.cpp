@@ -2,7 +2,7 @@
 // screen.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@
 #include <circle/devicenameservice.h>
 #include <circle/synchronize.h>
 #include <circle/util.h>
+#include <assert.h>
 
 #define ROTORS		4
 
@@ -38,11 +39,21 @@ enum TScreenState
 	ScreenStateNumber3
 };
 
-CScreenDevice::CScreenDevice (unsigned nWidth, unsigned nHeight, boolean bVirtual)
+CScreenDevice::CScreenDevice (unsigned nWidth, unsigned nHeight, boolean bVirtual,
+			      unsigned nBuffers)
 :	m_nInitWidth (nWidth),
 	m_nInitHeight (nHeight),
 	m_bVirtual (bVirtual),
+	m_nBuffers (nBuffers),
 	m_pFrameBuffer (0),
+	m_bShadowBuffer (FALSE),
+	m_nFrameBufferPitch (0),
+#ifdef SCREEN_HW_SCROLL
+	m_bHWScroll (FALSE),
+	m_nWindowOffset (0),
+	m_nDisplayOffset (0),
+	m_WindowSpinLock (TASK_LEVEL),
+#endif
 	m_pBuffer (0),
 	m_nState (ScreenStateStart),
 	m_nScrollStart (0),
@@ -59,11 +70,13 @@ CScreenDevice::CScreenDevice (unsigned nWidth, unsigned nHeight, boolean bVirtua
 	, m_SpinLock (TASK_LEVEL)
 #endif
 {
+	assert (1 <= m_nBuffers && m_nBuffers <= SCREEN_MAX_BUFFERS);
 }
 
 CScreenDevice::~CScreenDevice (void)
 {
-	if (m_bVirtual)
+	if (   m_bVirtual
+	    || m_bShadowBuffer)
 	{
 		delete [] m_pBuffer;
 	}
@@ -77,7 +90,14 @@ boolean CScreenDevice::Initialize (void)
 {
 	if (!m_bVirtual)
 	{
-		m_pFrameBuffer = new CBcmFrameBuffer (m_nInitWidth, m_nInitHeight, DEPTH);
+#ifdef SCREEN_HW_SCROLL
+		// a frame buffer with double virtual height is used as ring buffer for scrolling
+		unsigned nFrameBuffers = m_nBuffers > 1 ? m_nBuffers : 2;
+#else
+		unsigned nFrameBuffers = m_nBuffers;
+#endif
+		m_pFrameBuffer = new CBcmFrameBuffer (m_nInitWidth, m_nInitHeight, DEPTH,
+						      0, 0, nFrameBuffers);
 #if DEPTH == 8
 		m_pFrameBuffer->SetPalette (NORMAL_COLOR, NORMAL_COLOR16);
 		m_pFrameBuffer->SetPalette (HIGH_COLOR,   HIGH_COLOR16);
@@ -105,6 +125,36 @@ boolean CScreenDevice::Initialize (void)
 			return FALSE;
 		}
 		m_nPitch /= sizeof (TScreenColor);
+
+		if (m_nBuffers > 1)
+		{
+			// the GPU may have refused the virtual size, a single buffer is
+			// updated from the shadow buffer without flipping then
+			m_nBuffers = m_pFrameBuffer->GetBufferCount ();
+
+			// draw into a shadow buffer in RAM, changed regions are copied in Update()
+			m_nFrameBufferPitch = m_nPitch;
+			m_nPitch = m_nWidth;
+			m_nSize = m_nWidth * m_nHeight * sizeof (TScreenColor);
+			m_pBuffer = new TScreenColor[m_nWidth * m_nHeight];
+			m_bShadowBuffer = TRUE;
+
+			for (unsigned i = 0; i < m_nBuffers; i++)
+			{
+				m_DirtyRect[i].nPosX1 = 0;
+				m_DirtyRect[i].nPosY1 = 0;
+				m_DirtyRect[i].nPosX2 = m_nWidth;
+				m_DirtyRect[i].nPosY2 = m_nHeight;
+			}
+		}
+#ifdef SCREEN_HW_SCROLL
+		else if (m_pFrameBuffer->GetBufferCount () > 1)
+		{
+			// m_pBuffer points to the displayed window
+			m_nSize = m_nPitch * m_nHeight * sizeof (TScreenColor);
+			m_bHWScroll = TRUE;
+		}
+#endif
 	}
 	else
 	{
@@ -194,6 +244,8 @@ boolean CScreenDevice::SetStatus (const TScreenStatus &Status)
 
 	memcpyblk (m_pBuffer, Status.pContent, m_nSize);
 
+	AddDirty (0, 0, m_nWidth, m_nHeight);
+
 	m_nState     = Status.nState;
 	m_nScrollStart = Status.nScrollStart;
 	m_nScrollEnd   = Status.nScrollEnd;
@@ -238,6 +290,15 @@ int CScreenDevice::Write (const void *pBuffer, size_t nCount)
 
 	DataMemBarrier ();
 
+#ifdef SCREEN_HW_SCROLL
+	// the property mailbox cannot be used with m_SpinLock held or from an IRQ handler
+	if (   m_bHWScroll
+	    && CurrentExecutionLevel () == TASK_LEVEL)
+	{
+		UpdateWindowOffset ();
+	}
+#endif
+
 	return nResult;
 }
 
@@ -535,6 +596,8 @@ void CScreenDevice::ClearDisplayEnd (void)
 	{
 		*pBuffer++ = BLACK_COLOR;
 	}
+
+	AddDirty (0, nPosY, m_nWidth, m_nHeight);
 }
 
 void CScreenDevice::ClearLineEnd (void)
@@ -734,24 +797,27 @@ void CScreenDevice::Scroll (void)
 {
 	unsigned nLines = m_CharGen.GetCharHeight ();
 
+#ifdef SCREEN_HW_SCROLL
+	// the window is moved at TASK_LEVEL only, because Write() has to update the
+	// virtual offset then, otherwise the lines are copied inside the current window
+	if (   m_bHWScroll
+	    && m_nScrollStart == 0
+	    && m_nScrollEnd == m_nUsedHeight
+	    && CurrentExecutionLevel () == TASK_LEVEL)
+	{
+		ScrollWindow (nLines);
+
+		return;
+	}
+#endif
+
 	u32 *pTo = (u32 *) (m_pBuffer + m_nScrollStart * m_nPitch);
 	u32 *pFrom = (u32 *) (m_pBuffer + (m_nScrollStart + nLines) * m_nPitch);
 
 	unsigned nSize = m_nPitch * (m_nScrollEnd - m_nScrollStart - nLines) * sizeof (TScreenColor);
 	if (nSize > 0)
 	{
-#ifdef SCREEN_DMA_BURST_LENGTH
-		m_DMAChannel.SetupMemCopy (pTo, pFrom, nSize, SCREEN_DMA_BURST_LENGTH, FALSE);
-
-		m_DMAChannel.Start ();
-		m_DMAChannel.Wait ();
-#else
-		unsigned nSizeBlk = nSize & ~0xF;
-		memcpyblk (pTo, pFrom, nSizeBlk);
-
-		// Handle framebuffers with row lengths not aligned to 16 bytes
-		memcpy ((u8 *) pTo + nSizeBlk, (u8 *) pFrom + nSizeBlk, nSize & 0xF);
-#endif
+		CopyLines (pTo, pFrom, nSize);
 
 		pTo += nSize / sizeof (u32);
 	}
@@ -761,6 +827,98 @@ void CScreenDevice::Scroll (void)
 	{
 		*pTo++ = BLACK_COLOR;
 	}
+
+	AddDirty (0, m_nScrollStart, m_nWidth, m_nScrollEnd);
+}
+
+#ifdef SCREEN_HW_SCROLL
+
+void CScreenDevice::ScrollWindow (unsigned nLines)
+{
+	assert (m_pFrameBuffer != 0);
+	TScreenColor *pFrameBuffer = (TScreenColor *) (uintptr) m_pFrameBuffer->GetBuffer ();
+
+	unsigned nWindowOffset = m_nWindowOffset + nLines;
+	if (nWindowOffset + m_nHeight > m_pFrameBuffer->GetVirtHeight ())
+	{
+		// the end of the frame buffer has been reached, continue at the top
+		nWindowOffset = 0;
+
+		unsigned nSize = m_nPitch * (m_nUsedHeight - nLines) * sizeof (TScreenColor);
+		if (nSize > 0)
+		{
+			CopyLines (pFrameBuffer, m_pBuffer + nLines * m_nPitch, nSize);
+		}
+	}
+
+	m_nWindowOffset = nWindowOffset;
+	m_pBuffer = pFrameBuffer + m_nWindowOffset * m_nPitch;
+
+	// clear the new line and the unused lines below, before they are displayed
+	u32 *pTo = (u32 *) (m_pBuffer + (m_nUsedHeight - nLines) * m_nPitch);
+	unsigned nSize = m_nPitch * (m_nHeight - m_nUsedHeight + nLines) * sizeof (TScreenColor) / sizeof (u32);
+	while (nSize--)
+	{
+		*pTo++ = BLACK_COLOR;
+	}
+
+	// the virtual offset is set by UpdateWindowOffset() after m_SpinLock has been released
+}
+
+void CScreenDevice::UpdateWindowOffset (void)
+{
+	assert (CurrentExecutionLevel () == TASK_LEVEL);
+
+	m_WindowSpinLock.Acquire ();
+
+	m_SpinLock.Acquire ();
+	unsigned nWindowOffset = m_nWindowOffset;
+	m_SpinLock.Release ();
+
+	if (nWindowOffset != m_nDisplayOffset)
+	{
+		assert (m_pFrameBuffer != 0);
+		if (m_pFrameBuffer->SetVirtualOffset (0, nWindowOffset))
+		{
+			m_nDisplayOffset = nWindowOffset;
+		}
+		else
+		{
+			// the display does not follow the window, move the window contents
+			// back to the displayed lines and continue with scrolling by copying
+			m_SpinLock.Acquire ();
+
+			TScreenColor *pDisplay =   (TScreenColor *) (uintptr) m_pFrameBuffer->GetBuffer ()
+						 + m_nDisplayOffset * m_nPitch;
+			memmove (pDisplay, m_pBuffer, m_nSize);
+
+			m_pBuffer = pDisplay;
+			m_nWindowOffset = m_nDisplayOffset;
+			m_bHWScroll = FALSE;
+
+			m_SpinLock.Release ();
+		}
+	}
+
+	m_WindowSpinLock.Release ();
+}
+
+#endif
+
+void CScreenDevice::CopyLines (void *pTo, const void *pFrom, unsigned nSize)
+{
+#ifdef SCREEN_DMA_BURST_LENGTH
+	m_DMAChannel.SetupMemCopy (pTo, pFrom, nSize, SCREEN_DMA_BURST_LENGTH, m_bShadowBuffer);
+
+	m_DMAChannel.Start ();
+	m_DMAChannel.Wait ();
+#else
+	unsigned nSizeBlk = nSize & ~0xF;
+	memcpyblk (pTo, pFrom, nSizeBlk);
+
+	// Handle framebuffers with row lengths not aligned to 16 bytes
+	memcpy ((u8 *) pTo + nSizeBlk, (const u8 *) pFrom + nSizeBlk, nSize & 0xF);
+#endif
 }
 
 void CScreenDevice::DisplayChar (char chChar, unsigned nPosX, unsigned nPosY, TScreenColor Color)
@@ -769,10 +927,12 @@ void CScreenDevice::DisplayChar (char chChar, unsigned nPosX, unsigned nPosY, TS
 	{
 		for (unsigned x = 0; x < m_CharGen.GetCharWidth (); x++)
 		{
-			SetPixel (nPosX + x, nPosY + y,
+			PutPixel (nPosX + x, nPosY + y,
 				  m_CharGen.GetPixel (chChar, x, y) ? Color : BLACK_COLOR);
 		}
 	}
+
+	AddDirty (nPosX, nPosY, nPosX + m_CharGen.GetCharWidth (), nPosY + m_CharGen.GetCharHeight ());
 }
 
 void CScreenDevice::EraseChar (unsigned nPosX, unsigned nPosY)
@@ -781,9 +941,11 @@ void CScreenDevice::EraseChar (unsigned nPosX, unsigned nPosY)
 	{
 		for (unsigned x = 0; x < m_CharGen.GetCharWidth (); x++)
 		{
-			SetPixel (nPosX + x, nPosY + y, BLACK_COLOR);
+			PutPixel (nPosX + x, nPosY + y, BLACK_COLOR);
 		}
 	}
+
+	AddDirty (nPosX, nPosY, nPosX + m_CharGen.GetCharWidth (), nPosY + m_CharGen.GetCharHeight ());
 }
 
 void CScreenDevice::InvertCursor (void)
@@ -799,23 +961,24 @@ void CScreenDevice::InvertCursor (void)
 		{
 			if (GetPixel (m_nCursorX + x, m_nCursorY + y) == BLACK_COLOR)
 			{
-				SetPixel (m_nCursorX + x, m_nCursorY + y, m_Color);
+				PutPixel (m_nCursorX + x, m_nCursorY + y, m_Color);
 			}
 			else
 			{
-				SetPixel (m_nCursorX + x, m_nCursorY + y, BLACK_COLOR);
+				PutPixel (m_nCursorX + x, m_nCursorY + y, BLACK_COLOR);
 			}
 		}
 	}
+
+	AddDirty (m_nCursorX, m_nCursorY + m_CharGen.GetUnderline (),
+		  m_nCursorX + m_CharGen.GetCharWidth (), m_nCursorY + m_CharGen.GetCharHeight ());
 }
 
 void CScreenDevice::SetPixel (unsigned nPosX, unsigned nPosY, TScreenColor Color)
 {
-	if (   nPosX < m_nWidth
-	    && nPosY < m_nHeight)
-	{
-		m_pBuffer[m_nPitch * nPosY + nPosX] = Color;
-	}
+	PutPixel (nPosX, nPosY, Color);
+
+	AddDirty (nPosX, nPosY, nPosX+1, nPosY+1);
 }
 
 TScreenColor CScreenDevice::GetPixel (unsigned nPosX, unsigned nPosY)
@@ -841,9 +1004,189 @@ void CScreenDevice::Rotor (unsigned nIndex, unsigned nCount)
 	DisplayChar (chChars[nCount], nPosX, 0, HIGH_COLOR);
 }
 
+void CScreenDevice::SetArea (unsigned nPosX1, unsigned nPosY1, unsigned nPosX2, unsigned nPosY2,
+			     const TScreenColor *pPixels)
+{
+	assert (pPixels != 0);
+
+	if (   nPosX1 > nPosX2
+	    || nPosY1 > nPosY2
+	    || nPosX1 >= m_nWidth
+	    || nPosY1 >= m_nHeight)
+	{
+		return;
+	}
+
+	unsigned nSourcePitch = nPosX2 - nPosX1 + 1;
+
+	// clip to the screen
+	if (nPosX2 >= m_nWidth)
+	{
+		nPosX2 = m_nWidth-1;
+	}
+
+	if (nPosY2 >= m_nHeight)
+	{
+		nPosY2 = m_nHeight-1;
+	}
+
+	size_t nLength = (nPosX2 - nPosX1 + 1) * sizeof (TScreenColor);
+	TScreenColor *pTo = m_pBuffer + m_nPitch * nPosY1 + nPosX1;
+
+	for (unsigned y = nPosY1; y <= nPosY2; y++)
+	{
+		memcpy (pTo, pPixels, nLength);
+
+		pTo += m_nPitch;
+		pPixels += nSourcePitch;
+	}
+
+	AddDirty (nPosX1, nPosY1, nPosX2+1, nPosY2+1);
+}
+
+unsigned CScreenDevice::GetBufferCount (void) const
+{
+	return m_bShadowBuffer ? m_nBuffers : 1;
+}
+
+void CScreenDevice::Update (boolean bWaitForVSync)
+{
+	if (!m_bShadowBuffer)
+	{
+		return;
+	}
+
+	assert (m_pFrameBuffer != 0);
+	unsigned nBackBuffer = m_pFrameBuffer->GetBackBufferIndex ();
+	assert (nBackBuffer < m_nBuffers);
+
+	// take the region, which has changed since the back buffer has been updated last
+	m_DirtySpinLock.Acquire ();
+
+	boolean bChanged = FALSE;
+	for (unsigned i = 0; i < m_nBuffers; i++)
+	{
+		if (m_DirtyRect[i].nPosX1 < m_DirtyRect[i].nPosX2)
+		{
+			bChanged = TRUE;
+		}
+	}
+
+	TScreenRect Rect = m_DirtyRect[nBackBuffer];
+
+	m_DirtyRect[nBackBuffer].nPosX1 = m_nWidth;
+	m_DirtyRect[nBackBuffer].nPosY1 = m_nHeight;
+	m_DirtyRect[nBackBuffer].nPosX2 = 0;
+	m_DirtyRect[nBackBuffer].nPosY2 = 0;
+
+	m_DirtySpinLock.Release ();
+
+	if (!bChanged)
+	{
+		return;
+	}
+
+	// with one buffer only, copy in the vertical blanking interval to reduce tearing
+	if (   m_nBuffers == 1
+	    && bWaitForVSync)
+	{
+		m_pFrameBuffer->WaitForVerticalSync ();
+	}
+
+	// pixels, which are changed during copying, are marked dirty again
+	if (Rect.nPosX1 < Rect.nPosX2)
+	{
+		TScreenColor *pTo =   (TScreenColor *) (uintptr) m_pFrameBuffer->GetBackBuffer ()
+				    + m_nFrameBufferPitch * Rect.nPosY1 + Rect.nPosX1;
+		const TScreenColor *pFrom = m_pBuffer + m_nPitch * Rect.nPosY1 + Rect.nPosX1;
+		size_t nLength = (Rect.nPosX2 - Rect.nPosX1) * sizeof (TScreenColor);
+
+		for (unsigned y = Rect.nPosY1; y < Rect.nPosY2; y++)
+		{
+			memcpy (pTo, pFrom, nLength);
+
+			pTo += m_nFrameBufferPitch;
+			pFrom += m_nPitch;
+		}
+	}
+
+	if (m_nBuffers > 1)
+	{
+		m_pFrameBuffer->Flip (bWaitForVSync);
+	}
+}
+
+void CScreenDevice::PutPixel (unsigned nPosX, unsigned nPosY, TScreenColor Color)
+{
+	if (   nPosX < m_nWidth
+	    && nPosY < m_nHeight)
+	{
+		m_pBuffer[m_nPitch * nPosY + nPosX] = Color;
+	}
+}
+
+void CScreenDevice::AddDirty (unsigned nPosX1, unsigned nPosY1, unsigned nPosX2, unsigned nPosY2)
+{
+	if (!m_bShadowBuffer)
+	{
+		return;
+	}
+
+	if (nPosX2 > m_nWidth)
+	{
+		nPosX2 = m_nWidth;
+	}
+
+	if (nPosY2 > m_nHeight)
+	{
+		nPosY2 = m_nHeight;
+	}
+
+	m_DirtySpinLock.Acquire ();
+
+	// all buffers have to be updated
+	for (unsigned i = 0; i < m_nBuffers; i++)
+	{
+		TScreenRect *pRect = &m_DirtyRect[i];
+
+		if (pRect->nPosX1 >= pRect->nPosX2)
+		{
+			pRect->nPosX1 = nPosX1;
+			pRect->nPosY1 = nPosY1;
+			pRect->nPosX2 = nPosX2;
+			pRect->nPosY2 = nPosY2;
+
+			continue;
+		}
+
+		if (nPosX1 < pRect->nPosX1)
+		{
+			pRect->nPosX1 = nPosX1;
+		}
+
+		if (nPosY1 < pRect->nPosY1)
+		{
+			pRect->nPosY1 = nPosY1;
+		}
+
+		if (nPosX2 > pRect->nPosX2)
+		{
+			pRect->nPosX2 = nPosX2;
+		}
+
+		if (nPosY2 > pRect->nPosY2)
+		{
+			pRect->nPosY2 = nPosY2;
+		}
+	}
+
+	m_DirtySpinLock.Release ();
+}
+
 #else	// #ifndef SCREEN_HEADLESS
 
-CScreenDevice::CScreenDevice (unsigned nWidth, unsigned nHeight, boolean bVirtual)
+CScreenDevice::CScreenDevice (unsigned nWidth, unsigned nHeight, boolean bVirtual,
+			      unsigned nBuffers)
 :	m_nInitWidth (nWidth),
 	m_nInitHeight (nHeight)
 {
@@ -908,8 +1251,22 @@ TScreenColor CScreenDevice::GetPixel (unsigned nPosX, unsigned nPosY)
 	return BLACK_COLOR;
 }
 
+void CScreenDevice::SetArea (unsigned nPosX1, unsigned nPosY1, unsigned nPosX2, unsigned nPosY2,
+			     const TScreenColor *pPixels)
+{
+}
+
 void CScreenDevice::Rotor (unsigned nIndex, unsigned nCount)
 {
 }
 
+unsigned CScreenDevice::GetBufferCount (void) const
+{
+	return 1;
+}
+
+void CScreenDevice::Update (boolean bWaitForVSync)
+{
+}
+
 #endif
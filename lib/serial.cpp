@@ -155,11 +155,9 @@ CSerialDevice::CSerialDevice (CInterruptSystem *pInterruptSystem, boolean bUseFI
 	m_nDevice (nDevice),
 	m_nBaseAddress (0),
 	m_bValid (FALSE),
-	m_nRxInPtr (0),
-	m_nRxOutPtr (0),
+	m_RxQueue (SERIAL_BUF_SIZE),
 	m_nRxStatus (0),
-	m_nTxInPtr (0),
-	m_nTxOutPtr (0),
+	m_TxQueue (SERIAL_BUF_SIZE),
 	m_nOptions (SERIAL_OPTION_ONLCR),
 	m_pMagic (0),
 	m_SpinLock (bUseFIQ ? FIQ_LEVEL : IRQ_LEVEL)
@@ -364,25 +362,27 @@ int CSerialDevice::Write (const void *pBuffer, size_t nCount)
 
 	if (m_pInterruptSystem != 0)
 	{
+		// the spin lock serializes the consumers of the TX queue
 		m_SpinLock.Acquire ();
 
-		if (m_nTxInPtr != m_nTxOutPtr)
+		if (m_TxQueue.GetAvail () > 0)
 		{
 			PeripheralEntry ();
 
-			while (m_nTxInPtr != m_nTxOutPtr)
+			while (!(read32 (ARM_UART_FR) & FR_TXFF_MASK))
 			{
-				if (!(read32 (ARM_UART_FR) & FR_TXFF_MASK))
+				u8 uchChar;
+				if (!m_TxQueue.Dequeue (&uchChar))
 				{
-					write32 (ARM_UART_DR, m_TxBuffer[m_nTxOutPtr++]);
-					m_nTxOutPtr &= SERIAL_BUF_MASK;
-				}
-				else
-				{
-					write32 (ARM_UART_IMSC, read32 (ARM_UART_IMSC) | INT_TX);
-
 					break;
 				}
+
+				write32 (ARM_UART_DR, uchChar);
+			}
+
+			if (m_TxQueue.GetAvail () > 0)
+			{
+				write32 (ARM_UART_IMSC, read32 (ARM_UART_IMSC) | INT_TX);
 			}
 
 			PeripheralExit ();
@@ -405,31 +405,11 @@ int CSerialDevice::Read (void *pBuffer, size_t nCount)
 
 	if (m_pInterruptSystem != 0)
 	{
-		m_SpinLock.Acquire ();
-
-		if (m_nRxStatus < 0)
-		{
-			nResult = m_nRxStatus;
-			m_nRxStatus = 0;
-		}
-		else
+		nResult = __atomic_exchange_n (&m_nRxStatus, 0, __ATOMIC_RELAXED);
+		if (nResult == 0)
 		{
-			while (nCount > 0)
-			{
-				if (m_nRxInPtr == m_nRxOutPtr)
-				{
-					break;
-				}
-
-				*pChar++ = m_RxBuffer[m_nRxOutPtr++];
-				m_nRxOutPtr &= SERIAL_BUF_MASK;
-
-				nCount--;
-				nResult++;
-			}
+			nResult = m_RxQueue.DequeueMultiple (pChar, nCount);
 		}
-
-		m_SpinLock.Release ();
 	}
 	else
 	{
@@ -504,21 +484,7 @@ unsigned CSerialDevice::AvailableForWrite (void)
 	assert (m_bValid);
 	assert (m_pInterruptSystem != 0);
 
-	m_SpinLock.Acquire ();
-
-	unsigned nResult;
-	if (m_nTxOutPtr <= m_nTxInPtr)
-	{
-		nResult = SERIAL_BUF_SIZE+m_nTxOutPtr-m_nTxInPtr-1;
-	}
-	else
-	{
-		nResult = m_nTxOutPtr-m_nTxInPtr-1;
-	}
-
-	m_SpinLock.Release ();
-
-	return nResult;
+	return m_TxQueue.GetFree ();
 }
 
 unsigned CSerialDevice::AvailableForRead (void)
@@ -526,21 +492,7 @@ unsigned CSerialDevice::AvailableForRead (void)
 	assert (m_bValid);
 	assert (m_pInterruptSystem != 0);
 
-	m_SpinLock.Acquire ();
-
-	unsigned nResult;
-	if (m_nRxInPtr < m_nRxOutPtr)
-	{
-		nResult = SERIAL_BUF_SIZE+m_nRxInPtr-m_nRxOutPtr;
-	}
-	else
-	{
-		nResult = m_nRxInPtr-m_nRxOutPtr;
-	}
-
-	m_SpinLock.Release ();
-
-	return nResult;
+	return m_RxQueue.GetAvail ();
 }
 
 int CSerialDevice::Peek (void)
@@ -548,17 +500,13 @@ int CSerialDevice::Peek (void)
 	assert (m_bValid);
 	assert (m_pInterruptSystem != 0);
 
-	m_SpinLock.Acquire ();
-
-	int nResult = -1;
-	if (m_nRxInPtr != m_nRxOutPtr)
+	u8 uchChar;
+	if (!m_RxQueue.Peek (&uchChar))
 	{
-		nResult = m_RxBuffer[m_nRxOutPtr];
+		return -1;
 	}
 
-	m_SpinLock.Release ();
-
-	return nResult;
+	return uchChar;
 }
 
 void CSerialDevice::Flush (void)
@@ -579,19 +527,9 @@ boolean CSerialDevice::Write (u8 uchChar)
 
 	if (m_pInterruptSystem != 0)
 	{
-		m_SpinLock.Acquire ();
-
-		if (((m_nTxInPtr+1) & SERIAL_BUF_MASK) != m_nTxOutPtr)
-		{
-			m_TxBuffer[m_nTxInPtr++] = uchChar;
-			m_nTxInPtr &= SERIAL_BUF_MASK;
-		}
-		else
-		{
-			bOK = FALSE;
-		}
-
-		m_SpinLock.Release ();
+		// Write() may be called on IRQ level (e.g. by CLogger) while the line spin lock
+		// is held on TASK_LEVEL (REALTIME), so the TX queue allows multiple producers
+		bOK = m_TxQueue.Enqueue (uchChar);
 	}
 	else
 	{
@@ -661,12 +599,7 @@ void CSerialDevice::InterruptHandler (void)
 			}
 		}
 
-		if (((m_nRxInPtr+1) & SERIAL_BUF_MASK) != m_nRxOutPtr)
-		{
-			m_RxBuffer[m_nRxInPtr++] = nDR & 0xFF;
-			m_nRxInPtr &= SERIAL_BUF_MASK;
-		}
-		else
+		if (!m_RxQueue.Enqueue (nDR & 0xFF))
 		{
 			if (m_nRxStatus == 0)
 			{
@@ -677,10 +610,10 @@ void CSerialDevice::InterruptHandler (void)
 
 	while (!(read32 (ARM_UART_FR) & FR_TXFF_MASK))
 	{
-		if (m_nTxInPtr != m_nTxOutPtr)
+		u8 uchChar;
+		if (m_TxQueue.Dequeue (&uchChar))
 		{
-			write32 (ARM_UART_DR, m_TxBuffer[m_nTxOutPtr++]);
-			m_nTxOutPtr &= SERIAL_BUF_MASK;
+			write32 (ARM_UART_DR, uchChar);
 		}
 		else
 		{
@@ -21,6 +21,26 @@
 #include <circle/util.h>
 #include <assert.h>
 
+// Write() converts the samples block by block in three passes:
+// 1. Decode the samples of the write format to left-justified s32 samples
+// 2. Map the channels to the hardware order (swap or duplicate mono samples)
+// 3. Encode the s32 samples to the hardware format
+// Each pass is a simple loop without branches depending on the format,
+// which the compiler can vectorize (NEON), where available.
+
+static void DecodeUnsigned8 (s32 *pTo, const void *pFrom, unsigned nSamples) MAXOPT;
+static void DecodeSigned16 (s32 *pTo, const void *pFrom, unsigned nSamples) MAXOPT;
+static void DecodeSigned24 (s32 *pTo, const void *pFrom, unsigned nSamples) MAXOPT;
+static void DecodeSigned32 (s32 *pTo, const void *pFrom, unsigned nSamples) MAXOPT;
+static void DecodeFloat (s32 *pTo, const void *pFrom, unsigned nSamples) MAXOPT;
+
+static void SwapChannels (s32 *pSamples, unsigned nFrames) MAXOPT;
+static void MonoToStereo (s32 *pSamples, unsigned nFrames) MAXOPT;
+
+static void EncodeSigned16 (void *pTo, const s32 *pFrom, unsigned nSamples, u32 nRange) MAXOPT;
+static void EncodeSigned24 (void *pTo, const s32 *pFrom, unsigned nSamples, u32 nRange) MAXOPT;
+static void EncodeUnsigned32 (void *pTo, const s32 *pFrom, unsigned nSamples, u32 nRange) MAXOPT;
+
 CSoundBaseDevice::CSoundBaseDevice (TSoundFormat HWFormat, u32 nRange32, unsigned nSampleRate,
 				    boolean bSwapChannels)
 :	m_HWFormat (HWFormat),
@@ -30,9 +50,8 @@ CSoundBaseDevice::CSoundBaseDevice (TSoundFormat HWFormat, u32 nRange32, unsigne
 	m_nNeedDataThreshold (0),
 	m_WriteFormat (SoundFormatUnknown),
 	m_nWriteChannels (0),
-	m_pQueue (0),
-	m_nInPtr (0),
-	m_nOutPtr (0),
+	m_pDecoder (0),
+	m_pEncoder (0),
 	m_pCallback (0)
 {
 	memset (m_NullFrame, 0, sizeof m_NullFrame);
@@ -43,16 +62,19 @@ CSoundBaseDevice::CSoundBaseDevice (TSoundFormat HWFormat, u32 nRange32, unsigne
 		m_nHWSampleSize = sizeof (s16);
 		m_nRangeMin = -32768;
 		m_nRangeMax = 32767;
+		m_pEncoder = EncodeSigned16;
 		break;
 
 	case SoundFormatSigned24:
 		m_nHWSampleSize = sizeof (u32);
 		m_nRangeMin = -(1 << 23)+1;
 		m_nRangeMax = (1 << 23)-1;
+		m_pEncoder = EncodeSigned24;
 		break;
 
 	case SoundFormatUnsigned32: {
 		m_nHWSampleSize = sizeof (u32);
+		m_pEncoder = EncodeUnsigned32;
 		m_nRangeMin = 0;
 		m_nRangeMax = (int) (nRange32-1);
 		assert (m_nRangeMax > 0);
@@ -72,9 +94,6 @@ CSoundBaseDevice::CSoundBaseDevice (TSoundFormat HWFormat, u32 nRange32, unsigne
 CSoundBaseDevice::~CSoundBaseDevice (void)
 {
 	m_pCallback = 0;
-
-	delete [] m_pQueue;
-	m_pQueue = 0;
 }
 
 int CSoundBaseDevice::GetRangeMin (void) const
@@ -89,14 +108,12 @@ int CSoundBaseDevice::GetRangeMax (void) const
 
 boolean CSoundBaseDevice::AllocateQueue (unsigned nSizeMsecs)
 {
-	assert (m_pQueue == 0);
+	assert (!m_Queue.IsValid ());
 	assert (1 <= nSizeMsecs && nSizeMsecs <= 1000);
 
-	// 1 byte remains free
-	m_nQueueSize = (m_nHWFrameSize*m_nSampleRate*nSizeMsecs + 999) / 1000 + 1;
+	m_nQueueSize = (m_nHWFrameSize*m_nSampleRate*nSizeMsecs + 999) / 1000;
 
-	m_pQueue = new u8[m_nQueueSize];
-	if (m_pQueue == 0)
+	if (!m_Queue.Initialize (m_nQueueSize))
 	{
 		return FALSE;
 	}
@@ -118,14 +135,27 @@ void CSoundBaseDevice::SetWriteFormat (TSoundFormat Format, unsigned nChannels)
 	{
 	case SoundFormatUnsigned8:
 		m_nWriteSampleSize = sizeof (u8);
+		m_pDecoder = DecodeUnsigned8;
 		break;
 
 	case SoundFormatSigned16:
 		m_nWriteSampleSize = sizeof (s16);
+		m_pDecoder = DecodeSigned16;
 		break;
 
 	case SoundFormatSigned24:
 		m_nWriteSampleSize = sizeof (u8)*3;
+		m_pDecoder = DecodeSigned24;
+		break;
+
+	case SoundFormatSigned32:
+		m_nWriteSampleSize = sizeof (s32);
+		m_pDecoder = DecodeSigned32;
+		break;
+
+	case SoundFormatFloat:
+		m_nWriteSampleSize = sizeof (float);
+		m_pDecoder = DecodeFloat;
 		break;
 
 	default:
@@ -154,7 +184,7 @@ int CSoundBaseDevice::Write (const void *pBuffer, size_t nCount)
 	{
 		// fast path for SoundFormatSigned16 Stereo without conversion
 
-		unsigned nBytes = GetQueueBytesFree ();
+		unsigned nBytes = m_Queue.GetFree ();
 		if (nBytes > nCount)
 		{
 			nBytes = nCount;
@@ -163,53 +193,34 @@ int CSoundBaseDevice::Write (const void *pBuffer, size_t nCount)
 
 		if (nBytes > 0)
 		{
-			Enqueue (pBuffer, nBytes);
-
-			nResult = nBytes;
+			nResult = m_Queue.EnqueueMultiple (pBuffer8, nBytes);
+			assert (nResult == (int) nBytes);
 		}
 	}
 	else
 	{
-		while (   nCount >= m_nWriteFrameSize
-		       && GetQueueBytesFree () >= m_nHWFrameSize)
+		unsigned nFrames = nCount / m_nWriteFrameSize;
+		unsigned nFramesFree = m_Queue.GetFree () / m_nHWFrameSize;
+		if (nFrames > nFramesFree)
 		{
-			u8 Frame[SOUND_MAX_FRAME_SIZE];
+			nFrames = nFramesFree;
+		}
 
-			if (!m_bSwapChannels)
-			{
-				ConvertSoundFormat (Frame, pBuffer8);
-				pBuffer8 += m_nWriteSampleSize;
-
-				if (m_nWriteChannels == 2)
-				{
-					ConvertSoundFormat (Frame+m_nHWSampleSize, pBuffer8);
-					pBuffer8 += m_nWriteSampleSize;
-				}
-				else
-				{
-					memcpy (Frame+m_nHWSampleSize, Frame, m_nHWSampleSize);
-				}
-			}
-			else
+		while (nFrames > 0)
+		{
+			unsigned nBlockFrames = nFrames;
+			if (nBlockFrames > SOUND_CONVERT_FRAMES)
 			{
-				ConvertSoundFormat (Frame+m_nHWSampleSize, pBuffer8);
-				pBuffer8 += m_nWriteSampleSize;
-
-				if (m_nWriteChannels == 2)
-				{
-					ConvertSoundFormat (Frame, pBuffer8);
-					pBuffer8 += m_nWriteSampleSize;
-				}
-				else
-				{
-					memcpy (Frame, Frame+m_nHWSampleSize, m_nHWSampleSize);
-				}
+				nBlockFrames = SOUND_CONVERT_FRAMES;
 			}
 
-			Enqueue (Frame, m_nHWFrameSize);
+			unsigned nBytes = ConvertFrames (pBuffer8, nBlockFrames);
 
-			nCount -= m_nWriteFrameSize;
-			nResult += m_nWriteFrameSize;
+			m_Queue.EnqueueMultiple (m_ConvertFrames, nBytes);
+
+			pBuffer8 += nBlockFrames * m_nWriteFrameSize;
+			nResult += nBlockFrames * m_nWriteFrameSize;
+			nFrames -= nBlockFrames;
 		}
 	}
 
@@ -228,13 +239,7 @@ unsigned CSoundBaseDevice::GetQueueFramesAvail (void)
 {
 	assert (m_nQueueSize > 0);
 
-	m_SpinLock.Acquire ();
-
-	unsigned nQueueBytesAvail = GetQueueBytesAvail ();
-
-	m_SpinLock.Release ();
-
-	return nQueueBytesAvail / m_nHWFrameSize;
+	return m_Queue.GetAvail () / m_nHWFrameSize;
 }
 
 void CSoundBaseDevice::RegisterNeedDataCallback (TSoundNeedDataCallback *pCallback, void *pParam)
@@ -266,66 +271,28 @@ unsigned CSoundBaseDevice::GetChunk (u32 *pBuffer, unsigned nChunkSize)
 	return GetChunkInternal (pBuffer, nChunkSize);
 }
 
-void CSoundBaseDevice::ConvertSoundFormat (void *pTo, const void *pFrom)
+unsigned CSoundBaseDevice::ConvertFrames (const void *pFrom, unsigned nFrames)
 {
-	s32 nValue = 0;
-
-	switch (m_WriteFormat)
-	{
-	case SoundFormatUnsigned8: {
-		const u8 *pValue = reinterpret_cast<const u8 *> (pFrom);
-		nValue = *pValue;
-		nValue -= 128;
-		nValue <<= 24;
-		} break;
+	assert (pFrom != 0);
+	assert (nFrames <= SOUND_CONVERT_FRAMES);
+	assert (m_pDecoder != 0);
+	assert (m_pEncoder != 0);
 
-	case SoundFormatSigned16: {
-		const s16 *pValue = reinterpret_cast<const s16 *> (pFrom);
-		nValue = *pValue;
-		nValue <<= 16;
-		} break;
-
-	case SoundFormatSigned24: {
-		const u32 *pValue = reinterpret_cast<const u32 *> (pFrom);
-		nValue = *pValue & 0xFFFFFF;
-		nValue <<= 8;
-		} break;
+	(*m_pDecoder) (m_ConvertSamples, pFrom, nFrames * m_nWriteChannels);
 
-	case SoundFormatUnknown:
-		memcpy (pTo, pFrom, m_nWriteSampleSize);
-		return;
-
-	default:
-		assert (0);
-		break;
+	if (m_nWriteChannels == 1)
+	{
+		MonoToStereo (m_ConvertSamples, nFrames);
 	}
-
-	switch (m_HWFormat)
+	else if (m_bSwapChannels)
 	{
-	case SoundFormatSigned16: {
-		s16 *pValue = reinterpret_cast<s16 *> (pTo);
-		*pValue = nValue >> 16;
-		} break;
-
-	case SoundFormatSigned24: {
-		s32 *pValue = reinterpret_cast<s32 *> (pTo);
-		*pValue = nValue >> 8;
-		} break;
-
-	case SoundFormatUnsigned32: {
-		s64 llValue = (s64) nValue;
-		llValue += 1U << 31;
-		llValue *= m_nRangeMax;
-		llValue >>= 32;
+		SwapChannels (m_ConvertSamples, nFrames);
+	}
 
-		u32 *pValue = reinterpret_cast<u32 *> (pTo);
-		*pValue = (u32) llValue;
-		} break;
+	(*m_pEncoder) (m_ConvertFrames, m_ConvertSamples, nFrames * SOUND_HW_CHANNELS,
+		       (u32) m_nRangeMax);
 
-	default:
-		assert (0);
-		break;
-	}
+	return nFrames * m_nHWFrameSize;
 }
 
 unsigned CSoundBaseDevice::GetChunkInternal (void *pBuffer, unsigned nChunkSize)
@@ -337,24 +304,11 @@ unsigned CSoundBaseDevice::GetChunkInternal (void *pBuffer, unsigned nChunkSize)
 	assert (nChunkSize % SOUND_HW_CHANNELS == 0);
 	unsigned nChunkSizeBytes = nChunkSize * m_nHWSampleSize;
 
-	m_SpinLock.Acquire ();
-
-	unsigned nQueueBytesAvail = GetQueueBytesAvail ();
-	unsigned nBytes = nQueueBytesAvail;
-	if (nBytes > nChunkSizeBytes)
-	{
-		nBytes = nChunkSizeBytes;
-	}
+	// no lock needed, this is the only consumer of the queue
+	unsigned nBytes = m_Queue.DequeueMultiple (pBuffer8, nChunkSizeBytes);
+	pBuffer8 += nBytes;
 
-	if (nBytes > 0)
-	{
-		Dequeue (pBuffer8, nBytes);
-
-		pBuffer8 += nBytes;
-		nQueueBytesAvail -= nBytes;
-	}
-
-	m_SpinLock.Release ();
+	unsigned nQueueBytesAvail = m_Queue.GetAvail ();
 
 	while (nBytes < nChunkSizeBytes)
 	{
@@ -373,66 +327,105 @@ unsigned CSoundBaseDevice::GetChunkInternal (void *pBuffer, unsigned nChunkSize)
 	return nChunkSize;
 }
 
-unsigned CSoundBaseDevice::GetQueueBytesFree (void)
+void DecodeUnsigned8 (s32 *pTo, const void *pFrom, unsigned nSamples)
 {
-	assert (m_nQueueSize > 1);
-	assert (m_nInPtr < m_nQueueSize);
-	assert (m_nOutPtr < m_nQueueSize);
+	const u8 *pSample = static_cast<const u8 *> (pFrom);
 
-	if (m_nOutPtr <= m_nInPtr)
+	for (unsigned i = 0; i < nSamples; i++)
 	{
-		return m_nQueueSize+m_nOutPtr-m_nInPtr-1;
+		pTo[i] = ((s32) pSample[i] - 128) << 24;
 	}
+}
 
-	return m_nOutPtr-m_nInPtr-1;
+void DecodeSigned16 (s32 *pTo, const void *pFrom, unsigned nSamples)
+{
+	const s16 *pSample = static_cast<const s16 *> (pFrom);
+
+	for (unsigned i = 0; i < nSamples; i++)
+	{
+		pTo[i] = (s32) pSample[i] << 16;
+	}
 }
 
-unsigned CSoundBaseDevice::GetQueueBytesAvail (void)
+void DecodeSigned24 (s32 *pTo, const void *pFrom, unsigned nSamples)
 {
-	assert (m_nQueueSize > 1);
-	assert (m_nInPtr < m_nQueueSize);
-	assert (m_nOutPtr < m_nQueueSize);
+	const u8 *pSample = static_cast<const u8 *> (pFrom);
 
-	if (m_nInPtr < m_nOutPtr)
+	for (unsigned i = 0; i < nSamples; i++, pSample += 3)
 	{
-		return m_nQueueSize+m_nInPtr-m_nOutPtr;
+		pTo[i] = (s32) (  (u32) pSample[0] << 8
+				| (u32) pSample[1] << 16
+				| (u32) pSample[2] << 24);
 	}
+}
 
-	return m_nInPtr-m_nOutPtr;
+void DecodeSigned32 (s32 *pTo, const void *pFrom, unsigned nSamples)
+{
+	memcpy (pTo, pFrom, nSamples * sizeof (s32));
 }
 
-void CSoundBaseDevice::Enqueue (const void *pBuffer, unsigned nCount)
+void DecodeFloat (s32 *pTo, const void *pFrom, unsigned nSamples)
 {
-	const u8 *p = static_cast<const u8 *> (pBuffer);
-	assert (p != 0);
-	assert (m_pQueue != 0);
+	const float *pSample = static_cast<const float *> (pFrom);
 
-	assert (nCount > 0);
-	while (nCount-- > 0)
+	for (unsigned i = 0; i < nSamples; i++)
 	{
-		m_pQueue[m_nInPtr] = *p++;
+		float fValue = pSample[i] * 2147483648.0f;
 
-		if (++m_nInPtr == m_nQueueSize)
-		{
-			m_nInPtr = 0;
-		}
+		// clip to the s32 range, 2147483647.0f is rounded to 2^31
+		fValue = fValue < 2147483520.0f ? fValue : 2147483520.0f;
+		fValue = fValue > -2147483648.0f ? fValue : -2147483648.0f;
+
+		pTo[i] = (s32) fValue;
+	}
+}
+
+void SwapChannels (s32 *pSamples, unsigned nFrames)
+{
+	for (unsigned i = 0; i < nFrames; i++, pSamples += 2)
+	{
+		s32 nLeft = pSamples[0];
+		pSamples[0] = pSamples[1];
+		pSamples[1] = nLeft;
 	}
 }
 
-void CSoundBaseDevice::Dequeue (void *pBuffer, unsigned nCount)
+// converts in place, beginning at the end
+void MonoToStereo (s32 *pSamples, unsigned nFrames)
 {
-	u8 *p = static_cast<u8 *> (pBuffer);
-	assert (p != 0);
-	assert (m_pQueue != 0);
+	while (nFrames-- > 0)
+	{
+		pSamples[nFrames*2] = pSamples[nFrames*2+1] = pSamples[nFrames];
+	}
+}
 
-	assert (nCount > 0);
-	while (nCount-- > 0)
+void EncodeSigned16 (void *pTo, const s32 *pFrom, unsigned nSamples, u32 nRange)
+{
+	s16 *pSample = static_cast<s16 *> (pTo);
+
+	for (unsigned i = 0; i < nSamples; i++)
 	{
-		*p++ = m_pQueue[m_nOutPtr];
+		pSample[i] = (s16) (pFrom[i] >> 16);
+	}
+}
 
-		if (++m_nOutPtr == m_nQueueSize)
-		{
-			m_nOutPtr = 0;
-		}
+void EncodeSigned24 (void *pTo, const s32 *pFrom, unsigned nSamples, u32 nRange)
+{
+	s32 *pSample = static_cast<s32 *> (pTo);
+
+	for (unsigned i = 0; i < nSamples; i++)
+	{
+		pSample[i] = pFrom[i] >> 8;
+	}
+}
+
+// scales the samples to 0..nRange
+void EncodeUnsigned32 (void *pTo, const s32 *pFrom, unsigned nSamples, u32 nRange)
+{
+	u32 *pSample = static_cast<u32 *> (pTo);
+
+	for (unsigned i = 0; i < nSamples; i++)
+	{
+		pSample[i] = (u32) (((u64) ((u32) pFrom[i] ^ 0x80000000U) * nRange) >> 32);
 	}
 }
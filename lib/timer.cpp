@@ -32,16 +32,75 @@
 
 struct TKernelTimer
 {
+	TKernelTimerLink     m_Link;		// must be first
 #ifndef NDEBUG
 	unsigned	     m_nMagic;
 #define KERNEL_TIMER_MAGIC	0x4B544D43
 #endif
+	TKernelTimerHandle   m_hTimer;		// 0 if not pending
+	unsigned	     m_nIndex;		// in the timer pool
+	unsigned	     m_nGeneration;	// makes handles unique on re-use
 	TKernelTimerHandler *m_pHandler;
 	unsigned	     m_nElapsesAt;
 	void 		    *m_pParam;
 	void 		    *m_pContext;
+	TKernelTimer	    *m_pNextFree;
 };
 
+// handle: bits 31-16 generation, bits 15-0 pool index + 1 (handle cannot be 0)
+#define KERNEL_TIMER_HANDLE(index, generation)	((TKernelTimerHandle) (((generation) & 0xFFFF) << 16 \
+									| ((index) + 1)))
+#define KERNEL_TIMER_INDEX(handle)		(((handle) & 0xFFFF) - 1)
+
+#if KERNEL_TIMER_MAX_BLOCKS * KERNEL_TIMER_BLOCK_SIZE > 0xFFFF
+	#error Too many kernel timers for handle format
+#endif
+
+static inline void ListInit (TKernelTimerLink *pHead)
+{
+	pHead->pNext = pHead;
+	pHead->pPrev = pHead;
+}
+
+static inline boolean ListIsEmpty (const TKernelTimerLink *pHead)
+{
+	return pHead->pNext == pHead;
+}
+
+static inline void ListAppend (TKernelTimerLink *pHead, TKernelTimerLink *pLink)
+{
+	pLink->pNext = pHead;
+	pLink->pPrev = pHead->pPrev;
+	pHead->pPrev->pNext = pLink;
+	pHead->pPrev = pLink;
+}
+
+static inline void ListRemove (TKernelTimerLink *pLink)
+{
+	pLink->pPrev->pNext = pLink->pNext;
+	pLink->pNext->pPrev = pLink->pPrev;
+	pLink->pNext = pLink;
+	pLink->pPrev = pLink;
+}
+
+// moves all entries of pFrom to the (empty) list pTo
+static inline void ListMove (TKernelTimerLink *pFrom, TKernelTimerLink *pTo)
+{
+	if (ListIsEmpty (pFrom))
+	{
+		ListInit (pTo);
+
+		return;
+	}
+
+	pTo->pNext = pFrom->pNext;
+	pTo->pPrev = pFrom->pPrev;
+	pTo->pNext->pPrev = pTo;
+	pTo->pPrev->pNext = pTo;
+
+	ListInit (pFrom);
+}
+
 extern "C" void DelayLoop (unsigned nCount);
 
 static const char FromTimer[] = "timer";
@@ -58,12 +117,23 @@ CTimer::CTimer (CInterruptSystem *pInterruptSystem)
 	m_nUptime (0),
 	m_nTime (0),
 	m_nMinutesDiff (0),
+	m_nKernelTimerWheelTicks (1),
+	m_nKernelTimerBlocks (0),
+	m_pFreeKernelTimer (0),
 	m_nMsDelay (200000),
 	m_nusDelay (m_nMsDelay / 1000),
 	m_nPeriodicHandlers (0)
 {
 	assert (s_pThis == 0);
 	s_pThis = this;
+
+	for (unsigned nLevel = 0; nLevel < KERNEL_TIMER_WHEEL_LEVELS; nLevel++)
+	{
+		for (unsigned nSlot = 0; nSlot < KERNEL_TIMER_WHEEL_SIZE; nSlot++)
+		{
+			ListInit (&m_KernelTimerWheel[nLevel][nSlot]);
+		}
+	}
 }
 
 CTimer::~CTimer (void)
@@ -81,16 +151,10 @@ CTimer::~CTimer (void)
 	m_pInterruptSystem->DisconnectIRQ (ARM_IRQLOCAL0_CNTPNS);
 #endif
 
-	TPtrListElement *pElement;
-	while ((pElement = m_KernelTimerList.GetFirst ()) != 0)
+	for (unsigned i = 0; i < m_nKernelTimerBlocks; i++)
 	{
-		TKernelTimer *pTimer = (TKernelTimer *) m_KernelTimerList.GetPtr (pElement);
-		assert (pTimer != 0);
-		assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
-
-		m_KernelTimerList.Remove (pElement);
-
-		delete pTimer;
+		delete [] m_pKernelTimerBlock[i];
+		m_pKernelTimerBlock[i] = 0;
 	}
 
 	s_pThis = 0;
@@ -318,6 +382,16 @@ CString *CTimer::GetTimeString (void)
 		return 0;
 	}
 
+	nTicks %= HZ;
+#if (HZ != 100)
+	nTicks = nTicks * 100 / HZ;
+#endif
+
+	return GetTimeString (nTime, nTicks);
+}
+
+CString *CTimer::GetTimeString (unsigned nTime, unsigned nHundredthTime)
+{
 	unsigned nSecond = nTime % 60;
 	nTime /= 60;
 	unsigned nMinute = nTime % 60;
@@ -354,21 +428,16 @@ CString *CTimer::GetTimeString (void)
 
 	unsigned nMonthDay = nTime + 1;
 
-	nTicks %= HZ;
-#if (HZ != 100)
-	nTicks = nTicks * 100 / HZ;
-#endif
-
 	CString *pString = new CString;
 	assert (pString != 0);
 
 	if (nYear > 1975)
 	{
-		pString->Format ("%s %2u %02u:%02u:%02u.%02u", s_pMonthName[nMonth], nMonthDay, nHour, nMinute, nSecond, nTicks);
+		pString->Format ("%s %2u %02u:%02u:%02u.%02u", s_pMonthName[nMonth], nMonthDay, nHour, nMinute, nSecond, nHundredthTime);
 	}
 	else
 	{
-		pString->Format ("%02u:%02u:%02u.%02u", nHours, nMinute, nSecond, nTicks);
+		pString->Format ("%02u:%02u:%02u.%02u", nHours, nMinute, nSecond, nHundredthTime);
 	}
 
 	return pString;
@@ -379,71 +448,46 @@ TKernelTimerHandle CTimer::StartKernelTimer (unsigned nDelay,
 					     void *pParam,
 					     void *pContext)
 {
-	TKernelTimer *pTimer = new TKernelTimer;
-	assert (pTimer != 0);
-
-	unsigned nElapsesAt = m_nTicks + nDelay;
-
 	assert (pHandler != 0);
-#ifndef NDEBUG
-	pTimer->m_nMagic     = KERNEL_TIMER_MAGIC;
-#endif
-	pTimer->m_pHandler   = pHandler;
-	pTimer->m_nElapsesAt = nElapsesAt;
-	pTimer->m_pParam     = pParam;
-	pTimer->m_pContext   = pContext;
 
 	m_KernelTimerSpinLock.Acquire ();
 
-	TPtrListElement *pPrevElement = 0;
-	TPtrListElement *pElement = m_KernelTimerList.GetFirst ();
-	while (pElement != 0)
+	TKernelTimer *pTimer = AllocateKernelTimer ();
+	if (pTimer == 0)
 	{
-		TKernelTimer *pTimer2 = (TKernelTimer *) m_KernelTimerList.GetPtr (pElement);
-		assert (pTimer2 != 0);
-		assert (pTimer2->m_nMagic == KERNEL_TIMER_MAGIC);
-
-		if ((int) (pTimer2->m_nElapsesAt-nElapsesAt) > 0)
-		{
-			break;
-		}
+		m_KernelTimerSpinLock.Release ();
 
-		pPrevElement = pElement;
-		pElement = m_KernelTimerList.GetNext (pElement);
+		// the callers rely on a valid handle, so we cannot continue
+		CLogger::Get ()->Write (FromTimer, LogPanic, "Kernel timer pool exhausted (%u timers)",
+					m_nKernelTimerBlocks * KERNEL_TIMER_BLOCK_SIZE);
 	}
 
-	if (pElement != 0)
-	{
-		m_KernelTimerList.InsertBefore (pElement, pTimer);
-	}
-	else
-	{
-		m_KernelTimerList.InsertAfter (pPrevElement, pTimer);
-	}
+	pTimer->m_pHandler   = pHandler;
+	pTimer->m_nElapsesAt = m_nTicks + nDelay;
+	pTimer->m_pParam     = pParam;
+	pTimer->m_pContext   = pContext;
+
+	InsertKernelTimer (pTimer);
+
+	TKernelTimerHandle hTimer = pTimer->m_hTimer;
 
 	m_KernelTimerSpinLock.Release ();
 
-	return (TKernelTimerHandle) pTimer;
+	return hTimer;
 }
 
 void CTimer::CancelKernelTimer (TKernelTimerHandle hTimer)
 {
-	TKernelTimer *pTimer = (TKernelTimer *) hTimer;
-	assert (pTimer != 0);
+	assert (hTimer != 0);
 
 	m_KernelTimerSpinLock.Acquire ();
 
-	TPtrListElement *pElement = m_KernelTimerList.Find (pTimer);
-	if (pElement != 0)
+	TKernelTimer *pTimer = GetKernelTimer (hTimer);
+	if (pTimer != 0)
 	{
-		assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
-
-		m_KernelTimerList.Remove (pElement);
+		ListRemove (&pTimer->m_Link);
 
-#ifndef NDEBUG
-		pTimer->m_nMagic = 0;
-#endif
-		delete pTimer;
+		FreeKernelTimer (pTimer);
 	}
 
 	m_KernelTimerSpinLock.Release ();
@@ -453,37 +497,173 @@ void CTimer::PollKernelTimers (void)
 {
 	m_KernelTimerSpinLock.Acquire ();
 
-	TPtrListElement *pElement = m_KernelTimerList.GetFirst ();
-	while (pElement != 0)
+	while ((int) (m_nTicks-m_nKernelTimerWheelTicks) >= 0)
 	{
-		TKernelTimer *pTimer = (TKernelTimer *) m_KernelTimerList.GetPtr (pElement);
-		assert (pTimer != 0);
-		assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+		// move timers from higher levels down, when a lower level wraps
+		unsigned nSlot = m_nKernelTimerWheelTicks & (KERNEL_TIMER_WHEEL_SIZE-1);
+		for (unsigned nLevel = 1; nSlot == 0 && nLevel < KERNEL_TIMER_WHEEL_LEVELS; nLevel++)
+		{
+			nSlot =    (m_nKernelTimerWheelTicks >> (nLevel * KERNEL_TIMER_WHEEL_BITS))
+				 & (KERNEL_TIMER_WHEEL_SIZE-1);
+
+			CascadeKernelTimers (nLevel, nSlot);
+		}
+
+		// timers started by a handler do not elapse in this tick
+		TKernelTimerLink Elapsed;
+		ListMove (&m_KernelTimerWheel[0][m_nKernelTimerWheelTicks & (KERNEL_TIMER_WHEEL_SIZE-1)],
+			  &Elapsed);
 
-		if ((int) (pTimer->m_nElapsesAt-m_nTicks) > 0)
+		m_nKernelTimerWheelTicks++;
+
+		while (!ListIsEmpty (&Elapsed))
 		{
-			break;
+			TKernelTimer *pTimer = (TKernelTimer *) Elapsed.pNext;
+			assert (pTimer != 0);
+			assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+
+			ListRemove (&pTimer->m_Link);
+
+			TKernelTimerHandle hTimer = pTimer->m_hTimer;
+			TKernelTimerHandler *pHandler = pTimer->m_pHandler;
+			void *pParam = pTimer->m_pParam;
+			void *pContext = pTimer->m_pContext;
+
+			FreeKernelTimer (pTimer);
+
+			m_KernelTimerSpinLock.Release ();
+
+			assert (pHandler != 0);
+			(*pHandler) (hTimer, pParam, pContext);
+
+			m_KernelTimerSpinLock.Acquire ();
 		}
+	}
 
-		TPtrListElement *pNextElement = m_KernelTimerList.GetNext (pElement);
-		m_KernelTimerList.Remove (pElement);
-		pElement = pNextElement;
+	m_KernelTimerSpinLock.Release ();
+}
 
-		m_KernelTimerSpinLock.Release ();
+TKernelTimer *CTimer::AllocateKernelTimer (void)
+{
+	if (m_pFreeKernelTimer == 0)
+	{
+		if (m_nKernelTimerBlocks >= KERNEL_TIMER_MAX_BLOCKS)
+		{
+			return 0;
+		}
+
+		TKernelTimer *pBlock = new TKernelTimer[KERNEL_TIMER_BLOCK_SIZE];
+		if (pBlock == 0)
+		{
+			return 0;
+		}
+
+		for (unsigned i = 0; i < KERNEL_TIMER_BLOCK_SIZE; i++)
+		{
+			pBlock[i].m_hTimer = 0;
+			pBlock[i].m_nIndex = m_nKernelTimerBlocks * KERNEL_TIMER_BLOCK_SIZE + i;
+			pBlock[i].m_nGeneration = 0;
+			pBlock[i].m_pNextFree = i < KERNEL_TIMER_BLOCK_SIZE-1 ? &pBlock[i+1] : 0;
+		}
 
-		TKernelTimerHandler *pHandler = pTimer->m_pHandler;
-		assert (pHandler != 0);
-		(*pHandler) ((TKernelTimerHandle) pTimer, pTimer->m_pParam, pTimer->m_pContext);
+		m_pKernelTimerBlock[m_nKernelTimerBlocks++] = pBlock;
+		m_pFreeKernelTimer = pBlock;
+	}
+
+	TKernelTimer *pTimer = m_pFreeKernelTimer;
+	m_pFreeKernelTimer = pTimer->m_pNextFree;
+
+	assert (pTimer->m_hTimer == 0);
+	pTimer->m_hTimer = KERNEL_TIMER_HANDLE (pTimer->m_nIndex, ++pTimer->m_nGeneration);
+#ifndef NDEBUG
+	pTimer->m_nMagic = KERNEL_TIMER_MAGIC;
+#endif
+	ListInit (&pTimer->m_Link);
 
+	return pTimer;
+}
+
+void CTimer::FreeKernelTimer (TKernelTimer *pTimer)
+{
+	assert (pTimer != 0);
+	assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
 #ifndef NDEBUG
-		pTimer->m_nMagic = 0;
+	pTimer->m_nMagic = 0;
 #endif
-		delete pTimer;
+	pTimer->m_hTimer = 0;
 
-		m_KernelTimerSpinLock.Acquire ();
+	pTimer->m_pNextFree = m_pFreeKernelTimer;
+	m_pFreeKernelTimer = pTimer;
+}
+
+TKernelTimer *CTimer::GetKernelTimer (TKernelTimerHandle hTimer)
+{
+	unsigned nIndex = KERNEL_TIMER_INDEX (hTimer);
+	unsigned nBlock = nIndex / KERNEL_TIMER_BLOCK_SIZE;
+	if (nBlock >= m_nKernelTimerBlocks)
+	{
+		return 0;
 	}
 
-	m_KernelTimerSpinLock.Release ();
+	TKernelTimer *pTimer = &m_pKernelTimerBlock[nBlock][nIndex % KERNEL_TIMER_BLOCK_SIZE];
+	if (pTimer->m_hTimer != hTimer)		// elapsed or cancelled before
+	{
+		return 0;
+	}
+
+	assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+
+	return pTimer;
+}
+
+void CTimer::InsertKernelTimer (TKernelTimer *pTimer)
+{
+	assert (pTimer != 0);
+
+	unsigned nElapsesAt = pTimer->m_nElapsesAt;
+	int nDelta = (int) (nElapsesAt-m_nKernelTimerWheelTicks);
+	if (nDelta < 0)				// elapses with next tick
+	{
+		nElapsesAt = m_nKernelTimerWheelTicks;
+		nDelta = 0;
+	}
+
+	unsigned nLevel = 0;
+	while (   nLevel < KERNEL_TIMER_WHEEL_LEVELS-1
+	       && (unsigned) nDelta >= 1U << ((nLevel+1) * KERNEL_TIMER_WHEEL_BITS))
+	{
+		nLevel++;
+	}
+
+	// too far in the future, will be cascaded again
+	const unsigned nMaxDelta = (1U << (KERNEL_TIMER_WHEEL_LEVELS * KERNEL_TIMER_WHEEL_BITS)) - 1;
+	if ((unsigned) nDelta > nMaxDelta)
+	{
+		nElapsesAt = m_nKernelTimerWheelTicks + nMaxDelta;
+	}
+
+	unsigned nSlot = (nElapsesAt >> (nLevel * KERNEL_TIMER_WHEEL_BITS)) & (KERNEL_TIMER_WHEEL_SIZE-1);
+
+	ListAppend (&m_KernelTimerWheel[nLevel][nSlot], &pTimer->m_Link);
+}
+
+void CTimer::CascadeKernelTimers (unsigned nLevel, unsigned nSlot)
+{
+	assert (0 < nLevel && nLevel < KERNEL_TIMER_WHEEL_LEVELS);
+	assert (nSlot < KERNEL_TIMER_WHEEL_SIZE);
+
+	TKernelTimerLink Cascade;
+	ListMove (&m_KernelTimerWheel[nLevel][nSlot], &Cascade);
+
+	while (!ListIsEmpty (&Cascade))
+	{
+		TKernelTimer *pTimer = (TKernelTimer *) Cascade.pNext;
+		assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+
+		ListRemove (&pTimer->m_Link);
+
+		InsertKernelTimer (pTimer);
+	}
 }
 
 void CTimer::InterruptHandler (void)
@@ -33,6 +33,7 @@
 #include <circle/koptions.h>
 #include <circle/sysconfig.h>
 #include <circle/debug.h>
+#include <circle/util.h>
 #include <assert.h>
 
 //
@@ -84,6 +85,10 @@ CDWHCIDevice::CDWHCIDevice (CInterruptSystem *pInterruptSystem, CTimer *pTimer)
 	{
 		m_bWaiting[nWaitBlock] = FALSE;
 	}
+
+	memset (m_PendingQueue, 0, sizeof m_PendingQueue);
+
+	ResetStatistics ();
 }
 
 CDWHCIDevice::~CDWHCIDevice (void)
@@ -692,64 +697,123 @@ boolean CDWHCIDevice::TransferStageAsync (CUSBRequest *pURB, boolean bIn, boolea
 					  unsigned nTimeoutMs)
 {
 	assert (pURB != 0);
-	
+
+	// channel is assigned later
+	CDWHCITransferStageData *pStageData =
+		new CDWHCITransferStageData (DWHCI_MAX_CHANNELS, pURB, bIn, bStatusStage, nTimeoutMs);
+	assert (pStageData != 0);
+
+	if (   pStageData->IsSplit ()
+	    && !pStageData->BeginSplitCycle ())
+	{
+		delete pStageData;
+
+		return FALSE;
+	}
+
 #ifndef USE_USB_SOF_INTR
-	unsigned nChannel = AllocateChannel ();
-	if (nChannel >= m_nChannels)
+	if (!ScheduleStage (pStageData))
 	{
+		delete pStageData;
+
 		return FALSE;
 	}
 #else
-	unsigned nChannel = DWHCI_MAX_CHANNELS;		// unused
+	PrepareStage (pStageData);
+
+	QueueTransaction (pStageData);
 #endif
+	
+	return TRUE;
+}
 
-	CDWHCITransferStageData *pStageData =
-		new CDWHCITransferStageData (nChannel, pURB, bIn, bStatusStage, nTimeoutMs);
+void CDWHCIDevice::PrepareStage (CDWHCITransferStageData *pStageData)
+{
 	assert (pStageData != 0);
 
-#ifndef USE_USB_SOF_INTR
-	assert (m_pStageData[nChannel] == 0);
-	m_pStageData[nChannel] = pStageData;
-
-	EnableChannelInterrupt (nChannel);
-#endif
-
 	if (!pStageData->IsSplit ())
 	{
 		pStageData->SetState (StageStateNoSplitTransfer);
 	}
 	else
 	{
-		if (!pStageData->BeginSplitCycle ())
-		{
-#ifndef USE_USB_SOF_INTR
-			DisableChannelInterrupt (nChannel);
-#endif
+		pStageData->SetState (StageStateStartSplit);
+		pStageData->SetSplitComplete (FALSE);
+		pStageData->GetFrameScheduler ()->StartSplit ();
+	}
+}
 
-			delete pStageData;
 #ifndef USE_USB_SOF_INTR
-			m_pStageData[nChannel] = 0;
-			
-			FreeChannel (nChannel);
-#endif
 
-			return FALSE;
+boolean CDWHCIDevice::ScheduleStage (CDWHCITransferStageData *pStageData)
+{
+	assert (pStageData != 0);
+
+	m_ChannelSpinLock.Acquire ();
+
+	unsigned nChannel = AllocateChannelLocked ();
+	if (nChannel >= m_nChannels)
+	{
+		boolean bOK = EnqueuePendingStage (pStageData);
+
+		m_ChannelSpinLock.Release ();
+
+		if (!bOK)
+		{
+			CLogger::Get ()->Write (FromDWHCI, LogWarning, "Too many pending USB transfers");
 		}
 
-		pStageData->SetState (StageStateStartSplit);
-		pStageData->SetSplitComplete (FALSE);
-		pStageData->GetFrameScheduler ()->StartSplit ();
+		return bOK;
 	}
 
-#ifndef USE_USB_SOF_INTR
-	StartTransaction (pStageData);
-#else
-	QueueTransaction (pStageData);
-#endif
-	
+	m_ChannelSpinLock.Release ();
+
+	StartStage (pStageData, nChannel);
+
 	return TRUE;
 }
 
+void CDWHCIDevice::StartStage (CDWHCITransferStageData *pStageData, unsigned nChannel)
+{
+	assert (pStageData != 0);
+	assert (nChannel < m_nChannels);
+
+	pStageData->SetChannelNumber (nChannel);
+
+	assert (m_pStageData[nChannel] == 0);
+	m_pStageData[nChannel] = pStageData;
+
+	EnableChannelInterrupt (nChannel);
+
+	PrepareStage (pStageData);
+
+	StartTransaction (pStageData);
+}
+
+void CDWHCIDevice::DelayPeriodicStage (CDWHCITransferStageData *pStageData)
+{
+	assert (pStageData != 0);
+	unsigned nChannel = pStageData->GetChannelNumber ();
+	assert (nChannel < m_nChannels);
+
+	pStageData->SetState (StageStatePeriodicDelay);
+
+	DisableChannelInterrupt (nChannel);
+
+	m_pStageData[nChannel] = 0;
+	pStageData->SetChannelNumber (DWHCI_MAX_CHANNELS);
+
+	FreeChannel (nChannel);
+
+	CUSBRequest *pURB = pStageData->GetURB ();
+	assert (pURB != 0);
+	unsigned nInterval = pURB->GetEndpoint ()->GetInterval ();
+
+	m_pTimer->StartKernelTimer (MSEC2HZ (nInterval), TimerStub, pStageData, this);
+}
+
+#endif
+
 #ifdef USE_USB_SOF_INTR
 
 void CDWHCIDevice::QueueTransaction (CDWHCITransferStageData *pStageData)
@@ -849,6 +913,8 @@ void CDWHCIDevice::StartChannel (CDWHCITransferStageData *pStageData)
 	
 	pStageData->SetSubState (StageSubStateWaitForTransactionComplete);
 
+	m_Statistics.Channel[nChannel].nTransactions++;
+
 	// reset all pending channel interrupts
 	CDWHCIRegister ChanInterrupt (DWHCI_HOST_CHAN_INT (nChannel));
 	ChanInterrupt.SetAll ();
@@ -1032,12 +1098,7 @@ void CDWHCIDevice::ChannelInterruptHandler (unsigned nChannel)
 
 				QueueDelayedTransaction (pStageData);
 #else
-				pStageData->SetState (StageStatePeriodicDelay);
-
-				unsigned nInterval = pURB->GetEndpoint ()->GetInterval ();
-
-				m_pTimer->StartKernelTimer (MSEC2HZ (nInterval), TimerStub,
-							    pStageData, this);
+				DelayPeriodicStage (pStageData);
 #endif
 
 				break;
@@ -1196,12 +1257,7 @@ void CDWHCIDevice::ChannelInterruptHandler (unsigned nChannel)
 
 					QueueDelayedTransaction (pStageData);
 #else
-					pStageData->SetState (StageStatePeriodicDelay);
-
-					unsigned nInterval = pURB->GetEndpoint ()->GetInterval ();
-
-					m_pTimer->StartKernelTimer (MSEC2HZ (nInterval),
-								    TimerStub, pStageData, this);
+					DelayPeriodicStage (pStageData);
 #endif
 				}
 			}
@@ -1341,19 +1397,17 @@ void CDWHCIDevice::TimerHandler (CDWHCITransferStageData *pStageData)
 	assert (pStageData != 0);
 	assert (pStageData->GetState () == StageStatePeriodicDelay);
 
-	if (pStageData->IsSplit ())
-	{
-		pStageData->SetState (StageStateStartSplit);
-	
-		pStageData->SetSplitComplete (FALSE);
-		pStageData->GetFrameScheduler ()->StartSplit ();
-	}
-	else
+	if (!ScheduleStage (pStageData))
 	{
-		pStageData->SetState (StageStateNoSplitTransfer);
-	}
+		CUSBRequest *pURB = pStageData->GetURB ();
+		assert (pURB != 0);
 
-	StartTransaction (pStageData);
+		pURB->SetStatus (0);
+
+		delete pStageData;
+
+		pURB->CallCompletionRoutine ();
+	}
 
 	PeripheralExit ();
 }
@@ -1375,6 +1429,50 @@ unsigned CDWHCIDevice::AllocateChannel (void)
 {
 	m_ChannelSpinLock.Acquire ();
 
+	unsigned nChannel = AllocateChannelLocked ();
+
+	m_ChannelSpinLock.Release ();
+
+	return nChannel;
+}
+
+void CDWHCIDevice::FreeChannel (unsigned nChannel)
+{
+	assert (nChannel < m_nChannels);
+	unsigned nChannelMask = 1 << nChannel; 
+	
+	m_ChannelSpinLock.Acquire ();
+	
+	assert (m_nChannelAllocated & nChannelMask);
+
+	unsigned nTicks = CTimer::GetClockTicks ();
+	m_Statistics.Channel[nChannel].nBusyTime += nTicks - m_nChannelStartTicks[nChannel];
+
+	// hand the channel over to the next waiting stage, if any
+	CDWHCITransferStageData *pStageData = DequeuePendingStage ();
+	if (pStageData == 0)
+	{
+		m_nChannelAllocated &= ~nChannelMask;
+
+		m_ChannelSpinLock.Release ();
+
+		return;
+	}
+
+	m_nChannelStartTicks[nChannel] = nTicks;
+	m_Statistics.Channel[nChannel].nStages++;
+
+	m_ChannelSpinLock.Release ();
+
+#ifndef USE_USB_SOF_INTR
+	StartStage (pStageData, nChannel);
+#else
+	assert (0);
+#endif
+}
+
+unsigned CDWHCIDevice::AllocateChannelLocked (void)
+{
 	unsigned nChannelMask = 1;
 	for (unsigned nChannel = 0; nChannel < m_nChannels; nChannel++)
 	{
@@ -1382,29 +1480,110 @@ unsigned CDWHCIDevice::AllocateChannel (void)
 		{
 			m_nChannelAllocated |= nChannelMask;
 
-			m_ChannelSpinLock.Release ();
-			
+			m_nChannelStartTicks[nChannel] = CTimer::GetClockTicks ();
+			m_Statistics.Channel[nChannel].nStages++;
+
 			return nChannel;
 		}
 		
 		nChannelMask <<= 1;
 	}
 	
-	m_ChannelSpinLock.Release ();
-	
 	return DWHCI_MAX_CHANNELS;
 }
 
-void CDWHCIDevice::FreeChannel (unsigned nChannel)
+boolean CDWHCIDevice::EnqueuePendingStage (CDWHCITransferStageData *pStageData)
 {
-	assert (nChannel < m_nChannels);
-	unsigned nChannelMask = 1 << nChannel; 
-	
+	assert (pStageData != 0);
+	TPendingQueue *pQueue = &m_PendingQueue[  pStageData->IsPeriodic ()
+						? DWHCI_QUEUE_PERIODIC : DWHCI_QUEUE_NON_PERIODIC];
+
+	if (pQueue->nCount == DWHCI_MAX_PENDING_STAGES)
+	{
+		return FALSE;
+	}
+
+	pQueue->pStageData[pQueue->nIn] = pStageData;
+	if (++pQueue->nIn == DWHCI_MAX_PENDING_STAGES)
+	{
+		pQueue->nIn = 0;
+	}
+	pQueue->nCount++;
+
+	m_Statistics.nPendingStages++;
+
+	unsigned nPending =   m_PendingQueue[DWHCI_QUEUE_PERIODIC].nCount
+			    + m_PendingQueue[DWHCI_QUEUE_NON_PERIODIC].nCount;
+	if (nPending > m_Statistics.nPendingMax)
+	{
+		m_Statistics.nPendingMax = nPending;
+	}
+
+	return TRUE;
+}
+
+CDWHCITransferStageData *CDWHCIDevice::DequeuePendingStage (void)
+{
+	for (unsigned i = 0; i < 2; i++)
+	{
+		TPendingQueue *pQueue = &m_PendingQueue[i];
+		if (pQueue->nCount > 0)
+		{
+			CDWHCITransferStageData *pStageData = pQueue->pStageData[pQueue->nOut];
+			assert (pStageData != 0);
+
+			if (++pQueue->nOut == DWHCI_MAX_PENDING_STAGES)
+			{
+				pQueue->nOut = 0;
+			}
+			pQueue->nCount--;
+
+			return pStageData;
+		}
+	}
+
+	return 0;
+}
+
+void CDWHCIDevice::GetStatistics (TDWHCIStatistics *pStatistics)
+{
+	assert (pStatistics != 0);
+
 	m_ChannelSpinLock.Acquire ();
-	
-	assert (m_nChannelAllocated & nChannelMask);
-	m_nChannelAllocated &= ~nChannelMask;
-	
+
+	unsigned nTicks = CTimer::GetClockTicks ();
+
+	*pStatistics = m_Statistics;
+	pStatistics->nChannels = m_nChannels;
+	pStatistics->nElapsedTime = nTicks - m_nStatisticsStartTicks;
+
+	// add the running time of allocated channels
+	for (unsigned nChannel = 0; nChannel < m_nChannels; nChannel++)
+	{
+		if (m_nChannelAllocated & (1 << nChannel))
+		{
+			pStatistics->Channel[nChannel].nBusyTime +=
+				nTicks - m_nChannelStartTicks[nChannel];
+		}
+	}
+
+	m_ChannelSpinLock.Release ();
+}
+
+void CDWHCIDevice::ResetStatistics (void)
+{
+	m_ChannelSpinLock.Acquire ();
+
+	unsigned nTicks = CTimer::GetClockTicks ();
+
+	memset (&m_Statistics, 0, sizeof m_Statistics);
+	m_nStatisticsStartTicks = nTicks;
+
+	for (unsigned nChannel = 0; nChannel < DWHCI_MAX_CHANNELS; nChannel++)
+	{
+		m_nChannelStartTicks[nChannel] = nTicks;
+	}
+
 	m_ChannelSpinLock.Release ();
 }
 
@@ -7,7 +7,7 @@
 //	Licensed under GPLv2
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2018-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2018-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -40,6 +40,11 @@
 #define RX_HEADER_SIZE			(4 + 4 + 2)
 #define TX_HEADER_SIZE			(4 + 4)
 
+// Burst transfers (multiple frames per bulk transfer)
+#define RX_BURST_BUFFER_SIZE		DEFAULT_BURST_CAP_SIZE
+#define TX_BURST_BUFFER_SIZE		9000
+#define FRAME_ALIGN			4	// each RX/TX header starts 32-bit aligned
+
 #define MAX_RX_FRAME_SIZE		(2*6 + 2 + 1500 + 4)
 
 // USB vendor requests
@@ -231,12 +236,25 @@ static const char FromLAN7800[] = "lan7800";
 CLAN7800Device::CLAN7800Device (CUSBFunction *pFunction)
 :	CUSBFunction (pFunction),
 	m_pEndpointBulkIn (0),
-	m_pEndpointBulkOut (0)
+	m_pEndpointBulkOut (0),
+	m_nRxOffset (0),
+	m_nRxLength (0)
 {
+	m_pRxBuffer = new u8[RX_BURST_BUFFER_SIZE];
+	assert (m_pRxBuffer != 0);
+
+	m_pTxBuffer = new u8[TX_BURST_BUFFER_SIZE];
+	assert (m_pTxBuffer != 0);
 }
 
 CLAN7800Device::~CLAN7800Device (void)
 {
+	delete [] m_pTxBuffer;
+	m_pTxBuffer = 0;
+
+	delete [] m_pRxBuffer;
+	m_pRxBuffer = 0;
+
 	delete m_pEndpointBulkOut;
 	m_pEndpointBulkOut = 0;
 
@@ -336,8 +354,8 @@ boolean CLAN7800Device::Configure (void)
 		return FALSE;
 	}
 
-	// enable the LEDs and SEF mode
-	if (!ReadWriteReg (HW_CFG, HW_CFG_LED0_EN | HW_CFG_LED1_EN, ~HW_CFG_MEF))
+	// enable the LEDs and MEF mode (multiple frames per bulk in transfer)
+	if (!ReadWriteReg (HW_CFG, HW_CFG_LED0_EN | HW_CFG_LED1_EN | HW_CFG_MEF))
 	{
 		return FALSE;
 	}
@@ -425,65 +443,143 @@ const CMACAddress *CLAN7800Device::GetMACAddress (void) const
 
 boolean CLAN7800Device::SendFrame (const void *pBuffer, unsigned nLength)
 {
-	if (nLength > FRAME_BUFFER_SIZE)
+	return SendFrames (&pBuffer, &nLength, 1) == 1;
+}
+
+unsigned CLAN7800Device::SendFrames (const void *const *ppBuffer, const unsigned *pLength,
+				     unsigned nCount)
+{
+	assert (ppBuffer != 0);
+	assert (pLength != 0);
+
+	// pack the frames (each with TX command A and B) into one bulk out transfer
+	unsigned nFrames;
+	unsigned nOffset = 0;
+	for (nFrames = 0; nFrames < nCount; nFrames++)
 	{
-		return FALSE;
+		unsigned nLength = pLength[nFrames];
+		if (nLength > FRAME_BUFFER_SIZE)
+		{
+			break;
+		}
+
+		unsigned nFrameOffset = (nOffset + FRAME_ALIGN-1) & ~(FRAME_ALIGN-1);
+		if (nFrameOffset + TX_HEADER_SIZE + nLength > TX_BURST_BUFFER_SIZE)
+		{
+			break;
+		}
+
+		assert (m_pTxBuffer != 0);
+		u32 *pTxHeader = (u32 *) (m_pTxBuffer + nFrameOffset);
+		pTxHeader[0] = (nLength & TX_CMD_A_LEN_MASK) | TX_CMD_A_FCS;
+		pTxHeader[1] = 0;
+
+		assert (ppBuffer[nFrames] != 0);
+		memcpy (m_pTxBuffer + nFrameOffset + TX_HEADER_SIZE, ppBuffer[nFrames], nLength);
+
+		nOffset = nFrameOffset + TX_HEADER_SIZE + nLength;
 	}
 
-	u8 TxBuffer[FRAME_BUFFER_SIZE+TX_HEADER_SIZE] ALIGN(4);		// DMA buffer
-	assert (pBuffer != 0);
-	memcpy (TxBuffer+TX_HEADER_SIZE, pBuffer, nLength);
+	if (nFrames == 0)
+	{
+		return 0;
+	}
 
-	u32 *pTxHeader = (u32 *) TxBuffer;
-	pTxHeader[0] = (nLength & TX_CMD_A_LEN_MASK) | TX_CMD_A_FCS;
-	pTxHeader[1] = 0;
-	
 	assert (m_pEndpointBulkOut != 0);
-	return GetHost ()->Transfer (m_pEndpointBulkOut, TxBuffer, nLength+TX_HEADER_SIZE) >= 0;
+	if (GetHost ()->Transfer (m_pEndpointBulkOut, m_pTxBuffer, nOffset) < 0)
+	{
+		return 0;
+	}
+
+	return nFrames;
 }
 
 boolean CLAN7800Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 {
-	assert (m_pEndpointBulkIn != 0);
-	assert (pBuffer != 0);
-	CUSBRequest URB (m_pEndpointBulkIn, pBuffer, FRAME_BUFFER_SIZE);
+	return ReceiveFrames (&pBuffer, pResultLength, 1) == 1;
+}
 
-	if (!GetHost ()->SubmitBlockingRequest (&URB))
-	{
-		return FALSE;
-	}
+unsigned CLAN7800Device::ReceiveFrames (void *const *ppBuffer, unsigned *pResultLength,
+					unsigned nMaxCount)
+{
+	assert (ppBuffer != 0);
+	assert (pResultLength != 0);
 
-	u32 nResultLength = URB.GetResultLength ();
-	if (nResultLength < RX_HEADER_SIZE)
+	unsigned nFrames = 0;
+	while (nFrames < nMaxCount)
 	{
-		return FALSE;
-	}
+		if (m_nRxOffset >= m_nRxLength)
+		{
+			if (nFrames > 0)	// do not poll again, if we have something
+			{
+				break;
+			}
 
-	u32 nRxStatus = *(u32 *) pBuffer;	// RX command A
-	if (nRxStatus & RX_CMD_A_RED)
-	{
-		CLogger::Get ()->Write (FromLAN7800, LogWarning, "RX error (status 0x%X)", nRxStatus);
+			// a bulk in transfer may contain multiple frames in MEF mode
+			assert (m_pEndpointBulkIn != 0);
+			assert (m_pRxBuffer != 0);
+			CUSBRequest URB (m_pEndpointBulkIn, m_pRxBuffer, RX_BURST_BUFFER_SIZE);
 
-		return FALSE;
-	}
-	
-	u32 nFrameLength = nRxStatus & RX_CMD_A_LEN_MASK;
-	assert (nFrameLength == nResultLength-RX_HEADER_SIZE);
-	assert (nFrameLength > 4);
-	if (nFrameLength <= 4)
-	{
-		return FALSE;
-	}
-	nFrameLength -= 4;	// ignore FCS
+			if (!GetHost ()->SubmitBlockingRequest (&URB))
+			{
+				break;
+			}
 
-	//CLogger::Get ()->Write (FromLAN7800, LogDebug, "Frame received (status 0x%X)", nRxStatus);
+			m_nRxOffset = 0;
+			m_nRxLength = URB.GetResultLength ();
+			if (m_nRxLength == 0)
+			{
+				break;
+			}
+		}
 
-	memcpy (pBuffer, (u8 *) pBuffer + RX_HEADER_SIZE, nFrameLength); // overwrite RX command A..C
+		if (m_nRxLength - m_nRxOffset < RX_HEADER_SIZE)
+		{
+			m_nRxOffset = m_nRxLength;		// ignore the rest
 
-	assert (pResultLength != 0);
-	*pResultLength = nFrameLength;
-	
-	return TRUE;
+			continue;
+		}
+
+		u8 *pRxHeader = m_pRxBuffer + m_nRxOffset;
+		u32 nRxStatus = *(u32 *) pRxHeader;	// RX command A
+		u32 nFrameLength = nRxStatus & RX_CMD_A_LEN_MASK;
+
+		if (nFrameLength > m_nRxLength - m_nRxOffset - RX_HEADER_SIZE)
+		{
+			CLogger::Get ()->Write (FromLAN7800, LogWarning, "Invalid RX length (%u)",
+						nFrameLength);
+
+			m_nRxOffset = m_nRxLength;		// ignore the rest
+
+			continue;
+		}
+
+		// next RX header starts 32-bit aligned
+		m_nRxOffset += (RX_HEADER_SIZE + nFrameLength + FRAME_ALIGN-1) & ~(FRAME_ALIGN-1);
+
+		if (nRxStatus & RX_CMD_A_RED)
+		{
+			CLogger::Get ()->Write (FromLAN7800, LogWarning, "RX error (status 0x%X)", nRxStatus);
+
+			continue;
+		}
+
+		if (   nFrameLength <= 4
+		    || nFrameLength-4 > FRAME_BUFFER_SIZE)
+		{
+			continue;
+		}
+		nFrameLength -= 4;	// ignore FCS
+
+		//CLogger::Get ()->Write (FromLAN7800, LogDebug, "Frame received (status 0x%X)", nRxStatus);
+
+		assert (ppBuffer[nFrames] != 0);
+		memcpy (ppBuffer[nFrames], pRxHeader + RX_HEADER_SIZE, nFrameLength);
+
+		pResultLength[nFrames++] = nFrameLength;
+	}
+
+	return nFrames;
 }
 
 boolean CLAN7800Device::IsLinkUp (void)
@@ -9,7 +9,7 @@
 // See the file lib/usb/README for details!
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -34,6 +34,15 @@
 #include <circle/debug.h>
 #include <assert.h>
 
+// Sizes
+#define HS_USB_PKT_SIZE			512
+#define DEFAULT_HS_BURST_CAP_SIZE	(16 * 1024 + 5 * HS_USB_PKT_SIZE)
+#define DEFAULT_BULK_IN_DELAY		0x2000
+
+#define RX_BURST_BUFFER_SIZE		DEFAULT_HS_BURST_CAP_SIZE
+#define RX_STATUS_SIZE			4
+#define FRAME_ALIGN			4	// each RX status starts 32-bit aligned
+
 // USB vendor requests
 #define WRITE_REGISTER			0xA0
 #define READ_REGISTER			0xA1
@@ -46,6 +55,9 @@
 	#define TX_CFG_ON			0x00000004
 #define HW_CFG				0x14
 	#define HW_CFG_BIR			0x00001000
+	#define HW_CFG_RXDOFF			0x00000600
+	#define HW_CFG_MEF			0x00000020
+	#define HW_CFG_BCE			0x00000002
 #define RX_FIFO_INF			0x18
 #define PM_CTRL				0x20
 #define LED_GPIO_CFG			0x24
@@ -128,12 +140,19 @@ static const char FromSMSC951x[] = "smsc951x";
 CSMSC951xDevice::CSMSC951xDevice (CUSBFunction *pFunction)
 :	CUSBFunction (pFunction),
 	m_pEndpointBulkIn (0),
-	m_pEndpointBulkOut (0)
+	m_pEndpointBulkOut (0),
+	m_nRxOffset (0),
+	m_nRxLength (0)
 {
+	m_pRxBuffer = new u8[RX_BURST_BUFFER_SIZE];
+	assert (m_pRxBuffer != 0);
 }
 
 CSMSC951xDevice::~CSMSC951xDevice (void)
 {
+	delete [] m_pRxBuffer;
+	m_pRxBuffer = 0;
+
 	delete m_pEndpointBulkOut;
 	m_pEndpointBulkOut = 0;
 
@@ -227,6 +246,18 @@ boolean CSMSC951xDevice::Configure (void)
 		return FALSE;
 	}
 
+	// enable MEF mode (multiple frames per bulk in transfer) with burst cap
+	u32 nHWConfig;
+	if (   !WriteReg (BURST_CAP, DEFAULT_HS_BURST_CAP_SIZE / HS_USB_PKT_SIZE)
+	    || !WriteReg (BULK_IN_DLY, DEFAULT_BULK_IN_DELAY)
+	    || !ReadReg (HW_CFG, &nHWConfig)
+	    || !WriteReg (HW_CFG, (nHWConfig & ~HW_CFG_RXDOFF) | HW_CFG_MEF | HW_CFG_BCE))
+	{
+		CLogger::Get ()->Write (FromSMSC951x, LogError, "Cannot set burst mode");
+
+		return FALSE;
+	}
+
 	if (   !WriteReg (LED_GPIO_CFG,   LED_GPIO_CFG_SPD_LED
 					| LED_GPIO_CFG_LNK_LED
 					| LED_GPIO_CFG_FDX_LED)
@@ -272,46 +303,90 @@ boolean CSMSC951xDevice::SendFrame (const void *pBuffer, unsigned nLength)
 
 boolean CSMSC951xDevice::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 {
-	assert (m_pEndpointBulkIn != 0);
-	assert (pBuffer != 0);
-	CUSBRequest URB (m_pEndpointBulkIn, pBuffer, FRAME_BUFFER_SIZE);
+	return ReceiveFrames (&pBuffer, pResultLength, 1) == 1;
+}
 
-	if (!GetHost ()->SubmitBlockingRequest (&URB))
-	{
-		return FALSE;
-	}
+unsigned CSMSC951xDevice::ReceiveFrames (void *const *ppBuffer, unsigned *pResultLength,
+					 unsigned nMaxCount)
+{
+	assert (ppBuffer != 0);
+	assert (pResultLength != 0);
 
-	u32 nResultLength = URB.GetResultLength ();
-	if (nResultLength < 4)				// should not happen with HW_CFG_BIR set
+	unsigned nFrames = 0;
+	while (nFrames < nMaxCount)
 	{
-		return FALSE;
-	}
+		if (m_nRxOffset >= m_nRxLength)
+		{
+			if (nFrames > 0)	// do not poll again, if we have something
+			{
+				break;
+			}
 
-	u32 nRxStatus = *(u32 *) pBuffer;
-	if (nRxStatus & RX_STS_ERROR)
-	{
-		CLogger::Get ()->Write (FromSMSC951x, LogWarning, "RX error (status 0x%X)", nRxStatus);
+			// a bulk in transfer may contain multiple frames in MEF mode
+			assert (m_pEndpointBulkIn != 0);
+			assert (m_pRxBuffer != 0);
+			CUSBRequest URB (m_pEndpointBulkIn, m_pRxBuffer, RX_BURST_BUFFER_SIZE);
 
-		return FALSE;
-	}
-	
-	u32 nFrameLength = RX_STS_FRAMELEN (nRxStatus);
-	assert (nFrameLength == nResultLength-4);
-	assert (nFrameLength > 4);
-	if (nFrameLength <= 4)
-	{
-		return FALSE;
-	}
-	nFrameLength -= 4;	// ignore CRC
+			if (!GetHost ()->SubmitBlockingRequest (&URB))
+			{
+				break;
+			}
 
-	//CLogger::Get ()->Write (FromSMSC951x, LogDebug, "Frame received (status 0x%X)", nRxStatus);
+			m_nRxOffset = 0;
+			m_nRxLength = URB.GetResultLength ();
+			if (m_nRxLength == 0)		// should not happen with HW_CFG_BIR set
+			{
+				break;
+			}
+		}
 
-	memcpy (pBuffer, (u8 *) pBuffer + 4, nFrameLength);	// overwrite RX status
+		if (m_nRxLength - m_nRxOffset < RX_STATUS_SIZE)
+		{
+			m_nRxOffset = m_nRxLength;		// ignore the rest
 
-	assert (pResultLength != 0);
-	*pResultLength = nFrameLength;
-	
-	return TRUE;
+			continue;
+		}
+
+		u8 *pRxStatus = m_pRxBuffer + m_nRxOffset;
+		u32 nRxStatus = *(u32 *) pRxStatus;
+		u32 nFrameLength = RX_STS_FRAMELEN (nRxStatus);
+
+		if (nFrameLength > m_nRxLength - m_nRxOffset - RX_STATUS_SIZE)
+		{
+			CLogger::Get ()->Write (FromSMSC951x, LogWarning, "Invalid RX length (%u)",
+						nFrameLength);
+
+			m_nRxOffset = m_nRxLength;		// ignore the rest
+
+			continue;
+		}
+
+		// next RX status starts 32-bit aligned
+		m_nRxOffset += (RX_STATUS_SIZE + nFrameLength + FRAME_ALIGN-1) & ~(FRAME_ALIGN-1);
+
+		if (nRxStatus & RX_STS_ERROR)
+		{
+			CLogger::Get ()->Write (FromSMSC951x, LogWarning, "RX error (status 0x%X)", nRxStatus);
+
+			continue;
+		}
+
+		if (   nFrameLength <= 4
+		    || nFrameLength-4 > FRAME_BUFFER_SIZE)
+		{
+			continue;
+		}
+		nFrameLength -= 4;	// ignore CRC
+
+		//CLogger::Get ()->Write (FromSMSC951x, LogDebug, "Frame received (status 0x%X)", nRxStatus);
+
+		assert (ppBuffer[nFrames] != 0);
+		memcpy (ppBuffer[nFrames], pRxStatus + RX_STATUS_SIZE, nFrameLength);
+
+		pResultLength[nFrames++] = nFrameLength;
+	}
+
+	return nFrames;
 }
 
 boolean CSMSC951xDevice::IsLinkUp (void)
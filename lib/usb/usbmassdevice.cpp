@@ -2,7 +2,7 @@
 // usbmassdevice.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -198,6 +198,11 @@ CUSBBulkOnlyMassStorageDevice::CUSBBulkOnlyMassStorageDevice (CUSBFunction *pFun
 	m_nCWBTag (0),
 	m_nBlockCount (0),
 	m_ullOffset (0),
+	m_pReadAheadBuffer (0),
+	m_nReadAheadBlock (0),
+	m_nReadAheadCount (0),
+	m_nReadAhead (0),
+	m_nNextBlock ((u32) -1),
 	m_pPartitionManager (0),
 	m_nDeviceNumber (0)
 {
@@ -218,6 +223,9 @@ CUSBBulkOnlyMassStorageDevice::~CUSBBulkOnlyMassStorageDevice (void)
 	delete m_pPartitionManager;
 	m_pPartitionManager = 0;
 
+	delete [] m_pReadAheadBuffer;
+	m_pReadAheadBuffer = 0;
+
 	delete m_pEndpointOut;
 	m_pEndpointOut =  0;
 	
@@ -402,6 +410,10 @@ boolean CUSBBulkOnlyMassStorageDevice::Configure (void)
 		return FALSE;
 	}
 
+	assert (m_pReadAheadBuffer == 0);
+	m_pReadAheadBuffer = new u8[UMSD_READ_AHEAD_MAX * UMSD_BLOCK_SIZE];
+	assert (m_pReadAheadBuffer != 0);
+
 	s_nDeviceNumberMap |= 1 << i;
 
 	assert (m_nDeviceNumber == 0);
@@ -428,52 +440,134 @@ boolean CUSBBulkOnlyMassStorageDevice::Configure (void)
 
 int CUSBBulkOnlyMassStorageDevice::Read (void *pBuffer, size_t nCount)
 {
-	unsigned nTries = 4;
+	assert (pBuffer != 0);
 
-	int nResult;
+	if (   (m_ullOffset & UMSD_BLOCK_MASK) != 0
+	    || m_ullOffset > UMSD_MAX_OFFSET
+	    || (nCount & UMSD_BLOCK_MASK) != 0)
+	{
+		return -1;
+	}
 
-	do
+	u32 nBlock = (u32) (m_ullOffset >> UMSD_BLOCK_SHIFT);
+	unsigned nBlocks = nCount >> UMSD_BLOCK_SHIFT;
+	if ((u64) nBlock + nBlocks > m_nBlockCount)
 	{
-		nResult = TryRead (pBuffer, nCount);
+		return -1;
+	}
+
+	u8 *pTo = (u8 *) pBuffer;
+	while (nBlocks > 0)
+	{
+		assert (m_pReadAheadBuffer != 0);
 
-		if (nResult != (int) nCount)
+		// served from the read-ahead buffer?
+		if (   nBlock >= m_nReadAheadBlock
+		    && nBlock <  m_nReadAheadBlock + m_nReadAheadCount)
 		{
-			int nStatus = Reset ();
-			if (nStatus != 0)
+			unsigned nIndex = nBlock - m_nReadAheadBlock;
+			unsigned nChunk = m_nReadAheadCount - nIndex;
+			if (nChunk > nBlocks)
 			{
-				return nStatus;
+				nChunk = nBlocks;
+			}
+
+			memcpy (pTo, m_pReadAheadBuffer + nIndex * UMSD_BLOCK_SIZE,
+				nChunk * UMSD_BLOCK_SIZE);
+
+			nBlock += nChunk;
+			pTo += nChunk * UMSD_BLOCK_SIZE;
+			nBlocks -= nChunk;
+
+			continue;
+		}
+
+		// double the read-ahead window on each sequential miss, reset it otherwise
+		if (nBlock == m_nNextBlock)
+		{
+			m_nReadAhead = m_nReadAhead*2 + 1;
+			if (m_nReadAhead > UMSD_READ_AHEAD_MAX)
+			{
+				m_nReadAhead = UMSD_READ_AHEAD_MAX;
 			}
 		}
+		else
+		{
+			m_nReadAhead = 0;
+		}
+
+		unsigned nFetch = nBlocks + m_nReadAhead;
+		if (nFetch > UMSD_READ_AHEAD_MAX)
+		{
+			nFetch = UMSD_READ_AHEAD_MAX;
+		}
+
+		if (nFetch > m_nBlockCount - nBlock)
+		{
+			nFetch = m_nBlockCount - nBlock;
+		}
+
+		if (nFetch <= nBlocks)
+		{
+			// large or random request, read directly into the caller's buffer
+			if (Transfer (nBlock, pTo, nBlocks, FALSE) < 0)
+			{
+				return -1;
+			}
+
+			nBlock += nBlocks;
+			nBlocks = 0;
+
+			break;
+		}
+
+		m_nReadAheadCount = 0;
+
+		if (Transfer (nBlock, m_pReadAheadBuffer, nFetch, FALSE) < 0)
+		{
+			return -1;
+		}
+
+		m_nReadAheadBlock = nBlock;
+		m_nReadAheadCount = nFetch;
 	}
-	while (   nResult != (int) nCount
-	       && --nTries > 0);
 
-	return nResult;
+	m_nNextBlock = nBlock;
+
+	return nCount;
 }
 
 int CUSBBulkOnlyMassStorageDevice::Write (const void *pBuffer, size_t nCount)
 {
-	unsigned nTries = 4;
+	assert (pBuffer != 0);
+
+	if (   (m_ullOffset & UMSD_BLOCK_MASK) != 0
+	    || m_ullOffset > UMSD_MAX_OFFSET
+	    || (nCount & UMSD_BLOCK_MASK) != 0)
+	{
+		return -1;
+	}
 
-	int nResult;
+	u32 nBlock = (u32) (m_ullOffset >> UMSD_BLOCK_SHIFT);
+	unsigned nBlocks = nCount >> UMSD_BLOCK_SHIFT;
+	if ((u64) nBlock + nBlocks > m_nBlockCount)
+	{
+		return -1;
+	}
 
-	do
+	// invalidate the read-ahead buffer, if the written range overlaps it
+	if (   nBlock < m_nReadAheadBlock + m_nReadAheadCount
+	    && nBlock + nBlocks > m_nReadAheadBlock)
 	{
-		nResult = TryWrite (pBuffer, nCount);
+		m_nReadAheadCount = 0;
+	}
 
-		if (nResult != (int) nCount)
-		{
-			int nStatus = Reset ();
-			if (nStatus != 0)
-			{
-				return nStatus;
-			}
-		}
+	if (Transfer (nBlock, (void *) pBuffer, nBlocks, TRUE) < 0)
+	{
+		return -1;
 	}
-	while (   nResult != (int) nCount
-	       && --nTries > 0);
 
-	return nResult;
+	return nCount;
 }
 
 u64 CUSBBulkOnlyMassStorageDevice::Seek (u64 ullOffset)
@@ -488,33 +582,71 @@ unsigned CUSBBulkOnlyMassStorageDevice::GetCapacity (void) const
 	return m_nBlockCount;
 }
 
-int CUSBBulkOnlyMassStorageDevice::TryRead (void *pBuffer, size_t nCount)
+int CUSBBulkOnlyMassStorageDevice::Transfer (u32 nBlockAddress, void *pBuffer, unsigned nBlocks,
+					     boolean bWrite)
 {
 	assert (pBuffer != 0);
 
-	if (   (m_ullOffset & UMSD_BLOCK_MASK) != 0
-	    || m_ullOffset > UMSD_MAX_OFFSET)
+	u8 *pData = (u8 *) pBuffer;
+	while (nBlocks > 0)
 	{
-		return -1;
-	}
-	u32 nBlockAddress = (u32) (m_ullOffset >> UMSD_BLOCK_SHIFT);
+		unsigned nChunk = nBlocks;
+		if (nChunk > UMSD_MAX_TRANSFER_BLOCKS)
+		{
+			nChunk = UMSD_MAX_TRANSFER_BLOCKS;
+		}
 
-	if ((nCount & UMSD_BLOCK_MASK) != 0)
-	{
-		return -1;
+		unsigned nTries = 4;
+
+		int nResult;
+
+		do
+		{
+			nResult =   bWrite
+				  ? TryWrite (nBlockAddress, pData, nChunk)
+				  : TryRead (nBlockAddress, pData, nChunk);
+
+			if (nResult < 0)
+			{
+				int nStatus = Reset ();
+				if (nStatus != 0)
+				{
+					return nStatus;
+				}
+			}
+		}
+		while (   nResult < 0
+		       && --nTries > 0);
+
+		if (nResult < 0)
+		{
+			return nResult;
+		}
+
+		nBlockAddress += nChunk;
+		pData += nChunk * UMSD_BLOCK_SIZE;
+		nBlocks -= nChunk;
 	}
-	u16 usTransferLength = (u16) (nCount >> UMSD_BLOCK_SHIFT);
 
-	//CLogger::Get ()->Write (FromUmsd, LogDebug, "TryRead %u/0x%X/%u", nBlockAddress, (unsigned) pBuffer, (unsigned) usTransferLength);
+	return 0;
+}
+
+int CUSBBulkOnlyMassStorageDevice::TryRead (u32 nBlockAddress, void *pBuffer, unsigned nBlocks)
+{
+	assert (pBuffer != 0);
+	assert (0 < nBlocks && nBlocks <= UMSD_MAX_TRANSFER_BLOCKS);
+
+	//CLogger::Get ()->Write (FromUmsd, LogDebug, "TryRead %u/0x%X/%u", nBlockAddress, (unsigned) pBuffer, nBlocks);
 
 	TSCSIRead10 SCSIRead;
 	SCSIRead.OperationCode		= SCSI_OP_READ;
 	SCSIRead.Reserved1		= 0;
 	SCSIRead.LogicalBlockAddress	= le2be32 (nBlockAddress);
 	SCSIRead.Reserved2		= 0;
-	SCSIRead.TransferLength		= le2be16 (usTransferLength);
+	SCSIRead.TransferLength		= le2be16 ((u16) nBlocks);
 	SCSIRead.Control		= SCSI_CONTROL;
 
+	size_t nCount = nBlocks * UMSD_BLOCK_SIZE;
 	if (Command (&SCSIRead, sizeof SCSIRead, pBuffer, nCount, TRUE) != (int) nCount)
 	{
 		CLogger::Get ()->Write (FromUmsd, LogError, "TryRead failed");
@@ -525,33 +657,22 @@ int CUSBBulkOnlyMassStorageDevice::TryRead (void *pBuffer, size_t nCount)
 	return nCount;
 }
 
-int CUSBBulkOnlyMassStorageDevice::TryWrite (const void *pBuffer, size_t nCount)
+int CUSBBulkOnlyMassStorageDevice::TryWrite (u32 nBlockAddress, const void *pBuffer, unsigned nBlocks)
 {
 	assert (pBuffer != 0);
+	assert (0 < nBlocks && nBlocks <= UMSD_MAX_TRANSFER_BLOCKS);
 
-	if (   (m_ullOffset & UMSD_BLOCK_MASK) != 0
-	    || m_ullOffset > UMSD_MAX_OFFSET)
-	{
-		return -1;
-	}
-	u32 nBlockAddress = (u32) (m_ullOffset >> UMSD_BLOCK_SHIFT);
-
-	if ((nCount & UMSD_BLOCK_MASK) != 0)
-	{
-		return -1;
-	}
-	u16 usTransferLength = (u16) (nCount >> UMSD_BLOCK_SHIFT);
-
-	//CLogger::Get ()->Write (FromUmsd, LogDebug, "TryWrite %u/0x%X/%u", nBlockAddress, (unsigned) pBuffer, (unsigned) usTransferLength);
+	//CLogger::Get ()->Write (FromUmsd, LogDebug, "TryWrite %u/0x%X/%u", nBlockAddress, (unsigned) pBuffer, nBlocks);
 
 	TSCSIWrite10 SCSIWrite;
 	SCSIWrite.OperationCode		= SCSI_OP_WRITE;
 	SCSIWrite.Flags			= SCSI_WRITE_FUA;
 	SCSIWrite.LogicalBlockAddress	= le2be32 (nBlockAddress);
 	SCSIWrite.Reserved		= 0;
-	SCSIWrite.TransferLength	= le2be16 (usTransferLength);
+	SCSIWrite.TransferLength	= le2be16 ((u16) nBlocks);
 	SCSIWrite.Control		= SCSI_CONTROL;
 
+	size_t nCount = nBlocks * UMSD_BLOCK_SIZE;
 	if (Command (&SCSIWrite, sizeof SCSIWrite, (void *) pBuffer, nCount, FALSE) < 0)
 	{
 		CLogger::Get ()->Write (FromUmsd, LogError, "TryWrite failed");
@@ -243,6 +243,12 @@ boolean CXHCIDevice::SubmitAsyncRequest (CUSBRequest *pURB, unsigned nTimeoutMs)
 	return pEndpoint->TransferAsync (pURB, nTimeoutMs);
 }
 
+void CXHCIDevice::SetInterruptModeration (unsigned nInterval)
+{
+	assert (m_pEventManager != 0);
+	m_pEventManager->SetInterruptModeration (nInterval);
+}
+
 CXHCIMMIOSpace *CXHCIDevice::GetMMIOSpace (void)
 {
 	assert (m_pMMIO != 0);
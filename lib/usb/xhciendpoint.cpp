@@ -2,7 +2,7 @@
 // xhciendpoint.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -40,10 +40,16 @@ CXHCIEndpoint::CXHCIEndpoint (CXHCIUSBDevice *pDevice, CXHCIDevice *pXHCIDevice)
 	m_pTransferRing (0),
 	m_uchEndpointID (1),
 	m_uchEndpointType (XHCI_EP_CONTEXT_EP_TYPE_CONTROL),
-	m_pURB (0),
+	m_nTDIn (0),
+	m_nTDOut (0),
+	m_nTDCount (0),
+	m_nQueueDepth (XHCI_CONFIG_QUEUE_DEPTH),
 	m_bTransferCompleted (TRUE),
+	m_nBusyStartTicks (0),
 	m_pInputContextBuffer (0)
 {
+	ResetStatistics ();
+
 	m_pTransferRing = new CXHCIRing (XHCIRingTypeTransfer,
 					 XHCI_CONFIG_TRANSFER_RING_SIZE, pXHCIDevice);
 	if (   m_pTransferRing == 0
@@ -66,10 +72,16 @@ CXHCIEndpoint::CXHCIEndpoint (CXHCIUSBDevice *pDevice, const TUSBEndpointDescrip
 	m_pTransferRing (0),
 	m_uchEndpointID (0),
 	m_uchEndpointType (0),
-	m_pURB (0),
+	m_nTDIn (0),
+	m_nTDOut (0),
+	m_nTDCount (0),
+	m_nQueueDepth (XHCI_CONFIG_QUEUE_DEPTH),
 	m_bTransferCompleted (TRUE),
+	m_nBusyStartTicks (0),
 	m_pInputContextBuffer (0)
 {
+	ResetStatistics ();
+
 	m_pTransferRing = new CXHCIRing (XHCIRingTypeTransfer,
 					 XHCI_CONFIG_TRANSFER_RING_SIZE, pXHCIDevice);
 	if (   m_pTransferRing == 0
@@ -236,6 +248,28 @@ boolean CXHCIEndpoint::TransferAsync (CUSBRequest *pURB, unsigned nTimeoutMs)
 	void *pBuffer = pURB->GetBuffer ();
 	u32 nBufLen = pURB->GetBufLen ();
 
+	// shared memory for ring expansion can be allocated at task level only
+	boolean bMayExpand = CurrentExecutionLevel () == TASK_LEVEL;
+
+	m_SpinLock.Acquire ();
+
+	if (m_nTDCount >= m_nQueueDepth)
+	{
+		m_SpinLock.Release ();
+
+		CLogger::Get ()->Write (From, LogWarning, "Too many requests on endpoint %u",
+					(unsigned) m_uchEndpointID);
+
+		return FALSE;
+	}
+
+	assert (m_nTDIn < XHCI_CONFIG_MAX_QUEUE_DEPTH);
+	TTransferDescriptor *pTD = &m_TD[m_nTDIn];
+	pTD->pURB = pURB;
+	pTD->nTRBs = 0;
+	pTD->nDataTRBs = 0;
+	pTD->bCompleted = FALSE;
+
 	if (   (m_uchEndpointType & 3) == 2		// bulk EP
 	    || (m_uchEndpointType & 3) == 3)		// interrupt EP
 	{
@@ -245,14 +279,66 @@ boolean CXHCIEndpoint::TransferAsync (CUSBRequest *pURB, unsigned nTimeoutMs)
 		assert ((uintptr) pBuffer > MEM_KERNEL_END);
 		CleanAndInvalidateDataCacheRange ((uintptr) pBuffer, nBufLen);
 
-		if (!EnqueueTRB (  XHCI_TRB_TYPE_NORMAL << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT
-				 | XHCI_TRANSFER_TRB_CONTROL_IOC,
-		     		 nBufLen | 0 << XHCI_TRANSFER_TRB_STATUS_TD_SIZE__SHIFT,
-				 XHCI_TO_DMA_LO (pBuffer),
-				 XHCI_TO_DMA_HI (pBuffer)))
+		// a TRB buffer must not cross a 64K boundary
+		u32 nOffset = (uintptr) pBuffer & (XHCI_TRANSFER_TRB_MAX_LENGTH-1);
+		unsigned nTRBs = (nOffset + nBufLen + XHCI_TRANSFER_TRB_MAX_LENGTH-1)
+				 / XHCI_TRANSFER_TRB_MAX_LENGTH;
+		if (   nTRBs > XHCI_CONFIG_MAX_TRBS_PER_TD
+		    || !ReserveTRBs (nTRBs, bMayExpand))
 		{
+			m_SpinLock.Release ();
+
+			CLogger::Get ()->Write (From, LogWarning, "Cannot queue %u TRBs on endpoint %u",
+						nTRBs, (unsigned) m_uchEndpointID);
+
 			return FALSE;
 		}
+
+		u32 nFlags = m_uchEndpointAddress & 0x80 ? XHCI_TRANSFER_TRB_CONTROL_ISP : 0;
+
+		u8 *pData = (u8 *) pBuffer;
+		u32 nRemaining = nBufLen;
+		for (unsigned i = 0; i < nTRBs; i++)
+		{
+			u32 nLength = XHCI_TRANSFER_TRB_MAX_LENGTH - nOffset;
+			if (nLength > nRemaining)
+			{
+				nLength = nRemaining;
+			}
+
+			nOffset = 0;
+			nRemaining -= nLength;
+
+			// number of packets remaining after this TRB
+			assert (m_usMaxPacketSize > 0);
+			u32 nTDSize = (nRemaining + m_usMaxPacketSize-1) / m_usMaxPacketSize;
+			if (nTDSize > XHCI_TRANSFER_TRB_TD_SIZE_MAX)
+			{
+				nTDSize = XHCI_TRANSFER_TRB_TD_SIZE_MAX;
+			}
+
+			TXHCITRB *pTRB = EnqueueTRB (  XHCI_TRB_TYPE_NORMAL << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT
+						     | nFlags
+						     | (  i < nTRBs-1
+							? XHCI_TRANSFER_TRB_CONTROL_CH
+							: XHCI_TRANSFER_TRB_CONTROL_IOC),
+						       nLength
+						     | nTDSize << XHCI_TRANSFER_TRB_STATUS_TD_SIZE__SHIFT,
+						     XHCI_TO_DMA_LO (pData),
+						     XHCI_TO_DMA_HI (pData));
+			assert (pTRB != 0);
+
+			pTD->pDataTRB[i] = pTRB;
+			pTD->nDataLength[i] = nLength;
+			pTD->pLastTRB = pTRB;
+
+			pData += nLength;
+		}
+
+		assert (nRemaining == 0);
+
+		pTD->nTRBs = nTRBs;
+		pTD->nDataTRBs = nTRBs;
 	}
 	else
 	{
@@ -285,46 +371,68 @@ boolean CXHCIEndpoint::TransferAsync (CUSBRequest *pURB, unsigned nTimeoutMs)
 			nDirStatus = XHCI_TRANSFER_TRB_CONTROL_DIR_IN;
 		}
 
-		// SETUP stage
-		if (!EnqueueTRB (  XHCI_TRB_TYPE_SETUP_STAGE << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT
-				 | uchTRT << XHCI_TRANSFER_TRB_CONTROL_TRT__SHIFT
-				 | XHCI_TRANSFER_TRB_CONTROL_IDT,
-				 sizeof (TSetupData),
-				   pSetup->bmRequestType | (u32) pSetup->bRequest << 8
-				 | (u32) pSetup->wValue << 16,
-				 pSetup->wIndex | (u32) pSetup->wLength << 16))
+		unsigned nTRBs = uchTRT != XHCI_TRANSFER_TRB_CONTROL_TRT_NODATA ? 3 : 2;
+		if (!ReserveTRBs (nTRBs, bMayExpand))
 		{
+			m_SpinLock.Release ();
+
+			CLogger::Get ()->Write (From, LogWarning, "Transfer ring full on endpoint %u",
+						(unsigned) m_uchEndpointID);
+
 			return FALSE;
 		}
 
+		// SETUP stage
+		EnqueueTRB (  XHCI_TRB_TYPE_SETUP_STAGE << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT
+			    | uchTRT << XHCI_TRANSFER_TRB_CONTROL_TRT__SHIFT
+			    | XHCI_TRANSFER_TRB_CONTROL_IDT,
+			    sizeof (TSetupData),
+			      pSetup->bmRequestType | (u32) pSetup->bRequest << 8
+			    | (u32) pSetup->wValue << 16,
+			    pSetup->wIndex | (u32) pSetup->wLength << 16);
+
 		// DATA stage
 		if (uchTRT != XHCI_TRANSFER_TRB_CONTROL_TRT_NODATA)
 		{
 			assert (pBuffer != 0);
 			assert (nBufLen > 0);
+			assert (nBufLen <= XHCI_TRANSFER_TRB_MAX_LENGTH);
 			assert ((uintptr) pBuffer > MEM_KERNEL_END);
 			CleanAndInvalidateDataCacheRange ((uintptr) pBuffer, nBufLen);
 
-			if (!EnqueueTRB (  XHCI_TRB_TYPE_DATA_STAGE << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT
-					 | nDirData,
-					 nBufLen | 0 << XHCI_TRANSFER_TRB_STATUS_TD_SIZE__SHIFT,
-					 XHCI_TO_DMA_LO (pBuffer),
-					 XHCI_TO_DMA_HI (pBuffer)))
-			{
-				return FALSE;
-			}
+			EnqueueTRB (  XHCI_TRB_TYPE_DATA_STAGE << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT
+				    | nDirData,
+				    nBufLen | 0 << XHCI_TRANSFER_TRB_STATUS_TD_SIZE__SHIFT,
+				    XHCI_TO_DMA_LO (pBuffer),
+				    XHCI_TO_DMA_HI (pBuffer));
 		}
 
 		// STATUS stage
-		if (!EnqueueTRB (  XHCI_TRB_TYPE_STATUS_STAGE << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT
-				 | nDirStatus | XHCI_TRANSFER_TRB_CONTROL_IOC))
-		{
-			return FALSE;
-		}
+		pTD->pLastTRB = EnqueueTRB (  XHCI_TRB_TYPE_STATUS_STAGE << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT
+					    | nDirStatus | XHCI_TRANSFER_TRB_CONTROL_IOC);
+		assert (pTD->pLastTRB != 0);
+
+		pTD->nTRBs = nTRBs;
 	}
 
-	assert (m_pURB == 0);
-	m_pURB = pURB;
+	assert (m_pTransferRing != 0);
+	pTD->pNextTRB = m_pTransferRing->GetEnqueuePosition ();
+	pTD->nStartTicks = CTimer::GetClockTicks ();
+
+	if (m_nTDCount++ == 0)
+	{
+		m_nBusyStartTicks = pTD->nStartTicks;
+	}
+
+	if (m_nTDCount > m_Statistics.nMaxQueued)
+	{
+		m_Statistics.nMaxQueued = m_nTDCount;
+	}
+
+	if (++m_nTDIn == XHCI_CONFIG_MAX_QUEUE_DEPTH)
+	{
+		m_nTDIn = 0;
+	}
 
 	DataSyncBarrier ();
 
@@ -332,10 +440,12 @@ boolean CXHCIEndpoint::TransferAsync (CUSBRequest *pURB, unsigned nTimeoutMs)
 	assert (XHCI_IS_ENDPOINTID (m_uchEndpointID));
 	m_pMMIO->db_write32 (m_pDevice->GetSlotID (), XHCI_REG_DB_TARGET_EP0 + m_uchEndpointID-1);
 
+	m_SpinLock.Release ();
+
 	return TRUE;
 }
 
-void CXHCIEndpoint::TransferEvent (u8 uchCompletionCode, u32 nTransferLength)
+void CXHCIEndpoint::TransferEvent (u8 uchCompletionCode, u32 nTransferLength, TXHCITRB *pTRB)
 {
 
 #ifdef XHCI_DEBUG2
@@ -347,22 +457,106 @@ void CXHCIEndpoint::TransferEvent (u8 uchCompletionCode, u32 nTransferLength)
 
 	DataMemBarrier ();
 
-	assert (m_pURB != 0);
-	CUSBRequest *pURB = m_pURB;
+	m_SpinLock.Acquire ();
 
-	if (   XHCI_TRB_SUCCESS (uchCompletionCode)
-	    || uchCompletionCode == XHCI_TRB_COMPLETION_CODE_SHORT_PACKET)
+	if (m_nTDCount == 0)
+	{
+		m_SpinLock.Release ();
+
+		CLogger::Get ()->Write (From, LogWarning, "Unexpected transfer event on endpoint %u",
+					(unsigned) m_uchEndpointID);
+
+		return;
+	}
+
+	TTransferDescriptor *pTD = &m_TD[m_nTDOut];
+
+	// A TD, which has been completed early on a short packet, is retired on the event
+	// for its last TRB, or on the first event for the next TD, if the xHC sends none.
+	if (pTD->bCompleted)
+	{
+		boolean bLastEvent = pTRB == pTD->pLastTRB;
+
+		RetireTD ();
+
+		if (   bLastEvent
+		    || m_nTDCount == 0)
+		{
+			m_SpinLock.Release ();
+
+			return;
+		}
+
+		pTD = &m_TD[m_nTDOut];
+	}
+
+	CUSBRequest *pURB = pTD->pURB;
+	assert (pURB != 0);
+	void *pBuffer = pURB->GetBuffer ();
+	u32 nBufLen = pURB->GetBufLen ();
+	unsigned nStartTicks = pTD->nStartTicks;
+
+	boolean bSuccess =    XHCI_TRB_SUCCESS (uchCompletionCode)
+			   || uchCompletionCode == XHCI_TRB_COMPLETION_CODE_SHORT_PACKET;
+
+	// find the TRB, which generated the event
+	u32 nResultLen = nBufLen;
+	boolean bLastTRB = TRUE;
+	if (pTRB != pTD->pLastTRB)
+	{
+		unsigned i;
+		for (i = 0, nResultLen = 0; i < pTD->nDataTRBs; i++)
+		{
+			if (pTD->pDataTRB[i] == pTRB)
+			{
+				break;
+			}
+
+			nResultLen += pTD->nDataLength[i];
+		}
+
+		if (i < pTD->nDataTRBs)
+		{
+			nResultLen += pTD->nDataLength[i];
+			bLastTRB = FALSE;
+		}
+		else if (bSuccess)
+		{
+			m_SpinLock.Release ();
+
+			CLogger::Get ()->Write (From, LogWarning, "Transfer event for unknown TRB");
+
+			return;
+		}
+	}
+
+	if (bSuccess)
+	{
+		assert (nTransferLength <= nResultLen);
+		nResultLen -= nTransferLength;
+	}
+
+	if (   bLastTRB
+	    || !bSuccess)
+	{
+		RetireTD ();
+	}
+	else
+	{
+		pTD->bCompleted = TRUE;
+	}
+
+	m_SpinLock.Release ();
+
+	if (bSuccess)
 	{
-		void *pBuffer = pURB->GetBuffer ();
-		u32 nBufLen = pURB->GetBufLen ();
 		if (pBuffer != 0)
 		{
 			assert (nBufLen > 0);
 			CleanAndInvalidateDataCacheRange ((uintptr) pBuffer, nBufLen);
 		}
 
-		assert (nTransferLength <= nBufLen);
-		pURB->SetResultLen (nBufLen - nTransferLength);
+		pURB->SetResultLen (nResultLen);
 
 		pURB->SetStatus (1);
 	}
@@ -372,11 +566,64 @@ void CXHCIEndpoint::TransferEvent (u8 uchCompletionCode, u32 nTransferLength)
 					(unsigned) uchCompletionCode, (unsigned) m_uchEndpointID);
 	}
 
-	m_pURB = 0;
+	UpdateStatistics (pURB, nStartTicks);
 
 	pURB->CallCompletionRoutine ();
 }
 
+void CXHCIEndpoint::SetQueueDepth (unsigned nDepth)
+{
+	assert (1 <= nDepth && nDepth <= XHCI_CONFIG_MAX_QUEUE_DEPTH);
+	assert (CurrentExecutionLevel () == TASK_LEVEL);
+
+	m_SpinLock.Acquire ();
+
+	m_nQueueDepth = nDepth;
+
+	// pre-allocate ring space for the typical case of two TRBs per TD
+	assert (m_pTransferRing != 0);
+	while (   m_pTransferRing->GetFreeTRBs () < nDepth * 2
+	       && m_pTransferRing->Expand ())
+	{
+		// just expand
+	}
+
+	m_SpinLock.Release ();
+}
+
+unsigned CXHCIEndpoint::GetQueueDepth (void) const
+{
+	return m_nQueueDepth;
+}
+
+void CXHCIEndpoint::GetStatistics (TXHCIEndpointStatistics *pStatistics)
+{
+	assert (pStatistics != 0);
+
+	m_SpinLock.Acquire ();
+
+	*pStatistics = m_Statistics;
+
+	if (m_nTDCount > 0)
+	{
+		pStatistics->nBusyTime += CTimer::GetClockTicks () - m_nBusyStartTicks;
+	}
+
+	m_SpinLock.Release ();
+}
+
+void CXHCIEndpoint::ResetStatistics (void)
+{
+	m_SpinLock.Acquire ();
+
+	memset (&m_Statistics, 0, sizeof m_Statistics);
+	m_Statistics.nLatencyMin = (unsigned) -1;
+
+	m_nBusyStartTicks = CTimer::GetClockTicks ();
+
+	m_SpinLock.Release ();
+}
+
 #ifndef NDEBUG
 
 void CXHCIEndpoint::DumpStatus (void)
@@ -414,7 +661,7 @@ void CXHCIEndpoint::CompletionRoutine (CUSBRequest *pURB, void *pParam, void *pC
 	pThis->m_bTransferCompleted = TRUE;
 }
 
-boolean CXHCIEndpoint::EnqueueTRB (u32 nControl, u32 nStatus, u32 nParameter1, u32 nParameter2)
+TXHCITRB *CXHCIEndpoint::EnqueueTRB (u32 nControl, u32 nStatus, u32 nParameter1, u32 nParameter2)
 {
 	assert (m_pTransferRing != 0);
 	TXHCITRB *pTransferTRB = m_pTransferRing->GetEnqueueTRB ();
@@ -437,6 +684,78 @@ boolean CXHCIEndpoint::EnqueueTRB (u32 nControl, u32 nStatus, u32 nParameter1, u
 	return pTransferTRB;
 }
 
+// called with m_SpinLock acquired
+boolean CXHCIEndpoint::ReserveTRBs (unsigned nTRBs, boolean bMayExpand)
+{
+	assert (m_pTransferRing != 0);
+	while (m_pTransferRing->GetFreeTRBs () < nTRBs)
+	{
+		if (   !bMayExpand
+		    || !m_pTransferRing->Expand ())
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+// called with m_SpinLock acquired
+void CXHCIEndpoint::RetireTD (void)
+{
+	assert (m_nTDCount > 0);
+	assert (m_nTDOut < XHCI_CONFIG_MAX_QUEUE_DEPTH);
+	TTransferDescriptor *pTD = &m_TD[m_nTDOut];
+
+	assert (m_pTransferRing != 0);
+	m_pTransferRing->FreeTRBs (pTD->nTRBs, pTD->pNextTRB);
+
+	pTD->pURB = 0;
+
+	if (++m_nTDOut == XHCI_CONFIG_MAX_QUEUE_DEPTH)
+	{
+		m_nTDOut = 0;
+	}
+
+	if (--m_nTDCount == 0)
+	{
+		m_Statistics.nBusyTime += CTimer::GetClockTicks () - m_nBusyStartTicks;
+	}
+}
+
+void CXHCIEndpoint::UpdateStatistics (const CUSBRequest *pURB, unsigned nStartTicks)
+{
+	assert (pURB != 0);
+	unsigned nLatency = CTimer::GetClockTicks () - nStartTicks;
+
+	m_SpinLock.Acquire ();
+
+	m_Statistics.nTransfers++;
+
+	if (pURB->GetStatus ())
+	{
+		m_Statistics.nBytes += pURB->GetResultLength ();
+	}
+	else
+	{
+		m_Statistics.nErrors++;
+	}
+
+	if (nLatency < m_Statistics.nLatencyMin)
+	{
+		m_Statistics.nLatencyMin = nLatency;
+	}
+
+	if (nLatency > m_Statistics.nLatencyMax)
+	{
+		m_Statistics.nLatencyMax = nLatency;
+	}
+
+	m_Statistics.nLatencySum += nLatency;
+
+	m_SpinLock.Release ();
+}
+
 TXHCIInputContext *CXHCIEndpoint::GetInputContextSetMaxPacketSize (void)
 {
 	assert (m_pInputContextBuffer == 0);
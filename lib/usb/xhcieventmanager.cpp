@@ -2,7 +2,7 @@
 // xhcieventmanager.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,7 +27,7 @@ static const char From[] = "xhcievt";
 CXHCIEventManager::CXHCIEventManager (CXHCIDevice *pXHCIDevice)
 :	m_pXHCIDevice (pXHCIDevice),
 	m_pMMIO (pXHCIDevice->GetMMIOSpace ()),
-	m_EventRing (XHCIRingTypeEvent, XHCI_CONFIG_EVENT_RING_SIZE, pXHCIDevice),
+	m_EventRing (XHCIRingTypeEvent, GetEventRingSize (pXHCIDevice->GetMMIOSpace ()), pXHCIDevice),
 	m_pERST (0)
 {
 	if (!m_EventRing.IsValid ())
@@ -36,18 +36,23 @@ CXHCIEventManager::CXHCIEventManager (CXHCIDevice *pXHCIDevice)
 	}
 
 	assert (m_pXHCIDevice != 0);
-	m_pERST = (TXHCIERSTEntry *) m_pXHCIDevice->AllocateSharedMem (sizeof (TXHCIERSTEntry));
+	unsigned nSegments = m_EventRing.GetSegmentCount ();
+	m_pERST = (TXHCIERSTEntry *) m_pXHCIDevice->AllocateSharedMem (
+						sizeof (TXHCIERSTEntry) * nSegments);
 	if (m_pERST == 0)
 	{
 		return;
 	}
 
-	m_pERST->RingSegmentBase = XHCI_TO_DMA (m_EventRing.GetFirstTRB ());
-	m_pERST->RingSegmentSize = m_EventRing.GetTRBCount ();
-	m_pERST->Reserved = 0;
+	for (unsigned i = 0; i < nSegments; i++)
+	{
+		m_pERST[i].RingSegmentBase = XHCI_TO_DMA (m_EventRing.GetSegment (i));
+		m_pERST[i].RingSegmentSize = XHCI_RING_SEGMENT_SIZE;
+		m_pERST[i].Reserved = 0;
+	}
 
 	assert (m_pMMIO != 0);
-	m_pMMIO->rt_write32 (0, XHCI_REG_RT_IR_ERSTSZ, 1);
+	m_pMMIO->rt_write32 (0, XHCI_REG_RT_IR_ERSTSZ, nSegments);
 	m_pMMIO->rt_write64 (0, XHCI_REG_RT_IR_ERSTBA_LO, XHCI_TO_DMA (m_pERST));
 	m_pMMIO->rt_write64 (0, XHCI_REG_RT_IR_ERDP_LO, XHCI_TO_DMA (m_EventRing.GetFirstTRB ()));
 	m_pMMIO->rt_write32 (0, XHCI_REG_RT_IR_IMOD, XHCI_CONFIG_IMODI);
@@ -97,6 +102,7 @@ boolean CXHCIEventManager::HandleEvents (void)
 		m_pXHCIDevice->GetSlotManager ()->TransferEvent (
 			pEventTRB->Status >> XHCI_EVENT_TRB_STATUS_COMPLETION_CODE__SHIFT,
 			pEventTRB->Status & XHCI_TRANSFER_EVENT_TRB_STATUS_TRB_TRANSFER_LENGTH__MASK,
+			(TXHCITRB *) XHCI_FROM_DMA (pEventTRB->Parameter),
 			pEventTRB->Control >> XHCI_CMD_COMPLETION_EVENT_TRB_CONTROL_SLOTID__SHIFT,
 			   (pEventTRB->Control & XHCI_TRANSFER_EVENT_TRB_CONTROL_ENDPOINTID__MASK)
 			>> XHCI_TRANSFER_EVENT_TRB_CONTROL_ENDPOINTID__SHIFT);
@@ -139,6 +145,14 @@ boolean CXHCIEventManager::HandleEvents (void)
 	return TRUE;
 }
 
+void CXHCIEventManager::SetInterruptModeration (unsigned nInterval)
+{
+	assert (nInterval <= XHCI_REG_RT_IR_IMOD_IMODI__MASK);
+
+	assert (m_pMMIO != 0);
+	m_pMMIO->rt_write32 (0, XHCI_REG_RT_IR_IMOD, nInterval);
+}
+
 #ifndef NDEBUG
 
 void CXHCIEventManager::DumpStatus (void)
@@ -147,3 +161,19 @@ void CXHCIEventManager::DumpStatus (void)
 }
 
 #endif
+
+unsigned CXHCIEventManager::GetEventRingSize (CXHCIMMIOSpace *pMMIO)
+{
+	assert (pMMIO != 0);
+	unsigned nERSTMax =    (pMMIO->cap_read32 (XHCI_REG_CAP_HCSPARAMS2)
+			     & XHCI_REG_CAP_HCSPARAMS2_ERST_MAX__MASK)
+			    >> XHCI_REG_CAP_HCSPARAMS2_ERST_MAX__SHIFT;
+
+	unsigned nSegments = XHCI_CONFIG_EVENT_RING_SIZE / XHCI_RING_SEGMENT_SIZE;
+	if (nSegments > 1U << nERSTMax)
+	{
+		nSegments = 1U << nERSTMax;
+	}
+
+	return nSegments * XHCI_RING_SEGMENT_SIZE;
+}
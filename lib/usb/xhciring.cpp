@@ -2,7 +2,7 @@
 // xhciring.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -19,6 +19,7 @@
 //
 #include <circle/usb/xhciring.h>
 #include <circle/usb/xhcidevice.h>
+#include <circle/synchronize.h>
 #include <circle/logger.h>
 #include <circle/debug.h>
 #include <assert.h>
@@ -27,123 +28,170 @@ static const char From[] = "xhciring";
 
 CXHCIRing::CXHCIRing (TXHCIRingType Type, unsigned nTRBCount, CXHCIDevice *pAllocator)
 :	m_Type (Type),
-	m_nTRBCount (nTRBCount),
 	m_pAllocator (pAllocator),
-	m_pFirstTRB (0),
+	m_nSegments (0),
+	m_nEnqueueSegment (0),
 	m_nEnqueueIndex (0),
+	m_nDequeueSegment (0),
 	m_nDequeueIndex (0),
-	m_nCycleState (XHCI_TRB_CONTROL_C)
+	m_nCycleState (XHCI_TRB_CONTROL_C),
+	m_nFreeTRBs (0)
 {
-	assert (m_nTRBCount >= 16);
-	assert (m_nTRBCount % 4 == 0);
+	assert (nTRBCount >= XHCI_RING_SEGMENT_SIZE);
+	assert (nTRBCount % XHCI_RING_SEGMENT_SIZE == 0);
+	unsigned nSegments = nTRBCount / XHCI_RING_SEGMENT_SIZE;
+	assert (nSegments <= XHCI_RING_MAX_SEGMENTS);
 
 	assert (m_pAllocator != 0);
-	m_pFirstTRB = (TXHCITRB *) m_pAllocator->AllocateSharedMem (m_nTRBCount * sizeof (TXHCITRB),
-								    64, 0x10000);
-	if (m_pFirstTRB == 0)
+	for (unsigned i = 0; i < nSegments; i++)
 	{
-		return;
+		m_pSegment[i] = AllocateSegment ();
+		if (m_pSegment[i] == 0)
+		{
+			while (m_nSegments > 0)		// ring is not valid
+			{
+				m_pAllocator->FreeSharedMem (m_pSegment[--m_nSegments]);
+			}
+
+			return;
+		}
+
+		m_nSegments++;
 	}
 
 	if (m_Type != XHCIRingTypeEvent)
 	{
-		TXHCITRB *pLinkTRB = &m_pFirstTRB[m_nTRBCount - 1];
+		for (unsigned i = 0; i < m_nSegments; i++)
+		{
+			InitLinkTRB (i);
+		}
 
-		pLinkTRB->Parameter = XHCI_TO_DMA (m_pFirstTRB);
-		pLinkTRB->Status = 0;
-		pLinkTRB->Control =   XHCI_TRB_TYPE_LINK << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT
-				    | XHCI_LINK_TRB_CONTROL_TC;
+		m_nFreeTRBs = m_nSegments * (XHCI_RING_SEGMENT_SIZE-1);
 	}
 }
 
 CXHCIRing::~CXHCIRing (void)
 {
-	if (m_pFirstTRB != 0)
+	while (m_nSegments > 0)
 	{
-		m_pAllocator->FreeSharedMem (m_pFirstTRB);
+		m_pAllocator->FreeSharedMem (m_pSegment[--m_nSegments]);
 
-		m_pFirstTRB = 0;
+		m_pSegment[m_nSegments] = 0;
 	}
 }
 
 boolean CXHCIRing::IsValid (void) const
 {
-	return m_pFirstTRB != 0;
+	return m_nSegments > 0;
 }
 
 unsigned CXHCIRing::GetTRBCount (void) const
 {
-	assert (m_pFirstTRB != 0);
+	assert (m_nSegments > 0);
+
+	return m_nSegments * XHCI_RING_SEGMENT_SIZE;
+}
+
+unsigned CXHCIRing::GetSegmentCount (void) const
+{
+	assert (m_nSegments > 0);
+
+	return m_nSegments;
+}
+
+TXHCITRB *CXHCIRing::GetSegment (unsigned nSegment)
+{
+	assert (nSegment < m_nSegments);
+	assert (m_pSegment[nSegment] != 0);
 
-	return m_nTRBCount;
+	return m_pSegment[nSegment];
 }
 
 TXHCITRB *CXHCIRing::GetFirstTRB (void)
 {
-	assert (m_pFirstTRB != 0);
+	assert (m_nSegments > 0);
 
-	return m_pFirstTRB;
+	return m_pSegment[0];
 }
 
 TXHCITRB *CXHCIRing::GetDequeueTRB (void)
 {
-	assert (m_pFirstTRB != 0);
-	assert (m_nDequeueIndex < m_nTRBCount);
+	assert (m_nDequeueSegment < m_nSegments);
+	assert (m_nDequeueIndex < XHCI_RING_SEGMENT_SIZE);
 
-	if ((m_pFirstTRB[m_nDequeueIndex].Control & XHCI_TRB_CONTROL_C) != m_nCycleState)
+	TXHCITRB *pTRB = &m_pSegment[m_nDequeueSegment][m_nDequeueIndex];
+	if ((pTRB->Control & XHCI_TRB_CONTROL_C) != m_nCycleState)
 	{
 		return 0;		// ring is empty
 	}
 
-	return &m_pFirstTRB[m_nDequeueIndex];
+	return pTRB;
 }
 
 TXHCITRB *CXHCIRing::GetEnqueueTRB (void)
 {
-	assert (m_pFirstTRB != 0);
-	assert (m_nEnqueueIndex < m_nTRBCount);
+	assert (m_nEnqueueSegment < m_nSegments);
+	assert (m_nEnqueueIndex < XHCI_RING_SEGMENT_SIZE-1);
+
+	if (   m_Type == XHCIRingTypeTransfer
+	    && m_nFreeTRBs == 0)
+	{
+		return 0;		// ring is full
+	}
 
-	if ((m_pFirstTRB[m_nEnqueueIndex].Control & XHCI_TRB_CONTROL_C) == m_nCycleState)
+	TXHCITRB *pTRB = &m_pSegment[m_nEnqueueSegment][m_nEnqueueIndex];
+	if ((pTRB->Control & XHCI_TRB_CONTROL_C) == m_nCycleState)
 	{
 		return 0;		// ring is full
 	}
 
-	return &m_pFirstTRB[m_nEnqueueIndex];
+	return pTRB;
 }
 
 TXHCITRB *CXHCIRing::IncrementDequeue (void)
 {
-	assert (m_pFirstTRB != 0);
 	assert (m_Type == XHCIRingTypeEvent);
-	assert (m_nDequeueIndex < m_nTRBCount);
+	assert (m_nDequeueSegment < m_nSegments);
+	assert (m_nDequeueIndex < XHCI_RING_SEGMENT_SIZE);
 
-	assert (   (m_pFirstTRB[m_nDequeueIndex].Control & XHCI_TRB_CONTROL_C)
+	assert (   (m_pSegment[m_nDequeueSegment][m_nDequeueIndex].Control & XHCI_TRB_CONTROL_C)
 		== m_nCycleState);	// there must be an entry on ring
 
-	if (++m_nDequeueIndex == m_nTRBCount)
+	if (++m_nDequeueIndex == XHCI_RING_SEGMENT_SIZE)
 	{
 		m_nDequeueIndex = 0;
 
-		m_nCycleState ^= XHCI_TRB_CONTROL_C;
+		if (++m_nDequeueSegment == m_nSegments)
+		{
+			m_nDequeueSegment = 0;
+
+			m_nCycleState ^= XHCI_TRB_CONTROL_C;
+		}
 	}
 
-	return &m_pFirstTRB[m_nDequeueIndex];
+	return &m_pSegment[m_nDequeueSegment][m_nDequeueIndex];
 }
 
 void CXHCIRing::IncrementEnqueue (void)
 {
-	assert (m_pFirstTRB != 0);
 	assert (m_Type != XHCIRingTypeEvent);
-	assert (m_nEnqueueIndex < m_nTRBCount);
+	assert (m_nEnqueueSegment < m_nSegments);
+	assert (m_nEnqueueIndex < XHCI_RING_SEGMENT_SIZE-1);
 
-	assert (   (m_pFirstTRB[m_nEnqueueIndex].Control & XHCI_TRB_CONTROL_C)
+	assert (   (m_pSegment[m_nEnqueueSegment][m_nEnqueueIndex].Control & XHCI_TRB_CONTROL_C)
 		== m_nCycleState);	// Cycle state must be already set
 
-	if (++m_nEnqueueIndex == m_nTRBCount-1)		// last index is used for Link TRB
+	if (m_Type == XHCIRingTypeTransfer)
 	{
-		TXHCITRB *pLinkTRB = &m_pFirstTRB[m_nEnqueueIndex];
+		assert (m_nFreeTRBs > 0);
+		m_nFreeTRBs--;
+	}
 
-		pLinkTRB->Control ^= XHCI_TRB_CONTROL_C;
+	if (++m_nEnqueueIndex == XHCI_RING_SEGMENT_SIZE-1)	// last index is used for Link TRB
+	{
+		TXHCITRB *pLinkTRB = &m_pSegment[m_nEnqueueSegment][m_nEnqueueIndex];
+
+		pLinkTRB->Control = (pLinkTRB->Control & ~XHCI_TRB_CONTROL_C) | m_nCycleState;
 
 		if (pLinkTRB->Control & XHCI_LINK_TRB_CONTROL_TC)
 		{
@@ -151,31 +199,169 @@ void CXHCIRing::IncrementEnqueue (void)
 		}
 
 		m_nEnqueueIndex = 0;
+
+		if (++m_nEnqueueSegment == m_nSegments)
+		{
+			m_nEnqueueSegment = 0;
+		}
 	}
 }
 
 u32 CXHCIRing::GetCycleState (void) const
 {
-	assert (m_pFirstTRB != 0);
+	assert (m_nSegments > 0);
 
 	return m_nCycleState;
 }
 
+TXHCITRB *CXHCIRing::GetEnqueuePosition (void)
+{
+	assert (m_Type == XHCIRingTypeTransfer);
+	assert (m_nEnqueueSegment < m_nSegments);
+
+	return &m_pSegment[m_nEnqueueSegment][m_nEnqueueIndex];
+}
+
+unsigned CXHCIRing::GetFreeTRBs (void) const
+{
+	assert (m_Type == XHCIRingTypeTransfer);
+
+	return m_nFreeTRBs;
+}
+
+boolean CXHCIRing::Expand (void)
+{
+	assert (m_Type == XHCIRingTypeTransfer);
+
+	if (m_nSegments == XHCI_RING_MAX_SEGMENTS)
+	{
+		return FALSE;
+	}
+
+	// If the xHC may still work on the previous lap of the enqueue segment, it would
+	// enter the new segment with the opposite cycle state. We have to wait then.
+	if (   m_nFreeTRBs < m_nSegments * (XHCI_RING_SEGMENT_SIZE-1)
+	    && m_nDequeueSegment == m_nEnqueueSegment
+	    && m_nDequeueIndex >= m_nEnqueueIndex)
+	{
+		return FALSE;
+	}
+
+	TXHCITRB *pSegment = AllocateSegment ();
+	if (pSegment == 0)
+	{
+		return FALSE;
+	}
+
+	// TRBs of the new segment must not be valid for the xHC yet
+	for (unsigned i = 0; i < XHCI_RING_SEGMENT_SIZE; i++)
+	{
+		pSegment[i].Control = m_nCycleState ^ XHCI_TRB_CONTROL_C;
+	}
+
+	unsigned nNewSegment = m_nEnqueueSegment + 1;
+	for (unsigned i = m_nSegments; i > nNewSegment; i--)
+	{
+		m_pSegment[i] = m_pSegment[i-1];
+	}
+
+	m_pSegment[nNewSegment] = pSegment;
+	m_nSegments++;
+
+	if (m_nDequeueSegment >= nNewSegment)
+	{
+		m_nDequeueSegment++;
+	}
+
+	InitLinkTRB (nNewSegment);
+
+	DataSyncBarrier ();
+
+	// link the enqueue segment to the new segment, it takes over the Toggle Cycle flag
+	TXHCITRB *pLinkTRB = &m_pSegment[m_nEnqueueSegment][XHCI_RING_SEGMENT_SIZE-1];
+	pLinkTRB->Parameter = XHCI_TO_DMA (pSegment);
+	if (nNewSegment == m_nSegments-1)
+	{
+		pLinkTRB->Control &= ~XHCI_LINK_TRB_CONTROL_TC;
+	}
+
+	DataSyncBarrier ();
+
+	m_nFreeTRBs += XHCI_RING_SEGMENT_SIZE-1;
+
+	return TRUE;
+}
+
+void CXHCIRing::FreeTRBs (unsigned nTRBs, TXHCITRB *pNextTRB)
+{
+	assert (m_Type == XHCIRingTypeTransfer);
+
+	m_nFreeTRBs += nTRBs;
+	assert (m_nFreeTRBs <= m_nSegments * (XHCI_RING_SEGMENT_SIZE-1));
+
+	int nSegment = FindSegment (pNextTRB);
+	assert (nSegment >= 0);
+
+	m_nDequeueSegment = (unsigned) nSegment;
+	m_nDequeueIndex = pNextTRB - m_pSegment[nSegment];
+}
+
 #ifndef NDEBUG
 
 void CXHCIRing::DumpStatus (const char *pFrom)
 {
-	CLogger::Get ()->Write (pFrom != 0 ? pFrom : From, LogDebug, "Count %u, %s %u, Cycle %u",
-				m_nTRBCount,
+	CLogger::Get ()->Write (pFrom != 0 ? pFrom : From, LogDebug,
+				"Count %u, Segments %u, %s %u/%u, Cycle %u",
+				GetTRBCount (), m_nSegments,
 				m_Type == XHCIRingTypeEvent ? "Dequeue" : "Enqueue",
+				m_Type == XHCIRingTypeEvent ? m_nDequeueSegment : m_nEnqueueSegment,
 				m_Type == XHCIRingTypeEvent ? m_nDequeueIndex : m_nEnqueueIndex,
 				m_nCycleState);
 
-	if (m_pFirstTRB != 0)
+	for (unsigned i = 0; i < m_nSegments; i++)
 	{
-		debug_hexdump (m_pFirstTRB, m_nTRBCount * sizeof (TXHCITRB),
+		debug_hexdump (m_pSegment[i], XHCI_RING_SEGMENT_SIZE * sizeof (TXHCITRB),
 			       pFrom != 0 ? pFrom : From);
 	}
 }
 
 #endif
+
+TXHCITRB *CXHCIRing::AllocateSegment (void)
+{
+	assert (m_pAllocator != 0);
+	return (TXHCITRB *) m_pAllocator->AllocateSharedMem (
+					XHCI_RING_SEGMENT_SIZE * sizeof (TXHCITRB), 64, 0x10000);
+}
+
+void CXHCIRing::InitLinkTRB (unsigned nSegment)
+{
+	assert (m_Type != XHCIRingTypeEvent);
+	assert (nSegment < m_nSegments);
+
+	TXHCITRB *pLinkTRB = &m_pSegment[nSegment][XHCI_RING_SEGMENT_SIZE-1];
+
+	pLinkTRB->Parameter = XHCI_TO_DMA (m_pSegment[(nSegment + 1) % m_nSegments]);
+	pLinkTRB->Status = 0;
+	pLinkTRB->Control =   XHCI_TRB_TYPE_LINK << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT
+			    | (pLinkTRB->Control & XHCI_TRB_CONTROL_C);
+
+	if (nSegment == m_nSegments-1)
+	{
+		pLinkTRB->Control |= XHCI_LINK_TRB_CONTROL_TC;
+	}
+}
+
+int CXHCIRing::FindSegment (const TXHCITRB *pTRB) const
+{
+	for (unsigned i = 0; i < m_nSegments; i++)
+	{
+		if (   pTRB >= m_pSegment[i]
+		    && pTRB <  m_pSegment[i] + XHCI_RING_SEGMENT_SIZE)
+		{
+			return (int) i;
+		}
+	}
+
+	return -1;
+}
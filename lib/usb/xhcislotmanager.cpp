@@ -2,7 +2,7 @@
 // xhcislotmanager.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -99,13 +99,14 @@ void CXHCISlotManager::AssignScratchpadBufferArray (u64 *pScratchpadBufferArray)
 	m_pDCBAA[0] = XHCI_TO_DMA (pScratchpadBufferArray);
 }
 
-void CXHCISlotManager::TransferEvent (u8 uchCompletionCode, u32 nTransferLength,
+void CXHCISlotManager::TransferEvent (u8 uchCompletionCode, u32 nTransferLength, TXHCITRB *pTRB,
 				      u8 uchSlotID, u8 uchEndpointID)
 {
 	assert (XHCI_IS_SLOTID (uchSlotID));
 	assert (m_pUSBDevice[uchSlotID-1] != 0);
 
-	m_pUSBDevice[uchSlotID-1]->TransferEvent (uchCompletionCode, nTransferLength, uchEndpointID);
+	m_pUSBDevice[uchSlotID-1]->TransferEvent (uchCompletionCode, nTransferLength, pTRB,
+						  uchEndpointID);
 }
 
 #ifndef NDEBUG
@@ -0,0 +1,331 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/net/in.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define TEST_RUNS		20000
+#define MAX_LENGTH		4096		// covers several NEON blocks
+#define MAX_MISALIGN		8
+#define GUARD_SIZE		16
+#define GUARD_BYTE		0xA5
+
+#define BENCHMARK_RUNS		10000
+
+static const char FromKernel[] = "kernel";
+
+static u8 s_Source[MAX_LENGTH + MAX_MISALIGN] ALIGN(16);
+static u8 s_Dest[GUARD_SIZE + MAX_LENGTH + MAX_MISALIGN + GUARD_SIZE] ALIGN(16);
+static u8 s_Header[64] ALIGN(16);
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_SourceIP (0x0100A8C0),		// 192.168.0.1
+	m_DestIP (0x0200A8C0)			// 192.168.0.2
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	boolean bOK = TestSimple (TEST_RUNS);
+	bOK = TestPseudoHeader (TEST_RUNS) && bOK;
+	bOK = TestCopy (TEST_RUNS) && bOK;
+
+	if (bOK)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "All tests passed");
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogError, "Test failed");
+	}
+
+	Benchmark (64);
+	Benchmark (576);
+	Benchmark (1460);
+	Benchmark (MAX_LENGTH);
+
+	return ShutdownHalt;
+}
+
+// SimpleCalculate() on random data, lengths and misalignments
+boolean CKernel::TestSimple (unsigned nRuns)
+{
+	for (unsigned nRun = 1; nRun <= nRuns; nRun++)
+	{
+		// test short lengths more often
+		unsigned nLength = 1 + m_Random.GetNumber () % (nRun & 1 ? 256 : MAX_LENGTH);
+		unsigned nOffset = m_Random.GetNumber () % MAX_MISALIGN;
+
+		u8 *pBuffer = s_Source + nOffset;
+		m_Random.Fill (pBuffer, nLength);
+
+		u16 usExpected = ~ReferenceFold (ReferenceSum (pBuffer, nLength));
+		u16 usResult = CChecksumCalculator::SimpleCalculate (pBuffer, nLength);
+		if (usResult != usExpected)
+		{
+			m_Logger.Write (FromKernel, LogError,
+					"SimpleCalculate: length %u, offset %u: 0x%04X, expected 0x%04X",
+					nLength, nOffset, (unsigned) usResult, (unsigned) usExpected);
+
+			return FALSE;
+		}
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "SimpleCalculate: %u runs OK", nRuns);
+
+	return TRUE;
+}
+
+// Calculate() with pseudo header on random data, lengths and misalignments
+boolean CKernel::TestPseudoHeader (unsigned nRuns)
+{
+	CChecksumCalculator Calculator (m_SourceIP, m_DestIP, IPPROTO_UDP);
+
+	TPseudoHeader PseudoHeader;
+	m_SourceIP.CopyTo (PseudoHeader.SourceAddress);
+	m_DestIP.CopyTo (PseudoHeader.DestinationAddress);
+	PseudoHeader.nZero = 0;
+	PseudoHeader.nProtocol = IPPROTO_UDP;
+
+	for (unsigned nRun = 1; nRun <= nRuns; nRun++)
+	{
+		unsigned nLength = 1 + m_Random.GetNumber () % (nRun & 1 ? 256 : MAX_LENGTH);
+		unsigned nOffset = m_Random.GetNumber () % MAX_MISALIGN;
+
+		u8 *pBuffer = s_Source + nOffset;
+		m_Random.Fill (pBuffer, nLength);
+
+		PseudoHeader.nTCPLength = le2be16 (nLength);
+		u32 nSum = ReferenceSum (&PseudoHeader, sizeof PseudoHeader);
+		u16 usExpected = ~ReferenceFold (ReferenceSum (pBuffer, nLength, nSum));
+
+		u16 usResult = Calculator.Calculate (pBuffer, nLength);
+		if (usResult != usExpected)
+		{
+			m_Logger.Write (FromKernel, LogError,
+					"Calculate: length %u, offset %u: 0x%04X, expected 0x%04X",
+					nLength, nOffset, (unsigned) usResult, (unsigned) usExpected);
+
+			return FALSE;
+		}
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Calculate: %u runs OK", nRuns);
+
+	return TRUE;
+}
+
+// CopyAndCalculate() with independent misalignment of source and destination,
+// checks the copied data and that the bytes around the destination are untouched
+boolean CKernel::TestCopy (unsigned nRuns)
+{
+	CChecksumCalculator Calculator (m_SourceIP, m_DestIP, IPPROTO_UDP);
+
+	TPseudoHeader PseudoHeader;
+	m_SourceIP.CopyTo (PseudoHeader.SourceAddress);
+	m_DestIP.CopyTo (PseudoHeader.DestinationAddress);
+	PseudoHeader.nZero = 0;
+	PseudoHeader.nProtocol = IPPROTO_UDP;
+
+	for (unsigned nRun = 1; nRun <= nRuns; nRun++)
+	{
+		unsigned nHeaderLength = 2 * (m_Random.GetNumber () % (sizeof s_Header / 2 + 1));
+		unsigned nLength = m_Random.GetNumber () % (nRun & 1 ? 256 : MAX_LENGTH);
+		if (nHeaderLength + nLength == 0)
+		{
+			nLength = 1;
+		}
+
+		unsigned nSourceOffset = m_Random.GetNumber () % MAX_MISALIGN;
+		unsigned nDestOffset = m_Random.GetNumber () % MAX_MISALIGN;
+
+		m_Random.Fill (s_Header, nHeaderLength);
+
+		u8 *pSource = s_Source + nSourceOffset;
+		m_Random.Fill (pSource, nLength);
+
+		memset (s_Dest, GUARD_BYTE, sizeof s_Dest);
+		u8 *pDest = s_Dest + GUARD_SIZE + nDestOffset;
+
+		PseudoHeader.nTCPLength = le2be16 (nHeaderLength + nLength);
+		u32 nSum = ReferenceSum (&PseudoHeader, sizeof PseudoHeader);
+		nSum = ReferenceSum (s_Header, nHeaderLength, nSum);
+		u16 usExpected = ~ReferenceFold (ReferenceSum (pSource, nLength, nSum));
+
+		u16 usResult = Calculator.CopyAndCalculate (s_Header, nHeaderLength,
+							    pDest, pSource, nLength);
+		if (usResult != usExpected)
+		{
+			m_Logger.Write (FromKernel, LogError,
+					"CopyAndCalculate: header %u, length %u, offsets %u/%u: "
+					"0x%04X, expected 0x%04X",
+					nHeaderLength, nLength, nSourceOffset, nDestOffset,
+					(unsigned) usResult, (unsigned) usExpected);
+
+			return FALSE;
+		}
+
+		if (memcmp (pDest, pSource, nLength) != 0)
+		{
+			m_Logger.Write (FromKernel, LogError,
+					"CopyAndCalculate: length %u, offsets %u/%u: Data mismatch",
+					nLength, nSourceOffset, nDestOffset);
+
+			return FALSE;
+		}
+
+		for (u8 *p = s_Dest; p < s_Dest + sizeof s_Dest; p++)
+		{
+			if (   (p < pDest || p >= pDest + nLength)
+			    && *p != GUARD_BYTE)
+			{
+				m_Logger.Write (FromKernel, LogError,
+						"CopyAndCalculate: length %u, offsets %u/%u: "
+						"Overwritten at %d",
+						nLength, nSourceOffset, nDestOffset,
+						(int) (p - pDest));
+
+				return FALSE;
+			}
+		}
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "CopyAndCalculate: %u runs OK", nRuns);
+
+	return TRUE;
+}
+
+void CKernel::Benchmark (unsigned nLength)
+{
+	assert (nLength <= MAX_LENGTH);
+	m_Random.Fill (s_Source, nLength);
+
+	u32 nSum = 0;
+	unsigned nStart = CTimer::GetClockTicks ();
+	for (unsigned i = 0; i < BENCHMARK_RUNS; i++)
+	{
+		nSum += ReferenceSum (s_Source, nLength);
+	}
+	unsigned nReferenceTime = CTimer::GetClockTicks () - nStart;
+
+	nStart = CTimer::GetClockTicks ();
+	for (unsigned i = 0; i < BENCHMARK_RUNS; i++)
+	{
+		nSum += CChecksumCalculator::SimpleCalculate (s_Source, nLength);
+	}
+	unsigned nSimpleTime = CTimer::GetClockTicks () - nStart;
+
+	CChecksumCalculator Calculator (m_SourceIP, m_DestIP, IPPROTO_UDP);
+	nStart = CTimer::GetClockTicks ();
+	for (unsigned i = 0; i < BENCHMARK_RUNS; i++)
+	{
+		nSum += Calculator.CopyAndCalculate (0, 0, s_Dest, s_Source, nLength);
+	}
+	unsigned nCopyTime = CTimer::GetClockTicks () - nStart;
+
+	// bytes per microsecond is MB/s
+	unsigned long long nBytes = (unsigned long long) nLength * BENCHMARK_RUNS;
+	m_Logger.Write (FromKernel, LogNotice,
+			"%4u bytes: reference %u MB/s, checksum %u MB/s, copy and checksum %u MB/s (%x)",
+			nLength,
+			(unsigned) (nBytes / (nReferenceTime ? nReferenceTime : 1)),
+			(unsigned) (nBytes / (nSimpleTime ? nSimpleTime : 1)),
+			(unsigned) (nBytes / (nCopyTime ? nCopyTime : 1)),
+			nSum & 0xF);		// prevents optimizing the loops away
+}
+
+u32 CKernel::ReferenceSum (const void *pBuffer, unsigned nLength, u32 nSum)
+{
+	const u8 *p = (const u8 *) pBuffer;
+
+	while (nLength >= 2)
+	{
+		nSum += p[0] | (u32) p[1] << 8;
+
+		p += 2;
+		nLength -= 2;
+	}
+
+	if (nLength != 0)
+	{
+		nSum += p[0];
+	}
+
+	return nSum;
+}
+
+u16 CKernel::ReferenceFold (u32 nSum)
+{
+	while (nSum >> 16)
+	{
+		nSum = (nSum & 0xFFFF) + (nSum >> 16);
+	}
+
+	return (u16) nSum;
+}
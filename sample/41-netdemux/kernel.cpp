@@ -0,0 +1,260 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/net/linklayer.h>
+#include <circle/net/networklayer.h>
+#include <circle/net/checksumcalculator.h>
+#include <circle/net/in.h>
+#include <circle/util.h>
+#include <assert.h>
+
+// Network configuration, no real network is used
+static const u8 OwnMACAddress[]  = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const u8 PeerMACAddress[] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+static const u8 IPAddress[]      = {192, 168, 0, 250};
+static const u8 NetMask[]        = {255, 255, 255, 0};
+static const u8 DefaultGateway[] = {192, 168, 0, 1};
+static const u8 DNSServer[]      = {192, 168, 0, 1};
+static const u8 PeerIPAddress[]  = {192, 168, 0, 2};
+
+#define OWN_PORT_BASE		40000
+#define PEER_PORT_BASE		50000
+
+#define PAYLOAD_SIZE		18		// gives a minimum Ethernet frame
+#define FRAME_SIZE		(  sizeof (TEthernetHeader) + sizeof (TIPHeader) \
+				 + sizeof (TUDPHeader) + PAYLOAD_SIZE)
+
+#define BATCH_SIZE		32		// datagrams per call of CNetSubSystem::Process()
+#define ROUNDS			200
+
+struct TUDPHeader
+{
+	u16	nSourcePort;
+	u16	nDestPort;
+	u16	nLength;
+	u16	nChecksum;
+}
+PACKED;
+
+static const unsigned Connections[] = {1, 10, 100, 500, MAX_CONNECTIONS};
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_Loopback (OwnMACAddress),
+	m_Net (IPAddress, NetMask, DefaultGateway, DNSServer, DEFAULT_HOSTNAME, NetDeviceTypeAny),
+	m_nConnections (0)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Net.Initialize (FALSE);
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	// The main task does not yield while measuring, so that the net task does not
+	// run concurrently and CNetSubSystem::Process() can be called from here.
+	for (unsigned i = 0; i < sizeof Connections / sizeof Connections[0]; i++)
+	{
+		unsigned nCount = Connections[i];
+		if (!OpenConnections (nCount))
+		{
+			m_Logger.Write (FromKernel, LogError, "Cannot open %u connections", nCount);
+
+			break;
+		}
+
+		unsigned nFirst = MeasureDelivery (0);
+		unsigned nLast = MeasureDelivery (nCount-1);
+
+		m_Logger.Write (FromKernel, LogNotice,
+				"%4u connections: %u ns to first, %u ns to last opened connection",
+				nCount, nFirst, nLast);
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Done");
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::OpenConnections (unsigned nCount)
+{
+	assert (nCount <= MAX_CONNECTIONS);
+
+	CIPAddress PeerIP (PeerIPAddress);
+
+	while (m_nConnections < nCount)
+	{
+		CSocket *pSocket = new CSocket (&m_Net, IPPROTO_UDP);
+		assert (pSocket != 0);
+
+		if (   pSocket->Bind (OWN_PORT_BASE + m_nConnections) < 0
+		    || pSocket->Connect (PeerIP, PEER_PORT_BASE + m_nConnections) < 0)
+		{
+			delete pSocket;
+
+			return FALSE;
+		}
+
+		m_pSocket[m_nConnections++] = pSocket;
+	}
+
+	return TRUE;
+}
+
+unsigned CKernel::MeasureDelivery (unsigned nIndex)
+{
+	assert (nIndex < m_nConnections);
+
+	u8 Frame[FRAME_SIZE] ALIGN(4);
+	BuildFrame (Frame, nIndex);
+
+	unsigned nIdle = MeasureProcess (0, 0, 0);
+	unsigned nBusy = MeasureProcess (Frame, BATCH_SIZE, m_pSocket[nIndex]);
+
+	// the difference is the time to pass the datagrams up the stack to the socket
+	return nBusy > nIdle ? (nBusy - nIdle) / BATCH_SIZE : 0;
+}
+
+unsigned CKernel::MeasureProcess (const void *pFrame, unsigned nFrames, CSocket *pSocket)
+{
+	unsigned nTotalTime = 0;
+	unsigned nLost = 0;
+
+	for (unsigned nRound = 0; nRound < ROUNDS; nRound++)
+	{
+		for (unsigned i = 0; i < nFrames; i++)
+		{
+			if (!m_Loopback.InjectFrame (pFrame, FRAME_SIZE))
+			{
+				assert (0);
+			}
+		}
+
+		unsigned nStart = CTimer::GetClockTicks ();
+
+		m_Net.Process ();
+
+		nTotalTime += CTimer::GetClockTicks () - nStart;
+
+		assert (m_Loopback.GetQueuedCount () == 0);
+
+		if (pSocket != 0)
+		{
+			unsigned nReceived = 0;
+			u8 Buffer[FRAME_BUFFER_SIZE];
+			while (pSocket->Receive (Buffer, sizeof Buffer, MSG_DONTWAIT) > 0)
+			{
+				nReceived++;
+			}
+
+			nLost += nFrames - nReceived;
+		}
+	}
+
+	if (nLost > 0)
+	{
+		m_Logger.Write (FromKernel, LogWarning, "%u datagrams not delivered", nLost);
+	}
+
+	return (unsigned) ((unsigned long long) nTotalTime * 1000 / ROUNDS);
+}
+
+void CKernel::BuildFrame (u8 *pFrame, unsigned nIndex)
+{
+	assert (pFrame != 0);
+	memset (pFrame, 0, FRAME_SIZE);
+
+	TEthernetHeader *pEthernetHeader = (TEthernetHeader *) pFrame;
+	memcpy (pEthernetHeader->MACReceiver, OwnMACAddress, MAC_ADDRESS_SIZE);
+	memcpy (pEthernetHeader->MACSender, PeerMACAddress, MAC_ADDRESS_SIZE);
+	pEthernetHeader->nProtocolType = BE (ETH_PROT_IP);
+
+	TIPHeader *pIPHeader = (TIPHeader *) (pFrame + sizeof (TEthernetHeader));
+	unsigned nIPLength = FRAME_SIZE - sizeof (TEthernetHeader);
+	pIPHeader->nVersionIHL          = IP_VERSION << 4 | IP_HEADER_LENGTH_DWORD_MIN;
+	pIPHeader->nTypeOfService       = IP_TOS_ROUTINE;
+	pIPHeader->nTotalLength         = le2be16 (nIPLength);
+	pIPHeader->nIdentification      = BE (IP_IDENTIFICATION_DEFAULT);
+	pIPHeader->nFlagsFragmentOffset = BE (IP_FRAGMENT_OFFSET_FIRST);
+	pIPHeader->nTTL                 = IP_TTL_DEFAULT;
+	pIPHeader->nProtocol            = IPPROTO_UDP;
+	memcpy (pIPHeader->SourceAddress, PeerIPAddress, IP_ADDRESS_SIZE);
+	memcpy (pIPHeader->DestinationAddress, IPAddress, IP_ADDRESS_SIZE);
+	pIPHeader->nHeaderChecksum = 0;
+	pIPHeader->nHeaderChecksum = CChecksumCalculator::SimpleCalculate (pIPHeader,
+									   sizeof (TIPHeader));
+
+	TUDPHeader *pUDPHeader = (TUDPHeader *) (pIPHeader + 1);
+	pUDPHeader->nSourcePort = le2be16 (PEER_PORT_BASE + nIndex);
+	pUDPHeader->nDestPort   = le2be16 (OWN_PORT_BASE + nIndex);
+	pUDPHeader->nLength     = le2be16 (sizeof (TUDPHeader) + PAYLOAD_SIZE);
+	pUDPHeader->nChecksum   = 0;		// no checksum
+}
@@ -0,0 +1,93 @@
+//
+// kernel.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _kernel_h
+#define _kernel_h
+
+#include <circle/memory.h>
+#include <circle/actled.h>
+#include <circle/koptions.h>
+#include <circle/devicenameservice.h>
+#include <circle/screen.h>
+#include <circle/serial.h>
+#include <circle/exceptionhandler.h>
+#include <circle/interrupt.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <circle/sched/scheduler.h>
+#include <circle/net/netsubsystem.h>
+#include <circle/net/socket.h>
+#include <circle/netdevice.h>
+#include <circle/types.h>
+#include "loopbackdevice.h"
+
+#define MAX_CONNECTIONS		1000
+
+enum TShutdownMode
+{
+	ShutdownNone,
+	ShutdownHalt,
+	ShutdownReboot
+};
+
+class CKernel
+{
+public:
+	CKernel (void);
+	~CKernel (void);
+
+	boolean Initialize (void);
+
+	TShutdownMode Run (void);
+
+private:
+	boolean OpenConnections (unsigned nCount);
+
+	// returns the processing time of one datagram to connection nIndex in nanoseconds
+	unsigned MeasureDelivery (unsigned nIndex);
+
+	// returns the time of one call to CNetSubSystem::Process() in nanoseconds,
+	// after nFrames copies of pFrame have been queued, the socket is drained afterwards
+	unsigned MeasureProcess (const void *pFrame, unsigned nFrames, CSocket *pSocket);
+
+	// builds a UDP datagram from the peer to connection nIndex
+	static void BuildFrame (u8 *pFrame, unsigned nIndex);
+
+private:
+	// do not change this order
+	CMemorySystem		m_Memory;
+	CActLED			m_ActLED;
+	CKernelOptions		m_Options;
+	CDeviceNameService	m_DeviceNameService;
+	CScreenDevice		m_Screen;
+	CSerialDevice		m_Serial;
+	CExceptionHandler	m_ExceptionHandler;
+	CInterruptSystem	m_Interrupt;
+	CTimer			m_Timer;
+	CLogger			m_Logger;
+	CScheduler		m_Scheduler;
+
+	CLoopbackDevice		m_Loopback;		// must be constructed before m_Net
+	CNetSubSystem		m_Net;
+
+	CSocket		       *m_pSocket[MAX_CONNECTIONS];
+	unsigned		m_nConnections;
+};
+
+#endif
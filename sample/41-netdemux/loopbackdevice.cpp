@@ -0,0 +1,93 @@
+//
+// loopbackdevice.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "loopbackdevice.h"
+#include <circle/util.h>
+#include <assert.h>
+
+CLoopbackDevice::CLoopbackDevice (const u8 *pMACAddress)
+:	m_MACAddress (pMACAddress),
+	m_nInPtr (0),
+	m_nOutPtr (0)
+{
+	AddNetDevice ();
+}
+
+CLoopbackDevice::~CLoopbackDevice (void)
+{
+}
+
+const CMACAddress *CLoopbackDevice::GetMACAddress (void) const
+{
+	return &m_MACAddress;
+}
+
+boolean CLoopbackDevice::SendFrame (const void *pBuffer, unsigned nLength)
+{
+	return TRUE;
+}
+
+boolean CLoopbackDevice::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
+{
+	if (m_nOutPtr == m_nInPtr)
+	{
+		return FALSE;
+	}
+
+	assert (pBuffer != 0);
+	assert (m_nLength[m_nOutPtr] <= FRAME_BUFFER_SIZE);
+	memcpy (pBuffer, m_pFrame[m_nOutPtr], m_nLength[m_nOutPtr]);
+
+	assert (pResultLength != 0);
+	*pResultLength = m_nLength[m_nOutPtr];
+
+	if (++m_nOutPtr == LOOPBACK_QUEUE_SIZE)
+	{
+		m_nOutPtr = 0;
+	}
+
+	return TRUE;
+}
+
+boolean CLoopbackDevice::InjectFrame (const void *pFrame, unsigned nLength)
+{
+	unsigned nInPtr = m_nInPtr + 1;
+	if (nInPtr == LOOPBACK_QUEUE_SIZE)
+	{
+		nInPtr = 0;
+	}
+
+	if (nInPtr == m_nOutPtr)
+	{
+		return FALSE;
+	}
+
+	assert (pFrame != 0);
+	m_pFrame[m_nInPtr] = pFrame;
+	m_nLength[m_nInPtr] = nLength;
+
+	m_nInPtr = nInPtr;
+
+	return TRUE;
+}
+
+unsigned CLoopbackDevice::GetQueuedCount (void) const
+{
+	return (m_nInPtr - m_nOutPtr) % LOOPBACK_QUEUE_SIZE;
+}
@@ -0,0 +1,59 @@
+//
+// loopbackdevice.h
+//
+// Net device, which returns frames from a queue, filled by the application
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _loopbackdevice_h
+#define _loopbackdevice_h
+
+#include <circle/netdevice.h>
+#include <circle/macaddress.h>
+#include <circle/types.h>
+
+#define LOOPBACK_QUEUE_SIZE	64
+
+class CLoopbackDevice : public CNetDevice
+{
+public:
+	CLoopbackDevice (const u8 *pMACAddress);
+	~CLoopbackDevice (void);
+
+	const CMACAddress *GetMACAddress (void) const;
+
+	// sent frames are discarded
+	boolean SendFrame (const void *pBuffer, unsigned nLength);
+
+	boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength);
+
+	// the frame will be returned by ReceiveFrame(), it is not copied here,
+	// returns FALSE if the queue is full
+	boolean InjectFrame (const void *pFrame, unsigned nLength);
+
+	unsigned GetQueuedCount (void) const;
+
+private:
+	CMACAddress m_MACAddress;
+
+	const void *m_pFrame[LOOPBACK_QUEUE_SIZE];
+	unsigned m_nLength[LOOPBACK_QUEUE_SIZE];
+	unsigned m_nInPtr;
+	unsigned m_nOutPtr;
+};
+
+#endif
@@ -0,0 +1,255 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/synchronize.h>
+#include <assert.h>
+
+#define LONG_DELAY	(60 * HZ)		// does not elapse during the test
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	// short delays stay in the first wheel level, long delays cascade down from
+	// the higher levels, the last run covers three levels
+	boolean bOK = TestRandomTimers (1000, 50);
+	bOK = TestRandomTimers (10000, 5 * HZ) && bOK;
+	bOK = TestRandomTimers (MAX_TIMERS / 2, 60 * HZ) && bOK;
+	bOK = TestPoolReuse () && bOK;
+
+	if (bOK)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "All tests passed");
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogError, "Test failed");
+	}
+
+	return ShutdownHalt;
+}
+
+// Starts nTimers timers with random delays from 1 to nMaxDelay ticks. Randomly
+// chosen timers are cancelled, while the timers are started. Checks that the
+// other timers elapse, not before their time and with the right handle.
+boolean CKernel::TestRandomTimers (unsigned nTimers, unsigned nMaxDelay)
+{
+	assert (nTimers <= MAX_TIMERS);
+
+	m_Logger.Write (FromKernel, LogNotice, "Starting %u timers (delay up to %u ticks)",
+			nTimers, nMaxDelay);
+
+	m_nElapsed = 0;
+	m_nEarly = 0;
+	m_nMaxLateness = 0;
+	m_nWrongHandle = 0;
+
+	unsigned nCancelled = 0;
+	unsigned nStartTime = 0;
+	unsigned nCancelTime = 0;
+
+	for (unsigned nSlot = 0; nSlot < nTimers; nSlot++)
+	{
+		unsigned nDelay = 1 + m_Random.GetNumber () % nMaxDelay;
+
+		// the timer must not elapse, before the slot is set up
+		EnterCritical ();
+
+		m_nElapsesAt[nSlot] = m_Timer.GetTicks () + nDelay;
+
+		unsigned nStart = CTimer::GetClockTicks ();
+		m_hTimer[nSlot] = m_Timer.StartKernelTimer (nDelay, TimerHandler, this,
+							     (void *) (uintptr) nSlot);
+		nStartTime += CTimer::GetClockTicks () - nStart;
+
+		LeaveCritical ();
+
+		if (m_hTimer[nSlot] == 0)
+		{
+			m_Logger.Write (FromKernel, LogError, "Cannot start timer %u", nSlot);
+
+			return FALSE;
+		}
+
+		// cancel every third timer on average, if it is still pending
+		if (m_Random.GetNumber () % 3 == 0)
+		{
+			unsigned nCancelSlot = m_Random.GetNumber () % (nSlot+1);
+
+			EnterCritical ();
+
+			if (m_hTimer[nCancelSlot] != 0)
+			{
+				nStart = CTimer::GetClockTicks ();
+				m_Timer.CancelKernelTimer (m_hTimer[nCancelSlot]);
+				nCancelTime += CTimer::GetClockTicks () - nStart;
+
+				m_hTimer[nCancelSlot] = 0;
+				nCancelled++;
+			}
+
+			LeaveCritical ();
+		}
+	}
+
+	// wait for the remaining timers
+	unsigned nStartTicks = m_Timer.GetTicks ();
+	while (   m_nElapsed + nCancelled < nTimers
+	       && m_Timer.GetTicks () - nStartTicks < nMaxDelay + 2*HZ)
+	{
+		// just wait
+	}
+
+	m_Logger.Write (FromKernel, LogNotice,
+			"%u elapsed, %u cancelled, max. lateness %u ticks, "
+			"start %u ns, cancel %u ns",
+			m_nElapsed, nCancelled, m_nMaxLateness,
+			(unsigned) ((unsigned long long) nStartTime * 1000 / nTimers),
+			nCancelled > 0 ? (unsigned) ((unsigned long long) nCancelTime * 1000
+						      / nCancelled) : 0);
+
+	if (   m_nElapsed + nCancelled != nTimers
+	    || m_nEarly != 0
+	    || m_nWrongHandle != 0)
+	{
+		m_Logger.Write (FromKernel, LogError, "%u missing, %u too early, %u wrong handle",
+				nTimers - m_nElapsed - nCancelled, m_nEarly, m_nWrongHandle);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+// Fills the kernel timer pool up to POOL_RESERVE timers with timers, which do not elapse
+// during the test, and cancels them again. This is repeated, so that the second run has to
+// reuse the timers of the pool. Exceeding the pool would cause a system panic.
+boolean CKernel::TestPoolReuse (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Filling the kernel timer pool (%u timers)",
+			MAX_TIMERS - POOL_RESERVE);
+
+	m_nElapsed = 0;
+
+	for (unsigned nRun = 1; nRun <= 2; nRun++)
+	{
+		for (unsigned nSlot = 0; nSlot < MAX_TIMERS - POOL_RESERVE; nSlot++)
+		{
+			m_hTimer[nSlot] = m_Timer.StartKernelTimer (LONG_DELAY, TimerHandler, this,
+								    (void *) (uintptr) nSlot);
+			assert (m_hTimer[nSlot] != 0);
+			m_nElapsesAt[nSlot] = m_Timer.GetTicks () + LONG_DELAY;
+		}
+
+		for (unsigned nSlot = 0; nSlot < MAX_TIMERS - POOL_RESERVE; nSlot++)
+		{
+			m_Timer.CancelKernelTimer (m_hTimer[nSlot]);
+			m_hTimer[nSlot] = 0;
+		}
+	}
+
+	if (m_nElapsed != 0)
+	{
+		m_Logger.Write (FromKernel, LogError, "%u cancelled timers elapsed", m_nElapsed);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void CKernel::TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pContext)
+{
+	CKernel *pThis = (CKernel *) pParam;
+	assert (pThis != 0);
+
+	unsigned nSlot = (unsigned) (uintptr) pContext;
+	assert (nSlot < MAX_TIMERS);
+
+	if (pThis->m_hTimer[nSlot] != hTimer)
+	{
+		pThis->m_nWrongHandle++;
+	}
+
+	int nLateness = (int) (pThis->m_Timer.GetTicks () - pThis->m_nElapsesAt[nSlot]);
+	if (nLateness < 0)
+	{
+		pThis->m_nEarly++;
+	}
+	else if ((unsigned) nLateness > pThis->m_nMaxLateness)
+	{
+		pThis->m_nMaxLateness = nLateness;
+	}
+
+	pThis->m_hTimer[nSlot] = 0;
+	pThis->m_nElapsed++;
+}
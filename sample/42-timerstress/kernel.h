@@ -0,0 +1,87 @@
+//
+// kernel.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _kernel_h
+#define _kernel_h
+
+#include <circle/memory.h>
+#include <circle/actled.h>
+#include <circle/koptions.h>
+#include <circle/devicenameservice.h>
+#include <circle/screen.h>
+#include <circle/serial.h>
+#include <circle/exceptionhandler.h>
+#include <circle/interrupt.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <circle/pseudorandom.h>
+#include <circle/types.h>
+
+#define MAX_TIMERS	(KERNEL_TIMER_MAX_BLOCKS * KERNEL_TIMER_BLOCK_SIZE)
+#define POOL_RESERVE	KERNEL_TIMER_BLOCK_SIZE		// for other timers of the system
+
+enum TShutdownMode
+{
+	ShutdownNone,
+	ShutdownHalt,
+	ShutdownReboot
+};
+
+class CKernel
+{
+public:
+	CKernel (void);
+	~CKernel (void);
+
+	boolean Initialize (void);
+
+	TShutdownMode Run (void);
+
+private:
+	boolean TestRandomTimers (unsigned nTimers, unsigned nMaxDelay);
+	boolean TestPoolReuse (void);
+
+	static void TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pContext);
+
+private:
+	// do not change this order
+	CMemorySystem		m_Memory;
+	CActLED			m_ActLED;
+	CKernelOptions		m_Options;
+	CDeviceNameService	m_DeviceNameService;
+	CScreenDevice		m_Screen;
+	CSerialDevice		m_Serial;
+	CExceptionHandler	m_ExceptionHandler;
+	CInterruptSystem	m_Interrupt;
+	CTimer			m_Timer;
+	CLogger			m_Logger;
+
+	// per slot, modified by TimerHandler() too
+	TKernelTimerHandle	m_hTimer[MAX_TIMERS];		// 0 if not pending
+	unsigned		m_nElapsesAt[MAX_TIMERS];
+
+	volatile unsigned	m_nElapsed;
+	volatile unsigned	m_nEarly;
+	volatile unsigned	m_nMaxLateness;
+	volatile unsigned	m_nWrongHandle;
+
+	CPseudoRandomNumberGenerator m_Random;
+};
+
+#endif
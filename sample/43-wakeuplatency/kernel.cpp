@@ -0,0 +1,131 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include "latencytask.h"
+#include "loadtask.h"
+#include <circle/sysconfig.h>
+#include <assert.h>
+
+#define SAMPLES			300
+#define LOAD_TASKS		2
+#define LOAD_SLICE_MICROS	1000		// a load task yields after this time
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+#ifdef PREEMPTIVE_SCHEDULER
+	m_Logger.Write (FromKernel, LogNotice, "Preemptive scheduler (time slice %u ticks)",
+			SCHEDULER_TIME_SLICE);
+#else
+	m_Logger.Write (FromKernel, LogNotice, "Cooperative scheduler");
+#endif
+
+	// the load tasks have the default priority
+	Measure (TASK_PRIORITY_DEFAULT, 0);
+	Measure (TASK_PRIORITY_DEFAULT, LOAD_TASKS);
+	Measure (TASK_PRIORITY_DEFAULT+1, LOAD_TASKS);
+	Measure (TASK_PRIORITY_HIGHEST, LOAD_TASKS);
+
+	m_Logger.Write (FromKernel, LogNotice, "Done");
+
+	return ShutdownHalt;
+}
+
+void CKernel::Measure (unsigned nPriority, unsigned nLoadTasks)
+{
+	CLoadTask *LoadTask[LOAD_TASKS];
+	assert (nLoadTasks <= LOAD_TASKS);
+	for (unsigned i = 0; i < nLoadTasks; i++)
+	{
+		LoadTask[i] = new CLoadTask (LOAD_SLICE_MICROS);
+		assert (LoadTask[i] != 0);
+	}
+
+	TLatencyResult Result;
+	CLatencyTask *pLatencyTask = new CLatencyTask (nPriority, SAMPLES, &Result);
+	assert (pLatencyTask != 0);
+
+	pLatencyTask->WaitForTermination ();
+
+	for (unsigned i = 0; i < nLoadTasks; i++)
+	{
+		LoadTask[i]->Stop ();
+	}
+
+	// let the load tasks terminate
+	m_Scheduler.MsSleep (100);
+
+	m_Logger.Write (FromKernel, LogNotice,
+			"Priority %2u, %u load tasks: min %u us, avg %u us, max %u us",
+			nPriority, nLoadTasks, Result.nMin, Result.nAverage, Result.nMax);
+}
@@ -0,0 +1,83 @@
+//
+// latencytask.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "latencytask.h"
+#include <assert.h>
+
+CLatencyTask::CLatencyTask (unsigned nPriority, unsigned nSamples, TLatencyResult *pResult)
+:	m_nSamples (nSamples),
+	m_pResult (pResult)
+{
+	assert (m_nSamples > 0);
+	assert (m_pResult != 0);
+
+	SetPriority (nPriority);
+}
+
+CLatencyTask::~CLatencyTask (void)
+{
+	m_pResult = 0;
+}
+
+void CLatencyTask::Run (void)
+{
+	unsigned nMin = (unsigned) -1;
+	unsigned nMax = 0;
+	unsigned long long nSum = 0;
+
+	for (unsigned i = 0; i < m_nSamples; i++)
+	{
+		m_Event.Clear ();
+
+		// vary the phase against the scheduling of the load tasks
+		CTimer::Get ()->StartKernelTimer (1 + i % 3, TimerHandler, this);
+
+		m_Event.Wait ();
+
+		unsigned nLatency = CTimer::GetClockTicks () - m_nSetTime;
+
+		if (nLatency < nMin)
+		{
+			nMin = nLatency;
+		}
+
+		if (nLatency > nMax)
+		{
+			nMax = nLatency;
+		}
+
+		nSum += nLatency;
+	}
+
+	assert (m_pResult != 0);
+	m_pResult->nSamples = m_nSamples;
+	m_pResult->nMin = nMin;
+	m_pResult->nMax = nMax;
+	m_pResult->nAverage = (unsigned) (nSum / m_nSamples);
+}
+
+void CLatencyTask::TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pContext)
+{
+	CLatencyTask *pThis = (CLatencyTask *) pParam;
+	assert (pThis != 0);
+
+	pThis->m_nSetTime = CTimer::GetClockTicks ();
+
+	pThis->m_Event.Set ();
+}
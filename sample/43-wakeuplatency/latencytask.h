@@ -0,0 +1,57 @@
+//
+// latencytask.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _latencytask_h
+#define _latencytask_h
+
+#include <circle/sched/task.h>
+#include <circle/sched/synchronizationevent.h>
+#include <circle/timer.h>
+#include <circle/types.h>
+
+struct TLatencyResult		// in microseconds
+{
+	unsigned	nSamples;
+	unsigned	nMin;
+	unsigned	nMax;
+	unsigned	nAverage;
+};
+
+class CLatencyTask : public CTask	// waits for an event, which is set from a timer IRQ
+{
+public:
+	// the task is deleted by the scheduler, when it terminates,
+	// so the result is written to *pResult
+	CLatencyTask (unsigned nPriority, unsigned nSamples, TLatencyResult *pResult);
+	~CLatencyTask (void);
+
+	void Run (void);
+
+private:
+	static void TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pContext);
+
+private:
+	unsigned	m_nSamples;
+	TLatencyResult *m_pResult;
+
+	CSynchronizationEvent m_Event;
+	volatile unsigned m_nSetTime;		// CTimer::GetClockTicks() at Set()
+};
+
+#endif
@@ -0,0 +1,51 @@
+//
+// loadtask.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "loadtask.h"
+#include <circle/sched/scheduler.h>
+#include <circle/timer.h>
+
+CLoadTask::CLoadTask (unsigned nSliceMicros)
+:	m_nSliceMicros (nSliceMicros),
+	m_bStop (FALSE)
+{
+}
+
+CLoadTask::~CLoadTask (void)
+{
+}
+
+void CLoadTask::Run (void)
+{
+	while (!m_bStop)
+	{
+		unsigned nStart = CTimer::GetClockTicks ();
+		while (CTimer::GetClockTicks () - nStart < m_nSliceMicros)
+		{
+			// just burn CPU time
+		}
+
+		CScheduler::Get ()->Yield ();
+	}
+}
+
+void CLoadTask::Stop (void)
+{
+	m_bStop = TRUE;
+}
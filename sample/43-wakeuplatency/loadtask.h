@@ -0,0 +1,42 @@
+//
+// loadtask.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _loadtask_h
+#define _loadtask_h
+
+#include <circle/sched/task.h>
+#include <circle/types.h>
+
+class CLoadTask : public CTask	// keeps the CPU busy, calls Yield() every nSliceMicros
+{
+public:
+	CLoadTask (unsigned nSliceMicros);
+	~CLoadTask (void);
+
+	void Run (void);
+
+	void Stop (void);
+
+private:
+	unsigned m_nSliceMicros;
+
+	volatile boolean m_bStop;
+};
+
+#endif
@@ -0,0 +1,279 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/fs/fsdef.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define PARTITION	"umsd1-1"		// default, select with "partition=emmc1-1" in cmdline.txt
+#define FILENAME	"fatbench.dat"
+
+#define FILE_SIZE	(8 * 1024 * 1024)
+#define MAX_REQUEST	(256 * 1024)
+
+static const struct
+{
+	unsigned nRequestSize;
+	unsigned nMisalign;		// buffer offset from a 4-byte boundary
+}
+Tests[] =
+{
+	{512,		0},
+	{4096,		0},
+	{4096,		1},		// buffer not aligned, uses the sector cache
+	{32768,		0},
+	{MAX_REQUEST,	0}
+};
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_USBHCI (&m_Interrupt, &m_Timer),
+	m_EMMC (&m_Interrupt, &m_Timer, &m_ActLED),
+	m_pPartition (m_Options.GetAppOptionString ("partition", PARTITION)),
+	m_pBuffer (0)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+	delete [] m_pBuffer;
+	m_pBuffer = 0;
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	// initialize the device of the selected partition only
+	if (bOK)
+	{
+		if (strncmp (m_pPartition, "emmc", 4) == 0)
+		{
+			bOK = m_EMMC.Initialize ();
+		}
+		else
+		{
+			bOK = m_USBHCI.Initialize ();
+		}
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	// Mount file system
+	CDevice *pPartition = m_DeviceNameService.GetDevice (m_pPartition, TRUE);
+	if (pPartition == 0)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Partition not found: %s", m_pPartition);
+	}
+
+	if (!m_FileSystem.Mount (pPartition))
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot mount partition: %s", m_pPartition);
+	}
+
+	m_pBuffer = new u8[MAX_REQUEST + 4];
+	assert (m_pBuffer != 0);
+
+	m_Logger.Write (FromKernel, LogNotice, "Sequential I/O with a %u KB file on %s",
+			FILE_SIZE / 1024, m_pPartition);
+
+	for (unsigned i = 0; i < sizeof Tests / sizeof Tests[0]; i++)
+	{
+		unsigned nWriteRate, nReadRate;
+		if (!Benchmark (Tests[i].nRequestSize, Tests[i].nMisalign, &nWriteRate, &nReadRate))
+		{
+			break;
+		}
+
+		m_Logger.Write (FromKernel, LogNotice,
+				"%6u bytes/request%s: write %u.%03u MB/s, read %u.%03u MB/s",
+				Tests[i].nRequestSize, Tests[i].nMisalign ? " (unaligned)" : "",
+				nWriteRate / 1000, nWriteRate % 1000,
+				nReadRate / 1000, nReadRate % 1000);
+	}
+
+	m_FileSystem.FileDelete (FILENAME);
+
+	m_FileSystem.UnMount ();
+
+	m_Logger.Write (FromKernel, LogNotice, "Done");
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::Benchmark (unsigned nRequestSize, unsigned nMisalign,
+			    unsigned *pWriteRate, unsigned *pReadRate)
+{
+	assert (nRequestSize <= MAX_REQUEST);
+	assert (nMisalign < 4);
+	u8 *pBuffer = m_pBuffer + nMisalign;
+
+	// write the file, the time includes closing it, which flushes the cache
+	unsigned hFile = m_FileSystem.FileCreate (FILENAME);
+	if (hFile == 0)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot create file: %s", FILENAME);
+
+		return FALSE;
+	}
+
+	unsigned nWriteTime = 0;
+	for (unsigned nOffset = 0; nOffset < FILE_SIZE; nOffset += nRequestSize)
+	{
+		FillPattern (pBuffer, nRequestSize, nOffset);
+
+		unsigned nStart = CTimer::GetClockTicks ();
+
+		if (m_FileSystem.FileWrite (hFile, pBuffer, nRequestSize) != nRequestSize)
+		{
+			m_Logger.Write (FromKernel, LogError, "Write error at offset %u", nOffset);
+
+			m_FileSystem.FileClose (hFile);
+
+			return FALSE;
+		}
+
+		nWriteTime += CTimer::GetClockTicks () - nStart;
+	}
+
+	unsigned nStart = CTimer::GetClockTicks ();
+
+	if (!m_FileSystem.FileClose (hFile))
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot close file");
+
+		return FALSE;
+	}
+
+	nWriteTime += CTimer::GetClockTicks () - nStart;
+
+	// read the file and verify its contents, the time does not include the verify
+	hFile = m_FileSystem.FileOpen (FILENAME);
+	if (hFile == 0)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot open file: %s", FILENAME);
+
+		return FALSE;
+	}
+
+	unsigned nReadTime = 0;
+	for (unsigned nOffset = 0; nOffset < FILE_SIZE; nOffset += nRequestSize)
+	{
+		unsigned nStart = CTimer::GetClockTicks ();
+
+		unsigned nResult = m_FileSystem.FileRead (hFile, pBuffer, nRequestSize);
+
+		nReadTime += CTimer::GetClockTicks () - nStart;
+
+		if (nResult != nRequestSize)
+		{
+			m_Logger.Write (FromKernel, LogError, "Read error at offset %u", nOffset);
+
+			m_FileSystem.FileClose (hFile);
+
+			return FALSE;
+		}
+
+		if (!CheckPattern (pBuffer, nRequestSize, nOffset))
+		{
+			m_Logger.Write (FromKernel, LogError, "Data mismatch at offset %u", nOffset);
+
+			m_FileSystem.FileClose (hFile);
+
+			return FALSE;
+		}
+	}
+
+	m_FileSystem.FileClose (hFile);
+
+	assert (pWriteRate != 0);
+	*pWriteRate = (unsigned) (FILE_SIZE * 1000ULL / (nWriteTime ? nWriteTime : 1));
+
+	assert (pReadRate != 0);
+	*pReadRate = (unsigned) (FILE_SIZE * 1000ULL / (nReadTime ? nReadTime : 1));
+
+	return TRUE;
+}
+
+void CKernel::FillPattern (u8 *pBuffer, unsigned nLength, unsigned nFileOffset)
+{
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		unsigned nPos = nFileOffset + i;
+
+		*pBuffer++ = (u8) (nPos ^ nPos >> 9);		// differs for each sector
+	}
+}
+
+boolean CKernel::CheckPattern (const u8 *pBuffer, unsigned nLength, unsigned nFileOffset)
+{
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		unsigned nPos = nFileOffset + i;
+
+		if (*pBuffer++ != (u8) (nPos ^ nPos >> 9))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
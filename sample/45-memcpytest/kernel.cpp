@@ -0,0 +1,431 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/machineinfo.h>
+#include <circle/synchronize.h>
+#include <circle/util.h>
+#include <circle/macros.h>
+#include <assert.h>
+
+#define MAX_EXHAUSTIVE		300		// all lengths up to this are tested
+#define MAX_LENGTH		16384
+#define MAX_MISALIGN		16
+#define GUARD_SIZE		64
+#define GUARD_BYTE		0xA5
+
+#define MOVE_AREA		1024
+#define MAX_MOVE_DELTA		40
+
+#define IRQ_COPY_SIZE		16384
+#define IRQ_TEST_SECS		3
+#define COMPUTE_ITERATIONS	100000
+
+#define BENCHMARK_BYTES		(16 * 1024 * 1024)
+
+static const char FromKernel[] = "kernel";
+
+// longer lengths, which are tested with all misalignments
+static const unsigned Lengths[] = {511, 512, 513, 1000, 4095, 4096, 4097, MAX_LENGTH-1, MAX_LENGTH};
+
+static u8 s_Source[MAX_LENGTH + MAX_MISALIGN] ALIGN(64);
+static u8 s_Dest[GUARD_SIZE + MAX_LENGTH + MAX_MISALIGN + GUARD_SIZE] ALIGN(64);
+
+static u8 s_MoveArea[MOVE_AREA] ALIGN(64);
+static u8 s_MoveExpected[MOVE_AREA] ALIGN(64);
+
+static u8 s_IRQSource[IRQ_COPY_SIZE] ALIGN(64);
+static u8 s_IRQDest[IRQ_COPY_SIZE] ALIGN(64);
+static volatile boolean s_bIRQCopy = FALSE;
+static volatile unsigned s_nIRQCopies = 0;
+
+static double Compute (double fSeed, unsigned nIterations) __attribute__ ((noinline));
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	boolean bOK = TestCopy ();
+	bOK = TestMove () && bOK;
+	bOK = TestSet () && bOK;
+	bOK = TestIRQ () && bOK;
+
+	if (bOK)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "All tests passed");
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogError, "Test failed");
+	}
+
+	static const unsigned BenchmarkLengths[] = {16, 64, 256, 1024, 4096, MAX_LENGTH};
+	for (unsigned i = 0; i < sizeof BenchmarkLengths / sizeof BenchmarkLengths[0]; i++)
+	{
+		Benchmark (BenchmarkLengths[i], 0);
+		Benchmark (BenchmarkLengths[i], 1);
+	}
+
+	return ShutdownHalt;
+}
+
+// memcpy() with all misalignments of source and destination, checks the bytes around the destination
+boolean CKernel::TestCopy (void)
+{
+	unsigned nTests = 0;
+
+	for (unsigned i = 0; i <= MAX_EXHAUSTIVE + sizeof Lengths / sizeof Lengths[0]; i++)
+	{
+		unsigned nLength = i <= MAX_EXHAUSTIVE ? i : Lengths[i - MAX_EXHAUSTIVE - 1];
+
+		for (unsigned nSrcOffset = 0; nSrcOffset < MAX_MISALIGN; nSrcOffset++)
+		{
+			for (unsigned nDestOffset = 0; nDestOffset < MAX_MISALIGN; nDestOffset++)
+			{
+				u8 *pSource = s_Source + nSrcOffset;
+				u8 *pDest = s_Dest + GUARD_SIZE + nDestOffset;
+
+				m_Random.Fill (pSource, nLength);
+				ReferenceSet (s_Dest, GUARD_BYTE, sizeof s_Dest);
+
+				if (   memcpy (pDest, pSource, nLength) != pDest
+				    || memcmp (pDest, pSource, nLength) != 0)
+				{
+					m_Logger.Write (FromKernel, LogError,
+							"memcpy: length %u, offsets %u/%u: Wrong data",
+							nLength, nSrcOffset, nDestOffset);
+
+					return FALSE;
+				}
+
+				for (unsigned j = 0; j < sizeof s_Dest; j++)
+				{
+					if (   (j < GUARD_SIZE + nDestOffset || j >= GUARD_SIZE + nDestOffset + nLength)
+					    && s_Dest[j] != GUARD_BYTE)
+					{
+						m_Logger.Write (FromKernel, LogError,
+								"memcpy: length %u, offsets %u/%u: Guard overwritten",
+								nLength, nSrcOffset, nDestOffset);
+
+						return FALSE;
+					}
+				}
+
+				nTests++;
+			}
+		}
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "memcpy: %u tests OK", nTests);
+
+	return TRUE;
+}
+
+// memmove() with overlapping regions in both directions
+boolean CKernel::TestMove (void)
+{
+	unsigned nTests = 0;
+
+	for (unsigned nLength = 0; nLength <= MOVE_AREA - 2*MAX_MOVE_DELTA - MAX_MISALIGN; nLength++)
+	{
+		// test short lengths with all deltas, longer lengths only with some
+		int nDeltaStep = nLength <= MAX_EXHAUSTIVE ? 1 : 13;
+
+		for (int nDelta = -MAX_MOVE_DELTA; nDelta <= MAX_MOVE_DELTA; nDelta += nDeltaStep)
+		{
+			for (unsigned nOffset = 0; nOffset < MAX_MISALIGN; nOffset += 5)
+			{
+				unsigned nSource = MAX_MOVE_DELTA + nOffset;
+				unsigned nDest = nSource + nDelta;
+
+				m_Random.Fill (s_MoveArea, MOVE_AREA);
+				ReferenceCopy (s_MoveExpected, s_MoveArea, MOVE_AREA);
+
+				// the reference copies forward or backward, so that the source is read first
+				if (nDelta <= 0)
+				{
+					ReferenceCopy (s_MoveExpected + nDest, s_MoveExpected + nSource, nLength);
+				}
+				else
+				{
+					for (unsigned i = nLength; i-- > 0;)
+					{
+						s_MoveExpected[nDest + i] = s_MoveExpected[nSource + i];
+					}
+				}
+
+				if (   memmove (s_MoveArea + nDest, s_MoveArea + nSource, nLength) != s_MoveArea + nDest
+				    || memcmp (s_MoveArea, s_MoveExpected, MOVE_AREA) != 0)
+				{
+					m_Logger.Write (FromKernel, LogError,
+							"memmove: length %u, source %u, delta %d: Wrong data",
+							nLength, nSource, nDelta);
+
+					return FALSE;
+				}
+
+				nTests++;
+			}
+		}
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "memmove: %u tests OK", nTests);
+
+	return TRUE;
+}
+
+// memset() with all misalignments, large zero fills use DC ZVA on AArch64
+boolean CKernel::TestSet (void)
+{
+	static const int Values[] = {0, 0x5A, 0x1FF};		// only the lower byte is used
+	unsigned nTests = 0;
+
+	for (unsigned i = 0; i <= MAX_EXHAUSTIVE + sizeof Lengths / sizeof Lengths[0]; i++)
+	{
+		unsigned nLength = i <= MAX_EXHAUSTIVE ? i : Lengths[i - MAX_EXHAUSTIVE - 1];
+
+		for (unsigned nOffset = 0; nOffset < MAX_MISALIGN; nOffset++)
+		{
+			for (unsigned nValue = 0; nValue < sizeof Values / sizeof Values[0]; nValue++)
+			{
+				u8 *pDest = s_Dest + GUARD_SIZE + nOffset;
+
+				ReferenceSet (s_Dest, GUARD_BYTE, sizeof s_Dest);
+
+				if (memset (pDest, Values[nValue], nLength) != pDest)
+				{
+					m_Logger.Write (FromKernel, LogError, "memset: Wrong return value");
+
+					return FALSE;
+				}
+
+				for (unsigned j = 0; j < sizeof s_Dest; j++)
+				{
+					u8 uchExpected = GUARD_BYTE;
+					if (j >= GUARD_SIZE + nOffset && j < GUARD_SIZE + nOffset + nLength)
+					{
+						uchExpected = (u8) Values[nValue];
+					}
+
+					if (s_Dest[j] != uchExpected)
+					{
+						m_Logger.Write (FromKernel, LogError,
+								"memset: length %u, offset %u, value 0x%X: Wrong data at %u",
+								nLength, nOffset, Values[nValue], j);
+
+						return FALSE;
+					}
+				}
+
+				nTests++;
+			}
+		}
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "memset: %u tests OK", nTests);
+
+	return TRUE;
+}
+
+// The library functions are called from IRQ handlers, while the interrupted code may use the
+// floating point registers, which are not saved on IRQ without SAVE_VFP_REGS_ON_IRQ.
+boolean CKernel::TestIRQ (void)
+{
+	double fSeed = 1.0 + m_Random.GetNumber () % 1000 / 1000.0;
+
+	EnterCritical ();
+	double fExpected = Compute (fSeed, COMPUTE_ITERATIONS);
+	LeaveCritical ();
+
+	m_Random.Fill (s_IRQSource, IRQ_COPY_SIZE);
+
+	m_Timer.RegisterPeriodicHandler (PeriodicHandler);
+	s_bIRQCopy = TRUE;
+
+	unsigned nRuns = 0;
+	unsigned nErrors = 0;
+	unsigned nStartTicks = m_Timer.GetTicks ();
+	while (m_Timer.GetTicks () - nStartTicks < IRQ_TEST_SECS * HZ)
+	{
+		if (Compute (fSeed, COMPUTE_ITERATIONS) != fExpected)
+		{
+			nErrors++;
+		}
+
+		nRuns++;
+	}
+
+	s_bIRQCopy = FALSE;
+
+	if (nErrors > 0)
+	{
+		m_Logger.Write (FromKernel, LogError, "IRQ: %u of %u results corrupted", nErrors, nRuns);
+
+		return FALSE;
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "IRQ: %u results with %u copies from IRQ OK",
+			nRuns, s_nIRQCopies);
+
+	return TRUE;
+}
+
+void CKernel::Benchmark (unsigned nLength, unsigned nMisalign)
+{
+	assert (nLength <= MAX_LENGTH);
+	assert (nMisalign < MAX_MISALIGN);
+	m_Random.Fill (s_Source, nLength + nMisalign);
+
+	unsigned nRuns = BENCHMARK_BYTES / nLength;
+
+	unsigned nStart = CTimer::GetClockTicks ();
+	for (unsigned i = 0; i < nRuns; i++)
+	{
+		ReferenceCopy (s_Dest, s_Source + nMisalign, nLength);
+	}
+	unsigned nReferenceTime = CTimer::GetClockTicks () - nStart;
+
+	nStart = CTimer::GetClockTicks ();
+	for (unsigned i = 0; i < nRuns; i++)
+	{
+		memcpy (s_Dest, s_Source + nMisalign, nLength);
+	}
+	unsigned nCopyTime = CTimer::GetClockTicks () - nStart;
+
+	nStart = CTimer::GetClockTicks ();
+	for (unsigned i = 0; i < nRuns; i++)
+	{
+		memset (s_Dest, 0, nLength);
+	}
+	unsigned nSetTime = CTimer::GetClockTicks () - nStart;
+
+	// bytes per microsecond is MB/s
+	unsigned long long nBytes = (unsigned long long) nLength * nRuns;
+
+	// the ARM clock in MHz gives the CPU cycles per microsecond
+	unsigned nClockMHz = CMachineInfo::Get ()->GetClockRate (CLOCK_ID_ARM) / 1000000;
+	unsigned nCopyCycles = (unsigned) (100ULL * nCopyTime * nClockMHz / nBytes);
+
+	m_Logger.Write (FromKernel, LogNotice,
+			"%5u bytes%s: byte loop %u MB/s, memcpy %u MB/s (%u.%02u cycles/byte), memset %u MB/s",
+			nLength, nMisalign ? " (unaligned)" : "",
+			(unsigned) (nBytes / (nReferenceTime ? nReferenceTime : 1)),
+			(unsigned) (nBytes / (nCopyTime ? nCopyTime : 1)),
+			nCopyCycles / 100, nCopyCycles % 100,
+			(unsigned) (nBytes / (nSetTime ? nSetTime : 1)));
+}
+
+// the loops must not be replaced with calls to memcpy() or memset() by the compiler
+void __attribute__ ((optimize ("no-tree-loop-distribute-patterns")))
+CKernel::ReferenceCopy (u8 *pDest, const u8 *pSource, unsigned nLength)
+{
+	while (nLength--)
+	{
+		*pDest++ = *pSource++;
+	}
+}
+
+void __attribute__ ((optimize ("no-tree-loop-distribute-patterns")))
+CKernel::ReferenceSet (u8 *pDest, u8 uchValue, unsigned nLength)
+{
+	while (nLength--)
+	{
+		*pDest++ = uchValue;
+	}
+}
+
+void CKernel::PeriodicHandler (void)
+{
+	if (!s_bIRQCopy)
+	{
+		return;
+	}
+
+	// aligned and unaligned copies
+	memcpy (s_IRQDest, s_IRQSource, IRQ_COPY_SIZE);
+	memmove (s_IRQDest + 1, s_IRQDest, IRQ_COPY_SIZE - 1);
+	memset (s_IRQDest, 0, IRQ_COPY_SIZE);
+
+	s_nIRQCopies++;
+}
+
+// keeps its values in floating point registers
+double Compute (double fSeed, unsigned nIterations)
+{
+	double x = fSeed;
+	double y = 0.5;
+
+	while (nIterations--)
+	{
+		x = x * 0.999 + y;
+		y = y * 1.0001 - x * 0.000001;
+	}
+
+	return x + y;
+}
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+#
+# httpload.py - HTTP keep-alive load test for the sample 46-httpload
+#
+# Usage: python3 httpload.py HOST [-p PATH] [-c CONNECTIONS] [-n REQUESTS] [--close]
+#
+
+import argparse
+import http.client
+import threading
+import time
+
+parser = argparse.ArgumentParser(description="HTTP keep-alive load test")
+parser.add_argument("host", help="IP address of the Raspberry Pi")
+parser.add_argument("-p", "--path", default="/small.txt", help="path to be requested")
+parser.add_argument("-c", "--connections", type=int, default=4, help="concurrent connections")
+parser.add_argument("-n", "--requests", type=int, default=100, help="requests per connection")
+parser.add_argument("--close", action="store_true", help="open a new connection for each request")
+args = parser.parse_args()
+
+lock = threading.Lock()
+latencies = []
+total_bytes = 0
+errors = 0
+
+def check_pattern(data):
+	# the *.bin content of the sample is the byte sequence 0, 1, ..., 255, 0, 1, ...
+	pattern = bytes(range(256)) * (len(data) // 256 + 1)
+	return data == pattern[:len(data)]
+
+def client():
+	global total_bytes, errors
+
+	conn = None
+	for i in range(args.requests):
+		if conn is None:
+			conn = http.client.HTTPConnection(args.host, timeout=30)
+
+		headers = {"Connection": "close"} if args.close else {}
+		start = time.monotonic()
+		try:
+			conn.request("GET", args.path, headers=headers)
+			response = conn.getresponse()
+			data = response.read()
+		except Exception as e:
+			with lock:
+				errors += 1
+			print("Request failed: " + str(e))
+			conn.close()
+			conn = None
+			continue
+		latency = time.monotonic() - start
+
+		ok = response.status == 200
+		if ok and args.path.endswith(".bin"):
+			ok = check_pattern(data)
+
+		with lock:
+			latencies.append(latency)
+			total_bytes += len(data)
+			if not ok:
+				errors += 1
+
+		if args.close or response.will_close:
+			conn.close()
+			conn = None
+
+	if conn is not None:
+		conn.close()
+
+threads = [threading.Thread(target=client) for i in range(args.connections)]
+
+start = time.monotonic()
+for thread in threads:
+	thread.start()
+for thread in threads:
+	thread.join()
+elapsed = time.monotonic() - start
+
+requests = len(latencies)
+print("%d requests of %s with %d connections (%s) in %.2f s"
+	% (requests, args.path, args.connections,
+	   "new connection per request" if args.close else "keep-alive", elapsed))
+if requests > 0:
+	latencies.sort()
+	print("%.1f requests/s, %.3f MB/s" % (requests / elapsed, total_bytes / elapsed / 1000000))
+	print("latency: avg %.2f ms, median %.2f ms, max %.2f ms"
+		% (sum(latencies) / requests * 1000, latencies[requests // 2] * 1000,
+		   latencies[-1] * 1000))
+print("%d errors" % errors)
@@ -0,0 +1,167 @@
+//
+// loadserver.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "loadserver.h"
+#include <circle/net/httpfileproducer.h>
+#include <circle/string.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define MAX_CONTENT_SIZE	(16*1024 + 32)	// 16 KB content parts plus chunk framing
+#define MAX_CONNECTIONS		16
+
+#define SMALL_SIZE		1024
+#define LARGE_SIZE		(1024*1024)
+
+static const char s_Index[] =
+	"<html><head><title>HTTP load test</title></head><body>\n"
+	"<p><a href=\"/small.txt\">/small.txt</a> 1 KB text from GetContent()</p>\n"
+	"<p><a href=\"/large.bin\">/large.bin</a> 1 MB pattern with Content-Length</p>\n"
+	"<p><a href=\"/chunked.bin\">/chunked.bin</a> 1 MB pattern with chunked coding</p>\n"
+	"<p>/FILENAME.EXT from the root directory of an USB flash drive</p>\n"
+	"</body></html>\n";
+
+CPatternProducer::CPatternProducer (unsigned nSize, boolean bKnownLength)
+:	m_nSize (nSize),
+	m_bKnownLength (bKnownLength),
+	m_nOffset (0)
+{
+}
+
+CPatternProducer::~CPatternProducer (void)
+{
+}
+
+int CPatternProducer::GetContentLength (void)
+{
+	return m_bKnownLength ? (int) m_nSize : -1;
+}
+
+int CPatternProducer::GetContentPart (u8 *pBuffer, unsigned nBufSize)
+{
+	assert (m_nOffset <= m_nSize);
+	unsigned nLength = m_nSize - m_nOffset;
+	if (nLength > nBufSize)
+	{
+		nLength = nBufSize;
+	}
+
+	assert (pBuffer != 0);
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		*pBuffer++ = (u8) m_nOffset++;
+	}
+
+	return (int) nLength;
+}
+
+CLoadServer::CLoadServer (CNetSubSystem *pNetSubSystem, CFATFileSystem *pFileSystem)
+:	CHTTPDaemon (pNetSubSystem, 0, MAX_CONTENT_SIZE, HTTP_PORT, 0, MAX_CONNECTIONS),
+	m_pFileSystem (pFileSystem)
+{
+}
+
+CLoadServer::~CLoadServer (void)
+{
+	m_pFileSystem = 0;
+}
+
+THTTPStatus CLoadServer::GetContent (const char  *pPath,
+				     const char  *pParams,
+				     const char  *pFormData,
+				     u8		 *pBuffer,
+				     unsigned    *pLength,
+				     const char **ppContentType)
+{
+	assert (pPath != 0);
+	assert (pBuffer != 0);
+	assert (pLength != 0);
+	assert (ppContentType != 0);
+
+	if (   strcmp (pPath, "/") == 0
+	    || strcmp (pPath, "/index.html") == 0)
+	{
+		unsigned nLength = sizeof s_Index-1;
+		assert (*pLength >= nLength);
+		memcpy (pBuffer, s_Index, nLength);
+		*pLength = nLength;
+	}
+	else if (strcmp (pPath, "/small.txt") == 0)
+	{
+		assert (*pLength >= SMALL_SIZE);
+		for (unsigned i = 0; i < SMALL_SIZE; i++)
+		{
+			pBuffer[i] = i % 64 == 63 ? '\n' : 'A' + i % 26;
+		}
+
+		*pLength = SMALL_SIZE;
+		*ppContentType = "text/plain";
+	}
+	else
+	{
+		return HTTPNotFound;
+	}
+
+	return HTTPOK;
+}
+
+CHTTPContentProducer *CLoadServer::GetContentProducer (const char  *pPath,
+						       const char  *pParams,
+						       const char  *pFormData,
+						       const char **ppContentType)
+{
+	assert (pPath != 0);
+	assert (ppContentType != 0);
+
+	if (strcmp (pPath, "/large.bin") == 0)
+	{
+		*ppContentType = "application/octet-stream";
+
+		return new CPatternProducer (LARGE_SIZE, TRUE);
+	}
+
+	if (strcmp (pPath, "/chunked.bin") == 0)
+	{
+		*ppContentType = "application/octet-stream";
+
+		return new CPatternProducer (LARGE_SIZE, FALSE);
+	}
+
+	if (   m_pFileSystem == 0
+	    || strcmp (pPath, "/") == 0
+	    || strcmp (pPath, "/index.html") == 0
+	    || strcmp (pPath, "/small.txt") == 0)
+	{
+		return 0;
+	}
+
+	CHTTPFileProducer *pProducer = new CHTTPFileProducer (m_pFileSystem);
+	assert (pProducer != 0);
+
+	if (!pProducer->Open (pPath))
+	{
+		delete pProducer;
+
+		return 0;		// GetContent() returns "not found"
+	}
+
+	*ppContentType = CHTTPFileProducer::GetContentType (pPath);
+
+	return pProducer;
+}
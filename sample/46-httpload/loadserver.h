@@ -0,0 +1,66 @@
+//
+// loadserver.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _loadserver_h
+#define _loadserver_h
+
+#include <circle/net/httpdaemon.h>
+#include <circle/net/netsubsystem.h>
+#include <circle/fs/fat/fatfs.h>
+#include <circle/types.h>
+
+class CPatternProducer : public CHTTPContentProducer	// byte n of the content is (u8) n
+{
+public:
+	CPatternProducer (unsigned nSize, boolean bKnownLength);
+	~CPatternProducer (void);
+
+	int GetContentLength (void);
+	int GetContentPart (u8 *pBuffer, unsigned nBufSize);
+
+private:
+	unsigned m_nSize;
+	boolean m_bKnownLength;
+	unsigned m_nOffset;
+};
+
+class CLoadServer : public CHTTPDaemon		// serves all connections from one task
+{
+public:
+	CLoadServer (CNetSubSystem  *pNetSubSystem,
+		     CFATFileSystem *pFileSystem);	// files are not served if 0
+	~CLoadServer (void);
+
+	THTTPStatus GetContent (const char  *pPath,
+				const char  *pParams,
+				const char  *pFormData,
+			        u8	    *pBuffer,
+			        unsigned    *pLength,
+			        const char **ppContentType);
+
+	CHTTPContentProducer *GetContentProducer (const char  *pPath,
+						  const char  *pParams,
+						  const char  *pFormData,
+						  const char **ppContentType);
+
+private:
+	CFATFileSystem *m_pFileSystem;
+};
+
+#endif
@@ -0,0 +1,282 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/usb/usbmassdevice.h>
+#include <assert.h>
+
+#define DEVICE		"umsd1"
+
+#define TEST_AREA	(16 * 1024 * 1024)	// bytes from the start of the drive
+#define RANDOM_SIZE	4096			// bytes per random request
+#define RANDOM_REQUESTS	1000
+
+#define WRITE_TEST				// rewrites the test area with its own data
+
+static const unsigned RequestSizes[] = {512, 4096, 32768, 131072};
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_USBHCI (&m_Interrupt, &m_Timer),
+	m_pDevice (0),
+	m_pBuffer (0)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+	delete [] m_pBuffer;
+	m_pBuffer = 0;
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_USBHCI.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	m_pDevice = m_DeviceNameService.GetDevice (DEVICE, TRUE);
+	if (m_pDevice == 0)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Device not found: %s", DEVICE);
+	}
+
+	u64 ullCapacity = (u64) ((CUSBBulkOnlyMassStorageDevice *) m_pDevice)->GetCapacity ()
+			  * UMSD_BLOCK_SIZE;
+	if (ullCapacity < TEST_AREA)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Drive is too small");
+	}
+
+	m_pBuffer = new u8[TEST_AREA + RANDOM_SIZE];
+	assert (m_pBuffer != 0);
+
+	m_Logger.Write (FromKernel, LogNotice, "Sequential I/O in the first %u KB of the drive",
+			TEST_AREA / 1024);
+
+	for (unsigned i = 0; i < sizeof RequestSizes / sizeof RequestSizes[0]; i++)
+	{
+		unsigned nReadRate;
+		if (!SequentialRead (RequestSizes[i], &nReadRate))
+		{
+			return ShutdownHalt;
+		}
+
+#ifdef WRITE_TEST
+		unsigned nWriteRate;
+		if (!SequentialWrite (RequestSizes[i], &nWriteRate))
+		{
+			return ShutdownHalt;
+		}
+
+		m_Logger.Write (FromKernel, LogNotice,
+				"%6u bytes/request: read %u.%03u MB/s, write %u.%03u MB/s",
+				RequestSizes[i], nReadRate / 1000, nReadRate % 1000,
+				nWriteRate / 1000, nWriteRate % 1000);
+#else
+		m_Logger.Write (FromKernel, LogNotice, "%6u bytes/request: read %u.%03u MB/s",
+				RequestSizes[i], nReadRate / 1000, nReadRate % 1000);
+#endif
+	}
+
+	unsigned nReadIOPS;
+	if (!RandomRead (ullCapacity, &nReadIOPS))
+	{
+		return ShutdownHalt;
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Random %u byte reads on the whole drive: %u IOPS",
+			RANDOM_SIZE, nReadIOPS);
+
+#ifdef WRITE_TEST
+	unsigned nWriteIOPS;
+	if (!RandomWrite (&nWriteIOPS))
+	{
+		return ShutdownHalt;
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Random %u byte writes in the test area: %u IOPS",
+			RANDOM_SIZE, nWriteIOPS);
+#endif
+
+	m_Logger.Write (FromKernel, LogNotice, "Done");
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::SequentialRead (unsigned nRequestSize, unsigned *pRate)
+{
+	assert (m_pDevice != 0);
+	assert (m_pBuffer != 0);
+
+	unsigned nStart = CTimer::GetClockTicks ();
+
+	for (unsigned nOffset = 0; nOffset < TEST_AREA; nOffset += nRequestSize)
+	{
+		if (   m_pDevice->Seek (nOffset) != nOffset
+		    || m_pDevice->Read (m_pBuffer + nOffset, nRequestSize) != (int) nRequestSize)
+		{
+			m_Logger.Write (FromKernel, LogError, "Read error at offset %u", nOffset);
+
+			return FALSE;
+		}
+	}
+
+	unsigned nTime = CTimer::GetClockTicks () - nStart;
+
+	assert (pRate != 0);
+	*pRate = (unsigned) (TEST_AREA * 1000ULL / (nTime ? nTime : 1));
+
+	return TRUE;
+}
+
+boolean CKernel::SequentialWrite (unsigned nRequestSize, unsigned *pRate)
+{
+	assert (m_pDevice != 0);
+	assert (m_pBuffer != 0);
+
+	unsigned nStart = CTimer::GetClockTicks ();
+
+	for (unsigned nOffset = 0; nOffset < TEST_AREA; nOffset += nRequestSize)
+	{
+		if (   m_pDevice->Seek (nOffset) != nOffset
+		    || m_pDevice->Write (m_pBuffer + nOffset, nRequestSize) != (int) nRequestSize)
+		{
+			m_Logger.Write (FromKernel, LogError, "Write error at offset %u", nOffset);
+
+			return FALSE;
+		}
+	}
+
+	unsigned nTime = CTimer::GetClockTicks () - nStart;
+
+	assert (pRate != 0);
+	*pRate = (unsigned) (TEST_AREA * 1000ULL / (nTime ? nTime : 1));
+
+	return TRUE;
+}
+
+boolean CKernel::RandomRead (u64 ullAreaSize, unsigned *pIOPS)
+{
+	assert (m_pDevice != 0);
+	assert (m_pBuffer != 0);
+
+	// read behind the saved test area data, which is needed for RandomWrite()
+	u64 ullRequests = ullAreaSize / RANDOM_SIZE;
+	assert (ullRequests > 0);
+
+	unsigned nStart = CTimer::GetClockTicks ();
+
+	for (unsigned i = 0; i < RANDOM_REQUESTS; i++)
+	{
+		u64 ullRandom = (u64) m_Random.GetNumber () << 32 | m_Random.GetNumber ();
+		u64 ullOffset = ullRandom % ullRequests * RANDOM_SIZE;
+
+		if (   m_pDevice->Seek (ullOffset) != ullOffset
+		    || m_pDevice->Read (m_pBuffer + TEST_AREA, RANDOM_SIZE) != RANDOM_SIZE)
+		{
+			m_Logger.Write (FromKernel, LogError, "Read error at block %u",
+					(unsigned) (ullOffset / UMSD_BLOCK_SIZE));
+
+			return FALSE;
+		}
+	}
+
+	unsigned nTime = CTimer::GetClockTicks () - nStart;
+
+	assert (pIOPS != 0);
+	*pIOPS = (unsigned) (RANDOM_REQUESTS * 1000000ULL / (nTime ? nTime : 1));
+
+	return TRUE;
+}
+
+boolean CKernel::RandomWrite (unsigned *pIOPS)
+{
+	assert (m_pDevice != 0);
+	assert (m_pBuffer != 0);
+
+	// the test area has been read into m_pBuffer before, and is written back at random
+	unsigned nStart = CTimer::GetClockTicks ();
+
+	for (unsigned i = 0; i < RANDOM_REQUESTS; i++)
+	{
+		unsigned nOffset = m_Random.GetNumber () % (TEST_AREA / RANDOM_SIZE) * RANDOM_SIZE;
+
+		if (   m_pDevice->Seek (nOffset) != nOffset
+		    || m_pDevice->Write (m_pBuffer + nOffset, RANDOM_SIZE) != RANDOM_SIZE)
+		{
+			m_Logger.Write (FromKernel, LogError, "Write error at offset %u", nOffset);
+
+			return FALSE;
+		}
+	}
+
+	unsigned nTime = CTimer::GetClockTicks () - nStart;
+
+	assert (pIOPS != 0);
+	*pIOPS = (unsigned) (RANDOM_REQUESTS * 1000000ULL / (nTime ? nTime : 1));
+
+	return TRUE;
+}
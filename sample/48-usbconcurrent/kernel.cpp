@@ -0,0 +1,208 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include "netloadtask.h"
+#include "storageloadtask.h"
+#include <circle/string.h>
+#include <assert.h>
+
+// Network configuration
+#define USE_DHCP
+
+#ifndef USE_DHCP
+static const u8 IPAddress[]      = {192, 168, 0, 250};
+static const u8 NetMask[]        = {255, 255, 255, 0};
+static const u8 DefaultGateway[] = {192, 168, 0, 1};
+static const u8 DNSServer[]      = {192, 168, 0, 1};
+#endif
+
+// the UDP datagrams are sent to this host (e.g. run "nc -ul 5001 >/dev/null" there)
+static const u8 TargetIP[]	 = {192, 168, 0, 1};
+#define TARGET_PORT		5001
+
+#define DEVICE			"umsd1"
+
+#define MEASURE_SECS		5
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_USBHCI (&m_Interrupt, &m_Timer)
+#ifndef USE_DHCP
+	, m_Net (IPAddress, NetMask, DefaultGateway, DNSServer)
+#endif
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_USBHCI.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Net.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+#if RASPPI <= 3
+	CDevice *pDevice = m_DeviceNameService.GetDevice (DEVICE, TRUE);
+	if (pDevice == 0)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Device not found: %s", DEVICE);
+	}
+
+	CString IPString;
+	CIPAddress (TargetIP).Format (&IPString);
+	m_Logger.Write (FromKernel, LogNotice, "Sending UDP datagrams to %s:%u",
+			(const char *) IPString, TARGET_PORT);
+
+	CNetLoadTask *pNetLoad = new CNetLoadTask (&m_Net, TargetIP, TARGET_PORT);
+	assert (pNetLoad != 0);
+
+	CStorageLoadTask *pStorageLoad = new CStorageLoadTask (pDevice);
+	assert (pStorageLoad != 0);
+
+	Measure ("Idle", 0, 0);
+	Measure ("Ethernet", pNetLoad, 0);
+	Measure ("Mass storage", 0, pStorageLoad);
+	Measure ("Ethernet and mass storage", pNetLoad, pStorageLoad);
+
+	pNetLoad->Stop ();
+	pStorageLoad->Stop ();
+
+	m_Logger.Write (FromKernel, LogNotice, "Done");
+#else
+	m_Logger.Write (FromKernel, LogError, "This sample needs the DWHCI USB controller (RPi 1-3, Zero)");
+#endif
+
+	return ShutdownHalt;
+}
+
+void CKernel::Measure (const char *pTitle, CNetLoadTask *pNetLoad, CStorageLoadTask *pStorageLoad)
+{
+#if RASPPI <= 3
+	if (pNetLoad != 0)
+	{
+		pNetLoad->Enable (TRUE);
+		pNetLoad->GetBytes ();
+	}
+
+	if (pStorageLoad != 0)
+	{
+		pStorageLoad->Enable (TRUE);
+		pStorageLoad->GetBytes ();
+	}
+
+	m_USBHCI.ResetStatistics ();
+
+	m_Scheduler.Sleep (MEASURE_SECS);
+
+	TDWHCIStatistics Statistics;
+	m_USBHCI.GetStatistics (&Statistics);
+
+	unsigned nNetBytes = 0;
+	if (pNetLoad != 0)
+	{
+		nNetBytes = pNetLoad->GetBytes ();
+		pNetLoad->Enable (FALSE);
+	}
+
+	unsigned nStorageBytes = 0;
+	if (pStorageLoad != 0)
+	{
+		nStorageBytes = pStorageLoad->GetBytes ();
+		pStorageLoad->Enable (FALSE);
+	}
+
+	// let the load tasks become idle
+	m_Scheduler.MsSleep (100);
+
+	unsigned nNetRate = nNetBytes / (MEASURE_SECS * 1000);
+	unsigned nStorageRate = nStorageBytes / (MEASURE_SECS * 1000);
+
+	m_Logger.Write (FromKernel, LogNotice, "%s: Ethernet TX %u.%03u MB/s, mass storage %u.%03u MB/s",
+			pTitle, nNetRate / 1000, nNetRate % 1000,
+			nStorageRate / 1000, nStorageRate % 1000);
+
+	u64 nElapsed = Statistics.nElapsedTime ? Statistics.nElapsedTime : 1;
+	for (unsigned i = 0; i < Statistics.nChannels; i++)
+	{
+		unsigned nPermille = (unsigned) (Statistics.Channel[i].nBusyTime * 1000 / nElapsed);
+
+		m_Logger.Write (FromKernel, LogNotice,
+				"Channel %u: %3u.%u%% busy, %u stages, %u transactions",
+				i, nPermille / 10, nPermille % 10,
+				Statistics.Channel[i].nStages, Statistics.Channel[i].nTransactions);
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "%u stages waited for a channel (max. %u at once)",
+			Statistics.nPendingStages, Statistics.nPendingMax);
+#endif
+}
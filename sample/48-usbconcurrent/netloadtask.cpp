@@ -0,0 +1,100 @@
+//
+// netloadtask.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "netloadtask.h"
+#include <circle/net/socket.h>
+#include <circle/net/in.h>
+#include <circle/sched/scheduler.h>
+#include <circle/logger.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define DATAGRAM_SIZE		1472		// fills an Ethernet frame
+#define DATAGRAMS_PER_YIELD	8
+
+static const char FromNetLoad[] = "netload";
+
+CNetLoadTask::CNetLoadTask (CNetSubSystem *pNetSubSystem, const u8 *pTargetIP, u16 nTargetPort)
+:	m_pNetSubSystem (pNetSubSystem),
+	m_TargetIP (pTargetIP),
+	m_nTargetPort (nTargetPort),
+	m_bStop (FALSE),
+	m_bEnabled (FALSE),
+	m_nBytes (0)
+{
+}
+
+CNetLoadTask::~CNetLoadTask (void)
+{
+	m_pNetSubSystem = 0;
+}
+
+void CNetLoadTask::Run (void)
+{
+	assert (m_pNetSubSystem != 0);
+	CSocket Socket (m_pNetSubSystem, IPPROTO_UDP);
+	if (Socket.Connect (m_TargetIP, m_nTargetPort) < 0)
+	{
+		CLogger::Get ()->Write (FromNetLoad, LogError, "Cannot connect");
+
+		return;
+	}
+
+	static u8 Datagram[DATAGRAM_SIZE];
+	memset (Datagram, 0x55, sizeof Datagram);
+
+	while (!m_bStop)
+	{
+		if (!m_bEnabled)
+		{
+			CScheduler::Get ()->MsSleep (10);
+
+			continue;
+		}
+
+		for (unsigned i = 0; i < DATAGRAMS_PER_YIELD; i++)
+		{
+			if (Socket.Send (Datagram, sizeof Datagram, MSG_DONTWAIT) == (int) sizeof Datagram)
+			{
+				m_nBytes += sizeof Datagram;
+			}
+		}
+
+		// let the network task send the queued frames
+		CScheduler::Get ()->Yield ();
+	}
+}
+
+void CNetLoadTask::Stop (void)
+{
+	m_bStop = TRUE;
+}
+
+void CNetLoadTask::Enable (boolean bEnable)
+{
+	m_bEnabled = bEnable;
+}
+
+unsigned CNetLoadTask::GetBytes (void)
+{
+	unsigned nBytes = m_nBytes;
+	m_nBytes = 0;
+
+	return nBytes;
+}
@@ -0,0 +1,54 @@
+//
+// netloadtask.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _netloadtask_h
+#define _netloadtask_h
+
+#include <circle/sched/task.h>
+#include <circle/net/netsubsystem.h>
+#include <circle/net/ipaddress.h>
+#include <circle/types.h>
+
+class CNetLoadTask : public CTask	// sends UDP datagrams as fast as possible
+{
+public:
+	CNetLoadTask (CNetSubSystem *pNetSubSystem, const u8 *pTargetIP, u16 nTargetPort);
+	~CNetLoadTask (void);
+
+	void Run (void);
+
+	void Stop (void);
+
+	// the load is generated only while enabled
+	void Enable (boolean bEnable);
+
+	// returns the number of bytes sent since the last call
+	unsigned GetBytes (void);
+
+private:
+	CNetSubSystem *m_pNetSubSystem;
+	CIPAddress m_TargetIP;
+	u16 m_nTargetPort;
+
+	volatile boolean m_bStop;
+	volatile boolean m_bEnabled;
+	volatile unsigned m_nBytes;
+};
+
+#endif
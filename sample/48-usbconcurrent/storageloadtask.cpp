@@ -0,0 +1,96 @@
+//
+// storageloadtask.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "storageloadtask.h"
+#include <circle/sched/scheduler.h>
+#include <circle/logger.h>
+#include <assert.h>
+
+#define REQUEST_SIZE	(64 * 1024)
+#define READ_AREA	(64 * 1024 * 1024)	// bytes from the start of the device
+
+static const char FromStorageLoad[] = "storageload";
+
+CStorageLoadTask::CStorageLoadTask (CDevice *pDevice)
+:	m_pDevice (pDevice),
+	m_bStop (FALSE),
+	m_bEnabled (FALSE),
+	m_nBytes (0)
+{
+}
+
+CStorageLoadTask::~CStorageLoadTask (void)
+{
+	m_pDevice = 0;
+}
+
+void CStorageLoadTask::Run (void)
+{
+	static u8 Buffer[REQUEST_SIZE];
+
+	unsigned nOffset = 0;
+	while (!m_bStop)
+	{
+		if (!m_bEnabled)
+		{
+			CScheduler::Get ()->MsSleep (10);
+
+			continue;
+		}
+
+		assert (m_pDevice != 0);
+		if (   m_pDevice->Seek (nOffset) != nOffset
+		    || m_pDevice->Read (Buffer, REQUEST_SIZE) != REQUEST_SIZE)
+		{
+			CLogger::Get ()->Write (FromStorageLoad, LogError,
+						"Read error at offset %u", nOffset);
+
+			return;
+		}
+
+		m_nBytes += REQUEST_SIZE;
+
+		nOffset += REQUEST_SIZE;
+		if (nOffset >= READ_AREA)
+		{
+			nOffset = 0;
+		}
+
+		// Read() busy-waits for the USB transfer, let the other tasks run in between
+		CScheduler::Get ()->Yield ();
+	}
+}
+
+void CStorageLoadTask::Stop (void)
+{
+	m_bStop = TRUE;
+}
+
+void CStorageLoadTask::Enable (boolean bEnable)
+{
+	m_bEnabled = bEnable;
+}
+
+unsigned CStorageLoadTask::GetBytes (void)
+{
+	unsigned nBytes = m_nBytes;
+	m_nBytes = 0;
+
+	return nBytes;
+}
@@ -0,0 +1,112 @@
+//
+// lockedqueue.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _lockedqueue_h
+#define _lockedqueue_h
+
+#include <circle/spinlock.h>
+#include <circle/types.h>
+#include <assert.h>
+
+// Ring buffer protected by a spin lock, as used by the drivers before the lock-free
+// ring buffers (e.g. CKeyboardBuffer), for comparison. Has the same interface.
+template <class T>
+class CLockedQueue
+{
+public:
+	CLockedQueue (unsigned nSize)
+	:	m_pBuffer (0),
+		m_nMask (0),
+		m_nIn (0),
+		m_nOut (0)
+	{
+		unsigned nAllocSize = 1;
+		while (nAllocSize <= nSize)	// one entry is always free
+		{
+			nAllocSize <<= 1;
+		}
+
+		m_pBuffer = new T[nAllocSize];
+		assert (m_pBuffer != 0);
+
+		m_nMask = nAllocSize-1;
+	}
+
+	~CLockedQueue (void)
+	{
+		delete [] m_pBuffer;
+		m_pBuffer = 0;
+	}
+
+	boolean Enqueue (const T &Entry)
+	{
+		return EnqueueMultiple (&Entry, 1) == 1;
+	}
+
+	unsigned EnqueueMultiple (const T *pEntries, unsigned nCount)
+	{
+		m_SpinLock.Acquire ();
+
+		unsigned nResult = 0;
+		while (   nResult < nCount
+		       && ((m_nIn+1) & m_nMask) != m_nOut)
+		{
+			m_pBuffer[m_nIn] = pEntries[nResult++];
+
+			m_nIn = (m_nIn+1) & m_nMask;
+		}
+
+		m_SpinLock.Release ();
+
+		return nResult;
+	}
+
+	boolean Dequeue (T *pEntry)
+	{
+		return DequeueMultiple (pEntry, 1) == 1;
+	}
+
+	unsigned DequeueMultiple (T *pEntries, unsigned nCount)
+	{
+		m_SpinLock.Acquire ();
+
+		unsigned nResult = 0;
+		while (   nResult < nCount
+		       && m_nIn != m_nOut)
+		{
+			pEntries[nResult++] = m_pBuffer[m_nOut];
+
+			m_nOut = (m_nOut+1) & m_nMask;
+		}
+
+		m_SpinLock.Release ();
+
+		return nResult;
+	}
+
+private:
+	T *m_pBuffer;
+	unsigned m_nMask;
+	unsigned m_nIn;
+	unsigned m_nOut;
+
+	CSpinLock m_SpinLock;
+};
+
+#endif
@@ -0,0 +1,317 @@
+//
+// queuebenchmark.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "queuebenchmark.h"
+#include "lockedqueue.h"
+#include <circle/ringbuffer.h>
+#include <circle/synchronize.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <assert.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+
+#define QUEUE_SIZE	1024
+#define ITEMS		3000000			// must be dividable by PRODUCERS_MPSC
+#define BATCH_SIZE	32
+
+#define PRODUCERS_SPSC	1
+#define PRODUCERS_MPSC	(CORES-1)
+
+#define CORE_SHIFT	24			// an item is (nCore << CORE_SHIFT) | nSequence
+#define SEQUENCE_MASK	((1 << CORE_SHIFT)-1)
+
+static const struct
+{
+	const char *pName;
+	boolean bMultiProducer;
+	boolean bBatch;
+}
+s_TestInfo[] =
+{
+	{"SPSC ring buffer",			FALSE,	FALSE},
+	{"SPSC ring buffer (batch)",		FALSE,	TRUE},
+	{"Locked queue, 1 producer",		FALSE,	FALSE},
+	{"Locked queue, 1 producer (batch)",	FALSE,	TRUE},
+	{"MPSC ring buffer",			TRUE,	FALSE},
+	{"MPSC ring buffer (batch)",		TRUE,	TRUE},
+	{"Locked queue, 3 producers",		TRUE,	FALSE},
+	{"Locked queue, 3 producers (batch)",	TRUE,	TRUE}
+};
+
+static const char FromBenchmark[] = "bench";
+
+template <class TQueue>
+static void Produce (TQueue *pQueue, unsigned nCore, unsigned nItems, boolean bBatch)
+{
+	assert (pQueue != 0);
+	u32 nItem = nCore << CORE_SHIFT;
+
+	if (!bBatch)
+	{
+		for (unsigned i = 0; i < nItems; i++)
+		{
+			while (!pQueue->Enqueue (nItem))
+			{
+				// queue is full
+			}
+
+			nItem++;
+		}
+
+		return;
+	}
+
+	u32 Batch[BATCH_SIZE];
+	while (nItems > 0)
+	{
+		unsigned nCount = nItems < BATCH_SIZE ? nItems : BATCH_SIZE;
+		for (unsigned i = 0; i < nCount; i++)
+		{
+			Batch[i] = nItem++;
+		}
+
+		for (unsigned nSent = 0; nSent < nCount;)
+		{
+			nSent += pQueue->EnqueueMultiple (Batch + nSent, nCount - nSent);
+		}
+
+		nItems -= nCount;
+	}
+}
+
+// checks, that the items of each producer arrive in order
+template <class TQueue>
+static boolean Consume (TQueue *pQueue, unsigned nItems, boolean bBatch)
+{
+	assert (pQueue != 0);
+	u32 NextSequence[CORES] = {0};
+
+	u32 Batch[BATCH_SIZE];
+	while (nItems > 0)
+	{
+		unsigned nCount;
+		if (!bBatch)
+		{
+			nCount = pQueue->Dequeue (&Batch[0]) ? 1 : 0;
+		}
+		else
+		{
+			nCount = pQueue->DequeueMultiple (Batch, BATCH_SIZE);
+		}
+
+		for (unsigned i = 0; i < nCount; i++)
+		{
+			unsigned nCore = Batch[i] >> CORE_SHIFT;
+			if (   nCore == 0
+			    || nCore >= CORES
+			    || (Batch[i] & SEQUENCE_MASK) != NextSequence[nCore]++)
+			{
+				return FALSE;
+			}
+		}
+
+		assert (nCount <= nItems);
+		nItems -= nCount;
+	}
+
+	return TRUE;
+}
+
+CQueueBenchmark::CQueueBenchmark (CMemorySystem *pMemorySystem)
+:	CMultiCoreSupport (pMemorySystem),
+	m_pQueue (0),
+	m_Test (QueueTestUnknown),
+	m_nGeneration (0),
+	m_nProducersDone (0)
+{
+}
+
+CQueueBenchmark::~CQueueBenchmark (void)
+{
+	assert (m_pQueue == 0);
+}
+
+void CQueueBenchmark::Run (unsigned nCore)
+{
+	if (nCore == 0)
+	{
+		Consumer ();
+	}
+	else
+	{
+		Producer (nCore);
+	}
+}
+
+void CQueueBenchmark::Consumer (void)
+{
+	CLogger *pLogger = CLogger::Get ();
+	assert (pLogger != 0);
+
+	pLogger->Write (FromBenchmark, LogNotice, "Transferring %u items via a queue of %u entries",
+			ITEMS, QUEUE_SIZE);
+
+	for (unsigned nTest = QueueTestSPSC; nTest < QueueTestExit; nTest++)
+	{
+		unsigned nItemsPerSecond;
+		if (!RunTest ((TQueueTest) nTest, &nItemsPerSecond))
+		{
+			pLogger->Write (FromBenchmark, LogError, "%s: Items out of order",
+					s_TestInfo[nTest].pName);
+
+			break;
+		}
+
+		pLogger->Write (FromBenchmark, LogNotice, "%-34s %6u K items/s",
+				s_TestInfo[nTest].pName, nItemsPerSecond / 1000);
+	}
+
+	m_Test = QueueTestExit;
+	DataMemBarrier ();
+	m_nGeneration++;
+}
+
+void CQueueBenchmark::Producer (unsigned nCore)
+{
+	unsigned nGeneration = 0;
+
+	while (1)
+	{
+		while (m_nGeneration == nGeneration)
+		{
+			// wait for the next test
+		}
+
+		nGeneration = m_nGeneration;
+		DataMemBarrier ();
+
+		TQueueTest Test = m_Test;
+		if (Test == QueueTestExit)
+		{
+			return;
+		}
+
+		assert (Test < QueueTestExit);
+		boolean bBatch = s_TestInfo[Test].bBatch;
+		unsigned nProducers = s_TestInfo[Test].bMultiProducer ? PRODUCERS_MPSC : PRODUCERS_SPSC;
+
+		if (nCore <= nProducers)
+		{
+			unsigned nItems = ITEMS / nProducers;
+
+			switch (Test)
+			{
+			case QueueTestSPSC:
+			case QueueTestSPSCBatch:
+				Produce ((CSPSCRingBuffer<u32> *) m_pQueue, nCore, nItems, bBatch);
+				break;
+
+			case QueueTestMPSC:
+			case QueueTestMPSCBatch:
+				Produce ((CMPSCRingBuffer<u32> *) m_pQueue, nCore, nItems, bBatch);
+				break;
+
+			default:
+				Produce ((CLockedQueue<u32> *) m_pQueue, nCore, nItems, bBatch);
+				break;
+			}
+
+			__atomic_fetch_add (&m_nProducersDone, 1, __ATOMIC_RELEASE);
+		}
+	}
+}
+
+boolean CQueueBenchmark::RunTest (TQueueTest Test, unsigned *pItemsPerSecond)
+{
+	assert (Test < QueueTestExit);
+	boolean bBatch = s_TestInfo[Test].bBatch;
+	unsigned nProducers = s_TestInfo[Test].bMultiProducer ? PRODUCERS_MPSC : PRODUCERS_SPSC;
+
+	CSPSCRingBuffer<u32> *pSPSC = 0;
+	CMPSCRingBuffer<u32> *pMPSC = 0;
+	CLockedQueue<u32> *pLocked = 0;
+
+	switch (Test)
+	{
+	case QueueTestSPSC:
+	case QueueTestSPSCBatch:
+		m_pQueue = pSPSC = new CSPSCRingBuffer<u32> (QUEUE_SIZE);
+		break;
+
+	case QueueTestMPSC:
+	case QueueTestMPSCBatch:
+		m_pQueue = pMPSC = new CMPSCRingBuffer<u32> (QUEUE_SIZE);
+		break;
+
+	default:
+		m_pQueue = pLocked = new CLockedQueue<u32> (QUEUE_SIZE);
+		break;
+	}
+
+	assert (m_pQueue != 0);
+
+	m_nProducersDone = 0;
+	m_Test = Test;
+
+	unsigned nStart = CTimer::GetClockTicks ();
+
+	// start the producers
+	DataMemBarrier ();
+	m_nGeneration++;
+
+	boolean bOK;
+	if (pSPSC != 0)
+	{
+		bOK = Consume (pSPSC, ITEMS, bBatch);
+	}
+	else if (pMPSC != 0)
+	{
+		bOK = Consume (pMPSC, ITEMS, bBatch);
+	}
+	else
+	{
+		bOK = Consume (pLocked, ITEMS, bBatch);
+	}
+
+	unsigned nTime = CTimer::GetClockTicks () - nStart;
+
+	if (!bOK)
+	{
+		// the producers may still access the queue, so it is not deleted
+		return FALSE;
+	}
+
+	while (__atomic_load_n (&m_nProducersDone, __ATOMIC_ACQUIRE) < nProducers)
+	{
+		// wait for the producers to return, before the queue is deleted
+	}
+
+	delete pSPSC;
+	delete pMPSC;
+	delete pLocked;
+	m_pQueue = 0;
+
+	assert (pItemsPerSecond != 0);
+	*pItemsPerSecond = (unsigned) (ITEMS * 1000000ULL / (nTime ? nTime : 1));
+
+	return TRUE;
+}
+
+#endif
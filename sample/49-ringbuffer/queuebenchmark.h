@@ -0,0 +1,69 @@
+//
+// queuebenchmark.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _queuebenchmark_h
+#define _queuebenchmark_h
+
+#include <circle/multicore.h>
+#include <circle/memory.h>
+#include <circle/types.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+
+enum TQueueTest
+{
+	QueueTestSPSC,
+	QueueTestSPSCBatch,
+	QueueTestLockedSPSC,
+	QueueTestLockedSPSCBatch,
+	QueueTestMPSC,
+	QueueTestMPSCBatch,
+	QueueTestLockedMPSC,
+	QueueTestLockedMPSCBatch,
+	QueueTestExit,
+	QueueTestUnknown
+};
+
+// Core 0 consumes the items, which are produced by core 1 (SPSC) or cores 1-3 (MPSC)
+class CQueueBenchmark : public CMultiCoreSupport
+{
+public:
+	CQueueBenchmark (CMemorySystem *pMemorySystem);
+	~CQueueBenchmark (void);
+
+	void Run (unsigned nCore);
+
+private:
+	void Consumer (void);
+	void Producer (unsigned nCore);
+
+	// returns FALSE if the items have not been received in order
+	boolean RunTest (TQueueTest Test, unsigned *pItemsPerSecond);
+
+private:
+	void *m_pQueue;					// type depends on the test
+
+	volatile TQueueTest m_Test;
+	volatile unsigned m_nGeneration;		// incremented for each test
+	volatile unsigned m_nProducersDone;
+};
+
+#endif
+
+#endif
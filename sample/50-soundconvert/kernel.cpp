@@ -0,0 +1,226 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include "nullsounddevice.h"
+#include <circle/util.h>
+#include <assert.h>
+
+#define SAMPLE_RATE	192000
+#define RANGE32		1024			// range of SoundFormatUnsigned32, similar to PWM
+#define QUEUE_MSECS	100
+
+#define BLOCK_FRAMES	4096			// frames per Write() call
+#define TEST_BLOCKS	100
+
+static const TSoundFormat HWFormats[] =
+{
+	SoundFormatSigned16,
+	SoundFormatSigned24,
+	SoundFormatUnsigned32
+};
+
+static const TSoundFormat WriteFormats[] =
+{
+	SoundFormatUnsigned8,
+	SoundFormatSigned16,
+	SoundFormatSigned24,
+	SoundFormatSigned32,
+	SoundFormatFloat
+};
+
+static const struct
+{
+	const char *pName;
+	unsigned nSampleSize;
+}
+FormatInfo[SoundFormatUnknown] =
+{
+	{"U8",		1},
+	{"S16",		2},
+	{"S24",		3},		// packed as write format
+	{"U32",		4},
+	{"S32",		4},
+	{"Float",	4}
+};
+
+static const char FromKernel[] = "kernel";
+
+static u32 s_Buffer[BLOCK_FRAMES * SOUND_HW_CHANNELS];
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	m_Logger.Write (FromKernel, LogNotice, "Write() of %u frames per call, real time is %u frames/s",
+			BLOCK_FRAMES, SAMPLE_RATE);
+
+	for (unsigned i = 0; i < sizeof HWFormats / sizeof HWFormats[0]; i++)
+	{
+		for (unsigned j = 0; j < sizeof WriteFormats / sizeof WriteFormats[0]; j++)
+		{
+			for (unsigned nChannels = 2; nChannels >= 1; nChannels--)
+			{
+				unsigned nRate;
+				if (!Benchmark (HWFormats[i], WriteFormats[j], nChannels, &nRate))
+				{
+					return ShutdownHalt;
+				}
+
+				m_Logger.Write (FromKernel, LogNotice,
+						"%-5s %-6s -> %-3s: %6u K frames/s (%4ux real time)",
+						FormatInfo[WriteFormats[j]].pName,
+						nChannels == 2 ? "stereo" : "mono",
+						FormatInfo[HWFormats[i]].pName,
+						nRate, nRate * 1000 / SAMPLE_RATE);
+			}
+		}
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Done");
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::Benchmark (TSoundFormat HWFormat, TSoundFormat WriteFormat, unsigned nChannels,
+			    unsigned *pRate)
+{
+	CNullSoundDevice *pSound = new CNullSoundDevice (HWFormat, RANGE32, SAMPLE_RATE);
+	assert (pSound != 0);
+
+	if (!pSound->AllocateQueue (QUEUE_MSECS))
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot allocate sound queue");
+
+		delete pSound;
+
+		return FALSE;
+	}
+
+	assert (pSound->GetQueueSizeFrames () >= BLOCK_FRAMES);
+
+	pSound->SetWriteFormat (WriteFormat, nChannels);
+
+	FillBuffer (WriteFormat);
+
+	int nBlockSize = BLOCK_FRAMES * nChannels * FormatInfo[WriteFormat].nSampleSize;
+	assert (nBlockSize <= (int) sizeof s_Buffer);
+
+	// only the time of Write() is measured, the queue is emptied afterwards
+	unsigned nTime = 0;
+	for (unsigned i = 0; i < TEST_BLOCKS; i++)
+	{
+		unsigned nStart = CTimer::GetClockTicks ();
+
+		int nResult = pSound->Write (s_Buffer, nBlockSize);
+
+		nTime += CTimer::GetClockTicks () - nStart;
+
+		if (nResult != nBlockSize)
+		{
+			m_Logger.Write (FromKernel, LogError, "Write() returned %d (expected %d)",
+					nResult, nBlockSize);
+
+			delete pSound;
+
+			return FALSE;
+		}
+
+		pSound->Discard ();
+	}
+
+	delete pSound;
+
+	assert (pRate != 0);
+	*pRate = (unsigned) (BLOCK_FRAMES * TEST_BLOCKS * 1000ULL / (nTime ? nTime : 1));
+
+	return TRUE;
+}
+
+void CKernel::FillBuffer (TSoundFormat WriteFormat)
+{
+	unsigned nWords = sizeof s_Buffer / sizeof s_Buffer[0];
+
+	if (WriteFormat == SoundFormatFloat)
+	{
+		// random data may contain NaNs, the samples must be in the range -1.0..1.0
+		float *pSample = reinterpret_cast<float *> (s_Buffer);
+		for (unsigned i = 0; i < nWords; i++)
+		{
+			pSample[i] = (s32) m_Random.GetNumber () / 2147483648.0f;
+		}
+	}
+	else
+	{
+		for (unsigned i = 0; i < nWords; i++)
+		{
+			s_Buffer[i] = m_Random.GetNumber ();
+		}
+	}
+}
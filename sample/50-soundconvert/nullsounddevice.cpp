@@ -0,0 +1,67 @@
+//
+// nullsounddevice.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "nullsounddevice.h"
+#include <assert.h>
+
+CNullSoundDevice::CNullSoundDevice (TSoundFormat HWFormat, u32 nRange32, unsigned nSampleRate,
+				    boolean bSwapChannels)
+:	CSoundBaseDevice (HWFormat, nRange32, nSampleRate, bSwapChannels),
+	m_HWFormat (HWFormat)
+{
+}
+
+CNullSoundDevice::~CNullSoundDevice (void)
+{
+}
+
+boolean CNullSoundDevice::Start (void)
+{
+	return TRUE;
+}
+
+void CNullSoundDevice::Cancel (void)
+{
+}
+
+boolean CNullSoundDevice::IsActive (void) const
+{
+	return FALSE;
+}
+
+void CNullSoundDevice::Discard (void)
+{
+	unsigned nSamples;
+	while ((nSamples = GetQueueFramesAvail () * SOUND_HW_CHANNELS) > 0)
+	{
+		if (nSamples > NULL_SOUND_CHUNK_SIZE)
+		{
+			nSamples = NULL_SOUND_CHUNK_SIZE;
+		}
+
+		if (m_HWFormat == SoundFormatSigned16)
+		{
+			GetChunk (reinterpret_cast<s16 *> (m_Chunk), nSamples);
+		}
+		else
+		{
+			GetChunk (m_Chunk, nSamples);
+		}
+	}
+}
@@ -0,0 +1,51 @@
+//
+// nullsounddevice.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _nullsounddevice_h
+#define _nullsounddevice_h
+
+#include <circle/soundbasedevice.h>
+#include <circle/types.h>
+
+#define NULL_SOUND_CHUNK_SIZE	2048		// samples, fetched at once by Discard()
+
+// Sound device without hardware, which only discards the queued samples.
+// Allows to measure the conversion done in CSoundBaseDevice::Write().
+
+class CNullSoundDevice : public CSoundBaseDevice
+{
+public:
+	CNullSoundDevice (TSoundFormat HWFormat, u32 nRange32, unsigned nSampleRate,
+			  boolean bSwapChannels = FALSE);
+	~CNullSoundDevice (void);
+
+	boolean Start (void);
+	void Cancel (void);
+	boolean IsActive (void) const;
+
+	// removes all frames from the queue
+	void Discard (void);
+
+private:
+	TSoundFormat m_HWFormat;
+
+	u32 m_Chunk[NULL_SOUND_CHUNK_SIZE];
+};
+
+#endif